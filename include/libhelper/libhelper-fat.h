@@ -115,6 +115,9 @@ struct fat_header {
 // libhelper-fat alias
 typedef struct fat_header           fat_header_t;
 
+#define FAT_MAGIC           0xcafebabe      /* fat_arch follows the header */
+#define FAT_MAGIC_64        0xcafebabf      /* fat_arch_64 follows the header */
+
 /**
  *  The fat_arch structs defines an architecture contained within the FAT archive.
  *  These follow the fat_header directly in the file.
@@ -128,6 +131,20 @@ struct fat_arch {
     uint32_t        align;          /* byte align */
 };
 
+/**
+ *  The 64 bit version of fat_arch, used when the header magic is FAT_MAGIC_64,
+ *  for slices that start or end beyond 4GB.
+ * 
+ */
+struct fat_arch_64 {
+    cpu_type_t      cputype;        /* cpu specifier for this architecture */
+    cpu_subtype_t   cpusubtype;     /* cpu subtype specifier for this architecture */
+    uint64_t        offset;         /* offset of where the Mach-O begins in the file */
+    uint64_t        size;           /* size of the Mach-O */
+    uint32_t        align;          /* byte align */
+    uint32_t        reserved;       /* reserved */
+};
+
 
 /**
  *  Libhelper Universal Binary header with parsed data about the FAT archive
@@ -141,7 +158,53 @@ struct __libhelper_fat_header_info {
 typedef struct __libhelper_fat_header_info      fat_header_info_t;
 
 
+/**
+ *  A slice of a Universal Binary. Both fat_arch and fat_arch_64 records are
+ *  swapped into this form, so callers never deal with the on-disk layout.
+ * 
+ */
+struct __libhelper_fat_slice {
+    cpu_type_t      cputype;        /* cpu specifier */
+    cpu_subtype_t   cpusubtype;     /* cpu subtype specifier */
+    uint64_t        offset;         /* offset of the Mach-O in the file */
+    uint64_t        size;           /* size of the Mach-O */
+    uint32_t        align;          /* byte align, as a power of 2 */
+};
+typedef struct __libhelper_fat_slice            fat_slice_t;
+
+/**
+ *  Maximum number of slices `mach_universal_read()` accepts. Real binaries
+ *  carry a handful, so the slices live inline and reading a header never
+ *  allocates.
+ */
+#define FAT_SLICES_MAX      16
+
+/**
+ *  Parsed Universal Binary header. Filled in by `mach_universal_read()`,
+ *  the slices are bounds checked against the view they were read from.
+ * 
+ */
+struct __libhelper_fat_info {
+    lh_view_t       view;                       /* the whole Universal Binary */
+    uint32_t        magic;                      /* FAT_MAGIC or FAT_MAGIC_64 */
+    uint32_t        nslices;                    /* number of slices */
+    fat_slice_t     slices[FAT_SLICES_MAX];
+};
+typedef struct __libhelper_fat_info             fat_info_t;
+
+/**
+ *  Result flags for `mach_universal_read()`.
+ */
+#define FAT_FAILURE         0x0
+#define FAT_SUCCESS         0x1
+
+
 // Functions
+extern int                   mach_universal_read            (lh_view_t view, fat_info_t *info);
+extern const fat_slice_t    *mach_universal_find_slice      (const fat_info_t *info, cpu_type_t cputype, cpu_subtype_t cpusubtype);
+extern void                 *macho_load_slice               (file_t *file, cpu_type_t cputype, cpu_subtype_t cpusubtype);
+extern size_t                macho_load_slices              (file_t *file, void **machos, size_t count, int nthreads);
+
 extern fat_header_info_t    *mach_universal_load    (file_t *file);
 extern fat_header_t         *swap_header_bytes      (fat_header_t *header);
 extern mach_header_t        *swap_mach_header_bytes (mach_header_t *header);
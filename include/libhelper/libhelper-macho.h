@@ -130,9 +130,11 @@ typedef int                 cpu_threadtype_t;
  */
 #ifdef __APPLE__
 #	define OSSwapInt32(x) 	 _OSSwapInt32(x)
+#	define OSSwapInt64(x) 	 _OSSwapInt64(x)
 #else
 #   include <byteswap.h>
 #	define OSSwapInt32(x)	bswap_32(x)
+#	define OSSwapInt64(x)	bswap_64(x)
 #endif
 
 	
@@ -360,6 +362,10 @@ struct __libhelper_macho {
     uint32_t             size;          /* size of mach-o */
     uint32_t             offset;        /* start of data */
     uint8_t             *data;          /* pointer to mach-o in memory */
+    file_t              *file;          /* backing file, NULL for raw buffers */
+    uint32_t             hdroff;        /* offset of the header, non-zero for fileset entries */
+    HArena              *arena;         /* swapped copy of the image, NULL for native images */
+    uint32_t            *valid;         /* one bit per load command that passed validation */
 
     /* file data */
     char                *path;          /* filepath */
@@ -367,10 +373,13 @@ struct __libhelper_macho {
     /* mach-o parsed properties */
     mach_header_t   *header;        /* mach-o header */
     HSList          *lcmds;         /* list of all load commands (including LC_SEGMENT) */
+    HArray          *commands;      /* mach_load_command_info_t for every command in lcmds */
     HSList          *scmds;         /* list of segment commands */
     HSList          *dylibs;        /* list of dynamic libraries */
     HSList          *symbols;       /* list of symbols */
     HSList          *strings;       /* list of strings */
+
+    file_t          *owned;         /* file opened by macho_load(), closed by macho_free() */
 };
 typedef struct __libhelper_macho            macho_t;
 
@@ -386,6 +395,10 @@ struct __libhelper_macho_32 {
     uint32_t             size;          /* size of mach-o */
     uint32_t             offset;        /* start of data */
     uint8_t             *data;          /* pointer to mach-o in memory */
+    file_t              *file;          /* backing file, NULL for raw buffers */
+    uint32_t             hdroff;        /* offset of the header, non-zero for fileset entries */
+    HArena              *arena;         /* swapped copy of the image, NULL for native images */
+    uint32_t            *valid;         /* one bit per load command that passed validation */
 
     /* file data */
     char                *path;          /* filepath */
@@ -393,10 +406,13 @@ struct __libhelper_macho_32 {
     /* mach-o parsed properties */
     mach_header_32_t    *header;        /* mach-o 32bit header */
     HSList              *lcmds;         /* list of all load commands (including LC_SEGMENT) */
+    HArray              *commands;      /* mach_load_command_info_t for every command in lcmds */
     HSList              *scmds;         /* list of segment commands */
     HSList              *dylibs;        /* list of dynamic libraries */
     HSList              *symbols;       /* list of symbols */
     HSList              *strings;       /* list of strings */
+
+    file_t              *owned;         /* file opened by macho_load(), closed by macho_free() */
 };
 typedef struct __libhelper_macho_32         macho_32_t;
 
@@ -431,14 +447,38 @@ extern char                     *mach_header_read_file_type_short   (uint32_t ty
  * 
  */
 extern void                     *macho_load                         (const char *filename);
-extern void                     *macho_create_from_buffer           (unsigned char *data);
+extern void                     *macho_create_from_buffer           (unsigned char *data);      // deprecated, no bounds
+extern void                     *macho_create_from_buffer_sized     (unsigned char *data, size_t size);
+extern void                     *macho_load_from_file               (file_t *file);
+extern void                     *macho_load_from_view               (lh_view_t view);
+extern void                     *macho_create_from_view             (lh_view_t view);
+extern void                      macho_free                         (void *macho);
+
+extern macho_t                  *macho_64_create_from_buffer        (unsigned char *data);      // deprecated, no bounds
+extern macho_t                  *macho_64_create_from_view          (lh_view_t view, uint32_t hdroff);
+extern macho_32_t               *macho_32_create_from_buffer        (unsigned char *data);      // deprecated, no bounds
+extern macho_32_t               *macho_32_create_from_view          (lh_view_t view);
+
+extern int                       macho_validate                     (lh_view_t view, uint32_t hdroff, uint32_t **valid);
 
-extern macho_t                  *macho_64_create_from_buffer        (unsigned char *data);
-extern macho_32_t               *macho_32_create_from_buffer        (unsigned char *data);
+/**
+ *  Result flags for `macho_validate()`.
+ */
+#define MACHO_VALID_FAILURE             0x0
+#define MACHO_VALID_SUCCESS             0x1
+
+/**
+ *  Whether load command `index` of a parsed Mach-O passed validation. The
+ *  parsers leave invalid commands out of every list, so anything reached
+ *  through a `macho_t` has already been checked.
+ */
+#define MACHO_COMMAND_VALID(macho, index)   ((macho)->valid[(index) / 32] & (1u << ((index) % 32)))
 
 extern void                     *macho_load_bytes                   (void *macho, size_t size, uint32_t offset);
 extern void                      macho_read_bytes                   (void *macho, uint32_t offset, void *buffer, size_t size);
 extern void                     *macho_get_bytes                    (void *macho, uint32_t offset);
+extern lh_view_t                 macho_get_view                     (void *macho, uint32_t offset, size_t size);
+extern lh_view_t                 macho_get_mapping                  (void *macho);
 
 
 /**
@@ -512,6 +552,83 @@ extern char                     *mach_load_command_get_string       (mach_load_c
 extern mach_load_command_info_t *mach_lc_find_given_cmd             (macho_t *macho, int cmd);  
 
 
+/**
+ *  Mach-O Load Command Descriptors.
+ * 
+ *  A table, built at compile time, with an entry for every known load command.
+ *  It is indexed by the command number with LC_REQ_DYLD folded out, so naming,
+ *  size checks and dispatch are a single lookup. Each entry has the minimum
+ *  cmdsize, which image types it belongs to, the layout used to byte swap it
+ *  and a function that checks the ranges it refers to.
+ * 
+ */
+typedef int (*mach_lc_check_func_t) (const uint8_t *cmd, uint32_t cmdsize, size_t size, int is64);
+
+struct __libhelper_lc_descriptor {
+    uint32_t                 cmd;           /* load command type */
+    char                    *name;          /* e.g. "LC_SEGMENT_64" */
+    uint32_t                 size;          /* minimum cmdsize */
+    uint32_t                 flags;         /* MACH_LC_* */
+    const char              *layout;        /* swap layout after cmd/cmdsize, or NULL */
+    mach_lc_check_func_t     check;         /* range checks, or NULL */
+};
+// libhelper-macho alias
+typedef struct __libhelper_lc_descriptor    mach_lc_descriptor_t;
+
+#define MACH_LC_ANY                 0x0
+#define MACH_LC_32                  0x1     /* only found in 32-bit images */
+#define MACH_LC_64                  0x2     /* only found in 64-bit images */
+#define MACH_LC_SEGMENT             0x4
+#define MACH_LC_DYLIB               0x8
+
+#define MACH_LC_INDEX(cmd)          ((cmd) & ~LC_REQ_DYLD)
+#define MACH_LC_INDEX_MAX           0x36
+
+extern const mach_lc_descriptor_t   *mach_lc_descriptor                 (uint32_t cmd);
+extern int                           mach_lc_check                      (const void *cmd, uint32_t cmdsize, size_t size, int is64);
+
+
+/**
+ *  Mach-O Load Command Iterator.
+ * 
+ *  Walks the raw load command area, from the end of the header up to
+ *  `sizeofcmds`, without building any lists. The iterator lives on the
+ *  caller's stack and every command is bounds checked before it is handed
+ *  out. A walk that stops on a malformed command sets `error`.
+ * 
+ */
+struct __libhelper_lc_iter {
+    uint8_t             *base;          /* start of the mapping */
+    uint64_t             offset;        /* offset of the next command */
+    uint64_t             end;           /* end of the load command area */
+    uint32_t             index;         /* index of the next command */
+    uint32_t             ncmds;         /* number of commands in the header */
+    int                  is64;          /* 64-bit header */
+    int                  error;         /* set if a command was malformed */
+};
+// libhelper-macho alias
+typedef struct __libhelper_lc_iter          mach_lc_iter_t;
+
+struct __libhelper_lc_entry {
+    uint32_t             cmd;           /* load command type */
+    uint32_t             cmdsize;       /* load command size */
+    void                *ptr;           /* the command, within the mapping */
+    uint32_t             offset;        /* offset of the command from `base` */
+    uint32_t             index;         /* index in the LC list */
+};
+// libhelper-macho alias
+typedef struct __libhelper_lc_entry         mach_lc_entry_t;
+
+#define MACH_LC_ITER_FAILURE        0x0
+#define MACH_LC_ITER_SUCCESS        0x1
+
+extern int                           mach_lc_iter_init                  (mach_lc_iter_t *it, void *data, size_t size, uint32_t hdroff);
+extern int                           mach_lc_iter_macho                 (mach_lc_iter_t *it, void *macho);
+extern int                           mach_lc_iter_next                  (mach_lc_iter_t *it, mach_lc_entry_t *entry);
+extern int                           mach_lc_iter_next_segment          (mach_lc_iter_t *it, mach_lc_entry_t *entry);
+extern int                           mach_lc_iter_next_dylib            (mach_lc_iter_t *it, mach_lc_entry_t *entry);
+
+
 /***********************************************************************
 * Mach-O Segment Commands.
 *
@@ -631,6 +748,21 @@ struct section { /* for 32-bit architectures */
 };
 typedef struct section  mach_section_32_t;
 
+// Section types, from the low byte of the section flags
+#define SECTION_TYPE                    0x000000ff
+#define SECTION_ATTRIBUTES              0xffffff00
+
+#define S_REGULAR                       0x0
+#define S_ZEROFILL                      0x1
+#define S_CSTRING_LITERALS              0x2
+#define S_SYMBOL_STUBS                  0x8
+#define S_GB_ZEROFILL                   0xc
+#define S_THREAD_LOCAL_ZEROFILL         0x12
+
+// Section attributes
+#define S_ATTR_PURE_INSTRUCTIONS        0x80000000
+#define S_ATTR_SOME_INSTRUCTIONS        0x00000400
+
 struct __libhelper_mach_section_info {
     mach_section_64_t       *section;
 
@@ -724,6 +856,17 @@ typedef struct source_version_command               mach_source_version_command_
 extern mach_source_version_command_t 	*mach_lc_find_source_version_cmd (macho_t *macho);
 extern char 							*mach_lc_source_version_string (mach_source_version_command_t *svc);
 
+/**
+ *  Buffer sizes that always fit the output of the formatting functions below,
+ *  including the terminator.
+ */
+#define MACH_SOURCE_VERSION_STRLEN      32
+#define MACH_VERSION_STRLEN             16
+#define MACH_UUID_STRLEN                37
+
+extern char                             *mach_lc_source_version_format (uint64_t version, char *buf, size_t len);
+extern char                             *mach_lc_version_format (uint32_t vers, char *buf, size_t len);
+
 /////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////
 
@@ -779,8 +922,8 @@ typedef struct mach_build_version_info_t {
 	mach_build_version_command_t *cmd;
 	
 	char 		*platform;
-	char		*minos;
-	char		*sdk;
+	char		 minos[MACH_VERSION_STRLEN];
+	char		 sdk[MACH_VERSION_STRLEN];
 
 	uint32_t	 ntools;
 	HSList 		*tools;
@@ -804,6 +947,13 @@ typedef struct mach_build_version_info_t {
 #define TOOL_LD	3
 
 extern mach_build_version_info_t 		*mach_lc_build_version_info (mach_build_version_command_t *bvc, off_t offset, macho_t *macho);
+extern uint32_t                          mach_lc_build_version_tools (macho_t *macho,
+                                                                      mach_build_version_command_t *bvc,
+                                                                      off_t offset,
+                                                                      build_tool_info_t *tools,
+                                                                      uint32_t max);
+extern char                             *mach_lc_platform_string (uint32_t platform);
+extern char                             *mach_lc_build_tool_string (uint32_t tool);
 
 /////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////
@@ -823,6 +973,7 @@ typedef struct uuid_command         mach_uuid_command_t;
 
 extern mach_uuid_command_t 		        *mach_lc_find_uuid_cmd (macho_t *macho);
 extern char 						    *mach_lc_uuid_string (mach_uuid_command_t *cmd);
+extern char                             *mach_lc_uuid_format (const uint8_t *uuid, char *buf, size_t len);
 
 
 /////////////////////////////////////////////////////////////////////////////////
@@ -1019,6 +1170,7 @@ typedef struct mach_dylib_command_info_t {
 
 
 extern char 		*mach_lc_load_dylib_format_version (uint32_t vers);
+extern char         *mach_lc_dylib_version_format (uint32_t vers, char *buf, size_t len);
 extern char 		*mach_lc_dylib_get_type_string (mach_dylib_command_t *dylib);
 
 
@@ -1079,6 +1231,8 @@ struct linkedit_data_command {
 // libhelper-macho alias
 typedef struct linkedit_data_command        mach_linkedit_data_command_t;
 
+extern mach_linkedit_data_command_t         *mach_lc_find_function_starts_cmd   (macho_t *macho);
+
 /////////////////////////////////////////////////////////////////////////////////
 
 /**
@@ -1334,6 +1488,13 @@ struct dysymtab_command {
 // libhelper-macho alias
 typedef struct dysymtab_command         mach_dysymtab_command_t;
 
+/*
+ * An indirect symbol table entry is a symbol table index, or one of these
+ * for a local or absolute symbol that was stripped.
+ */
+#define INDIRECT_SYMBOL_LOCAL   0x80000000
+#define INDIRECT_SYMBOL_ABS     0x40000000
+
 
 // Functions
 extern mach_dysymtab_command_t              *mach_lc_find_dysymtab_cmd      (macho_t *macho);
@@ -1342,7 +1503,620 @@ extern mach_dysymtab_command_t              *mach_lc_find_dysymtab_cmd      (mac
 /////////////////////////////////////////////////////////////////////////////////////
 
 
+/***********************************************************************
+* Mach-O Streaming Parser.
+*
+*   Parses a Mach-O incrementally from a non-seekable source, such as a
+*   pipe or a decompressor. The header and load commands are parsed as
+*   soon as they have arrived, segment and section metadata is reported
+*   before the body is read, and only ranges that have been requested
+*   are buffered.
+*
+************************************************************************/
+
+/**
+ *  Callbacks fired by the stream as data arrives. Any of these may be NULL.
+ * 
+ *  Segments and sections are always reported using the 64 bit structures,
+ *  32 bit commands are widened before they are passed on. The pointers are
+ *  only valid for the duration of the callback.
+ * 
+ */
+struct __libhelper_macho_stream_callbacks {
+    void        (*header)       (void *ctx, const mach_header_t *header);
+    void        (*segment)      (void *ctx, const mach_segment_command_64_t *seg, uint32_t index);
+    void        (*section)      (void *ctx, const mach_section_64_t *sect, uint32_t segindex);
+    void        (*load_command) (void *ctx, const mach_load_command_t *lc, uint32_t offset);
+    void        (*range)        (void *ctx, int index, lh_view_t data);
+};
+typedef struct __libhelper_macho_stream_callbacks       macho_stream_callbacks_t;
+
+/**
+ *  Read function for pull-mode streams. Behaves like read(2): returns the
+ *  number of bytes read, 0 at the end of the stream, or -1 on error.
+ * 
+ */
+typedef long                    (*macho_stream_read_func_t)         (void *ctx, void *buf, size_t size);
+
+typedef struct __libhelper_macho_stream                 macho_stream_t;
+
+/**
+ *  Result flags for the streaming functions.
+ */
+#define MACHO_STREAM_FAILURE        0x0
+#define MACHO_STREAM_SUCCESS        0x1
+
+extern macho_stream_t           *macho_stream_create                (const macho_stream_callbacks_t *callbacks, void *ctx);
+extern void                      macho_stream_free                  (macho_stream_t *stream);
+
+extern int                       macho_stream_request_range         (macho_stream_t *stream, uint64_t offset, uint64_t size);
+extern int                       macho_stream_request_segment       (macho_stream_t *stream, const char *segname);
+
+extern int                       macho_stream_feed                  (macho_stream_t *stream, const void *buf, size_t size);
+extern int                       macho_stream_finish                (macho_stream_t *stream);
+extern int                       macho_stream_run                   (macho_stream_t *stream, macho_stream_read_func_t read_func, void *ctx);
+extern int                       macho_stream_run_fd                (macho_stream_t *stream, int fd);
+
+extern const mach_header_t      *macho_stream_get_header            (macho_stream_t *stream);
+extern lh_view_t                 macho_stream_get_load_commands     (macho_stream_t *stream);
+extern lh_view_t                 macho_stream_get_range             (macho_stream_t *stream, int index);
+extern uint64_t                  macho_stream_get_position          (macho_stream_t *stream);
+
+
+/////////////////////////////////////////////////////////////////////////////////////
+
+/***********************************************************************
+* Mach-O Content Hashing.
+*
+*	Hash every segment and section of a Mach-O straight from the mapping,
+*   so dedup decisions and cache keys come from the same parse.
+*
+************************************************************************/
+
+/**
+ *  A hashed region of a Mach-O. Segments have an empty `sectname`, and
+ *  zero-fill sections hash as empty since they have no file contents.
+ * 
+ */
+struct __libhelper_macho_region_hash {
+    char             segname[17];       /* segment name */
+    char             sectname[17];      /* section name, empty for segments */
+    uint64_t         offset;            /* file offset of the region */
+    uint64_t         size;              /* size of the region in the file */
+    lh_hash_t        hash;              /* hash of the region contents */
+};
+typedef struct __libhelper_macho_region_hash        macho_region_hash_t;
+
+extern int                       macho_hash                         (void *macho, lh_hash_type_t type, lh_hash_t *out);
+extern macho_region_hash_t      *macho_hash_regions                 (void *macho, lh_hash_type_t type, int *count);
+
+
+/////////////////////////////////////////////////////////////////////////////////////
+
+/***********************************************************************
+* Mach-O Parse Index.
+*
+*	A flattened, mmap()-able copy of the parsed load commands, segments,
+*   sections and symbols of a Mach-O, stored next to the binary or in a
+*   cache directory. Re-opening a binary with a valid index is a single
+*   mmap() of the index, with no parsing.
+*
+************************************************************************/
+
+#define MACHO_INDEX_MAGIC               "LHINDEX"
+#define MACHO_INDEX_VERSION             1
+#define MACHO_INDEX_EXTENSION           ".lhindex"
+
+/**
+ *  Index file header. The binary is identified by its LC_UUID, size and
+ *  modification time; if any of them differ the index is stale. All of
+ *  the offsets are from the start of the index and are 8 byte aligned.
+ * 
+ */
+struct __libhelper_macho_index_header {
+    char             magic[8];          /* MACHO_INDEX_MAGIC */
+    uint32_t         version;           /* MACHO_INDEX_VERSION */
+    uint32_t         header_size;       /* sizeof (macho_index_header_t) */
+
+    uint8_t          uuid[16];          /* LC_UUID of the binary, or zero */
+    uint64_t         file_size;         /* size of the binary */
+    int64_t          file_mtime;        /* modification time of the binary */
+
+    uint32_t         macho_magic;       /* mach header fields */
+    uint32_t         cputype;
+    uint32_t         cpusubtype;
+    uint32_t         filetype;
+
+    uint32_t         ncmds;             /* number of load commands */
+    uint32_t         nsegments;         /* number of segments */
+    uint32_t         nsections;         /* number of sections */
+    uint32_t         nsymbols;          /* number of symbols */
+    uint32_t         nbuckets;          /* size of the name hash, a power of two */
+    uint32_t         naddrs;            /* number of symbols in the address index */
+
+    uint64_t         cmds_off;          /* macho_index_command_t[ncmds] */
+    uint64_t         segments_off;      /* macho_index_segment_t[nsegments] */
+    uint64_t         sections_off;      /* macho_index_section_t[nsections] */
+    uint64_t         symbols_off;       /* macho_index_symbol_t[nsymbols] */
+    uint64_t         buckets_off;       /* uint32_t[nbuckets], symbol index + 1 */
+    uint64_t         addrs_off;         /* uint32_t[naddrs], sorted by address */
+    uint64_t         strtab_off;        /* symbol names */
+    uint64_t         strtab_size;
+};
+typedef struct __libhelper_macho_index_header       macho_index_header_t;
+
+struct __libhelper_macho_index_command {
+    uint32_t         cmd;               /* load command type */
+    uint32_t         cmdsize;           /* load command size */
+    uint32_t         offset;            /* offset in the Mach-O */
+    uint32_t         index;             /* index in the load command list */
+};
+typedef struct __libhelper_macho_index_command      macho_index_command_t;
+
+struct __libhelper_macho_index_segment {
+    char             segname[16];
+    uint64_t         vmaddr;
+    uint64_t         vmsize;
+    uint64_t         fileoff;
+    uint64_t         filesize;
+    int32_t          maxprot;
+    int32_t          initprot;
+    uint32_t         nsects;
+    uint32_t         first_section;     /* index of the first section */
+    uint32_t         flags;
+    uint32_t         reserved;
+};
+typedef struct __libhelper_macho_index_segment      macho_index_segment_t;
+
+struct __libhelper_macho_index_section {
+    char             sectname[16];
+    char             segname[16];
+    uint64_t         addr;
+    uint64_t         size;
+    uint32_t         offset;
+    uint32_t         align;
+    uint32_t         flags;
+    uint32_t         segment;           /* index of the owning segment */
+};
+typedef struct __libhelper_macho_index_section      macho_index_section_t;
+
+struct __libhelper_macho_index_symbol {
+    uint64_t         value;             /* n_value */
+    uint32_t         name;              /* offset of the name in the strtab */
+    uint8_t          type;              /* n_type */
+    uint8_t          sect;              /* n_sect */
+    uint16_t         desc;              /* n_desc */
+};
+typedef struct __libhelper_macho_index_symbol       macho_index_symbol_t;
+
+/**
+ *  An opened index. The tables point straight into the index mapping, and
+ *  `binary` is the mapping of the binary the index describes, if known.
+ * 
+ */
+struct __libhelper_macho_index {
+    file_t                          *file;          /* index mapping */
+    file_t                          *binary;        /* binary mapping, or NULL */
+
+    const macho_index_header_t      *header;
+    const macho_index_command_t     *cmds;
+    const macho_index_segment_t     *segments;
+    const macho_index_section_t     *sections;
+    const macho_index_symbol_t      *symbols;
+    const uint32_t                  *buckets;
+    const uint32_t                  *addrs;
+    lh_view_t                        strtab;
+};
+typedef struct __libhelper_macho_index              macho_index_t;
+
+extern int                           macho_index_write              (void *macho, const char *path);
+extern macho_index_t                *macho_index_open               (const char *path, const char *binary);
+extern macho_index_t                *macho_index_open_cached        (const char *binary, const char *cache_dir);
+extern void                          macho_index_free               (macho_index_t *index);
+
+extern const macho_index_symbol_t   *macho_index_find_symbol        (macho_index_t *index, const char *name);
+extern const macho_index_symbol_t   *macho_index_symbol_at          (macho_index_t *index, uint64_t addr);
+extern const char                   *macho_index_symbol_name        (macho_index_t *index, const macho_index_symbol_t *sym);
+extern const macho_index_section_t  *macho_index_find_section       (macho_index_t *index, const char *segname, const char *sectname);
+
+/**
+ *  Result flags for `macho_index_write()`.
+ */
+#define MACHO_INDEX_FAILURE             0x0
+#define MACHO_INDEX_SUCCESS             0x1
+
+
+/////////////////////////////////////////////////////////////////////////////////////
+
+/***********************************************************************
+* Mach-O Batch Loading.
+*
+*	Parse many Mach-O's at once on a work stealing thread pool, e.g. every
+*   binary in an extracted IPSW. Results arrive through a callback, or a
+*   completion queue the caller drains with `macho_batch_next()`.
+*
+************************************************************************/
+
+/**
+ *  A file to load. When `path` is NULL, `view` is parsed in place instead.
+ * 
+ */
+struct __libhelper_macho_batch_item {
+    const char          *path;          /* path to load, or NULL */
+    lh_view_t            view;          /* in-memory Mach-O, when path is NULL */
+    void                *user;          /* passed back in the result */
+};
+typedef struct __libhelper_macho_batch_item         macho_batch_item_t;
+
+struct __libhelper_macho_batch_result {
+    size_t               index;         /* index of the item */
+    void                *user;          /* the item's user pointer */
+    void                *macho;         /* parsed Mach-O, or NULL on failure */
+    uint64_t             cost;          /* bytes charged against the budget */
+};
+typedef struct __libhelper_macho_batch_result       macho_batch_result_t;
+
+typedef void (*macho_batch_callback_t) (void *ctx, macho_batch_result_t *result);
 
+/**
+ *  Batch options. `memory_budget` caps the input size of the files that
+ *  are being parsed or waiting to be collected; once it is reached workers
+ *  hold off starting new files until results are consumed. A job larger
+ *  than the whole budget still runs, on its own.
+ *
+ *  A result stops counting against the budget once it is delivered, i.e.
+ *  when `macho_batch_next()` returns it or the callback returns. From then
+ *  on the Mach-O belongs to the caller, who frees it with `macho_free()`,
+ *  so results the caller keeps around are not bounded by the budget.
+ * 
+ */
+struct __libhelper_macho_batch_options {
+    int                      nthreads;          /* 0 for one per core */
+    uint64_t                 memory_budget;     /* 0 for no limit */
+    macho_batch_callback_t   callback;          /* NULL to use the completion queue */
+    void                    *ctx;               /* passed to the callback */
+};
+typedef struct __libhelper_macho_batch_options      macho_batch_options_t;
+
+typedef struct __libhelper_macho_batch              macho_batch_t;
+
+extern macho_batch_t            *macho_batch_start                  (const macho_batch_item_t *items, size_t count, const macho_batch_options_t *options);
+extern int                       macho_batch_next                   (macho_batch_t *batch, macho_batch_result_t *result);
+extern void                      macho_batch_free                   (macho_batch_t *batch);
+extern size_t                    macho_load_many                    (const macho_batch_item_t *items, size_t count, const macho_batch_options_t *options);
+
+/**
+ *  Result flags for `macho_batch_next()`.
+ */
+#define MACHO_BATCH_FAILURE             0x0
+#define MACHO_BATCH_SUCCESS             0x1
+
+
+/***********************************************************************
+* Mach-O Filesets.
+*
+*	MH_FILESET images, e.g. modern kernelcaches, embed each kext as its
+*   own Mach-O described by an LC_FILESET_ENTRY command. Entries are
+*   parsed in place over the fileset mapping, and can be parsed in
+*   parallel.
+*
+************************************************************************/
+
+/**
+ *  An LC_FILESET_ENTRY, unpacked. `entry_id` is borrowed from the fileset.
+ * 
+ */
+struct __libhelper_macho_fileset_entry {
+    char                *entry_id;      /* e.g. com.apple.kernel */
+    uint64_t             vmaddr;        /* memory address of the entry */
+    uint64_t             fileoff;       /* file offset of the entry's header */
+    uint32_t             offset;        /* offset of the LC_FILESET_ENTRY command */
+};
+typedef struct __libhelper_macho_fileset_entry      macho_fileset_entry_t;
+
+/**
+ *  Entries of a fileset and their parsed images. `images[i]` stays NULL
+ *  until entry `i` is loaded, and `by_id` holds the entry indexes sorted
+ *  by entry_id for `macho_fileset_find()`.
+ * 
+ */
+struct __libhelper_macho_fileset {
+    macho_t                 *macho;         /* the fileset itself */
+    macho_fileset_entry_t   *entries;
+    macho_t                **images;
+    uint32_t                *by_id;
+    size_t                   count;
+};
+typedef struct __libhelper_macho_fileset            macho_fileset_t;
+
+extern macho_fileset_t          *macho_fileset_load                 (macho_t *macho);
+extern macho_t                  *macho_fileset_entry_load           (macho_t *macho, const macho_fileset_entry_t *entry);
+extern size_t                    macho_fileset_load_all             (macho_fileset_t *fileset, int nthreads);
+extern macho_t                  *macho_fileset_find                 (macho_fileset_t *fileset, const char *entry_id);
+extern void                      macho_fileset_free                 (macho_fileset_t *fileset);
+
+
+/***********************************************************************
+* Mach-O Byte Swapping.
+*
+*	Opposite-endian images (MH_CIGAM, MH_CIGAM_64) are copied into an
+*   arena once, when they are loaded, and every structure libhelper reads
+*   is swapped to host order in that copy. Native images are parsed in
+*   place as before and never touch this code.
+*
+************************************************************************/
+
+/**
+ *  Field layouts for `mach_swap_structs()`. Each character is one field:
+ *  B is a byte, H/h 16 bits, I/i 32 bits and Q/q 64 bits. A count followed
+ *  by `s`, e.g. 16s, is raw bytes that are left alone.
+ * 
+ */
+#define MACH_LAYOUT_NLIST               "IBBHI"
+#define MACH_LAYOUT_NLIST_64            "IBBHQ"
+#define MACH_LAYOUT_SECTION             "16s16sIIIIIIIII"
+#define MACH_LAYOUT_SECTION_64          "16s16sQQIIIIIIII"
+#define MACH_LAYOUT_FAT_ARCH            "iiIII"
+#define MACH_LAYOUT_FAT_ARCH_64         "iiQQII"
+
+extern int                       mach_swap_structs                  (void *data, size_t count, const char *layout);
+extern void                      mach_swap_relocations              (void *data, size_t count);
+extern unsigned char            *macho_swap_image                   (lh_view_t view, HArena *arena);
+
+/**
+ *  Result flags for `mach_swap_structs()`.
+ */
+#define MACH_SWAP_FAILURE               0x0
+#define MACH_SWAP_SUCCESS               0x1
+
+
+/***********************************************************************
+* Mach-O Name Interning.
+*
+*	Intern segment, dylib and symbol names into a shared `lh_intern_t`,
+*   so names can be compared, and joined across binaries, as integers.
+*
+************************************************************************/
+
+extern uint32_t                 *macho_intern_dylibs                (void *macho, lh_intern_t *pool, uint32_t *count);
+extern uint32_t                 *macho_intern_segments              (void *macho, lh_intern_t *pool, uint32_t *count);
+extern uint32_t                 *macho_intern_symbols               (void *macho, lh_intern_t *pool, uint32_t *count);
+
+
+/***********************************************************************
+* Mach-O Searching.
+*
+*	Byte searches over a whole Mach-O, or restricted to one segment or
+*   section, straight from the mapping. Offsets are file offsets into
+*   the Mach-O.
+*
+************************************************************************/
+
+/**
+ *  A region of the Mach-O file, such as a section, with the address it is
+ *  mapped at.
+ * 
+ */
+struct __libhelper_macho_region {
+    char             segname[17];       /* segment name */
+    char             sectname[17];      /* section name */
+    uint64_t         offset;            /* file offset of the region */
+    uint64_t         size;              /* size of the region in the file */
+    uint64_t         vmaddr;            /* address of the region in memory */
+};
+typedef struct __libhelper_macho_region             macho_region_t;
+
+extern int                       macho_find_region                  (void *macho, const char *segname, const char *sectname,
+                                                                     uint64_t *offset, uint64_t *size);
+extern macho_region_t           *macho_find_exec_regions            (void *macho, int *count);
+extern macho_region_t           *macho_fileset_find_exec_regions    (void *macho, macho_fileset_t *fileset, int *count);
+extern size_t                    macho_patterns_scan                (void *macho, const bh_patterns_t *set,
+                                                                     const char *segname, const char *sectname,
+                                                                     bh_patterns_func_t func, void *ctx);
+extern size_t                   *macho_masked_find_all              (void *macho, const bh_masked_t *pat,
+                                                                     const char *segname, const char *sectname,
+                                                                     int nthreads, size_t *count);
+
+/**
+ *  Result flags for `macho_find_region()`.
+ */
+#define MACHO_SEARCH_FAILURE            0x0
+#define MACHO_SEARCH_SUCCESS            0x1
+
+
+/***********************************************************************
+* Mach-O Cross References.
+*
+*	An index of every address referenced from the executable sections of
+*   an arm64 Mach-O, built in one pass. Finding the code that references
+*   a string, a global or a function is then a binary search.
+*
+************************************************************************/
+
+/**
+ *  A reference to `target` made by the instruction at `from`. For ADRP
+ *  pairs this is the ADD, load or store that completes the address.
+ *
+ */
+struct __libhelper_macho_xref {
+    uint64_t         target;            /* address that is referenced */
+    uint64_t         from;              /* address of the referencing instruction */
+    uint32_t         kind;              /* MACHO_XREF_* */
+};
+typedef struct __libhelper_macho_xref               macho_xref_t;
+typedef struct __libhelper_macho_xref_index         macho_xref_index_t;
+
+#define MACHO_XREF_ADRP_ADD             0x1
+#define MACHO_XREF_ADRP_LDR             0x2     /* ADRP followed by a load or store */
+#define MACHO_XREF_ADR                  0x3
+#define MACHO_XREF_LDR_LITERAL          0x4
+
+extern macho_xref_index_t       *macho_xref_index_create            (void *macho, int nthreads);
+extern macho_xref_index_t       *macho_fileset_xref_index_create    (void *macho, macho_fileset_t *fileset, int nthreads);
+extern void                      macho_xref_index_free              (macho_xref_index_t *index);
+extern size_t                    macho_xref_index_count             (const macho_xref_index_t *index);
+extern size_t                    macho_xref_lookup                  (const macho_xref_index_t *index, uint64_t target,
+                                                                     size_t *first);
+extern size_t                    macho_xref_lookup_range            (const macho_xref_index_t *index, uint64_t start,
+                                                                     uint64_t end, size_t *first);
+extern int                       macho_xref_get                     (const macho_xref_index_t *index, size_t i,
+                                                                     macho_xref_t *out);
+
+/**
+ *  Result flags for `macho_xref_get()`.
+ */
+#define MACHO_XREF_FAILURE              0x0
+#define MACHO_XREF_SUCCESS              0x1
+
+
+/***********************************************************************
+* Mach-O Call Graph.
+*
+*	Direct calls, BL and tail call B, between the functions of an arm64
+*   Mach-O or fileset. Calls are stored by caller with an index by
+*   callee, so both directions are a slice of an array.
+*
+************************************************************************/
+
+/**
+ *  A function, found from LC_FUNCTION_STARTS, the symbol table, a symbol
+ *  stub or by being called. Names are borrowed from the Mach-O.
+ *
+ */
+struct __libhelper_macho_function {
+    uint64_t         addr;              /* start address */
+    uint64_t         size;              /* bytes up to the next function, or the end of the section */
+    const char      *name;              /* symbol name, or NULL */
+    uint32_t         flags;             /* MACHO_FUNCTION_* */
+};
+typedef struct __libhelper_macho_function           macho_function_t;
+
+#define MACHO_FUNCTION_START            0x1     /* listed in LC_FUNCTION_STARTS */
+#define MACHO_FUNCTION_SYMBOL           0x2     /* has a symbol */
+#define MACHO_FUNCTION_STUB             0x4     /* symbol stub, named after the imported symbol */
+#define MACHO_FUNCTION_CALLED           0x8     /* target of a BL */
+
+struct __libhelper_macho_call {
+    uint64_t         site;              /* address of the branch */
+    uint64_t         target;            /* address branched to */
+    uint32_t         caller;            /* function holding the branch, or MACHO_CALLGRAPH_NONE */
+    uint32_t         callee;            /* function branched to */
+    uint32_t         kind;              /* MACHO_CALL_* */
+};
+typedef struct __libhelper_macho_call               macho_call_t;
+
+#define MACHO_CALL_BL                   0x1
+#define MACHO_CALL_B                    0x2
+
+/**
+ *  `calls[callees_index[f] .. callees_index[f + 1]]` are made by function
+ *  `f`, and `callers[callers_index[f] .. callers_index[f + 1]]` index the
+ *  calls made to it. Calls from outside any function come last.
+ *
+ */
+struct __libhelper_macho_callgraph {
+    macho_function_t    *functions;     /* sorted by address */
+    size_t               nfunctions;
+    macho_call_t        *calls;         /* sorted by caller, then site */
+    size_t               ncalls;
+
+    uint32_t            *callees_index; /* nfunctions + 2 offsets into calls */
+    uint32_t            *callers;       /* indexes into calls, sorted by callee */
+    uint32_t            *callers_index; /* nfunctions + 1 offsets into callers */
+
+    uint32_t            *buckets;       /* function index + 1, by name hash */
+    uint32_t             nbuckets;
+};
+typedef struct __libhelper_macho_callgraph          macho_callgraph_t;
+
+#define MACHO_CALLGRAPH_NONE            0xffffffff
+
+extern uint64_t                 *macho_function_starts              (void *macho, size_t *count);
+
+extern macho_callgraph_t        *macho_callgraph_create             (void *macho, int nthreads);
+extern macho_callgraph_t        *macho_fileset_callgraph_create     (void *macho, macho_fileset_t *fileset, int nthreads);
+extern void                      macho_callgraph_free               (macho_callgraph_t *graph);
+extern uint32_t                  macho_callgraph_function_at        (const macho_callgraph_t *graph, uint64_t addr);
+extern uint32_t                  macho_callgraph_find_symbol        (const macho_callgraph_t *graph, const char *name);
+extern size_t                    macho_callgraph_callees            (const macho_callgraph_t *graph, uint32_t function,
+                                                                     const macho_call_t **calls);
+extern size_t                    macho_callgraph_callers            (const macho_callgraph_t *graph, uint32_t function,
+                                                                     const uint32_t **calls);
+
+
+/***********************************************************************
+* Mach-O Patchfinder.
+*
+*	Find addresses in an arm64 Mach-O or kernelcache from recipes of
+*   simple steps, e.g. find a string, its xref, the function holding it
+*   and then that function's second BL. Recipes share one string scan,
+*   one xref index and one call graph, and results can be kept on disk
+*   by the binary's LC_UUID.
+*
+************************************************************************/
+
+#define MACHO_PF_MAGIC                  "LHPATCH"
+#define MACHO_PF_VERSION                2
+#define MACHO_PF_EXTENSION              ".lhpf"
+
+#define MACHO_PF_MAX_STEPS              8
+
+/**
+ *  Each step works on the address left by the one before it. Where a step
+ *  can have several results, `n` picks one, counting from zero, and a
+ *  negative `n` counts back from the last.
+ *
+ */
+#define MACHO_PF_END                    0x0     /* end of the recipe */
+#define MACHO_PF_ADDRESS                0x1     /* start at `value` */
+#define MACHO_PF_STRING                 0x2     /* start of the first C string that is exactly `str` */
+#define MACHO_PF_SYMBOL                 0x3     /* function or stub named `str` */
+#define MACHO_PF_XREF                   0x4     /* `n`th instruction referencing the address */
+#define MACHO_PF_FUNCTION               0x5     /* start of the function holding the address */
+#define MACHO_PF_BL                     0x6     /* target of the `n`th BL in the function holding the address */
+#define MACHO_PF_BL_AFTER               0x7     /* target of the `n`th BL at or after the address, in its function */
+#define MACHO_PF_CALLER                 0x8     /* start of the `n`th function calling the function at the address */
+#define MACHO_PF_ADD                    0x9     /* add `value` */
+#define MACHO_PF_SUBSTRING              0xa     /* start of the first C string containing `str` */
+
+struct __libhelper_macho_pf_step {
+    uint32_t         op;                /* MACHO_PF_* */
+    int32_t          n;                 /* which result to take */
+    const char      *str;               /* string or symbol name */
+    uint64_t         value;             /* address or addend */
+};
+typedef struct __libhelper_macho_pf_step            macho_pf_step_t;
+
+/**
+ *  A recipe is a name and up to MACHO_PF_MAX_STEPS steps, the rest are left
+ *  zeroed. Results are cached by the steps, so the name is only a label.
+ *
+ */
+struct __libhelper_macho_pf_recipe {
+    const char          *name;
+    macho_pf_step_t      steps[MACHO_PF_MAX_STEPS];
+};
+typedef struct __libhelper_macho_pf_recipe          macho_pf_recipe_t;
+
+struct __libhelper_macho_pf_result {
+    uint64_t         addr;              /* result, when found */
+    uint32_t         step;              /* steps completed */
+    uint32_t         flags;             /* MACHO_PF_RESULT_* */
+};
+typedef struct __libhelper_macho_pf_result          macho_pf_result_t;
+
+#define MACHO_PF_RESULT_FOUND           0x1
+#define MACHO_PF_RESULT_CACHED          0x2     /* from a previous run, or the disk cache */
+
+typedef struct __libhelper_macho_patchfinder        macho_patchfinder_t;
+
+extern macho_patchfinder_t      *macho_patchfinder_create           (void *macho, const char *cache_dir, int nthreads);
+extern void                      macho_patchfinder_free             (macho_patchfinder_t *pf);
+extern size_t                    macho_patchfinder_run              (macho_patchfinder_t *pf, const macho_pf_recipe_t *recipes,
+                                                                     size_t count, macho_pf_result_t *results);
+
+
+/////////////////////////////////////////////////////////////////////////////////////
 
 
 #ifdef cplusplus
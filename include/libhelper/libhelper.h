@@ -56,24 +56,60 @@ extern int			 libhelper_is_debug			();
 *
 ***********************************************************************/
 
+/**
+ *	Called by `file_close()` to release memory handed over with
+ *	`file_from_buffer_with_free()`.
+ *
+ */
+typedef void (*file_free_func_t) (void *data, size_t size, void *ctx);
+
 /**
  *	Libhelper file structure: wrapper for `FILE` with some extra info
  *	regarding the file.
  *
  */
 struct __libhelper_file {
-	char			*path;		/* loaded file path */
-	size_t			 size;		/* loaded file size */
-	unsigned char	*data;		/* mmaped() file */
+	char				*path;		/* loaded file path, NULL for buffers */
+	size_t				 size;		/* loaded file size */
+	unsigned char		*data;		/* mmaped() file, or wrapped buffer */
+
+	int					 flags;		/* ownership of `data`, see below */
+	file_free_func_t	 free_func;	/* releases `data`, or NULL */
+	void				*free_ctx;	/* passed to `free_func` */
+
+	uint64_t			 dev;		/* device and inode `path` was mapped from */
+	uint64_t			 ino;
 };
 typedef struct __libhelper_file		file_t;
 
+/**
+ *	Ownership flags for `file_t` data. A borrowed buffer is left alone by
+ *	`file_close()`, an owned one is free()'d and a mapped one is munmap()'d.
+ *	LH_FILE_COPY makes `file_from_buffer()` take its own copy of the data,
+ *	which it then owns.
+ */
+#define		LH_FILE_BORROWED		0x0
+#define		LH_FILE_OWNED			0x1
+#define		LH_FILE_MAPPED			0x2
+#define		LH_FILE_COPY			0x4
+
 // Functions for handling files
 extern file_t			*file_create	();
 extern file_t			*file_load		(const char *path);
 extern void				 file_close		(file_t *file);
 extern void				 file_free		(file_t *file);
 
+extern file_t *
+file_from_buffer (void *data,
+				  size_t size,
+				  int flags);
+
+extern file_t *
+file_from_buffer_with_free (void *data,
+							size_t size,
+							file_free_func_t free_func,
+							void *ctx);
+
 extern const void *
 file_get_data (file_t *f, 
 			   uint32_t offset);
@@ -97,7 +133,63 @@ file_dup_data (file_t *f,
 
 
 /**
- *	Result flags for `file_read()` and `file_write_new()`.
+ *	A range of bytes within a file, used to extract several regions into
+ *	one output file with `file_write_ranges()`.
+ *
+ */
+struct __libhelper_file_range {
+	uint64_t		offset;		/* offset of the range in the file */
+	uint64_t		size;		/* size of the range */
+};
+typedef struct __libhelper_file_range	file_range_t;
+
+// Functions for extracting ranges without copying through user space
+extern int
+file_copy_range (file_t *f,
+				 uint64_t offset,
+				 uint64_t size,
+				 int fd,
+				 uint64_t fd_offset);
+
+extern int
+file_write_range (file_t *f,
+				  uint64_t offset,
+				  uint64_t size,
+				  const char *path);
+
+extern int
+file_write_ranges (file_t *f,
+				   const file_range_t *ranges,
+				   int count,
+				   const char *path);
+
+
+/**
+ *	Paging hints for large mappings. Searches over big files advise the
+ *	whole range as sequential, then ask for each chunk ahead of the thread
+ *	that is going to read it.
+ */
+#define		LH_ADVISE_NORMAL		0x0
+#define		LH_ADVISE_SEQUENTIAL	0x1
+#define		LH_ADVISE_RANDOM		0x2
+#define		LH_ADVISE_WILLNEED		0x3
+#define		LH_ADVISE_DONTNEED		0x4
+
+extern int
+lh_advise (const void *addr,
+		   size_t size,
+		   int advice);
+
+extern int
+file_advise (file_t *f,
+			 size_t offset,
+			 size_t size,
+			 int advice);
+
+
+/**
+ *	Result flags for `file_read()`, `file_write_new()` and the range
+ *	extraction functions.
  */
 #define		LH_FILE_FAILURE			0x0
 #define 	LH_FILE_SUCCESS			0x1
@@ -105,6 +197,207 @@ file_dup_data (file_t *f,
 
 /* End of libhelper-file */
 
+/***********************************************************************
+* File views.
+*
+*	A view is a bounded window onto memory that libhelper does not own,
+*	usually the mmap() of a `file_t`. Views are passed around by value,
+*	so creating and narrowing one never allocates or copies.
+*
+***********************************************************************/
+
+/**
+ *	Libhelper view structure: pointer, length and the file the memory is
+ *	borrowed from (NULL when the view wraps a plain buffer).
+ *
+ */
+struct __libhelper_view {
+	const unsigned char	*data;		/* start of the viewed bytes */
+	size_t				 size;		/* number of viewed bytes */
+	file_t				*file;		/* owning file, or NULL */
+};
+typedef struct __libhelper_view		lh_view_t;
+
+#define		LH_VIEW_NULL			((lh_view_t) { NULL, 0, NULL })
+
+// Functions for creating and narrowing views
+extern lh_view_t		 lh_view_create		(const void *data, size_t size, file_t *file);
+extern lh_view_t		 file_get_view		(file_t *f, size_t offset, size_t size);
+extern int				 lh_view_is_valid	(lh_view_t view);
+
+extern int
+lh_view_sub (lh_view_t view,
+			 size_t offset,
+			 size_t size,
+			 lh_view_t *out);
+
+extern const void *
+lh_view_ptr (lh_view_t view,
+			 size_t offset,
+			 size_t size);
+
+extern const char *
+lh_view_cstr (lh_view_t view,
+			  size_t offset);
+
+// Typed reads, all bounds checked. Results are only written on success.
+extern int				 lh_view_read_u8	(lh_view_t view, size_t offset, uint8_t *out);
+extern int				 lh_view_read_u16	(lh_view_t view, size_t offset, uint16_t *out);
+extern int				 lh_view_read_u32	(lh_view_t view, size_t offset, uint32_t *out);
+extern int				 lh_view_read_u64	(lh_view_t view, size_t offset, uint64_t *out);
+extern int				 lh_view_read_be32	(lh_view_t view, size_t offset, uint32_t *out);
+extern int				 lh_view_read_be64	(lh_view_t view, size_t offset, uint64_t *out);
+
+/**
+ *	Result flags for `lh_view_sub()` and the typed read functions.
+ */
+#define		LH_VIEW_FAILURE			0x0
+#define		LH_VIEW_SUCCESS			0x1
+
+
+/* End of libhelper-view */
+
+/***********************************************************************
+* Threading.
+*
+*	A minimal parallel-for used to spread independent jobs, such as
+*	hashing chunks of a file, across the available cores, and a work
+*	stealing pool for jobs whose sizes vary wildly.
+*
+***********************************************************************/
+
+typedef void (*lh_job_func_t) (void *ctx, size_t index);
+
+extern int				 lh_thread_count	();
+
+extern void
+lh_parallel_for (size_t count,
+				 lh_job_func_t func,
+				 void *ctx,
+				 int nthreads);
+
+/**
+ *	Work stealing thread pool. Each worker has its own queue and takes the
+ *	most recently pushed job from it, then steals the oldest jobs from the
+ *	other workers once it runs dry, so one huge job never holds up the
+ *	small ones queued behind it.
+ *
+ */
+typedef struct __libhelper_pool		lh_pool_t;
+
+extern lh_pool_t		*lh_pool_create		(int nthreads);
+extern void				 lh_pool_wait		(lh_pool_t *pool);
+extern void				 lh_pool_free		(lh_pool_t *pool);
+
+extern int
+lh_pool_submit (lh_pool_t *pool,
+				lh_job_func_t func,
+				void *ctx,
+				size_t index);
+
+/**
+ *	Result flags for `lh_pool_submit()`.
+ */
+#define		LH_POOL_FAILURE			0x0
+#define		LH_POOL_SUCCESS			0x1
+
+
+/* End of libhelper-thread */
+
+/***********************************************************************
+* Hashing.
+*
+*	Content hashes over views and files. The fast hashes are not
+*	cryptographic and are meant for deduplication and cache keys. Inputs
+*	larger than LH_HASH_CHUNK_SIZE are hashed as a tree of chunks, so the
+*	chunks can be hashed in parallel.
+*
+***********************************************************************/
+
+typedef enum {
+	LH_HASH_FAST64,
+	LH_HASH_FAST128,
+	LH_HASH_SHA256
+} lh_hash_type_t;
+
+#define		LH_HASH_CHUNK_SIZE		(4 * 1024 * 1024)
+#define		LH_HASH_MAX_SIZE		32
+
+/**
+ *	Libhelper hash structure: the digest bytes, most significant first for
+ *	the fast hashes so they print the same as the integer value.
+ *
+ */
+struct __libhelper_hash {
+	lh_hash_type_t	 type;						/* hash algorithm */
+	uint32_t		 size;						/* digest size in bytes */
+	unsigned char	 digest[LH_HASH_MAX_SIZE];	/* digest */
+};
+typedef struct __libhelper_hash		lh_hash_t;
+
+// Functions for hashing memory, views and files
+extern uint64_t			 lh_hash64			(const void *data, size_t size, uint64_t seed);
+
+extern int
+lh_view_hash (lh_view_t view,
+			  lh_hash_type_t type,
+			  lh_hash_t *out);
+
+extern int
+lh_hash_views (const lh_view_t *views,
+			   size_t count,
+			   lh_hash_type_t type,
+			   lh_hash_t *out);
+
+extern int
+file_hash (file_t *f,
+		   lh_hash_type_t type,
+		   lh_hash_t *out);
+
+extern char *
+lh_hash_to_string (const lh_hash_t *hash,
+				   char *buf,
+				   size_t len);
+
+/**
+ *	Result flags for the hashing functions.
+ */
+#define		LH_HASH_FAILURE			0x0
+#define		LH_HASH_SUCCESS			0x1
+
+
+/* End of libhelper-hash */
+
+/***********************************************************************
+* String interning.
+*
+*	Maps byte strings to stable 32 bit ids, so names shared by many
+*	binaries, such as segment names, dylib paths and common symbols, are
+*	stored once and compared as integers. A pool is sharded by hash and
+*	can be used from any number of threads and Mach-O's at once.
+*
+***********************************************************************/
+
+typedef struct __libhelper_intern		lh_intern_t;
+
+extern lh_intern_t		*lh_intern_create	();
+extern void				 lh_intern_free		(lh_intern_t *pool);
+extern size_t			 lh_intern_count	(lh_intern_t *pool);
+
+extern uint32_t			 lh_intern			(lh_intern_t *pool, const void *str, size_t len);
+extern uint32_t			 lh_intern_cstr		(lh_intern_t *pool, const char *str);
+extern uint32_t			 lh_intern_lookup	(lh_intern_t *pool, const void *str, size_t len);
+extern const char		*lh_intern_string	(lh_intern_t *pool, uint32_t id, size_t *len);
+
+/**
+ *	Id that is never handed out, returned on failure or when a string
+ *	isn't in the pool.
+ */
+#define		LH_INTERN_NONE			0x0
+
+
+/* End of libhelper-intern */
+
 /***********************************************************************
 * Logging.
 *
@@ -146,7 +439,9 @@ extern int				__printf (log_type msg_type, char *fmt, ...);
 * Boyermoore Horspool memmem()
 *
 *   Boyermoore Horspool, or Horspool's Algorithim, is an algorithm for
-*   finding substrings in a buffer.
+*   finding substrings in a buffer. Where the CPU has a vector unit, SIMD
+*   is used instead, filtering on the first and last byte of the needle
+*   with the widest instructions available. Horspool is the fallback.
 *
 ***********************************************************************/
 
@@ -155,6 +450,116 @@ extern int				__printf (log_type msg_type, char *fmt, ...);
 extern unsigned char 		*bh_memmem (const unsigned char *haystack, 	size_t hlen,
 										const unsigned char *needle,	size_t nlen);
 
+/**
+ *	A needle prepared once for many searches: the search implementation is
+ *	picked and the skip table built up front. The needle is not copied.
+ */
+typedef struct __libhelper_needle	bh_needle_t;
+struct __libhelper_needle {
+	const unsigned char		*needle;
+	size_t					 len;
+	unsigned char			*(*search) (const unsigned char *haystack, size_t hlen,
+										const unsigned char *needle, size_t nlen);
+	size_t					 skip[__UCHAR_MAX + 1];
+};
+
+extern int					 bh_needle_init (bh_needle_t *compiled, const unsigned char *needle, size_t nlen);
+extern unsigned char		*bh_needle_find (const bh_needle_t *compiled, const unsigned char *haystack, size_t hlen);
+
+/**
+ *	Parallel search for very large haystacks, e.g. a whole mapped kernel
+ *	cache. The haystack is split into chunks that overlap by the needle
+ *	length less one, and each chunk is paged in ahead of the thread that
+ *	searches it. Results are the same as a single threaded search.
+ */
+extern unsigned char		*bh_memmem_parallel (const unsigned char *haystack, size_t hlen,
+												 const unsigned char *needle, size_t nlen, int nthreads);
+extern size_t				*bh_memmem_all (const unsigned char *haystack, size_t hlen,
+											const unsigned char *needle, size_t nlen, int nthreads, size_t *count);
+extern unsigned char		*bh_needle_find_parallel (const bh_needle_t *compiled, const unsigned char *haystack,
+													  size_t hlen, int nthreads);
+extern size_t				*bh_needle_find_all (const bh_needle_t *compiled, const unsigned char *haystack,
+												 size_t hlen, int nthreads, size_t *count);
+
+/**
+ *	Result flags for `bh_needle_init()`.
+ */
+#define		BH_NEEDLE_FAILURE		0x0
+#define		BH_NEEDLE_SUCCESS		0x1
+
+
+/**
+ *	Multi-pattern search. A set of patterns is compiled once into an
+ *	Aho-Corasick automaton, then every occurrence of every pattern is found
+ *	in a single pass. While no pattern is partially matched, a SIMD test on
+ *	the first bytes of the patterns skips ahead.
+ */
+typedef struct __libhelper_patterns	bh_patterns_t;
+
+/**
+ *	Called for each match with the id of the pattern, which is the order it
+ *	was added in, and the offset of its first byte. Return non-zero to
+ *	stop the scan.
+ */
+typedef int (*bh_patterns_func_t) (void *ctx, uint32_t pattern, size_t offset);
+
+extern bh_patterns_t		*bh_patterns_create ();
+extern int					 bh_patterns_add (bh_patterns_t *set, const unsigned char *pattern, size_t len);
+extern int					 bh_patterns_compile (bh_patterns_t *set);
+extern size_t				 bh_patterns_count (const bh_patterns_t *set);
+extern void					 bh_patterns_free (bh_patterns_t *set);
+
+extern size_t
+bh_patterns_scan (const bh_patterns_t *set,
+				  const unsigned char *data,
+				  size_t len,
+				  bh_patterns_func_t func,
+				  void *ctx);
+
+/**
+ *	Result flags for `bh_patterns_add()` and `bh_patterns_compile()`.
+ */
+#define		BH_PATTERNS_FAILURE		0x0
+#define		BH_PATTERNS_SUCCESS		0x1
+
+
+/**
+ *	Masked pattern search, for signatures with wildcard bits such as A64
+ *	instructions with their immediates masked out. Matches are only found
+ *	at aligned offsets. A vector filter compares the most specific word or
+ *	byte of the pattern under its mask, and candidates are verified in full.
+ */
+#define		BH_MASKED_MAX			64
+#define		BH_MASKED_NONE			((size_t) -1)
+
+typedef struct __libhelper_masked	bh_masked_t;
+struct __libhelper_masked {
+	unsigned char			 bytes[BH_MASKED_MAX];	/* pattern, already masked */
+	unsigned char			 mask[BH_MASKED_MAX];
+	size_t					 len;
+	size_t					 align;
+
+	size_t					 anchor;				/* offset of the filtered word or byte */
+	size_t					 anchor_width;			/* 4 or 1 */
+	uint32_t				 anchor_mask;
+	uint32_t				 anchor_value;
+
+	size_t					(*next) (const bh_masked_t *pat, const unsigned char *data, size_t from, size_t to);
+};
+
+extern int					 bh_masked_init (bh_masked_t *pat, const unsigned char *bytes, const unsigned char *mask,
+											 size_t len, size_t align);
+extern int					 bh_masked_init_insns (bh_masked_t *pat, const uint32_t *insns, const uint32_t *masks, size_t count);
+extern unsigned char		*bh_masked_find (const bh_masked_t *pat, const unsigned char *data, size_t len);
+extern size_t				*bh_masked_find_all (const bh_masked_t *pat, const unsigned char *data, size_t len,
+												 int nthreads, size_t *count);
+
+/**
+ *	Result flags for `bh_masked_init()`.
+ */
+#define		BH_MASKED_FAILURE		0x0
+#define		BH_MASKED_SUCCESS		0x1
+
 
 /***********************************************************************
 * HLibc.
@@ -178,44 +583,156 @@ extern HSList	*h_slist_append (HSList *list, void *data);
 extern HSList	*h_slist_remove (HSList *list, void *data);
 extern int		h_slist_length (HSList *list);
 extern void		*h_slist_nth_data (HSList *list, int n);
+extern HSList	*h_slist_append_tail (HSList *list, HSList **tail, void *data);
 
 
 /* HSList end */
 ///////////////////////////////////////////////////////////////
+/* HArena start */
+
+
+/**
+ *	HArena structure. A bump allocator: allocations are carved out of large
+ *	blocks and are only ever released all at once, by h_arena_free().
+ */
+typedef struct __libhelper_harena HArena;
+struct __libhelper_harena {
+	struct __libhelper_harena_block	*blocks;
+	size_t							 block_size;
+};
+
+// HArena functions
+extern HArena	*h_arena_new (size_t block_size);
+extern void		*h_arena_alloc (HArena *arena, size_t size);
+extern void		*h_arena_alloc0 (HArena *arena, size_t size);
+extern void		h_arena_free (HArena *arena);
+
+
+/* HArena end */
+///////////////////////////////////////////////////////////////
+/* HArray start */
+
+
+/**
+ *	HArray structure. A contiguous, growable array of fixed size elements.
+ *	Appending is amortised O(1) and indexing is O(1). When `arena` is set,
+ *	storage comes from the arena and is released with it, rather than by
+ *	h_array_free().
+ */
+typedef struct __libhelper_harray HArray;
+struct __libhelper_harray {
+	void			*data;			/* elements */
+	size_t			 len;			/* number of elements */
+	size_t			 cap;			/* number of elements there is room for */
+	size_t			 elem_size;		/* size of one element */
+	HArena			*arena;			/* backing arena, or NULL for malloc() */
+};
+
+#define HARRAY_FAILURE		0x0
+#define HARRAY_SUCCESS		0x1
+
+// HArray functions
+extern HArray	*h_array_new (size_t elem_size);
+extern HArray	*h_array_sized_new (size_t elem_size, size_t reserve);
+extern HArray	*h_array_arena_new (HArena *arena, size_t elem_size, size_t reserve);
+extern int		 h_array_reserve (HArray *array, size_t count);
+extern void		*h_array_push (HArray *array, const void *elem);
+extern void		 h_array_shrink (HArray *array);
+extern void		 h_array_clear (HArray *array);
+extern void		 h_array_free (HArray *array);
+
+/**
+ *	Element `i` of `array`, as `type`. There is no bounds check.
+ */
+#define h_array_index(array, type, i)		(((type *) (array)->data)[(i)])
+
+/**
+ *	Loop over every element of `array`, with `var` pointing at each in turn.
+ *	The array must not grow inside the loop.
+ */
+#define h_array_foreach(array, type, var)								\
+	for (type *var = (type *) (array)->data;							\
+		 var < (type *) (array)->data + (array)->len; var++)
+
+
+/* HArray end */
+///////////////////////////////////////////////////////////////
 /* HString start */
 
 
 /**
  *	HString structure
+ *
+ *	A caller-owned HString set up with h_string_init() keeps strings shorter
+ *	than H_STRING_INLINE_LEN in `inline_buf`, with `str` pointing at it, and
+ *	only moves them to the heap once they outgrow it. Because of that such
+ *	an HString must not be copied by value. Strings from h_string_new() and
+ *	h_string_sized_new() always keep `str` on the heap, as they always have.
  */
+#define H_STRING_INLINE_LEN		24
+
 typedef struct __libhelper_hstring HString;
 struct __libhelper_hstring {
 	char		*str;
 	size_t 	 	len;
 	size_t 	 	allocated;
+	char		inline_buf[H_STRING_INLINE_LEN];
 };
 
 
 /**
- *	String list implementation
+ *	String list implementation. `data` holds the `ptrs` array followed by
+ *	the copy of the string, so `ptrs` and `data` are the same allocation,
+ *	and is reused by strsplit_into().
  */
 typedef struct __libhelper_stringlist StringList;
 struct __libhelper_stringlist {
 	char	  **ptrs;
 	int			count;
+	void	   *data;
+	size_t		size;
+};
+
+
+/**
+ *	Tokenizer over an existing buffer. Tokens are (pointer, length) views
+ *	into the buffer, nothing is copied or allocated.
+ */
+typedef struct __libhelper_strsplit_iter StringSplitIter;
+struct __libhelper_strsplit_iter {
+	const char	*str;
+	size_t		 len;
+	size_t		 pos;
+	const char	*delim;
+	size_t		 delim_len;
+	int			 done;
 };
 
 
 // HString functions
+extern void		 h_string_init (HString *string);
 extern HString	*h_string_new (const char *init);
 extern HString 	*h_string_insert_len (HString *string, size_t pos, const char *val, size_t len);
 extern HString 	*h_string_append_len (HString *string, const char *val, size_t len);
+extern HString 	*h_string_append (HString *string, const char *val);
 extern HString 	*h_string_sized_new (size_t size);
 
 extern HString 	*h_string_insert_c (HString *string, size_t pos, char c);
 extern HString 	*h_string_append_c (HString *string, char c);
 
+extern HString 	*h_string_append_printf (HString *string, const char *fmt, ...);
+extern HString 	*h_string_append_vprintf (HString *string, const char *fmt, va_list args);
+
+extern HString 	*h_string_reset (HString *string);
+extern void		 h_string_clear (HString *string);
+extern char		*h_string_free (HString *string, int free_segment);
+
 extern StringList	*strsplit (const char *s, const char *delim);
+extern StringList	*strsplit_into (StringList *list, const char *s, const char *delim);
+extern void			 stringlist_free (StringList *list);
+
+extern void			 strsplit_init (StringSplitIter *it, const char *s, size_t len, const char *delim);
+extern int			 strsplit_next (StringSplitIter *it, const char **token, size_t *len);
 
 // string append, multiple string append
 extern char		*strappend (char *a, char *b);
@@ -24,13 +24,28 @@
 //
 //===------------------------------------------------------------------===//
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#	define _GNU_SOURCE		/* copy_file_range() */
+#endif
+#ifndef _POSIX_C_SOURCE
+#	define _POSIX_C_SOURCE	200809L		/* pwrite(), strdup() */
+#endif
+#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)
+#	define _DARWIN_C_SOURCE			/* madvise(), which POSIX alone hides */
+#endif
+
 #include "libhelper/libhelper.h"
+#include "hlib.h"
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#	include <sys/sendfile.h>
+#endif
+
 file_t *file_create ()
 {
 	file_t *file = malloc (sizeof (file_t));
@@ -41,22 +56,30 @@ file_t *file_create ()
 
 file_t *file_load (const char *path)
 {
-	file_t *file = file_create ();
+	file_t *file = NULL;
 
 	/* set the file path */
 	if (!path) {
 		//error ("File path is not valid\n");
 		return NULL;
 	}
-	file->path = strdup (path);
 
 	/* create the file descriptor */
-	int fd = open (file->path, O_RDONLY);
+	int fd = open (path, O_RDONLY);
+	if (fd < 0) {
+		errorf ("file_load(): could not open %s: %d\n", path, errno);
+		return NULL;
+	}
+
+	file = file_create ();
+	file->path = strdup (path);
 
 	/* calculate the file file */
 	struct stat st;
 	fstat (fd, &st);
 	file->size = st.st_size;
+	file->dev = (uint64_t) st.st_dev;
+	file->ino = (uint64_t) st.st_ino;
 
 	/* mmap() the file */
 	file->data = mmap (NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
@@ -64,16 +87,159 @@ file_t *file_load (const char *path)
 
 	if (file->data == MAP_FAILED) {
 		errorf ("file_load(): mapping failed: %d\n", errno);
+		file->data = NULL;
+		file_free (file);
 		return NULL;
 	}
+	file->flags = LH_FILE_MAPPED;
 	
-	return (file->data) ? file : NULL;
+	return file;
+}
+
+
+/**
+ *	Wrap a buffer that is already in memory, e.g. a decompressed payload,
+ *	so it can be handed to anything that takes a `file_t` without going
+ *	through the filesystem. `flags` says who owns the buffer:
+ *
+ *		LH_FILE_BORROWED	caller keeps ownership and must outlive the file.
+ *		LH_FILE_OWNED		buffer was malloc()'d and is free()'d on close.
+ *		LH_FILE_MAPPED		buffer was mmap()'d and is munmap()'d on close.
+ *		LH_FILE_COPY		buffer is copied, the caller keeps the original.
+ *
+ */
+file_t *file_from_buffer (void *data, size_t size, int flags)
+{
+	file_t *file;
+
+	if (!data) {
+		errorf ("file_from_buffer(): invalid data\n");
+		return NULL;
+	}
+
+	file = file_create ();
+	file->size = size;
+
+	if (flags & LH_FILE_COPY) {
+		file->data = malloc (size);
+		if (!file->data) {
+			free (file);
+			return NULL;
+		}
+		memcpy (file->data, data, size);
+		file->flags = LH_FILE_OWNED;
+	} else {
+		file->data = (unsigned char *) data;
+		file->flags = flags;
+	}
+
+	return file;
+}
+
+
+/**
+ *	Wrap a buffer whose memory has to be released in a particular way, e.g.
+ *	returned by another allocator. `free_func` is called with `ctx` once
+ *	the file is closed.
+ *
+ */
+file_t *file_from_buffer_with_free (void *data, size_t size, file_free_func_t free_func, void *ctx)
+{
+	file_t *file = file_from_buffer (data, size, LH_FILE_BORROWED);
+	if (!file)
+		return NULL;
+
+	file->free_func = free_func;
+	file->free_ctx = ctx;
+	return file;
+}
+
+
+/**
+ *	Tell the kernel how `size` bytes at `addr` are about to be read, so
+ *	pages of a cold mapping can be read ahead, or dropped once they have
+ *	been used. The range is widened to whole pages. Hints are advisory:
+ *	memory that is not a mapping, or a platform without madvise(), is
+ *	quietly ignored.
+ *
+ *	@returns		LH_FILE_SUCCESS, or LH_FILE_FAILURE if the hint was rejected.
+ */
+int lh_advise (const void *addr, size_t size, int advice)
+{
+	long page = sysconf (_SC_PAGESIZE);
+	uintptr_t start, end;
+	int flag;
+
+	if (!addr || !size)
+		return LH_FILE_SUCCESS;
+
+	switch (advice) {
+		case LH_ADVISE_SEQUENTIAL:	flag = MADV_SEQUENTIAL;	break;
+		case LH_ADVISE_RANDOM:		flag = MADV_RANDOM;		break;
+		case LH_ADVISE_WILLNEED:	flag = MADV_WILLNEED;	break;
+		case LH_ADVISE_DONTNEED:	flag = MADV_DONTNEED;	break;
+		default:					flag = MADV_NORMAL;		break;
+	}
+
+	if (page <= 0)
+		return LH_FILE_FAILURE;
+
+	start = (uintptr_t) addr & ~((uintptr_t) page - 1);
+	end = ((uintptr_t) addr + size + page - 1) & ~((uintptr_t) page - 1);
+
+	return (madvise ((void *) start, end - start, flag)) ? LH_FILE_FAILURE : LH_FILE_SUCCESS;
+}
+
+
+/**
+ *	Paging hint for `size` bytes of a file from `offset`. Only mmap()'d
+ *	files are advised, buffers that are already in memory have nothing
+ *	to read ahead.
+ *
+ */
+int file_advise (file_t *f, size_t offset, size_t size, int advice)
+{
+	if (!f || !f->data || offset >= f->size)
+		return LH_FILE_FAILURE;
+	if (!(f->flags & LH_FILE_MAPPED))
+		return LH_FILE_SUCCESS;
+
+	return lh_advise (f->data + offset, MIN (size, f->size - offset), advice);
+}
+
+
+/**
+ *	Release the file data according to its ownership. The `file_t` itself
+ *	is kept, so it can be reused.
+ *
+ */
+void file_close (file_t *file)
+{
+	if (!file || !file->data)
+		return;
+
+	if (file->free_func)
+		file->free_func (file->data, file->size, file->free_ctx);
+	else if (file->flags & LH_FILE_MAPPED)
+		munmap (file->data, file->size);
+	else if (file->flags & LH_FILE_OWNED)
+		free (file->data);
+
+	file->data = NULL;
+	file->size = 0;
+	file->flags = LH_FILE_BORROWED;
+	file->free_func = NULL;
+	file->free_ctx = NULL;
 }
 
 
 void file_free (file_t *file)
 {
-	file = NULL;
+	if (!file)
+		return;
+
+	file_close (file);
+	free (file->path);
 	free (file);
 }
 
@@ -111,4 +277,164 @@ file_dup_data (file_t *f, uint32_t offset, size_t size)
 	void *buf = malloc (size);
 	file_read_data (f, offset, buf, size);
 	return buf;
-}
\ No newline at end of file
+}
+
+/**
+ *	Write `size` bytes from the file mapping to `fd` at `fd_offset`. This
+ *	is the slow path, used when the kernel can't copy between the two
+ *	descriptors for us.
+ *
+ */
+static int
+file_copy_range_pwrite (file_t *f, uint64_t offset, uint64_t size, int fd, uint64_t fd_offset)
+{
+	while (size) {
+		ssize_t n = pwrite (fd, f->data + offset, size, (off_t) fd_offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return LH_FILE_FAILURE;
+
+		offset += n;
+		fd_offset += n;
+		size -= n;
+	}
+	return LH_FILE_SUCCESS;
+}
+
+
+/**
+ *	Have the kernel copy as much of the range as it will. Returns the
+ *	number of bytes copied, which is short if neither copy_file_range()
+ *	nor sendfile() can handle this pair of descriptors.
+ *
+ */
+static uint64_t
+file_copy_range_kernel (int in, uint64_t offset, uint64_t size, int fd, uint64_t fd_offset)
+{
+	uint64_t done = 0;
+
+#ifdef __linux__
+	off_t in_off = (off_t) offset, out_off = (off_t) fd_offset;
+
+	// copy_file_range() can reflink on filesystems that support it
+	while (done < size) {
+		ssize_t n = copy_file_range (in, &in_off, fd, &out_off, size - done, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		done += n;
+	}
+
+	// older kernels, or copies across filesystems, can still use sendfile()
+	if (done < size && lseek (fd, out_off, SEEK_SET) == out_off) {
+		while (done < size) {
+			ssize_t n = sendfile (fd, in, &in_off, size - done);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				break;
+			done += n;
+		}
+	}
+#else
+	(void) in; (void) offset; (void) fd; (void) fd_offset; (void) size;
+#endif
+
+	return done;
+}
+
+
+/**
+ *	Open the file a mapping was loaded from, as long as the path still
+ *	names that file. If it was replaced or resized since, the kernel would
+ *	copy bytes that aren't the ones in the mapping.
+ *
+ */
+static int
+file_reopen (file_t *f)
+{
+	struct stat st;
+	int fd;
+
+	if (!f->path || !(f->flags & LH_FILE_MAPPED) || (fd = open (f->path, O_RDONLY)) < 0)
+		return -1;
+
+	if (fstat (fd, &st) || (uint64_t) st.st_dev != f->dev || (uint64_t) st.st_ino != f->ino ||
+		(size_t) st.st_size != f->size) {
+		debugf ("file_reopen(): %s has changed since it was mapped\n", f->path);
+		close (fd);
+		return -1;
+	}
+	return fd;
+}
+
+
+/**
+ *	Copy `size` bytes at `offset` within a file to `fd` at `fd_offset`.
+ *	When the file is backed by a path the copy is done by the kernel, so
+ *	the data never passes through user space. Buffers, files that changed
+ *	on disk since they were mapped, and anything the kernel refuses, are
+ *	written from the mapping with pwrite().
+ *
+ */
+int
+file_copy_range (file_t *f, uint64_t offset, uint64_t size, int fd, uint64_t fd_offset)
+{
+	uint64_t done = 0;
+	int in = -1;
+
+	if (!f || !f->data || offset > f->size || size > f->size - offset) {
+		errorf ("file_copy_range(): range is outside of the file\n");
+		return LH_FILE_FAILURE;
+	}
+
+	if ((in = file_reopen (f)) >= 0) {
+		done = file_copy_range_kernel (in, offset, size, fd, fd_offset);
+		close (in);
+	}
+
+	if (done == size)
+		return LH_FILE_SUCCESS;
+	return file_copy_range_pwrite (f, offset + done, size - done, fd, fd_offset + done);
+}
+
+
+/**
+ *	Extract `size` bytes at `offset` within a file to a new file at `path`.
+ *
+ */
+int
+file_write_range (file_t *f, uint64_t offset, uint64_t size, const char *path)
+{
+	file_range_t range = { offset, size };
+	return file_write_ranges (f, &range, 1, path);
+}
+
+
+/**
+ *	Extract a list of ranges within a file, one after another, to a new
+ *	file at `path`.
+ *
+ */
+int
+file_write_ranges (file_t *f, const file_range_t *ranges, int count, const char *path)
+{
+	uint64_t out_off = 0;
+	int fd, res = LH_FILE_SUCCESS;
+
+	fd = open (path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+	if (fd < 0) {
+		errorf ("file_write_ranges(): could not open %s: %d\n", path, errno);
+		return LH_FILE_FAILURE;
+	}
+
+	for (int i = 0; i < count && res; i++) {
+		res = file_copy_range (f, ranges[i].offset, ranges[i].size, fd, out_off);
+		out_off += ranges[i].size;
+	}
+
+	close (fd);
+	return res;
+}
@@ -0,0 +1,138 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "hlib.h"
+
+#define H_ARENA_ALIGN           16
+#define H_ARENA_BLOCK_DEFAULT   (64 * 1024)
+
+struct __libhelper_harena_block {
+    struct __libhelper_harena_block     *next;
+    size_t                               size;
+    size_t                               used;
+    _Alignas (H_ARENA_ALIGN) unsigned char data[];
+};
+
+
+static struct __libhelper_harena_block *h_arena_block_new (size_t size)
+{
+    struct __libhelper_harena_block *block = malloc (sizeof (struct __libhelper_harena_block) + size);
+    if (!block)
+        return NULL;
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+
+HArena *h_arena_new (size_t block_size)
+{
+    HArena *arena = h_slice_alloc0 (sizeof (HArena));
+    if (!arena)
+        return NULL;
+
+    arena->block_size = (block_size) ? block_size : H_ARENA_BLOCK_DEFAULT;
+    return arena;
+}
+
+
+/**
+ *  Allocate `size` bytes, aligned to 16 bytes so SIMD code can use them.
+ *  Large requests get a block of their own, which is linked behind the
+ *  current block so its free space isn't wasted.
+ */
+void *h_arena_alloc (HArena *arena, size_t size)
+{
+    struct __libhelper_harena_block *block;
+    size_t used;
+
+    if (!arena)
+        return NULL;
+
+    size = (size + H_ARENA_ALIGN - 1) & ~((size_t) H_ARENA_ALIGN - 1);
+    if (!size)
+        size = H_ARENA_ALIGN;
+
+    block = arena->blocks;
+    if (block) {
+        used = (block->used + H_ARENA_ALIGN - 1) & ~((size_t) H_ARENA_ALIGN - 1);
+        if (used <= block->size && size <= block->size - used) {
+            block->used = used + size;
+            return block->data + used;
+        }
+    }
+
+    if (size > arena->block_size / 4) {
+        struct __libhelper_harena_block *big = h_arena_block_new (size);
+        if (!big)
+            return NULL;
+
+        if (block) {
+            big->next = block->next;
+            block->next = big;
+        } else {
+            arena->blocks = big;
+        }
+        big->used = size;
+        return big->data;
+    }
+
+    block = h_arena_block_new (arena->block_size);
+    if (!block)
+        return NULL;
+
+    block->next = arena->blocks;
+    arena->blocks = block;
+    block->used = size;
+    return block->data;
+}
+
+
+void *h_arena_alloc0 (HArena *arena, size_t size)
+{
+    void *mem = h_arena_alloc (arena, size);
+    if (mem)
+        memset (mem, '\0', size);
+    return mem;
+}
+
+
+void h_arena_free (HArena *arena)
+{
+    struct __libhelper_harena_block *block, *next;
+
+    if (!arena)
+        return;
+
+    for (block = arena->blocks; block; block = next) {
+        next = block->next;
+        free (block);
+    }
+    free (arena);
+}
@@ -0,0 +1,189 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "hlib.h"
+
+#define H_ARRAY_MIN_CAP         8
+
+
+static HArray *h_array_create (HArena *arena, size_t elem_size, size_t reserve)
+{
+    HArray *array;
+
+    if (!elem_size)
+        return NULL;
+
+    array = (arena) ? h_arena_alloc0 (arena, sizeof (HArray)) : h_slice_alloc0 (sizeof (HArray));
+    if (!array)
+        return NULL;
+
+    array->elem_size = elem_size;
+    array->arena = arena;
+
+    if (reserve && !h_array_reserve (array, reserve)) {
+        if (!arena)
+            free (array);
+        return NULL;
+    }
+    return array;
+}
+
+
+HArray *h_array_new (size_t elem_size)
+{
+    return h_array_create (NULL, elem_size, 0);
+}
+
+
+/**
+ *  Create an array with room for `reserve` elements up front. When the
+ *  final size is known, nothing moves while the array is filled, so
+ *  pointers to elements stay valid.
+ */
+HArray *h_array_sized_new (size_t elem_size, size_t reserve)
+{
+    return h_array_create (NULL, elem_size, reserve);
+}
+
+
+/**
+ *  Create an array whose storage, and the array itself, are allocated from
+ *  `arena`. Growing leaves the old storage behind in the arena, so reserve
+ *  the expected size where possible.
+ */
+HArray *h_array_arena_new (HArena *arena, size_t elem_size, size_t reserve)
+{
+    if (!arena)
+        return NULL;
+    return h_array_create (arena, elem_size, reserve);
+}
+
+
+/**
+ *  Make sure there is room for at least `count` elements in total.
+ */
+int h_array_reserve (HArray *array, size_t count)
+{
+    void *data;
+    size_t cap;
+
+    if (!array)
+        return HARRAY_FAILURE;
+    if (count <= array->cap)
+        return HARRAY_SUCCESS;
+    if (count > SIZE_MAX / array->elem_size)
+        return HARRAY_FAILURE;
+
+    // grow geometrically so a run of pushes is amortised O(1)
+    cap = MAX (array->cap * 2, H_ARRAY_MIN_CAP);
+    if (cap < count || cap > SIZE_MAX / array->elem_size)
+        cap = count;
+
+    if (array->arena) {
+        data = h_arena_alloc (array->arena, cap * array->elem_size);
+        if (data && array->len)
+            memcpy (data, array->data, array->len * array->elem_size);
+    } else {
+        data = realloc (array->data, cap * array->elem_size);
+    }
+    if (!data)
+        return HARRAY_FAILURE;
+
+    array->data = data;
+    array->cap = cap;
+    return HARRAY_SUCCESS;
+}
+
+
+/**
+ *  Append an element, copied from `elem`, or zeroed if `elem` is NULL.
+ * 
+ *  @returns        pointer to the new element, or NULL on failure.
+ */
+void *h_array_push (HArray *array, const void *elem)
+{
+    unsigned char *slot;
+
+    if (!array)
+        return NULL;
+    if (array->len == array->cap && !h_array_reserve (array, array->len + 1))
+        return NULL;
+
+    slot = (unsigned char *) array->data + array->len * array->elem_size;
+    if (elem)
+        memcpy (slot, elem, array->elem_size);
+    else
+        memset (slot, '\0', array->elem_size);
+
+    array->len++;
+    return slot;
+}
+
+
+/**
+ *  Give back any spare capacity. Arena-backed arrays are left alone.
+ */
+void h_array_shrink (HArray *array)
+{
+    void *data;
+
+    if (!array || array->arena || array->len == array->cap)
+        return;
+
+    if (!array->len) {
+        free (array->data);
+        array->data = NULL;
+        array->cap = 0;
+        return;
+    }
+
+    data = realloc (array->data, array->len * array->elem_size);
+    if (data) {
+        array->data = data;
+        array->cap = array->len;
+    }
+}
+
+
+/**
+ *  Remove every element, keeping the storage for reuse.
+ */
+void h_array_clear (HArray *array)
+{
+    if (array)
+        array->len = 0;
+}
+
+
+void h_array_free (HArray *array)
+{
+    if (!array || array->arena)
+        return;
+
+    free (array->data);
+    free (array);
+}
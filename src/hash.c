@@ -0,0 +1,386 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+
+#include <stdatomic.h>
+
+/* SHA-256 comes from the same place as the img4 crypto */
+#if defined(__APPLE__) && defined(__MACH__)
+#   define LH_HASH_USE_COMMONCRYPTO
+#   include <CommonCrypto/CommonDigest.h>
+#else
+#   define LH_HASH_USE_OPENSSL
+#   include <openssl/sha.h>
+#endif
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Fast hash                          									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  The 64 bit fast hash is XXH64, so results can be checked against any
+ *  other xxHash implementation. The 128 bit hash runs the same four lanes
+ *  and derives a second, independent word from them with a different
+ *  merge and tail, so it costs a single pass over the data.
+ *
+ */
+#define PRIME64_1       0x9E3779B185EBCA87ULL
+#define PRIME64_2       0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3       0x165667B19E3779F9ULL
+#define PRIME64_4       0x85EBCA77C2B2AE63ULL
+#define PRIME64_5       0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, r)    (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint64_t hash_read64 (const unsigned char *p)
+{
+    uint64_t v;
+    memcpy (&v, p, sizeof (v));
+    return v;
+}
+
+static inline uint32_t hash_read32 (const unsigned char *p)
+{
+    uint32_t v;
+    memcpy (&v, p, sizeof (v));
+    return v;
+}
+
+static inline uint64_t hash_round (uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = ROTL64 (acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t hash_merge (uint64_t acc, uint64_t val)
+{
+    acc ^= hash_round (0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+static inline uint64_t hash_avalanche (uint64_t h)
+{
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+
+/**
+ *  Hash `size` bytes, writing the 64 bit hash to out[0] and the second
+ *  word of the 128 bit hash to out[1].
+ *
+ */
+static void hash_fast (const unsigned char *p, size_t size, uint64_t seed, uint64_t out[2])
+{
+    const unsigned char *end = p + size;
+    uint64_t h, h2;
+
+    if (size >= 32) {
+        const unsigned char *limit = end - 32;
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+
+        do {
+            v1 = hash_round (v1, hash_read64 (p));
+            v2 = hash_round (v2, hash_read64 (p + 8));
+            v3 = hash_round (v3, hash_read64 (p + 16));
+            v4 = hash_round (v4, hash_read64 (p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = ROTL64 (v1, 1) + ROTL64 (v2, 7) + ROTL64 (v3, 12) + ROTL64 (v4, 18);
+        h = hash_merge (h, v1);
+        h = hash_merge (h, v2);
+        h = hash_merge (h, v3);
+        h = hash_merge (h, v4);
+
+        h2 = ROTL64 (v4, 1) + ROTL64 (v3, 7) + ROTL64 (v2, 12) + ROTL64 (v1, 18);
+        h2 = hash_merge (h2, v4);
+        h2 = hash_merge (h2, v3);
+        h2 = hash_merge (h2, v2);
+        h2 = hash_merge (h2, v1);
+    } else {
+        h = seed + PRIME64_5;
+        h2 = (seed ^ PRIME64_4) + PRIME64_5;
+    }
+
+    h += (uint64_t) size;
+    h2 += (uint64_t) size;
+
+    while (p + 8 <= end) {
+        uint64_t k = hash_round (0, hash_read64 (p));
+        h ^= k;
+        h = ROTL64 (h, 27) * PRIME64_1 + PRIME64_4;
+        h2 ^= k;
+        h2 = ROTL64 (h2, 29) * PRIME64_2 + PRIME64_3;
+        p += 8;
+    }
+
+    if (p + 4 <= end) {
+        uint64_t k = (uint64_t) hash_read32 (p);
+        h ^= k * PRIME64_1;
+        h = ROTL64 (h, 23) * PRIME64_2 + PRIME64_3;
+        h2 ^= k * PRIME64_2;
+        h2 = ROTL64 (h2, 21) * PRIME64_1 + PRIME64_4;
+        p += 4;
+    }
+
+    while (p < end) {
+        h ^= (*p) * PRIME64_5;
+        h = ROTL64 (h, 11) * PRIME64_1;
+        h2 ^= (*p) * PRIME64_1;
+        h2 = ROTL64 (h2, 13) * PRIME64_5;
+        p++;
+    }
+
+    out[0] = hash_avalanche (h);
+    out[1] = hash_avalanche (h2 ^ out[0]);
+}
+
+
+/**
+ *  XXH64 of a buffer.
+ *
+ */
+uint64_t lh_hash64 (const void *data, size_t size, uint64_t seed)
+{
+    uint64_t out[2];
+    hash_fast ((const unsigned char *) data, size, seed, out);
+    return out[0];
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Tree hashing                          									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Inputs up to LH_HASH_CHUNK_SIZE are hashed directly. Anything larger is
+ *  split into chunks, each chunk gets a 128 bit leaf hash, and the root is
+ *  the fast hash of the leaves seeded with the total size. The result only
+ *  depends on the input, never on how many threads were used.
+ *
+ */
+struct __libhelper_hash_tree {
+    const unsigned char     *data;
+    size_t                   size;
+    uint64_t                *leaves;
+};
+
+static void hash_tree_leaf (void *ctx, size_t index)
+{
+    struct __libhelper_hash_tree *tree = (struct __libhelper_hash_tree *) ctx;
+    size_t offset = index * LH_HASH_CHUNK_SIZE;
+    size_t len = tree->size - offset;
+
+    if (len > LH_HASH_CHUNK_SIZE)
+        len = LH_HASH_CHUNK_SIZE;
+    hash_fast (tree->data + offset, len, 0, &tree->leaves[index * 2]);
+}
+
+static int hash_tree (const unsigned char *data, size_t size, uint64_t out[2], int nthreads)
+{
+    struct __libhelper_hash_tree tree;
+    size_t count;
+
+    if (size <= LH_HASH_CHUNK_SIZE) {
+        hash_fast (data, size, 0, out);
+        return LH_HASH_SUCCESS;
+    }
+
+    count = (size + LH_HASH_CHUNK_SIZE - 1) / LH_HASH_CHUNK_SIZE;
+    tree.data = data;
+    tree.size = size;
+    tree.leaves = malloc (count * 2 * sizeof (uint64_t));
+    if (!tree.leaves)
+        return LH_HASH_FAILURE;
+
+    lh_parallel_for (count, hash_tree_leaf, &tree, nthreads);
+
+    hash_fast ((const unsigned char *) tree.leaves, count * 2 * sizeof (uint64_t), (uint64_t) size, out);
+    free (tree.leaves);
+    return LH_HASH_SUCCESS;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- SHA-256                              									 --*/
+//===-----------------------------------------------------------------------===//
+
+static int hash_sha256 (const unsigned char *data, size_t size, unsigned char *out)
+{
+#ifdef LH_HASH_USE_COMMONCRYPTO
+    // CC_LONG is 32 bits, so feed large inputs in pieces
+    CC_SHA256_CTX ctx;
+    CC_SHA256_Init (&ctx);
+    while (size) {
+        CC_LONG len = (size > 0x40000000) ? 0x40000000 : (CC_LONG) size;
+        CC_SHA256_Update (&ctx, data, len);
+        data += len;
+        size -= len;
+    }
+    CC_SHA256_Final (out, &ctx);
+    return LH_HASH_SUCCESS;
+#else
+    return (SHA256 (data, size, out)) ? LH_HASH_SUCCESS : LH_HASH_FAILURE;
+#endif
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Public API                              								 --*/
+//===-----------------------------------------------------------------------===//
+
+static void hash_store64 (unsigned char *out, uint64_t v)
+{
+    for (int i = 7; i >= 0; i--, v >>= 8)
+        out[i] = (unsigned char) v;
+}
+
+static int hash_view (lh_view_t view, lh_hash_type_t type, lh_hash_t *out, int nthreads)
+{
+    uint64_t fast[2];
+
+    if (!out || !view.data)
+        return LH_HASH_FAILURE;
+
+    memset (out, '\0', sizeof (lh_hash_t));
+    out->type = type;
+
+    switch (type) {
+        case LH_HASH_FAST64:
+        case LH_HASH_FAST128:
+            if (!hash_tree (view.data, view.size, fast, nthreads))
+                return LH_HASH_FAILURE;
+
+            hash_store64 (out->digest, fast[0]);
+            out->size = 8;
+            if (type == LH_HASH_FAST128) {
+                hash_store64 (out->digest + 8, fast[1]);
+                out->size = 16;
+            }
+            return LH_HASH_SUCCESS;
+
+        case LH_HASH_SHA256:
+            out->size = 32;
+            return hash_sha256 (view.data, view.size, out->digest);
+
+        default:
+            errorf ("lh_view_hash(): unknown hash type: %d\n", type);
+            return LH_HASH_FAILURE;
+    }
+}
+
+
+/**
+ *  Hash the contents of a view. Large views are hashed on multiple threads
+ *  with the fast hashes; SHA-256 is inherently sequential.
+ *
+ */
+int lh_view_hash (lh_view_t view, lh_hash_type_t type, lh_hash_t *out)
+{
+    return hash_view (view, type, out, 0);
+}
+
+
+/**
+ *  Hash a whole file.
+ *
+ */
+int file_hash (file_t *f, lh_hash_type_t type, lh_hash_t *out)
+{
+    if (!f || !f->data)
+        return LH_HASH_FAILURE;
+    return lh_view_hash (lh_view_create (f->data, f->size, f), type, out);
+}
+
+
+/**
+ *  Hash many views at once, one job per view, writing the results to the
+ *  matching entries of `out`. Useful for hashing every segment and section
+ *  of an image without walking the mapping once per region.
+ *
+ */
+struct __libhelper_hash_batch {
+    const lh_view_t         *views;
+    lh_hash_type_t           type;
+    lh_hash_t               *out;
+    atomic_int              failed;
+};
+
+static void hash_batch_job (void *ctx, size_t index)
+{
+    struct __libhelper_hash_batch *batch = (struct __libhelper_hash_batch *) ctx;
+
+    if (!hash_view (batch->views[index], batch->type, &batch->out[index], 1))
+        atomic_store (&batch->failed, 1);
+}
+
+int lh_hash_views (const lh_view_t *views, size_t count, lh_hash_type_t type, lh_hash_t *out)
+{
+    struct __libhelper_hash_batch batch;
+
+    if (!views || !out)
+        return LH_HASH_FAILURE;
+
+    batch.views = views;
+    batch.type = type;
+    batch.out = out;
+    atomic_init (&batch.failed, 0);
+
+    lh_parallel_for (count, hash_batch_job, &batch, 0);
+    return (atomic_load (&batch.failed)) ? LH_HASH_FAILURE : LH_HASH_SUCCESS;
+}
+
+
+/**
+ *  Write a hash as lowercase hex into `buf`, which needs room for two
+ *  characters per digest byte plus the terminator.
+ *
+ */
+char *lh_hash_to_string (const lh_hash_t *hash, char *buf, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    if (!hash || !buf || len < (size_t) hash->size * 2 + 1)
+        return NULL;
+
+    for (uint32_t i = 0; i < hash->size; i++) {
+        buf[i * 2] = hex[hash->digest[i] >> 4];
+        buf[i * 2 + 1] = hex[hash->digest[i] & 0xf];
+    }
+    buf[hash->size * 2] = '\0';
+    return buf;
+}
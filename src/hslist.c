@@ -55,6 +55,33 @@ HSList *h_slist_append (HSList *list, void *data)
 }
 
 
+/**
+ *  Append to a list whose last node the caller keeps in `tail`, so the
+ *  list doesn't have to be walked. `tail` must start out NULL for an empty
+ *  list, and is updated to the new node.
+ */
+HSList *h_slist_append_tail (HSList *list, HSList **tail, void *data)
+{
+    HSList *new;
+
+    if (!list || !*tail)
+        *tail = h_slist_last (list);
+
+    new = h_slice_alloc0 (sizeof(HSList));
+    new->data = data;
+    new->next = NULL;
+
+    if (*tail) {
+        (*tail)->next = new;
+        *tail = new;
+        return list;
+    }
+
+    *tail = new;
+    return new;
+}
+
+
 HSList *h_slist_last (HSList *list)
 {
     if (list) {
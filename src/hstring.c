@@ -42,13 +42,47 @@ nearest_power (size_t base, size_t num)
     }
 }
 
-static void
+/**
+ *  Make room for `len` more bytes plus the terminator. A string that
+ *  outgrows its inline buffer moves to the heap, and stays there.
+ */
+static int
 h_string_maybe_expand (HString *string, size_t len)
 {
-    if (string->len + len >= string->allocated) {
-        string->allocated = nearest_power (1, string->len + len + 1);
-        string->str = realloc (string->str, string->allocated);
+    size_t allocated;
+    char *str;
+
+    if (string->len + len < string->allocated)
+        return 1;
+
+    allocated = nearest_power (1, string->len + len + 1);
+    if (string->str == string->inline_buf) {
+        str = malloc (allocated);
+        if (str)
+            memcpy (str, string->inline_buf, string->len + 1);
+    } else {
+        str = realloc (string->str, allocated);
     }
+
+    if (!str)
+        return 0;
+
+    string->str = str;
+    string->allocated = allocated;
+    return 1;
+}
+
+/**
+ *  Initialise a caller-owned HString, for example one on the stack. It
+ *  starts out in the inline buffer, so short strings never touch the heap.
+ *  Release it with h_string_clear().
+ */
+void h_string_init (HString *string)
+{
+    string->str = string->inline_buf;
+    string->len = 0;
+    string->allocated = H_STRING_INLINE_LEN;
+    string->inline_buf[0] = '\0';
 }
 
 HString *h_string_new (const char *init)
@@ -99,7 +133,8 @@ HString *h_string_insert_len (HString *string, size_t pos, const char *val, size
         size_t offset = val - string->str;
         size_t precount = 0;
 
-        h_string_maybe_expand (string, len_unsigned);
+        if (!h_string_maybe_expand (string, len_unsigned))
+            return string;
         val = string->str + offset;
         /* At this point, val is valid again */
 
@@ -124,7 +159,8 @@ HString *h_string_insert_len (HString *string, size_t pos, const char *val, size
         }
    } else {
 
-       h_string_maybe_expand (string, len_unsigned);
+       if (!h_string_maybe_expand (string, len_unsigned))
+           return string;
 
        /* If we aren't appending at the end, move a hunk
         * of the old stirng to the end, opening up space
@@ -148,21 +184,58 @@ HString *h_string_insert_len (HString *string, size_t pos, const char *val, size
    return string;
 }
 
+/**
+ *  Append `len` bytes of `val`. Appending never has to open a gap, so
+ *  this skips the insert logic and is a single copy.
+ */
 HString *h_string_append_len (HString *string, const char *val, size_t len)
 {
-    return h_string_insert_len (string, -1, val, len);
+    size_t offset = 0;
+    int inside;
+
+    if (!string || !len || !val)
+        return string;
+
+    // val may point into the string itself, and move if the string grows
+    inside = (val >= string->str && val < string->str + string->allocated);
+    if (inside)
+        offset = val - string->str;
+
+    if (!h_string_maybe_expand (string, len))
+        return string;
+    if (inside)
+        val = string->str + offset;
+
+    memmove (string->str + string->len, val, len);
+    string->len += len;
+    string->str[string->len] = '\0';
+
+    return string;
+}
+
+HString *h_string_append (HString *string, const char *val)
+{
+    if (!val)
+        return string;
+    return h_string_append_len (string, val, strlen (val));
 }
 
 HString *h_string_sized_new (size_t size)
 {
     HString *string = h_slice_alloc0 (sizeof(HString));
+    size_t allocated = nearest_power (1, MAX (size, 2) + 1);
+    if (!string)
+        return NULL;
 
-    string->allocated = 0;
-    string->len = 0;
-    string->str = NULL;
-    
-    h_string_maybe_expand (string, MAX(size, 2));
-    string->str[0] = 0;
+    // heap strings keep their characters on the heap, callers may own `str`
+    h_string_init (string);
+    string->str = malloc (allocated);
+    if (!string->str) {
+        free (string);
+        return NULL;
+    }
+    string->str[0] = '\0';
+    string->allocated = allocated;
     
     return string;
 }
@@ -173,7 +246,8 @@ HString *h_string_insert_c (HString *string, size_t pos, char c)
 
     h_return_val_if_fail (string != NULL, NULL);
 
-    h_string_maybe_expand (string, 1);
+    if (!h_string_maybe_expand (string, 1))
+        return string;
 
     if (pos <= -1) {
         pos = string->len;
@@ -198,49 +272,280 @@ HString *h_string_insert_c (HString *string, size_t pos, char c)
 
 HString *h_string_append_c (HString *string, char c)
 {
-    h_return_val_if_fail (string != NULL, NULL);
-    return h_string_insert_c (string, -1, c);
+    if (!string)
+        return NULL;
+
+    if (string->len + 1 >= string->allocated && !h_string_maybe_expand (string, 1))
+        return string;
+
+    string->str[string->len++] = c;
+    string->str[string->len] = '\0';
+
+    return string;
+}
+
+/**
+ *  Format straight into the spare capacity at the end of the string. Only
+ *  if the output doesn't fit is the string grown and formatted again.
+ */
+HString *h_string_append_vprintf (HString *string, const char *fmt, va_list args)
+{
+    size_t spare;
+    va_list copy;
+    int len;
+
+    if (!string || !fmt)
+        return string;
+
+    va_copy (copy, args);
+    spare = string->allocated - string->len;
+    len = vsnprintf (string->str + string->len, spare, fmt, args);
+
+    if (len >= 0 && (size_t) len >= spare) {
+        if (h_string_maybe_expand (string, len))
+            vsnprintf (string->str + string->len, len + 1, fmt, copy);
+        else
+            len = -1;
+    }
+    va_end (copy);
+
+    // a failed or truncated attempt may have overwritten the terminator
+    if (len < 0) {
+        string->str[string->len] = '\0';
+        return string;
+    }
+
+    string->len += len;
+    return string;
+}
+
+HString *h_string_append_printf (HString *string, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start (args, fmt);
+    h_string_append_vprintf (string, fmt, args);
+    va_end (args);
+
+    return string;
+}
+
+/**
+ *  Empty the string, keeping its storage so it can be built again
+ *  without allocating.
+ */
+HString *h_string_reset (HString *string)
+{
+    if (!string)
+        return NULL;
+
+    string->len = 0;
+    string->str[0] = '\0';
+    return string;
+}
+
+/**
+ *  Free any heap storage of a caller-owned string, leaving it empty and
+ *  ready for reuse. The HString itself is not freed.
+ */
+void h_string_clear (HString *string)
+{
+    if (!string)
+        return;
+
+    if (string->str != string->inline_buf)
+        free (string->str);
+    h_string_init (string);
+}
+
+/**
+ *  Free a string created with h_string_new() or h_string_sized_new(). If
+ *  `free_segment` is zero the character data is returned, and must be
+ *  free()'d by the caller.
+ */
+char *h_string_free (HString *string, int free_segment)
+{
+    char *segment = NULL;
+
+    if (!string)
+        return NULL;
+
+    if (!free_segment && string->str == string->inline_buf) {
+        segment = malloc (string->len + 1);
+        if (segment)
+            memcpy (segment, string->str, string->len + 1);
+    } else if (!free_segment) {
+        segment = string->str;
+    } else if (string->str != string->inline_buf) {
+        free (string->str);
+    }
+
+    free (string);
+    return segment;
 }
 
 ///////////////////////////////////////////////////////////////////////
 
-StringList *strsplit (const char *s, const char *delim)
+/**
+ *  Find the next `delim` in `len` bytes of `s`. A single byte delimiter
+ *  is a plain memchr(). Longer ones use memchr() to skip to each candidate
+ *  first byte, and only compare the rest there.
+ */
+static const char *strsplit_find (const char *s, size_t len, const char *delim, size_t delim_len)
 {
-    StringList *rv = malloc (sizeof (StringList));
+    const char *end = s + len;
+
+    if (delim_len == 1)
+        return memchr (s, *delim, len);
+
+    while ((size_t) (end - s) >= delim_len) {
+        s = memchr (s, *delim, (end - s) - delim_len + 1);
+        if (!s)
+            return NULL;
+        if (!memcmp (s + 1, delim + 1, delim_len - 1))
+            return s;
+        s++;
+    }
+    return NULL;
+}
+
+/**
+ *  Start splitting `len` bytes of `s` on `delim`. Nothing is copied, the
+ *  tokens are views into `s`, which must outlive the iterator.
+ */
+void strsplit_init (StringSplitIter *it, const char *s, size_t len, const char *delim)
+{
+    it->str = s;
+    it->len = (s) ? len : 0;
+    it->pos = 0;
+    it->delim = delim;
+    it->delim_len = (delim) ? strlen (delim) : 0;
+    it->done = (s == NULL);
+}
+
+/**
+ *  Get the next token. Tokens are not NUL terminated. As with strsplit(),
+ *  adjacent delimiters give empty tokens, and there is always one more
+ *  token than there are delimiters.
+ *
+ *  @returns        1 with `token` and `len` set, or 0 when there are none left.
+ */
+int strsplit_next (StringSplitIter *it, const char **token, size_t *len)
+{
+    const char *start, *found = NULL;
+
+    if (it->done)
+        return 0;
+
+    start = it->str + it->pos;
+    if (it->delim_len)
+        found = strsplit_find (start, it->len - it->pos, it->delim, it->delim_len);
 
+    if (found) {
+        *len = found - start;
+        it->pos += *len + it->delim_len;
+    } else {
+        *len = it->len - it->pos;
+        it->pos = it->len;
+        it->done = 1;
+    }
+
+    *token = start;
+    return 1;
+}
+
+static int stringlist_reserve (StringList *list, size_t size)
+{
     void *data;
-    char *_s = (char *) s;
-    const char **ptrs;
-    unsigned int
-        ptrsSize, nbWords = 1,
-        sLen = strlen (s),
-        delimLen = strlen (delim);
-
-    while (( _s = strstr (_s, delim)))
-    {
-        _s += delimLen;
-        ++nbWords;
+
+    if (size <= list->size)
+        return 1;
+
+    size = MAX (size, list->size * 2);
+    data = realloc (list->data, size);
+    if (!data)
+        return 0;
+
+    list->data = data;
+    list->size = size;
+    return 1;
+}
+
+/**
+ *  Split `s` on `delim` into `list`, reusing the storage of whatever it
+ *  held before. If `list` is NULL a new one is created. The pointer array
+ *  and the copy of the string share a single buffer, with `ptrs` at the
+ *  start of it so it can still be free()'d, which only grows when a split
+ *  needs more room. The tokens are counted first, so the copy can be
+ *  placed after the array and is never moved.
+ *
+ *  @returns        the list, or NULL on failure.
+ */
+StringList *strsplit_into (StringList *list, const char *s, const char *delim)
+{
+    StringSplitIter it;
+    const char *token;
+    size_t slen, ptrs_size, count = 0, len;
+    char *buf;
+    int created = 0;
+
+    if (!s || !delim)
+        return NULL;
+
+    if (!list) {
+        list = calloc (1, sizeof (StringList));
+        if (!list)
+            return NULL;
+        created = 1;
     }
 
-    rv->count = nbWords;
-
-    ptrsSize = (nbWords + 1) * sizeof(char*);
-    ptrs = data = malloc (ptrsSize + sLen + 1);
-    if (data) {
-        *ptrs = 
-            _s = strcpy (((char *) data) + ptrsSize, s);
-        if (nbWords > 1) {
-            while ((_s = strstr (_s, delim))) {
-                *_s = '\0';
-                _s += delimLen;
-                *++ptrs = _s;
-            }
-        }
-        *++ptrs = NULL;
+    slen = strlen (s);
+    strsplit_init (&it, s, slen, delim);
+    while (strsplit_next (&it, &token, &len))
+        count++;
+
+    // the pointer array goes first, with the copy after it
+    ptrs_size = (count + 1) * sizeof (char *);
+    if (!stringlist_reserve (list, ptrs_size + slen + 1))
+        goto split_failed;
+
+    list->ptrs = (char **) list->data;
+    buf = (char *) list->data + ptrs_size;
+    memcpy (buf, s, slen + 1);
+
+    count = 0;
+    strsplit_init (&it, buf, slen, delim);
+    while (strsplit_next (&it, &token, &len)) {
+        list->ptrs[count++] = (char *) token;
+        buf[(token - buf) + len] = '\0';
+    }
+    list->ptrs[count] = NULL;
+    list->count = (int) count;
+
+    return list;
+
+split_failed:
+    if (created) {
+        stringlist_free (list);
+    } else {
+        list->ptrs = NULL;
+        list->count = 0;
     }
+    return NULL;
+}
+
+StringList *strsplit (const char *s, const char *delim)
+{
+    return strsplit_into (NULL, s, delim);
+}
 
-    rv->ptrs = data;
-    return rv;
+void stringlist_free (StringList *list)
+{
+    if (!list)
+        return;
+
+    free (list->data);
+    free (list);
 }
 
 char *strappend(char *a, char *b) {
@@ -271,44 +576,39 @@ char *mstrappend(char *toap, ...) {
     va_list arg;                        // va_list arguments
     char *rt;                           // string to return
     size_t count = strlen(toap) / 2;    // amount of parameters given
-    size_t len = 0;                     // length of all the parameters together
-    char *content[count];               // array to hold each parameter from va_arg()
+    size_t len = 0, off = 0;            // length of all the parameters together
     
-    // Initialise the va list
-    va_start(arg, toap);     
-            
-    // If there are enough args to continue
-    if (count > 1) {
-        for (size_t i = 0; i < count; i++) {
-            // assign va_arg to a temp var
-            char *tmp = va_arg(arg, char*);
-            /* assign len as the current value + length of current value of tmp
-                this is to get the full amount of characters in the final
-                appended string */
-            len = len + strlen(tmp);
-            // set i on content to value of tmp
-            content[i] = tmp;
-        }
-    
-        // allocated enough bytes in rt for all contents values + a null byte
-        rt = malloc(len + 1);
-        for (size_t i = 0; i < count; i++) {
-            // append content at i to rt
-            rt = strappend(rt, content[i]);
-        }
-    
-    } else {
-        // Not enough args to continue, present error
+    // If there aren't enough args to continue, present error
+    if (count < 2) {
         errorf("Not enough args given");
         // Return with NULL to prevent continuation and SEGFAULT
         return NULL;
     }
-    
-    // append a Null byte to the end of rt
-    rt = strappend(rt, "\0");
-    
+
+    char *content[count];               // array to hold each parameter from va_arg()
+    size_t lens[count];                 // and its length
+
+    // Initialise the va list
+    va_start(arg, toap);     
+    for (size_t i = 0; i < count; i++) {
+        content[i] = va_arg(arg, char*);
+        lens[i] = strlen(content[i]);
+        len += lens[i];
+    }
     // Stop the va_list
     va_end(arg);
+    
+    // allocate enough bytes in rt for all contents values + a null byte,
+    // and copy each one in after the last
+    rt = malloc(len + 1);
+    if (!rt)
+        return NULL;
+
+    for (size_t i = 0; i < count; i++) {
+        memcpy(rt + off, content[i], lens[i]);
+        off += lens[i];
+    }
+    rt[len] = '\0';
             
     // Return the newly appended string
     return rt;
@@ -318,16 +618,17 @@ char *mstrappend(char *toap, ...) {
 int __printf(log_type msg_type, char *fmt, ...) {
     // Create arg and done vars
     va_list arg;
+    char *tmp = NULL;
     int done;
 
     // Append what is needed depending on msg_type
     if (msg_type == LOG_ERROR) {
-        fmt = mstrappend("%s%s%s", ANSI_COLOR_RED "[Error] ", fmt, ANSI_COLOR_RED ANSI_COLOR_RESET);
+        tmp = mstrappend("%s%s%s", ANSI_COLOR_RED "[Error] ", fmt, ANSI_COLOR_RED ANSI_COLOR_RESET);
     } else if (msg_type == LOG_WARNING) {
-        fmt = mstrappend("%s%s%s", ANSI_COLOR_YELLOW "[Warning] ", fmt, ANSI_COLOR_YELLOW ANSI_COLOR_RESET);        
+        tmp = mstrappend("%s%s%s", ANSI_COLOR_YELLOW "[Warning] ", fmt, ANSI_COLOR_YELLOW ANSI_COLOR_RESET);        
     } else if (msg_type == LOG_DEBUG) {
 #if LIBHELPER_DEBUG
-        fmt = mstrappend("%s%s%s", ANSI_COLOR_CYAN "DEBUG: ", fmt, ANSI_COLOR_CYAN ANSI_COLOR_RESET);  
+        tmp = mstrappend("%s%s%s", ANSI_COLOR_CYAN "DEBUG: ", fmt, ANSI_COLOR_CYAN ANSI_COLOR_RESET);  
 #else
         return 1;
 #endif      
@@ -337,66 +638,14 @@ int __printf(log_type msg_type, char *fmt, ...) {
     va_start(arg, fmt);
         
     // assign the value of vfpritnf to done
-    done = vfprintf(stdout, fmt, arg);
+    done = vfprintf(stdout, (tmp) ? tmp : fmt, arg);
         
     // End the variable argument list with arg
     va_end(arg);
+
+    // the prefixed format was only needed for this message
+    free(tmp);
         
     // Return value of done
     return done;
 }
-
-unsigned char *
-bh_memmem (const unsigned char *haystack, size_t hlen,
-           const unsigned char *needle,   size_t nlen)
-{
-    size_t last, scan = 0;
-    size_t bad_char_skip[__UCHAR_MAX + 1]; /* Officially called:
-                                          * bad character shift */
-
-    /* Sanity checks on the parameters */
-    if (nlen <= 0 || !haystack || !needle)
-        return NULL;
-
-    /* ---- Preprocess ---- */
-    /* Initialize the table to default value */
-    /* When a character is encountered that does not occur
-     * in the needle, we can safely skip ahead for the whole
-     * length of the needle.
-     */
-    for (scan = 0; scan <= __UCHAR_MAX; scan = scan + 1)
-        bad_char_skip[scan] = nlen;
-
-    /* C arrays have the first byte at [0], therefore:
-     * [nlen - 1] is the last byte of the array. */
-    last = nlen - 1;
-
-    /* Then populate it with the analysis of the needle */
-    for (scan = 0; scan < last; scan = scan + 1)
-        bad_char_skip[needle[scan]] = last - scan;
-
-    /* ---- Do the matching ---- */
-
-    /* Search the haystack, while the needle can still be within it. */
-    while (hlen >= nlen)
-    {
-        /* scan from the end of the needle */
-        for (scan = last; haystack[scan] == needle[scan]; scan = scan - 1)
-            if (scan == 0) /* If the first byte matches, we've found it. */
-                return (void *)haystack;
-
-        /* otherwise, we need to skip some bytes and start again.
-           Note that here we are getting the skip value based on the last byte
-           of needle, no matter where we didn't match. So if needle is: "abcd"
-           then we are skipping based on 'd' and that value will be 4, and
-           for "abcdd" we again skip on 'd' but the value will be only 1.
-           The alternative of pretending that the mismatched character was
-           the last character is slower in the normal case (E.g. finding
-           "abcd" in "...azcd..." gives 4 by using 'd' but only
-           4-2==2 using 'z'. */
-        hlen     -= bad_char_skip[haystack[last]];
-        haystack += bad_char_skip[haystack[last]];
-    }
-
-    return NULL; 
-}
\ No newline at end of file
@@ -0,0 +1,349 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#ifndef _POSIX_C_SOURCE
+#   define _POSIX_C_SOURCE  200809L     /* pthread_rwlock_t */
+#endif
+#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)
+#   define _DARWIN_C_SOURCE
+#endif
+
+#include "libhelper/libhelper.h"
+#include "hlib.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define LH_INTERN_SHARD_BITS        6
+#define LH_INTERN_SHARDS            (1u << LH_INTERN_SHARD_BITS)
+#define LH_INTERN_LOCAL_MAX         ((UINT32_MAX >> LH_INTERN_SHARD_BITS) - 1)
+#define LH_INTERN_MIN_SLOTS         64
+#define LH_INTERN_ARENA_BLOCK       (16 * 1024)
+
+
+/**
+ *  An interned string. Records live in the shard's arena and never move,
+ *  so the pointers handed out by lh_intern_string() stay valid until the
+ *  pool is freed.
+ *
+ */
+struct __libhelper_intern_record {
+    uint64_t        hash;
+    uint32_t        len;
+    char            str[];
+};
+
+/**
+ *  Each shard owns a slice of the id space, its own lock, arena and an
+ *  open addressed table of record indexes. Strings are spread over the
+ *  shards by hash, so threads interning different names rarely meet.
+ *
+ *  The record directory is only ever replaced, never resized in place.
+ *  The old directory stays in the arena, so an id can be resolved without
+ *  taking the lock.
+ *
+ */
+struct __libhelper_intern_shard {
+    pthread_rwlock_t                                     lock;
+    HArena                                              *arena;
+
+    uint32_t                                            *slots;     /* record index + 1, or 0 if empty */
+    uint32_t                                             nslots;
+
+    _Atomic (struct __libhelper_intern_record **)        records;
+    _Atomic (uint32_t)                                   count;
+    uint32_t                                             cap;
+};
+
+struct __libhelper_intern {
+    struct __libhelper_intern_shard      shards[LH_INTERN_SHARDS];
+    atomic_size_t                        count;
+};
+
+
+static inline uint32_t lh_intern_make_id (uint32_t shard, uint32_t index)
+{
+    return ((index + 1) << LH_INTERN_SHARD_BITS) | shard;
+}
+
+
+/**
+ *  Look for `str` in the shard's table. The caller holds the shard lock.
+ *
+ *  @returns        the id, or LH_INTERN_NONE if it isn't there.
+ */
+static uint32_t lh_intern_probe (struct __libhelper_intern_shard *shard, uint32_t s,
+                                 const void *str, size_t len, uint64_t hash)
+{
+    struct __libhelper_intern_record **records;
+    uint32_t b;
+
+    if (!shard->nslots)
+        return LH_INTERN_NONE;
+
+    records = atomic_load_explicit (&shard->records, memory_order_relaxed);
+    b = (uint32_t) (hash >> LH_INTERN_SHARD_BITS) & (shard->nslots - 1);
+
+    while (shard->slots[b]) {
+        struct __libhelper_intern_record *rec = records[shard->slots[b] - 1];
+        if (rec->hash == hash && rec->len == len && !memcmp (rec->str, str, len))
+            return lh_intern_make_id (s, shard->slots[b] - 1);
+        b = (b + 1) & (shard->nslots - 1);
+    }
+    return LH_INTERN_NONE;
+}
+
+
+/**
+ *  Make room for one more string. The table is kept at most half full.
+ *  Called with the shard lock held for writing.
+ *
+ */
+static int lh_intern_shard_grow (struct __libhelper_intern_shard *shard)
+{
+    struct __libhelper_intern_record **records, **old;
+    uint32_t count = atomic_load_explicit (&shard->count, memory_order_relaxed);
+
+    old = atomic_load_explicit (&shard->records, memory_order_relaxed);
+
+    if (count == shard->cap) {
+        uint32_t cap = (shard->cap) ? shard->cap * 2 : LH_INTERN_MIN_SLOTS / 2;
+
+        records = h_arena_alloc (shard->arena, (size_t) cap * sizeof (*records));
+        if (!records)
+            return 0;
+        if (count)
+            memcpy (records, old, (size_t) count * sizeof (*records));
+
+        // readers resolving ids may still hold the old directory, it is
+        // left behind in the arena rather than freed
+        atomic_store_explicit (&shard->records, records, memory_order_release);
+        shard->cap = cap;
+        old = records;
+    }
+
+    if ((uint64_t) (count + 1) * 2 > shard->nslots) {
+        uint32_t nslots = (shard->nslots) ? shard->nslots * 2 : LH_INTERN_MIN_SLOTS;
+        uint32_t *slots = calloc (nslots, sizeof (uint32_t));
+        if (!slots)
+            return 0;
+
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t b = (uint32_t) (old[i]->hash >> LH_INTERN_SHARD_BITS) & (nslots - 1);
+            while (slots[b])
+                b = (b + 1) & (nslots - 1);
+            slots[b] = i + 1;
+        }
+
+        free (shard->slots);
+        shard->slots = slots;
+        shard->nslots = nslots;
+    }
+    return 1;
+}
+
+
+/**
+ *  Create an empty pool. A pool is safe to share between threads, and
+ *  between as many Mach-O's as needed.
+ *
+ */
+lh_intern_t *lh_intern_create ()
+{
+    lh_intern_t *pool = calloc (1, sizeof (lh_intern_t));
+    if (!pool)
+        return NULL;
+
+    for (uint32_t i = 0; i < LH_INTERN_SHARDS; i++) {
+        struct __libhelper_intern_shard *shard = &pool->shards[i];
+
+        shard->arena = h_arena_new (LH_INTERN_ARENA_BLOCK);
+        if (!shard->arena) {
+            for (uint32_t j = 0; j < i; j++) {
+                pthread_rwlock_destroy (&pool->shards[j].lock);
+                h_arena_free (pool->shards[j].arena);
+            }
+            free (pool);
+            return NULL;
+        }
+        pthread_rwlock_init (&shard->lock, NULL);
+        atomic_init (&shard->records, NULL);
+        atomic_init (&shard->count, 0);
+    }
+    atomic_init (&pool->count, 0);
+    return pool;
+}
+
+
+/**
+ *  Intern `len` bytes of `str`. Equal strings always get the same id, for
+ *  as long as the pool lives.
+ *
+ *  @returns        the id, or LH_INTERN_NONE on failure.
+ */
+uint32_t lh_intern (lh_intern_t *pool, const void *str, size_t len)
+{
+    struct __libhelper_intern_shard *shard;
+    struct __libhelper_intern_record *rec, **records;
+    uint64_t hash;
+    uint32_t s, id, b, count;
+
+    if (!pool || (!str && len) || len > UINT32_MAX - 1)
+        return LH_INTERN_NONE;
+
+    hash = lh_hash64 (str, len, 0);
+    s = (uint32_t) hash & (LH_INTERN_SHARDS - 1);
+    shard = &pool->shards[s];
+
+    // most names are already there, so try with the shared lock first
+    pthread_rwlock_rdlock (&shard->lock);
+    id = lh_intern_probe (shard, s, str, len, hash);
+    pthread_rwlock_unlock (&shard->lock);
+    if (id)
+        return id;
+
+    pthread_rwlock_wrlock (&shard->lock);
+
+    // someone may have added it while the lock was dropped
+    id = lh_intern_probe (shard, s, str, len, hash);
+    count = atomic_load_explicit (&shard->count, memory_order_relaxed);
+    if (id || count >= LH_INTERN_LOCAL_MAX || !lh_intern_shard_grow (shard))
+        goto intern_done;
+
+    rec = h_arena_alloc (shard->arena, sizeof (*rec) + len + 1);
+    if (!rec)
+        goto intern_done;
+
+    rec->hash = hash;
+    rec->len = (uint32_t) len;
+    if (len)
+        memcpy (rec->str, str, len);
+    rec->str[len] = '\0';
+
+    records = atomic_load_explicit (&shard->records, memory_order_relaxed);
+    records[count] = rec;
+
+    b = (uint32_t) (hash >> LH_INTERN_SHARD_BITS) & (shard->nslots - 1);
+    while (shard->slots[b])
+        b = (b + 1) & (shard->nslots - 1);
+    shard->slots[b] = count + 1;
+
+    // publish the record before anyone can resolve its id
+    atomic_store_explicit (&shard->count, count + 1, memory_order_release);
+    atomic_fetch_add (&pool->count, 1);
+    id = lh_intern_make_id (s, count);
+
+intern_done:
+    pthread_rwlock_unlock (&shard->lock);
+    return id;
+}
+
+
+uint32_t lh_intern_cstr (lh_intern_t *pool, const char *str)
+{
+    if (!str)
+        return LH_INTERN_NONE;
+    return lh_intern (pool, str, strlen (str));
+}
+
+
+/**
+ *  Find the id of `str` without adding it.
+ *
+ *  @returns        the id, or LH_INTERN_NONE if it was never interned.
+ */
+uint32_t lh_intern_lookup (lh_intern_t *pool, const void *str, size_t len)
+{
+    struct __libhelper_intern_shard *shard;
+    uint64_t hash;
+    uint32_t s, id;
+
+    if (!pool || (!str && len))
+        return LH_INTERN_NONE;
+
+    hash = lh_hash64 (str, len, 0);
+    s = (uint32_t) hash & (LH_INTERN_SHARDS - 1);
+    shard = &pool->shards[s];
+
+    pthread_rwlock_rdlock (&shard->lock);
+    id = lh_intern_probe (shard, s, str, len, hash);
+    pthread_rwlock_unlock (&shard->lock);
+    return id;
+}
+
+
+/**
+ *  Resolve an id back to its string, which is NUL terminated. This never
+ *  takes a lock. The string is owned by the pool.
+ *
+ *  @returns        the string, or NULL if `id` is not from this pool.
+ */
+const char *lh_intern_string (lh_intern_t *pool, uint32_t id, size_t *len)
+{
+    struct __libhelper_intern_shard *shard;
+    struct __libhelper_intern_record **records;
+    uint32_t index;
+
+    if (!pool || id == LH_INTERN_NONE)
+        return NULL;
+
+    shard = &pool->shards[id & (LH_INTERN_SHARDS - 1)];
+    index = (id >> LH_INTERN_SHARD_BITS) - 1;
+
+    // the count is published after the record and its directory, so any
+    // index below it can be read from the directory loaded after it
+    if (index >= atomic_load_explicit (&shard->count, memory_order_acquire))
+        return NULL;
+    records = atomic_load_explicit (&shard->records, memory_order_acquire);
+
+    if (len)
+        *len = records[index]->len;
+    return records[index]->str;
+}
+
+
+/**
+ *  Number of distinct strings in the pool.
+ *
+ */
+size_t lh_intern_count (lh_intern_t *pool)
+{
+    return (pool) ? atomic_load (&pool->count) : 0;
+}
+
+
+void lh_intern_free (lh_intern_t *pool)
+{
+    if (!pool)
+        return;
+
+    for (uint32_t i = 0; i < LH_INTERN_SHARDS; i++) {
+        pthread_rwlock_destroy (&pool->shards[i].lock);
+        free (pool->shards[i].slots);
+        h_arena_free (pool->shards[i].arena);
+    }
+    free (pool);
+}
@@ -31,11 +31,18 @@
  *  Copyright (c) 2017 xerub
  */
 
+#ifndef _POSIX_C_SOURCE
+#   define _POSIX_C_SOURCE  200809L     /* pwrite() */
+#endif
+#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)
+#   define _DARWIN_C_SOURCE
+#endif
+
 #include "libhelper/img4/sep.h"
 
-uint8_t     *kernel         = MAP_FAILED;
-size_t       kernel_size    = 0;
-static int   kernel_fd      = -1;
+uint8_t         *kernel         = MAP_FAILED;
+size_t           kernel_size    = 0;
+static file_t   *kernel_file    = NULL;
 
 #define IS64(image) (*(uint8_t *)(image) & 1)
 #define MACHO(p) ((*(unsigned int *)(p) & ~1) == 0xfeedface)
@@ -44,21 +51,14 @@ static int   kernel_fd      = -1;
 ******************************************************************/
 
 /**
- *  The whole file interaction here needs to be implemented into file_t
- *  in some way, so the file can still be mmaped into a buffer/pointer
- *  rather than using file_GeT_bytes () all the time.
+ *  Extract a component straight from the firmware file. The copy is done
+ *  by the kernel where possible, see `file_copy_range()`.
  * 
  */
 static
-int write_file (const char *name, const void *buf, size_t size)
+int write_file (const char *name, size_t offset, size_t size)
 {
-    int fd;
-    size_t sz;
-    fd = open (name, O_CREAT | O_WRONLY | O_TRUNC, 0644);
-    if (fd < 0) return -1;
-    sz = write (fd, buf, size);
-    close (fd);
-    return (sz == size) ? 0 : -1;
+    return (file_write_range (kernel_file, offset, size, name)) ? 0 : -1;
 }
 /*****************************************************************
 ******************************************************************/
@@ -81,9 +81,8 @@ size_t calc_size (const uint8_t *ptr, size_t sz)
     //  Basically, libhelper has part-32bit support, in the sense that it
     //  can recognise 32bit header and you can parse a 32bit header.
     //
-    unsigned i;
-    const mach_header_32_t *header = (mach_header_32_t *) ptr;
-    const uint8_t *lc_ptr = ptr + sizeof(mach_header_32_t);
+    mach_lc_entry_t entry;
+    mach_lc_iter_t it;
     size_t end, tsize = 0;
 
 
@@ -96,9 +95,7 @@ size_t calc_size (const uint8_t *ptr, size_t sz)
 
     if (!MACHO(ptr)) return 0;
 
-    if (IS64(ptr)) {
-        lc_ptr += 4;
-    } else {
+    if (!IS64(ptr)) {
         errorf ("Cannot handle 32bit\n");
         exit (0);
     }
@@ -108,70 +105,74 @@ size_t calc_size (const uint8_t *ptr, size_t sz)
     //  load commands there are, how big each segment is, then add that to the
     //  size of the header and we have our file size.
     //
-    for (i = 0; i < header->ncmds; i++) {
-        const mach_load_command_t *cmd = (mach_load_command_t *) lc_ptr;
+    //  Every command, and every segment, has to lie within the `sz` bytes we
+    //  were given, otherwise this isn't a Mach-O after all. The iterator
+    //  checks the commands, the segments are checked here.
+    //
+    if (!mach_lc_iter_init (&it, (void *) ptr, sz, 0))
+        return 0;
+
+    while (mach_lc_iter_next_segment (&it, &entry)) {
+        const mach_segment_command_64_t *seg = (mach_segment_command_64_t *) entry.ptr;
 
         //  Because SEPOS is 64bit, not 32bit, I'm not including checking for
         //  32bit segments, well, atleast not until they're implemented in
         //  libhelper-macho.
         //
-        if (cmd->cmd == LC_SEGMENT) warningf ("Cannot handle 32bit Segments");
-        if (cmd->cmd == LC_SEGMENT_64) {
-            const mach_segment_command_64_t *seg = (mach_segment_command_64_t *) lc_ptr;
-            end = seg->fileoff + seg->filesize;
-            if (tsize < end) {
-                tsize = end;
-            }
+        if (entry.cmd == LC_SEGMENT) {
+            warningf ("Cannot handle 32bit Segments");
+            continue;
         }
 
-        //  Move the Load Command pointer so we can parse
-        //  the next command.
-        //
-        lc_ptr += cmd->cmdsize;
+        if (entry.cmdsize < sizeof (mach_segment_command_64_t) || seg->fileoff > sz || seg->filesize > sz - seg->fileoff)
+            return 0;
+
+        end = seg->fileoff + seg->filesize;
+        if (tsize < end) {
+            tsize = end;
+        }
     }
 
+    if (it.error)
+        return 0;
+
     return tsize;
 }
 
 static
 size_t restore_linkedit (uint8_t *ptr, size_t size)
 {
-    unsigned i;
-    mach_header_32_t *hdr = (mach_header_32_t *) ptr;
+    mach_lc_entry_t entry;
+    mach_lc_iter_t it;
     uint64_t min = -1;
     uint64_t delta = 0;
-    int is64 = 0;
-    uint8_t *lc_ptr;
 
     //  Similar checks as in calc_size, check whether the ptr is a Mach-O,
     //  that the size is less than 4096 bytes, and that it is 64bit
     //
     if (size < 4096) return -1;
     if (!MACHO (ptr)) return -1;
-    if (IS64 (ptr)) is64 = 4;
 
 
-    //  Set lc_ptr to the end of the mach header, plus it's current value and
-    //  is64. Then go through each load command until we find a segment command,
+    //  Go through each segment command, looking for the __PAGEZERO segment,
+    //  then set the min which is used when restoring the __LINKEDIT segment.
     //
-    //  Look for the __PAGEZERO segments, then set the min which is used when
-    //  restoring the __LINKEDIT segment.
-    //
-    lc_ptr = ptr + sizeof (mach_header_32_t) + is64;
-    for (i = 0; i < hdr->ncmds; i++) {
-        const mach_load_command_t *cmd = (mach_load_command_t *) lc_ptr;
+    if (!mach_lc_iter_init (&it, ptr, size, 0))
+        return -1;
+
+    while (mach_lc_iter_next_segment (&it, &entry)) {
 
         //  If the segment is 32bit, ignore it.
         //
-        if (cmd->cmd == LC_SEGMENT) warningf ("Cannot handle 32bit");
+        if (entry.cmd == LC_SEGMENT) {
+            warningf ("Cannot handle 32bit");
+            continue;
+        }
 
-        if (cmd->cmdsize == LC_SEGMENT_64) {
-            const mach_segment_command_64_t *seg = (mach_segment_command_64_t *) lc_ptr;
-            if (strcmp (seg->segname, "__PAGEZERO") && min > seg->vmaddr) {
-                min = seg->vmaddr;
-            }
+        const mach_segment_command_64_t *seg = (mach_segment_command_64_t *) entry.ptr;
+        if (strcmp (seg->segname, "__PAGEZERO") && min > seg->vmaddr) {
+            min = seg->vmaddr;
         }
-        lc_ptr += cmd->cmdsize;
     }
 
 
@@ -183,37 +184,37 @@ size_t restore_linkedit (uint8_t *ptr, size_t size)
     //  Then, add that to the segment file offset, and the symbol table string
     //  table offset and symbol table offset.
     //
-    lc_ptr = ptr + sizeof (mach_header_32_t) + is64;
-    for (i = 0; i < hdr->ncmds; i++) {
-        const mach_load_command_t *cmd = (mach_load_command_t *) lc_ptr;
+    mach_lc_iter_init (&it, ptr, size, 0);
+    while (mach_lc_iter_next (&it, &entry)) {
 
         //  If the segment is 32bit, ignore it.
         //
-        if (cmd->cmd == LC_SEGMENT) warningf ("Cannot handle 32bit");
+        if (entry.cmd == LC_SEGMENT) warningf ("Cannot handle 32bit");
 
-        if (cmd->cmd == LC_SEGMENT_64) {
-            mach_segment_command_64_t *seg = (mach_segment_command_64_t *) lc_ptr;
+        if (entry.cmd == LC_SEGMENT_64) {
+            mach_segment_command_64_t *seg = (mach_segment_command_64_t *) entry.ptr;
             if (!strcmp (seg->segname, "__LINKEDIT")) {
                 delta = seg->vmaddr - min - seg->fileoff;
                 seg->fileoff += delta;
             }
         }
 
-        if (cmd->cmd == LC_SYMTAB) {
-            mach_symtab_command_t *sym = (mach_symtab_command_t *) lc_ptr;
+        if (entry.cmd == LC_SYMTAB) {
+            mach_symtab_command_t *sym = (mach_symtab_command_t *) entry.ptr;
             if (sym->stroff) sym->stroff += delta;
             if (sym->symoff) sym->symoff += delta;
         }
-        lc_ptr += cmd->cmdsize;
     }
 
     return 0;
 }
 
 static
-int restore_file (unsigned index, const unsigned char *buf, size_t size, int restore)
+int restore_file (unsigned index, size_t offset, size_t size, int restore)
 {
-    int      rv;
+    const unsigned char *buf = kernel + offset;
+    int      fd, rv = 0;
+    size_t   hsize;
     void    *tmp;
     char     name[256];
     char     tail[12 + 1];
@@ -261,43 +262,51 @@ int restore_file (unsigned index, const unsigned char *buf, size_t size, int res
     }
 
     snprintf (name, sizeof(name), "sepdump%02u_%s", index, tail);
-    if (!restore) {
-        return write_file (name, buf, size);
+    if (!restore || size < 4096 || !MACHO (buf)) {
+        return write_file (name, offset, size);
+    }
+
+    //  Restoring __LINKEDIT only touches the load commands, so extract the
+    //  component as-is and then write a patched copy of just the header and
+    //  load commands over the top, rather than copying the whole thing.
+    //
+    hsize = sizeof (mach_header_32_t) + ((IS64 (buf)) ? 4 : 0) + ((mach_header_32_t *) buf)->sizeofcmds;
+    if (hsize > size) {
+        return write_file (name, offset, size);
     }
 
-    tmp = malloc (size);
-    if (!tmp) {
+    fd = open (name, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) {
         return -1;
     }
 
-    memcpy (tmp, buf, size);
-    restore_linkedit (tmp, size);
-    rv = write_file (name, tmp, size);
-    free (tmp);
+    tmp = malloc (hsize);
+    if (!tmp || !file_copy_range (kernel_file, offset, size, fd, 0)) {
+        rv = -1;
+    } else {
+        memcpy (tmp, buf, hsize);
+        if (!restore_linkedit (tmp, size) && pwrite (fd, tmp, hsize, 0) != (ssize_t) hsize) {
+            rv = -1;
+        }
+    }
 
+    free (tmp);
+    close (fd);
     return rv;
-
 }
 
 void sep_split_init (char *filename)
 {
-    // Try to open and load the file into 'kernel_fd'
-    kernel_fd = open (filename, O_RDONLY);
-    if (kernel_fd < 0) {
+    // Try to open and load the file into 'kernel_file'
+    kernel_file = file_load (filename);
+    if (!kernel_file) {
         errorf ("There was a problem opening the file: %s\n", filename);
         exit (0);
     }
 
-    // get the size of the file
-    kernel_size = lseek (kernel_fd, 0, SEEK_END);
-
-    // mmap the file into the kernel pointer
-    kernel = mmap (NULL, kernel_size, PROT_READ, MAP_PRIVATE, kernel_fd, 0);
-    if (kernel == MAP_FAILED) {
-        close (kernel_fd);
-        errorf ("Could not map the file.\n");
-        exit (0);
-    }
+    // the mapping and size come from the loaded file
+    kernel = kernel_file->data;
+    kernel_size = kernel_file->size;
 
     printf ("[*] File loaded okay. Attempting to identify Mach-O regions...\n");
     
@@ -323,12 +332,12 @@ void sep_split_init (char *filename)
         //
         size_t sz = calc_size (kernel + i, kernel_size - i);
         if (sz) {
-            restore_file(j++, kernel + last, i - last, restore);
+            restore_file(j++, last, i - last, restore);
 
             last = i;
             i += sz - 4;
         }
     }
-    restore_file(j, kernel + last, i - last, restore);
+    restore_file(j, last, ((i < kernel_size) ? i : kernel_size) - last, restore);
 
 }
\ No newline at end of file
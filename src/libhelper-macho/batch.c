@@ -0,0 +1,350 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Mach-O Batch Loading                   								 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Completed results are handed to the consumer through an intrusive
+ *  multi-producer, single-consumer queue. Producers only ever swap the
+ *  head pointer, so workers never block each other to publish a result.
+ *  There is one node per item, plus the initial stub, allocated up front.
+ *
+ */
+struct __libhelper_batch_node {
+    _Atomic (struct __libhelper_batch_node *)    next;
+    macho_batch_result_t                         result;
+};
+
+struct __libhelper_macho_batch {
+    macho_batch_item_t                          *items;
+    uint64_t                                    *costs;
+    size_t                                       count;
+    macho_batch_options_t                        opts;
+    lh_pool_t                                   *pool;
+
+    /* memory budget */
+    pthread_mutex_t                              lock;
+    pthread_cond_t                               budget;
+    pthread_cond_t                               ready;
+    uint64_t                                     in_flight;
+    int                                          cancelled;
+
+    /* completion queue */
+    struct __libhelper_batch_node               *nodes;
+    _Atomic (struct __libhelper_batch_node *)    head;
+    struct __libhelper_batch_node               *tail;
+    size_t                                       delivered;
+    atomic_size_t                                loaded;
+};
+
+
+static void batch_queue_push (macho_batch_t *batch, struct __libhelper_batch_node *node)
+{
+    struct __libhelper_batch_node *prev;
+
+    atomic_store (&node->next, NULL);
+    prev = atomic_exchange (&batch->head, node);
+    atomic_store (&prev->next, node);
+}
+
+/**
+ *  Pop the oldest result. The node that held it becomes the new stub.
+ *  Only ever called by the consumer.
+ *
+ */
+static int batch_queue_pop (macho_batch_t *batch, macho_batch_result_t *out)
+{
+    struct __libhelper_batch_node *tail = batch->tail;
+    struct __libhelper_batch_node *next = atomic_load (&tail->next);
+
+    if (!next)
+        return 0;
+
+    *out = next->result;
+    batch->tail = next;
+    return 1;
+}
+
+
+/**
+ *  Wait until `cost` bytes fit in the budget. A job always runs when
+ *  nothing else is in flight, however large it is.
+ *
+ */
+static void batch_budget_acquire (macho_batch_t *batch, uint64_t cost)
+{
+    pthread_mutex_lock (&batch->lock);
+    if (batch->opts.memory_budget) {
+        while (!batch->cancelled && batch->in_flight && batch->in_flight + cost > batch->opts.memory_budget)
+            pthread_cond_wait (&batch->budget, &batch->lock);
+    }
+    batch->in_flight += cost;
+    pthread_mutex_unlock (&batch->lock);
+}
+
+static void batch_budget_release (macho_batch_t *batch, uint64_t cost)
+{
+    pthread_mutex_lock (&batch->lock);
+    batch->in_flight -= cost;
+    pthread_cond_broadcast (&batch->budget);
+    pthread_mutex_unlock (&batch->lock);
+}
+
+
+static void batch_job (void *ctx, size_t index)
+{
+    macho_batch_t *batch = (macho_batch_t *) ctx;
+    macho_batch_item_t *item = &batch->items[index];
+    struct __libhelper_batch_node *node = &batch->nodes[index];
+    macho_batch_result_t result;
+    int cancelled;
+
+    result.index = index;
+    result.user = item->user;
+    result.macho = NULL;
+    result.cost = batch->costs[index];
+
+    batch_budget_acquire (batch, result.cost);
+
+    pthread_mutex_lock (&batch->lock);
+    cancelled = batch->cancelled;
+    pthread_mutex_unlock (&batch->lock);
+
+    if (!cancelled) {
+        result.macho = (item->path) ? macho_load (item->path) : macho_load_from_view (item->view);
+        if (result.macho)
+            atomic_fetch_add (&batch->loaded, 1);
+    }
+
+    // with a callback the result is consumed as soon as it returns
+    if (batch->opts.callback) {
+        if (!cancelled)
+            batch->opts.callback (batch->opts.ctx, &result);
+        batch_budget_release (batch, result.cost);
+        return;
+    }
+
+    node->result = result;
+    batch_queue_push (batch, node);
+
+    pthread_mutex_lock (&batch->lock);
+    pthread_cond_signal (&batch->ready);
+    pthread_mutex_unlock (&batch->lock);
+}
+
+
+/**
+ *  Sort jobs largest first, so the big files start straight away and the
+ *  small ones fill in around them. Submissions are spread round-robin and
+ *  every queue runs in submission order, so each worker also starts with
+ *  its largest file.
+ *
+ */
+struct __libhelper_batch_order {
+    uint64_t        cost;
+    size_t          index;
+};
+
+static int batch_cost_compare (const void *a, const void *b)
+{
+    const struct __libhelper_batch_order *x = a, *y = b;
+    if (x->cost != y->cost)
+        return (x->cost < y->cost) ? 1 : -1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+
+/**
+ *  Start loading `count` items in the background. The item array is
+ *  copied, but any paths and views it refers to must stay valid until
+ *  `macho_batch_free()`.
+ *
+ *  @returns        the batch, or NULL on failure.
+ */
+macho_batch_t *macho_batch_start (const macho_batch_item_t *items, size_t count, const macho_batch_options_t *options)
+{
+    struct __libhelper_batch_order *order = NULL;
+    macho_batch_t *batch;
+
+    if (!items && count)
+        return NULL;
+
+    batch = calloc (1, sizeof (macho_batch_t));
+    if (!batch)
+        return NULL;
+
+    if (options)
+        batch->opts = *options;
+    batch->count = count;
+    batch->items = malloc ((count ? count : 1) * sizeof (macho_batch_item_t));
+    batch->costs = calloc (count ? count : 1, sizeof (uint64_t));
+    batch->nodes = calloc (count + 1, sizeof (struct __libhelper_batch_node));
+    order = malloc ((count ? count : 1) * sizeof (struct __libhelper_batch_order));
+    if (!batch->items || !batch->costs || !batch->nodes || !order)
+        goto start_failed;
+
+    memcpy (batch->items, items, count * sizeof (macho_batch_item_t));
+    batch->tail = &batch->nodes[count];
+    atomic_init (&batch->head, batch->tail);
+    atomic_init (&batch->loaded, 0);
+    pthread_mutex_init (&batch->lock, NULL);
+    pthread_cond_init (&batch->budget, NULL);
+    pthread_cond_init (&batch->ready, NULL);
+
+    // the cost of a job is its input size
+    for (size_t i = 0; i < count; i++) {
+        struct stat st;
+
+        if (items[i].path)
+            batch->costs[i] = (!stat (items[i].path, &st)) ? (uint64_t) st.st_size : 0;
+        else
+            batch->costs[i] = items[i].view.size;
+
+        order[i].cost = batch->costs[i];
+        order[i].index = i;
+    }
+    qsort (order, count, sizeof (struct __libhelper_batch_order), batch_cost_compare);
+
+    batch->pool = lh_pool_create (batch->opts.nthreads);
+    if (!batch->pool)
+        goto start_failed;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!lh_pool_submit (batch->pool, batch_job, batch, order[i].index)) {
+            // run it here rather than lose it
+            batch_job (batch, order[i].index);
+        }
+    }
+
+    free (order);
+    return batch;
+
+start_failed:
+    free (order);
+    free (batch->nodes);
+    free (batch->costs);
+    free (batch->items);
+    free (batch);
+    return NULL;
+}
+
+
+/**
+ *  Wait for the next result from the completion queue. Results arrive in
+ *  completion order, not item order. The Mach-O in the result belongs to
+ *  the caller, and is freed with `macho_free()`.
+ *
+ *  @returns        MACHO_BATCH_SUCCESS with `result` filled in, or
+ *                  MACHO_BATCH_FAILURE once every result was collected.
+ */
+int macho_batch_next (macho_batch_t *batch, macho_batch_result_t *result)
+{
+    if (!batch || !result || batch->opts.callback || batch->delivered == batch->count)
+        return MACHO_BATCH_FAILURE;
+
+    pthread_mutex_lock (&batch->lock);
+    while (!batch_queue_pop (batch, result))
+        pthread_cond_wait (&batch->ready, &batch->lock);
+    pthread_mutex_unlock (&batch->lock);
+
+    batch->delivered++;
+    batch_budget_release (batch, result->cost);
+    return MACHO_BATCH_SUCCESS;
+}
+
+
+/**
+ *  Wait for the workers and free the batch. Items that had not started
+ *  yet are skipped, and results that were never collected are freed.
+ *  Results already handed to the caller are left alone.
+ *
+ */
+void macho_batch_free (macho_batch_t *batch)
+{
+    macho_batch_result_t result;
+
+    if (!batch)
+        return;
+
+    // wake anything held back by the budget, nobody is left to consume
+    pthread_mutex_lock (&batch->lock);
+    if (!batch->opts.callback)
+        batch->cancelled = 1;
+    pthread_cond_broadcast (&batch->budget);
+    pthread_mutex_unlock (&batch->lock);
+
+    lh_pool_free (batch->pool);
+
+    // the workers are gone, so whatever is still queued was never delivered
+    while (batch_queue_pop (batch, &result))
+        macho_free (result.macho);
+    free (batch->nodes);
+
+    pthread_mutex_destroy (&batch->lock);
+    pthread_cond_destroy (&batch->budget);
+    pthread_cond_destroy (&batch->ready);
+    free (batch->costs);
+    free (batch->items);
+    free (batch);
+}
+
+
+/**
+ *  Load every item and deliver each result to `options->callback` as it
+ *  completes. Blocks until the whole batch is done. The callback owns the
+ *  Mach-O it is given, and frees it with `macho_free()`.
+ *
+ *  @returns        number of items that loaded successfully.
+ */
+size_t macho_load_many (const macho_batch_item_t *items, size_t count, const macho_batch_options_t *options)
+{
+    macho_batch_t *batch;
+    size_t loaded;
+
+    if (!options || !options->callback) {
+        errorf ("macho_load_many(): a callback is required, use macho_batch_start() for a queue\n");
+        return 0;
+    }
+
+    batch = macho_batch_start (items, count, options);
+    if (!batch)
+        return 0;
+
+    lh_pool_wait (batch->pool);
+    loaded = atomic_load (&batch->loaded);
+    macho_batch_free (batch);
+    return loaded;
+}
@@ -0,0 +1,840 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+#include "hlib.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MACHO_CALL_X86          1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define MACHO_CALL_NEON         1
+#endif
+
+/* instructions handed to each thread */
+#define MACHO_CALL_CHUNK        (256 * 1024)
+
+/* B and BL, which only differ in the top bit */
+#define MACHO_CALL_IS_BRANCH(insn)      (((insn) & 0x7c000000) == 0x14000000)
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Function Starts                       									 --*/
+//===-----------------------------------------------------------------------===//
+
+static uint64_t macho_text_vmaddr (macho_t *macho)
+{
+    int is32 = (macho->header->magic == MACH_MAGIC_32);
+
+    for (HSList *l = macho->scmds; l; l = l->next) {
+        if (is32) {
+            mach_segment_command_32_t *seg = ((mach_segment_info_32_t *) l->data)->segcmd;
+            if (!strncmp (seg->segname, "__TEXT", 16))
+                return seg->vmaddr;
+        } else {
+            mach_segment_command_64_t *seg = ((mach_segment_info_t *) l->data)->segcmd;
+            if (!strncmp (seg->segname, "__TEXT", 16))
+                return seg->vmaddr;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ *  Decode LC_FUNCTION_STARTS. The table is a run of ULEB128 deltas, the
+ *  first from the start of __TEXT, ending with a zero delta.
+ *
+ *  @returns        malloc()'d array of addresses in ascending order, or NULL
+ *                  if there is no table.
+ */
+uint64_t *macho_function_starts (void *macho, size_t *count)
+{
+    macho_t *tmp = (macho_t *) macho;
+    mach_linkedit_data_command_t *cmd;
+    const unsigned char *p, *end;
+    uint64_t addr;
+    HArray *starts;
+    uint64_t *ret;
+    lh_view_t view;
+
+    if (!count)
+        return NULL;
+    *count = 0;
+    if (!tmp || !tmp->header || !(cmd = mach_lc_find_function_starts_cmd (tmp)) || !cmd->datasize)
+        return NULL;
+
+    view = macho_get_view (tmp, cmd->dataoff, cmd->datasize);
+    if (!lh_view_is_valid (view)) {
+        warningf ("macho_function_starts(): LC_FUNCTION_STARTS lies outside of the Mach-O\n");
+        return NULL;
+    }
+
+    starts = h_array_new (sizeof (uint64_t));
+    if (!starts)
+        return NULL;
+
+    addr = macho_text_vmaddr (tmp);
+    p = view.data;
+    end = view.data + view.size;
+    while (p < end) {
+        uint64_t delta = 0;
+        int shift = 0;
+
+        do {
+            if (shift < 64)
+                delta |= (uint64_t) (*p & 0x7f) << shift;
+            shift += 7;
+        } while ((*p++ & 0x80) && p < end);
+
+        if (!delta)
+            break;
+        addr += delta;
+        if (!h_array_push (starts, &addr)) {
+            h_array_free (starts);
+            return NULL;
+        }
+    }
+
+    *count = starts->len;
+    ret = starts->data;
+    if (!ret)
+        *count = 0;
+    free (starts);
+    return ret;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Branch Scanning                       									 --*/
+//===-----------------------------------------------------------------------===//
+
+typedef size_t (*macho_call_next_func_t) (const unsigned char *code, size_t from, size_t to);
+
+static inline uint32_t macho_call_insn (const unsigned char *code, size_t i)
+{
+    uint32_t insn;
+    memcpy (&insn, code + (i << 2), sizeof (insn));
+    return insn;
+}
+
+static size_t macho_call_next_scalar (const unsigned char *code, size_t from, size_t to)
+{
+    for (size_t i = from; i < to; i++) {
+        if (MACHO_CALL_IS_BRANCH (macho_call_insn (code, i)))
+            return i;
+    }
+    return to;
+}
+
+#ifdef MACHO_CALL_X86
+
+__attribute__((target("avx2")))
+static size_t macho_call_next_avx2 (const unsigned char *code, size_t from, size_t to)
+{
+    const __m256i mask = _mm256_set1_epi32 (0x7c000000);
+    const __m256i bits = _mm256_set1_epi32 (0x14000000);
+    size_t i = from;
+
+    for (; i + 8 <= to; i += 8) {
+        __m256i w = _mm256_loadu_si256 ((const __m256i *) (code + (i << 2)));
+        int hit = _mm256_movemask_ps (_mm256_castsi256_ps (_mm256_cmpeq_epi32 (_mm256_and_si256 (w, mask), bits)));
+
+        if (hit)
+            return i + (size_t) __builtin_ctz ((unsigned) hit);
+    }
+    return macho_call_next_scalar (code, i, to);
+}
+
+#endif /* MACHO_CALL_X86 */
+
+#ifdef MACHO_CALL_NEON
+
+static size_t macho_call_next_neon (const unsigned char *code, size_t from, size_t to)
+{
+    const uint32x4_t mask = vdupq_n_u32 (0x7c000000);
+    const uint32x4_t bits = vdupq_n_u32 (0x14000000);
+    size_t i = from;
+
+    for (; i + 4 <= to; i += 4) {
+        uint32x4_t w = vreinterpretq_u32_u8 (vld1q_u8 (code + (i << 2)));
+
+        if (vmaxvq_u32 (vceqq_u32 (vandq_u32 (w, mask), bits)))
+            return macho_call_next_scalar (code, i, i + 4);
+    }
+    return macho_call_next_scalar (code, i, to);
+}
+
+#endif /* MACHO_CALL_NEON */
+
+static macho_call_next_func_t macho_call_resolve ()
+{
+#if defined(MACHO_CALL_X86)
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+        return macho_call_next_avx2;
+#elif defined(MACHO_CALL_NEON)
+    return macho_call_next_neon;
+#endif
+    return macho_call_next_scalar;
+}
+
+
+struct __libhelper_call_chunk {
+    const unsigned char     *code;
+    uint64_t                 vmaddr;            /* address of the region */
+    size_t                   from;              /* instructions in the chunk */
+    size_t                   to;
+};
+
+struct __libhelper_call_scan {
+    struct __libhelper_call_chunk   *chunks;
+    HArray                         **results;   /* per chunk macho_call_t, NULL if it failed */
+    macho_call_next_func_t           next;
+};
+
+static int macho_call_site_compare (const void *a, const void *b)
+{
+    const macho_call_t *x = a, *y = b;
+    return (x->site > y->site) - (x->site < y->site);
+}
+
+static void macho_call_chunk (void *ctx, size_t index)
+{
+    struct __libhelper_call_scan *scan = (struct __libhelper_call_scan *) ctx;
+    struct __libhelper_call_chunk *chunk = &scan->chunks[index];
+    HArray *found = h_array_new (sizeof (macho_call_t));
+
+    if (!found)
+        return;
+
+    for (size_t i = chunk->from; (i = scan->next (chunk->code, i, chunk->to)) < chunk->to; i++) {
+        uint32_t insn = macho_call_insn (chunk->code, i);
+        int64_t imm = (int64_t) ((uint64_t) (insn & 0x3ffffff) << 38) >> 36;
+        macho_call_t call;
+
+        call.site = chunk->vmaddr + (i << 2);
+        call.target = call.site + (uint64_t) imm;
+        call.caller = call.callee = MACHO_CALLGRAPH_NONE;
+        call.kind = (insn & 0x80000000) ? MACHO_CALL_BL : MACHO_CALL_B;
+
+        if (!h_array_push (found, &call)) {
+            h_array_free (found);
+            return;
+        }
+    }
+    scan->results[index] = found;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Functions                             									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Candidate function, from one of the sources below. Candidates at the
+ *  same address are merged, `order` keeps the merge deterministic.
+ *
+ */
+struct __libhelper_call_func {
+    uint64_t        addr;
+    const char     *name;
+    uint32_t        flags;
+    uint32_t        order;
+};
+
+static int macho_call_func_compare (const void *a, const void *b)
+{
+    const struct __libhelper_call_func *x = a, *y = b;
+    if (x->addr != y->addr)
+        return (x->addr > y->addr) ? 1 : -1;
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+static int macho_call_func_add (HArray *funcs, uint64_t addr, const char *name, uint32_t flags)
+{
+    struct __libhelper_call_func f;
+
+    f.addr = addr;
+    f.name = (name && *name) ? name : NULL;
+    f.flags = flags;
+    f.order = (uint32_t) funcs->len;
+    return h_array_push (funcs, &f) != NULL;
+}
+
+static int macho_region_compare (const void *a, const void *b)
+{
+    const macho_region_t *x = a, *y = b;
+    return (x->vmaddr > y->vmaddr) - (x->vmaddr < y->vmaddr);
+}
+
+/* region holding `addr`, or NULL */
+static const macho_region_t *macho_call_region (const macho_region_t *regions, int count, uint64_t addr)
+{
+    int lo = 0, hi = count;
+
+    while (lo < hi) {
+        int mid = lo + ((hi - lo) >> 1);
+        if (regions[mid].vmaddr + regions[mid].size <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo < count && regions[lo].vmaddr <= addr) ? &regions[lo] : NULL;
+}
+
+
+/**
+ *  Symbols defined in code, and the stubs named after the symbols they
+ *  import, from one image. A stub's entry in the indirect symbol table is
+ *  found through the `reserved1` and `reserved2` fields of its section.
+ *
+ */
+static void macho_call_symbols (macho_t *image, const macho_region_t *regions, int nregions, HArray *funcs)
+{
+    mach_symtab_command_t *symtab = mach_lc_find_symtab_cmd (image);
+    mach_dysymtab_command_t *dysymtab = mach_lc_find_dysymtab_cmd (image);
+    const nlist *syms = NULL;
+    const uint32_t *indirect = NULL;
+    uint32_t nsyms = 0, nindirect = 0;
+    lh_view_t strtab = LH_VIEW_NULL;
+
+    if (symtab) {
+        syms = lh_view_ptr (macho_get_view (image, symtab->symoff, (size_t) symtab->nsyms * sizeof (nlist)),
+                            0, (size_t) symtab->nsyms * sizeof (nlist));
+        strtab = macho_get_view (image, symtab->stroff, symtab->strsize);
+        nsyms = (syms) ? symtab->nsyms : 0;
+    }
+
+    for (uint32_t i = 0; i < nsyms; i++) {
+        if ((syms[i].n_type & N_STAB) || (syms[i].n_type & N_TYPE) != N_SECT)
+            continue;
+        if (macho_call_region (regions, nregions, syms[i].n_value))
+            macho_call_func_add (funcs, syms[i].n_value, lh_view_cstr (strtab, syms[i].n_strx), MACHO_FUNCTION_SYMBOL);
+    }
+
+    if (dysymtab) {
+        indirect = lh_view_ptr (macho_get_view (image, dysymtab->indirectsymoff, (size_t) dysymtab->nindirectsyms * 4),
+                                0, (size_t) dysymtab->nindirectsyms * 4);
+        nindirect = (indirect) ? dysymtab->nindirectsyms : 0;
+    }
+    if (!nindirect)
+        return;
+
+    for (HSList *l = image->scmds; l; l = l->next) {
+        for (HSList *s = ((mach_segment_info_t *) l->data)->sects; s; s = s->next) {
+            mach_section_64_t *sect = (mach_section_64_t *) s->data;
+
+            if ((sect->flags & SECTION_TYPE) != S_SYMBOL_STUBS || !sect->reserved2)
+                continue;
+
+            for (uint64_t k = 0; k < sect->size / sect->reserved2; k++) {
+                uint64_t entry = sect->reserved1 + k;
+                const char *name = NULL;
+
+                if (entry >= nindirect)
+                    break;
+                if (!(indirect[entry] & (INDIRECT_SYMBOL_LOCAL | INDIRECT_SYMBOL_ABS)) && indirect[entry] < nsyms)
+                    name = lh_view_cstr (strtab, syms[indirect[entry]].n_strx);
+
+                if (macho_call_region (regions, nregions, sect->addr + (k * sect->reserved2)))
+                    macho_call_func_add (funcs, sect->addr + (k * sect->reserved2), name, MACHO_FUNCTION_STUB);
+            }
+        }
+    }
+}
+
+
+/**
+ *  Everything that looks like the start of a function: LC_FUNCTION_STARTS,
+ *  symbols, stubs and the target of every BL. Candidates at the same
+ *  address are merged, and each function runs up to the next one, or the
+ *  end of its section.
+ *
+ */
+static int macho_call_functions (macho_callgraph_t *graph, macho_t *macho, const macho_fileset_t *fileset,
+                                 const macho_region_t *regions, int nregions, const HArray *calls)
+{
+    HArray *funcs = h_array_new (sizeof (struct __libhelper_call_func));
+    struct __libhelper_call_func *f;
+    size_t n = 0;
+
+    if (!funcs)
+        return 0;
+
+    // the Mach-O itself, then the entries when it's a fileset
+    for (size_t i = 0; i <= ((fileset) ? fileset->count : 0); i++) {
+        macho_t *image = (i) ? fileset->images[i - 1] : macho;
+        uint64_t *starts;
+        size_t count;
+
+        if (!image)
+            continue;
+        macho_call_symbols (image, regions, nregions, funcs);
+
+        starts = macho_function_starts (image, &count);
+        for (size_t k = 0; k < count; k++) {
+            if (macho_call_region (regions, nregions, starts[k]))
+                macho_call_func_add (funcs, starts[k], NULL, MACHO_FUNCTION_START);
+        }
+        free (starts);
+    }
+
+    h_array_foreach (calls, macho_call_t, call) {
+        if (call->kind == MACHO_CALL_BL && macho_call_region (regions, nregions, call->target))
+            macho_call_func_add (funcs, call->target, NULL, MACHO_FUNCTION_CALLED);
+    }
+
+    f = (struct __libhelper_call_func *) funcs->data;
+    qsort (f, funcs->len, sizeof (*f), macho_call_func_compare);
+
+    graph->functions = malloc ((funcs->len ? funcs->len : 1) * sizeof (macho_function_t));
+    if (!graph->functions) {
+        h_array_free (funcs);
+        return 0;
+    }
+
+    for (size_t i = 0; i < funcs->len; i++) {
+        macho_function_t *fn = &graph->functions[n];
+
+        if (n && graph->functions[n - 1].addr == f[i].addr) {
+            fn = &graph->functions[n - 1];
+            fn->flags |= f[i].flags;
+            if (!fn->name)
+                fn->name = f[i].name;
+            continue;
+        }
+
+        fn->addr = f[i].addr;
+        fn->name = f[i].name;
+        fn->flags = f[i].flags;
+        n++;
+    }
+    h_array_free (funcs);
+
+    for (size_t i = 0; i < n; i++) {
+        const macho_region_t *r = macho_call_region (regions, nregions, graph->functions[i].addr);
+        uint64_t end = r->vmaddr + r->size;
+
+        if (i + 1 < n && graph->functions[i + 1].addr < end)
+            end = graph->functions[i + 1].addr;
+        graph->functions[i].size = end - graph->functions[i].addr;
+    }
+
+    graph->nfunctions = n;
+    return 1;
+}
+
+
+/**
+ *  Name lookups are an open addressed hash over the named functions. The
+ *  lowest addressed function with a name wins.
+ *
+ */
+static int macho_call_names (macho_callgraph_t *graph)
+{
+    uint32_t named = 0;
+
+    for (size_t i = 0; i < graph->nfunctions; i++)
+        named += (graph->functions[i].name != NULL);
+
+    graph->nbuckets = 1;
+    while (graph->nbuckets < named * 2)
+        graph->nbuckets <<= 1;
+
+    graph->buckets = calloc (graph->nbuckets, sizeof (uint32_t));
+    if (!graph->buckets)
+        return 0;
+
+    for (size_t i = 0; i < graph->nfunctions; i++) {
+        const char *name = graph->functions[i].name;
+        uint32_t b;
+
+        if (!name)
+            continue;
+
+        b = (uint32_t) lh_hash64 (name, strlen (name), 0) & (graph->nbuckets - 1);
+        while (graph->buckets[b]) {
+            if (!strcmp (graph->functions[graph->buckets[b] - 1].name, name))
+                break;
+            b = (b + 1) & (graph->nbuckets - 1);
+        }
+        if (!graph->buckets[b])
+            graph->buckets[b] = (uint32_t) i + 1;
+    }
+    return 1;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Call Graph                            									 --*/
+//===-----------------------------------------------------------------------===//
+
+/* calls handed to each thread when they are resolved */
+#define MACHO_CALL_BLOCK        (64 * 1024)
+
+struct __libhelper_call_resolve {
+    const macho_callgraph_t     *graph;
+    macho_call_t                *calls;
+    size_t                       count;
+};
+
+/* last function starting at or before `addr`, or MACHO_CALLGRAPH_NONE */
+static uint32_t macho_call_floor (const macho_callgraph_t *graph, uint64_t addr)
+{
+    size_t lo = 0, hi = graph->nfunctions;
+
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) >> 1);
+        if (graph->functions[mid].addr <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo) ? (uint32_t) (lo - 1) : MACHO_CALLGRAPH_NONE;
+}
+
+
+/**
+ *  Work out the caller and callee of a block of calls. Calls are sorted by
+ *  site, so after one binary search the caller is found by walking along
+ *  the functions. A B only counts as a call when it lands on the start of
+ *  another function, i.e. a tail call. Anything else has its callee left
+ *  as MACHO_CALLGRAPH_NONE and is dropped.
+ *
+ */
+static void macho_call_resolve_block (void *ctx, size_t index)
+{
+    struct __libhelper_call_resolve *r = (struct __libhelper_call_resolve *) ctx;
+    const macho_callgraph_t *graph = r->graph;
+    size_t from = index * MACHO_CALL_BLOCK;
+    size_t to = MIN (from + MACHO_CALL_BLOCK, r->count);
+    uint32_t f = macho_call_floor (graph, r->calls[from].site);
+    size_t next = (f == MACHO_CALLGRAPH_NONE) ? 0 : f;
+
+    for (size_t i = from; i < to; i++) {
+        macho_call_t *call = &r->calls[i];
+        uint32_t callee;
+
+        while (next + 1 < graph->nfunctions && graph->functions[next + 1].addr <= call->site)
+            next++;
+        call->caller = (graph->nfunctions && graph->functions[next].addr <= call->site &&
+                        call->site - graph->functions[next].addr < graph->functions[next].size)
+                     ? (uint32_t) next : MACHO_CALLGRAPH_NONE;
+
+        callee = macho_callgraph_function_at (graph, call->target);
+        if (callee != MACHO_CALLGRAPH_NONE && graph->functions[callee].addr != call->target)
+            callee = MACHO_CALLGRAPH_NONE;
+        if (call->kind == MACHO_CALL_B && callee == call->caller)
+            callee = MACHO_CALLGRAPH_NONE;
+        call->callee = callee;
+    }
+}
+
+
+/**
+ *  Lay the calls out by caller, and an index of them by callee, both as
+ *  offsets into a flat array (compressed sparse rows). Counting sorts are
+ *  stable, so calls from one function stay in address order.
+ *
+ */
+static int macho_call_rows (macho_callgraph_t *graph, const macho_call_t *calls, size_t count)
+{
+    size_t nfuncs = graph->nfunctions;
+    uint32_t *pos;
+
+    graph->calls = malloc ((count ? count : 1) * sizeof (macho_call_t));
+    graph->callees_index = calloc (nfuncs + 2, sizeof (uint32_t));
+    graph->callers = malloc ((count ? count : 1) * sizeof (uint32_t));
+    graph->callers_index = calloc (nfuncs + 1, sizeof (uint32_t));
+    pos = malloc ((nfuncs + 1) * sizeof (uint32_t));
+    if (!graph->calls || !graph->callees_index || !graph->callers || !graph->callers_index || !pos) {
+        free (pos);
+        return 0;
+    }
+
+    // by caller, calls that aren't in any function go last
+    for (size_t i = 0; i < count; i++)
+        graph->callees_index[((calls[i].caller == MACHO_CALLGRAPH_NONE) ? nfuncs : calls[i].caller) + 1]++;
+    for (size_t f = 0; f <= nfuncs; f++)
+        graph->callees_index[f + 1] += graph->callees_index[f];
+
+    memcpy (pos, graph->callees_index, (nfuncs + 1) * sizeof (uint32_t));
+    for (size_t i = 0; i < count; i++)
+        graph->calls[pos[(calls[i].caller == MACHO_CALLGRAPH_NONE) ? nfuncs : calls[i].caller]++] = calls[i];
+
+    // by callee, pointing back into the calls
+    for (size_t i = 0; i < count; i++)
+        graph->callers_index[graph->calls[i].callee + 1]++;
+    for (size_t f = 0; f < nfuncs; f++)
+        graph->callers_index[f + 1] += graph->callers_index[f];
+
+    memcpy (pos, graph->callers_index, nfuncs * sizeof (uint32_t));
+    for (size_t i = 0; i < count; i++)
+        graph->callers[pos[graph->calls[i].callee]++] = (uint32_t) i;
+
+    graph->ncalls = count;
+    free (pos);
+    return 1;
+}
+
+
+/**
+ *  Build the direct call graph of an arm64 Mach-O, from every BL and B in
+ *  its executable sections, on `nthreads` threads or `lh_thread_count()`
+ *  when zero. On a fileset the symbols, stubs and function starts of every
+ *  entry are used as well.
+ *
+ *  @returns        the call graph, or NULL on failure.
+ */
+macho_callgraph_t *macho_callgraph_create (void *macho, int nthreads)
+{
+    return macho_fileset_callgraph_create (macho, NULL, nthreads);
+}
+
+
+/**
+ *  `macho_callgraph_create()` for a caller that already has the fileset
+ *  loaded, so its entries aren't parsed again. With a NULL `fileset` one
+ *  is loaded when the Mach-O is a fileset, and freed once the graph is
+ *  built.
+ *
+ */
+macho_callgraph_t *macho_fileset_callgraph_create (void *macho, macho_fileset_t *fileset, int nthreads)
+{
+    macho_t *tmp = (macho_t *) macho;
+    macho_callgraph_t *graph = NULL;
+    macho_fileset_t *loaded = NULL;
+    struct __libhelper_call_scan scan;
+    struct __libhelper_call_resolve resolve;
+    macho_region_t *regions = NULL;
+    HArray *calls = NULL;
+    size_t nchunks = 0, n = 0;
+    int nregions = 0;
+
+    memset (&scan, 0, sizeof (scan));
+    if (!tmp || !tmp->header || tmp->header->magic != MACH_MAGIC_64 || tmp->header->cputype != CPU_TYPE_ARM64) {
+        errorf ("macho_callgraph_create(): only arm64 Mach-O's are supported\n");
+        return NULL;
+    }
+
+    graph = calloc (1, sizeof (macho_callgraph_t));
+    calls = h_array_new (sizeof (macho_call_t));
+    if (!graph || !calls)
+        goto graph_failed;
+
+    // the entries of a fileset bring their own symbols and function starts
+    if (!fileset && tmp->header->filetype == MACH_TYPE_FILESET && (fileset = loaded = macho_fileset_load (tmp)))
+        macho_fileset_load_all (fileset, nthreads);
+
+    regions = macho_fileset_find_exec_regions (tmp, fileset, &nregions);
+    if (regions)
+        qsort (regions, nregions, sizeof (macho_region_t), macho_region_compare);
+
+    for (int i = 0; i < nregions; i++)
+        nchunks += (regions[i].size / 4 + MACHO_CALL_CHUNK - 1) / MACHO_CALL_CHUNK;
+
+    scan.chunks = calloc (nchunks ? nchunks : 1, sizeof (struct __libhelper_call_chunk));
+    scan.results = calloc (nchunks ? nchunks : 1, sizeof (HArray *));
+    scan.next = macho_call_resolve ();
+    if (!scan.chunks || !scan.results)
+        goto graph_failed;
+
+    nchunks = 0;
+    for (int i = 0; i < nregions; i++) {
+        size_t insns = regions[i].size / 4;
+        lh_view_t view;
+
+        if (!insns || regions[i].offset > UINT32_MAX)
+            continue;
+
+        // sections that fall outside the mapping aren't scanned
+        view = macho_get_view (tmp, (uint32_t) regions[i].offset, insns * 4);
+        if (!lh_view_is_valid (view))
+            continue;
+
+        for (size_t from = 0; from < insns; from += MACHO_CALL_CHUNK) {
+            struct __libhelper_call_chunk *chunk = &scan.chunks[nchunks++];
+            chunk->code = view.data;
+            chunk->vmaddr = regions[i].vmaddr;
+            chunk->from = from;
+            chunk->to = MIN (from + MACHO_CALL_CHUNK, insns);
+        }
+    }
+
+    lh_parallel_for (nchunks, macho_call_chunk, &scan, nthreads);
+
+    // regions are sorted, so joining the chunks in order sorts the calls by site
+    for (size_t i = 0; i < nchunks; i++) {
+        if (!scan.results[i] || !h_array_reserve (calls, calls->len + scan.results[i]->len))
+            goto graph_failed;
+        if (!scan.results[i]->len)
+            continue;
+        memcpy ((macho_call_t *) calls->data + calls->len, scan.results[i]->data,
+                scan.results[i]->len * sizeof (macho_call_t));
+        calls->len += scan.results[i]->len;
+    }
+
+    // unless sections overlap, which only a malformed Mach-O does
+    for (size_t i = 1; i < calls->len; i++) {
+        if (h_array_index (calls, macho_call_t, i).site < h_array_index (calls, macho_call_t, i - 1).site) {
+            qsort (calls->data, calls->len, sizeof (macho_call_t), macho_call_site_compare);
+            break;
+        }
+    }
+
+    if (!macho_call_functions (graph, tmp, fileset, regions, nregions, calls) || !macho_call_names (graph))
+        goto graph_failed;
+
+    resolve.graph = graph;
+    resolve.calls = (macho_call_t *) calls->data;
+    resolve.count = calls->len;
+    lh_parallel_for ((calls->len + MACHO_CALL_BLOCK - 1) / MACHO_CALL_BLOCK, macho_call_resolve_block, &resolve, nthreads);
+
+    // drop branches that aren't calls
+    h_array_foreach (calls, macho_call_t, call) {
+        if (call->callee != MACHO_CALLGRAPH_NONE)
+            resolve.calls[n++] = *call;
+    }
+
+    if (!macho_call_rows (graph, resolve.calls, n))
+        goto graph_failed;
+
+    for (size_t i = 0; i < nchunks; i++)
+        h_array_free (scan.results[i]);
+    free (scan.results);
+    free (scan.chunks);
+    free (regions);
+    h_array_free (calls);
+    macho_fileset_free (loaded);
+    return graph;
+
+graph_failed:
+    if (scan.results) {
+        for (size_t i = 0; i < nchunks; i++)
+            h_array_free (scan.results[i]);
+    }
+    free (scan.results);
+    free (scan.chunks);
+    free (regions);
+    h_array_free (calls);
+    macho_fileset_free (loaded);
+    macho_callgraph_free (graph);
+    return NULL;
+}
+
+
+void macho_callgraph_free (macho_callgraph_t *graph)
+{
+    if (!graph)
+        return;
+
+    free (graph->functions);
+    free (graph->calls);
+    free (graph->callees_index);
+    free (graph->callers);
+    free (graph->callers_index);
+    free (graph->buckets);
+    free (graph);
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Lookups                               									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Find the function that contains `addr`.
+ *
+ *  @returns        function id, or MACHO_CALLGRAPH_NONE.
+ */
+uint32_t macho_callgraph_function_at (const macho_callgraph_t *graph, uint64_t addr)
+{
+    uint32_t f;
+
+    if (!graph || (f = macho_call_floor (graph, addr)) == MACHO_CALLGRAPH_NONE)
+        return MACHO_CALLGRAPH_NONE;
+    return (addr - graph->functions[f].addr < graph->functions[f].size) ? f : MACHO_CALLGRAPH_NONE;
+}
+
+
+/**
+ *  Find a function, or the stub of an imported function, by name.
+ *
+ *  @returns        function id, or MACHO_CALLGRAPH_NONE.
+ */
+uint32_t macho_callgraph_find_symbol (const macho_callgraph_t *graph, const char *name)
+{
+    uint32_t b;
+
+    if (!graph || !name || !graph->buckets)
+        return MACHO_CALLGRAPH_NONE;
+
+    b = (uint32_t) lh_hash64 (name, strlen (name), 0) & (graph->nbuckets - 1);
+    for (uint32_t probes = 0; probes < graph->nbuckets && graph->buckets[b]; probes++) {
+        uint32_t i = graph->buckets[b] - 1;
+        if (!strcmp (graph->functions[i].name, name))
+            return i;
+        b = (b + 1) & (graph->nbuckets - 1);
+    }
+    return MACHO_CALLGRAPH_NONE;
+}
+
+
+/**
+ *  The calls made by `function`, in address order.
+ *
+ *  @returns        number of calls, with `calls` pointing at the first.
+ */
+size_t macho_callgraph_callees (const macho_callgraph_t *graph, uint32_t function, const macho_call_t **calls)
+{
+    if (!graph || function >= graph->nfunctions)
+        return 0;
+
+    if (calls)
+        *calls = &graph->calls[graph->callees_index[function]];
+    return graph->callees_index[function + 1] - graph->callees_index[function];
+}
+
+
+/**
+ *  The calls made to `function`, as indexes into `graph->calls`. The
+ *  caller of each is `graph->calls[i].caller`.
+ *
+ *  @returns        number of calls, with `calls` pointing at the first.
+ */
+size_t macho_callgraph_callers (const macho_callgraph_t *graph, uint32_t function, const uint32_t **calls)
+{
+    if (!graph || function >= graph->nfunctions)
+        return 0;
+
+    if (calls)
+        *calls = &graph->callers[graph->callers_index[function]];
+    return graph->callers_index[function + 1] - graph->callers_index[function];
+}
@@ -0,0 +1,160 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Load Command Iterator               								 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Start walking the load commands of the Mach-O whose header is `hdroff`
+ *  bytes into `data`. Only the header is checked here; each command is
+ *  checked as it is reached.
+ * 
+ *  @param          it to initialise, usually on the stack.
+ *  @param          data the image is in.
+ *  @param          size of data.
+ *  @param          hdroff of the header within data.
+ * 
+ *  @returns        MACH_LC_ITER_SUCCESS, or MACH_LC_ITER_FAILURE if there
+ *                  is no native-endian Mach-O header at `hdroff`.
+ */
+int mach_lc_iter_init (mach_lc_iter_t *it, void *data, size_t size, uint32_t hdroff)
+{
+    const mach_header_32_t *hdr;
+    size_t hdrsize;
+
+    if (!it)
+        return MACH_LC_ITER_FAILURE;
+    memset (it, 0, sizeof (mach_lc_iter_t));
+
+    if (!data || hdroff > size || size - hdroff < sizeof (mach_header_32_t))
+        return MACH_LC_ITER_FAILURE;
+
+    hdr = (const mach_header_32_t *) ((uint8_t *) data + hdroff);
+    if (hdr->magic != MACH_MAGIC_64 && hdr->magic != MACH_MAGIC_32)
+        return MACH_LC_ITER_FAILURE;
+
+    it->is64 = (hdr->magic == MACH_MAGIC_64);
+    hdrsize = (it->is64) ? sizeof (mach_header_t) : sizeof (mach_header_32_t);
+    if (size - hdroff < hdrsize || hdr->sizeofcmds > size - hdroff - hdrsize)
+        return MACH_LC_ITER_FAILURE;
+
+    it->base = (uint8_t *) data;
+    it->offset = hdroff + hdrsize;
+    it->end = it->offset + hdr->sizeofcmds;
+    it->ncmds = hdr->ncmds;
+    return MACH_LC_ITER_SUCCESS;
+}
+
+
+/**
+ *  Start walking the load commands of a loaded Mach-O, 32 or 64 bit.
+ * 
+ */
+int mach_lc_iter_macho (mach_lc_iter_t *it, void *macho)
+{
+    macho_t *tmp = (macho_t *) macho;
+    lh_view_t map;
+
+    if (!tmp)
+        return MACH_LC_ITER_FAILURE;
+
+    map = macho_get_mapping (tmp);
+    return mach_lc_iter_init (it, (void *) map.data, map.size, tmp->hdroff);
+}
+
+
+/**
+ *  Hand out the next load command.
+ * 
+ *  @returns        MACH_LC_ITER_SUCCESS with `entry` filled in, or
+ *                  MACH_LC_ITER_FAILURE at the end of the commands or on a
+ *                  malformed one, in which case `it->error` is set.
+ */
+int mach_lc_iter_next (mach_lc_iter_t *it, mach_lc_entry_t *entry)
+{
+    const mach_load_command_t *lc;
+
+    if (!it->base || it->error || it->index >= it->ncmds)
+        return MACH_LC_ITER_FAILURE;
+
+    lc = (const mach_load_command_t *) (it->base + it->offset);
+    if (it->end - it->offset < sizeof (mach_load_command_t) ||
+        lc->cmdsize < sizeof (mach_load_command_t) || lc->cmdsize > it->end - it->offset) {
+        debugf ("command-iter.c: mach_lc_iter_next(): command %u at offset 0x%llx is malformed\n",
+                it->index, (unsigned long long) it->offset);
+        it->error = 1;
+        return MACH_LC_ITER_FAILURE;
+    }
+
+    entry->cmd = lc->cmd;
+    entry->cmdsize = lc->cmdsize;
+    entry->ptr = (void *) lc;
+    entry->offset = (uint32_t) it->offset;
+    entry->index = it->index;
+
+    it->offset += lc->cmdsize;
+    it->index++;
+    return MACH_LC_ITER_SUCCESS;
+}
+
+
+/**
+ *  Skip forward to the next command whose descriptor has every flag in
+ *  `flags` set.
+ * 
+ */
+static int mach_lc_iter_next_flagged (mach_lc_iter_t *it, mach_lc_entry_t *entry, uint32_t flags)
+{
+    while (mach_lc_iter_next (it, entry)) {
+        const mach_lc_descriptor_t *desc = mach_lc_descriptor (entry->cmd);
+        if (desc && (desc->flags & flags) == flags)
+            return MACH_LC_ITER_SUCCESS;
+    }
+    return MACH_LC_ITER_FAILURE;
+}
+
+/**
+ *  Hand out the next LC_SEGMENT or LC_SEGMENT_64 command.
+ * 
+ */
+int mach_lc_iter_next_segment (mach_lc_iter_t *it, mach_lc_entry_t *entry)
+{
+    return mach_lc_iter_next_flagged (it, entry, MACH_LC_SEGMENT);
+}
+
+/**
+ *  Hand out the next dylib command, e.g. LC_LOAD_DYLIB.
+ * 
+ */
+int mach_lc_iter_next_dylib (mach_lc_iter_t *it, mach_lc_entry_t *entry)
+{
+    return mach_lc_iter_next_flagged (it, entry, MACH_LC_DYLIB);
+}
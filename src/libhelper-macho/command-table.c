@@ -0,0 +1,296 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Load Command Checks                 								 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Each check is given a command whose cmdsize has already been checked
+ *  against the descriptor, and the size of the mapping. It checks that every
+ *  range the command refers to lies within the mapping.
+ * 
+ */
+
+static int mach_lc_range (size_t size, uint64_t offset, uint64_t len)
+{
+    return offset <= size && len <= size - offset;
+}
+
+static int mach_lc_array (size_t size, uint64_t offset, uint64_t count, uint64_t stride)
+{
+    return offset <= size && count <= (size - offset) / stride;
+}
+
+/**
+ *  A string at `str` bytes into a command must start after the fixed part
+ *  of the command and be terminated before the command ends.
+ */
+static int mach_lc_str (const uint8_t *cmd, uint32_t cmdsize, size_t fixed, uint32_t str)
+{
+    return str >= fixed && str < cmdsize && memchr (cmd + str, '\0', cmdsize - str);
+}
+
+
+static int mach_lc_check_segment_64 (const uint8_t *cmd, uint32_t cmdsize, size_t size, int is64)
+{
+    const mach_segment_command_64_t *seg = (const mach_segment_command_64_t *) cmd;
+    const mach_section_64_t *sect = (const mach_section_64_t *) (cmd + sizeof (mach_segment_command_64_t));
+    (void) is64;
+
+    if (seg->nsects > (cmdsize - sizeof (mach_segment_command_64_t)) / sizeof (mach_section_64_t))
+        return 0;
+    if (!mach_lc_range (size, seg->fileoff, seg->filesize))
+        return 0;
+
+    for (uint32_t i = 0; i < seg->nsects; i++, sect++) {
+        uint32_t type = sect->flags & SECTION_TYPE;
+        int zerofill = (type == S_ZEROFILL || type == S_GB_ZEROFILL || type == S_THREAD_LOCAL_ZEROFILL);
+
+        if (!zerofill && !mach_lc_range (size, sect->offset, sect->size))
+            return 0;
+        if (!mach_lc_array (size, sect->reloff, sect->nreloc, 8))
+            return 0;
+    }
+    return 1;
+}
+
+static int mach_lc_check_segment_32 (const uint8_t *cmd, uint32_t cmdsize, size_t size, int is64)
+{
+    const mach_segment_command_32_t *seg = (const mach_segment_command_32_t *) cmd;
+    const mach_section_32_t *sect = (const mach_section_32_t *) (cmd + sizeof (mach_segment_command_32_t));
+    (void) is64;
+
+    if (seg->nsects > (cmdsize - sizeof (mach_segment_command_32_t)) / sizeof (mach_section_32_t))
+        return 0;
+    if (!mach_lc_range (size, seg->fileoff, seg->filesize))
+        return 0;
+
+    for (uint32_t i = 0; i < seg->nsects; i++, sect++) {
+        uint32_t type = sect->flags & SECTION_TYPE;
+        int zerofill = (type == S_ZEROFILL || type == S_GB_ZEROFILL || type == S_THREAD_LOCAL_ZEROFILL);
+
+        if (!zerofill && !mach_lc_range (size, sect->offset, sect->size))
+            return 0;
+        if (!mach_lc_array (size, sect->reloff, sect->nreloc, 8))
+            return 0;
+    }
+    return 1;
+}
+
+static int mach_lc_check_symtab (const uint8_t *cmd, uint32_t cmdsize, size_t size, int is64)
+{
+    const mach_symtab_command_t *symtab = (const mach_symtab_command_t *) cmd;
+    (void) cmdsize;
+
+    return mach_lc_array (size, symtab->symoff, symtab->nsyms, (is64) ? 16 : 12) &&
+           mach_lc_range (size, symtab->stroff, symtab->strsize);
+}
+
+static int mach_lc_check_dysymtab (const uint8_t *cmd, uint32_t cmdsize, size_t size, int is64)
+{
+    const mach_dysymtab_command_t *dysymtab = (const mach_dysymtab_command_t *) cmd;
+    (void) cmdsize, (void) is64;
+
+    return mach_lc_array (size, dysymtab->indirectsymoff, dysymtab->nindirectsyms, 4) &&
+           mach_lc_array (size, dysymtab->extreloff, dysymtab->nextrel, 8) &&
+           mach_lc_array (size, dysymtab->locreloff, dysymtab->nlocrel, 8);
+}
+
+static int mach_lc_check_dylib (const uint8_t *cmd, uint32_t cmdsize, size_t size, int is64)
+{
+    (void) size, (void) is64;
+    return mach_lc_str (cmd, cmdsize, sizeof (mach_dylib_command_t), ((const mach_dylib_command_t *) cmd)->dylib.offset);
+}
+
+/* dylinker, rpath and the other commands that only carry a string */
+static int mach_lc_check_str (const uint8_t *cmd, uint32_t cmdsize, size_t size, int is64)
+{
+    (void) size, (void) is64;
+    return mach_lc_str (cmd, cmdsize, sizeof (mach_dylinker_command_t), ((const mach_dylinker_command_t *) cmd)->offset);
+}
+
+static int mach_lc_check_fileset_entry (const uint8_t *cmd, uint32_t cmdsize, size_t size, int is64)
+{
+    const mach_fileset_entry_t *entry = (const mach_fileset_entry_t *) cmd;
+    (void) is64;
+
+    return mach_lc_range (size, entry->fileoff, sizeof (mach_header_t)) &&
+           mach_lc_str (cmd, cmdsize, sizeof (mach_fileset_entry_t), entry->offset);
+}
+
+static int mach_lc_check_linkedit_data (const uint8_t *cmd, uint32_t cmdsize, size_t size, int is64)
+{
+    const mach_linkedit_data_command_t *data = (const mach_linkedit_data_command_t *) cmd;
+    (void) cmdsize, (void) is64;
+
+    return mach_lc_range (size, data->dataoff, data->datasize);
+}
+
+static int mach_lc_check_dyld_info (const uint8_t *cmd, uint32_t cmdsize, size_t size, int is64)
+{
+    const mach_dyld_info_command_t *info = (const mach_dyld_info_command_t *) cmd;
+    (void) cmdsize, (void) is64;
+
+    return mach_lc_range (size, info->rebase_off, info->rebase_size) &&
+           mach_lc_range (size, info->bind_off, info->bind_size) &&
+           mach_lc_range (size, info->weak_bind_off, info->weak_bind_size) &&
+           mach_lc_range (size, info->lazy_bind_off, info->lazy_bind_size) &&
+           mach_lc_range (size, info->export_off, info->export_size);
+}
+
+static int mach_lc_check_build_version (const uint8_t *cmd, uint32_t cmdsize, size_t size, int is64)
+{
+    const mach_build_version_command_t *build = (const mach_build_version_command_t *) cmd;
+    (void) size, (void) is64;
+
+    return build->ntools <= (cmdsize - sizeof (mach_build_version_command_t)) / sizeof (struct build_tool_version);
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Load Command Descriptors            								 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Every known load command, indexed by its number with LC_REQ_DYLD folded
+ *  out. The minimum sizes are those of the structures in loader.h, and the
+ *  layouts describe everything after `cmd` and `cmdsize` for the byte
+ *  swapper (see mach_swap_structs()). Anything past the layout, e.g. the
+ *  string that follows a dylib command, is bytes.
+ * 
+ */
+#define LC_DESC(c, sz, fl, lay, fn)     [MACH_LC_INDEX (c)] = { c, #c, sz, fl, lay, fn }
+
+static const mach_lc_descriptor_t mach_lc_descriptors[MACH_LC_INDEX_MAX] =
+{
+    LC_DESC (LC_SEGMENT,                  sizeof (mach_segment_command_32_t),    MACH_LC_32 | MACH_LC_SEGMENT,  "16sIIIIiiII",  mach_lc_check_segment_32),
+    LC_DESC (LC_SYMTAB,                   sizeof (mach_symtab_command_t),        MACH_LC_ANY,                   "IIII",         mach_lc_check_symtab),
+    LC_DESC (LC_SYMSEG,                   16,                                    MACH_LC_ANY,                   "II",           NULL),
+    LC_DESC (LC_THREAD,                   8,                                     MACH_LC_ANY,                   NULL,           NULL),
+    LC_DESC (LC_UNIXTHREAD,               8,                                     MACH_LC_ANY,                   NULL,           NULL),
+    LC_DESC (LC_LOADFVMLIB,               20,                                    MACH_LC_ANY,                   "III",          NULL),
+    LC_DESC (LC_IDFVMLIB,                 20,                                    MACH_LC_ANY,                   "III",          NULL),
+    LC_DESC (LC_IDENT,                    8,                                     MACH_LC_ANY,                   NULL,           NULL),
+    LC_DESC (LC_FVMFILE,                  16,                                    MACH_LC_ANY,                   "II",           NULL),
+    LC_DESC (LC_PREPAGE,                  8,                                     MACH_LC_ANY,                   NULL,           NULL),
+    LC_DESC (LC_DYSYMTAB,                 sizeof (mach_dysymtab_command_t),      MACH_LC_ANY,                   "18I",          mach_lc_check_dysymtab),
+    LC_DESC (LC_LOAD_DYLIB,               sizeof (mach_dylib_command_t),         MACH_LC_DYLIB,                 "IIII",         mach_lc_check_dylib),
+    LC_DESC (LC_ID_DYLIB,                 sizeof (mach_dylib_command_t),         MACH_LC_DYLIB,                 "IIII",         mach_lc_check_dylib),
+    LC_DESC (LC_LOAD_DYLINKER,            sizeof (mach_dylinker_command_t),      MACH_LC_ANY,                   "I",            mach_lc_check_str),
+    LC_DESC (LC_ID_DYLINKER,              sizeof (mach_dylinker_command_t),      MACH_LC_ANY,                   "I",            mach_lc_check_str),
+    LC_DESC (LC_PREBOUND_DYLIB,           20,                                    MACH_LC_ANY,                   "III",          NULL),
+    LC_DESC (LC_ROUTINES,                 40,                                    MACH_LC_32,                    "8I",           NULL),
+    LC_DESC (LC_SUB_FRAMEWORK,            12,                                    MACH_LC_ANY,                   "I",            mach_lc_check_str),
+    LC_DESC (LC_SUB_UMBRELLA,             12,                                    MACH_LC_ANY,                   "I",            mach_lc_check_str),
+    LC_DESC (LC_SUB_CLIENT,               12,                                    MACH_LC_ANY,                   "I",            mach_lc_check_str),
+    LC_DESC (LC_SUB_LIBRARY,              12,                                    MACH_LC_ANY,                   "I",            mach_lc_check_str),
+    LC_DESC (LC_TWOLEVEL_HINTS,           16,                                    MACH_LC_ANY,                   "II",           NULL),
+    LC_DESC (LC_PREBIND_CKSUM,            12,                                    MACH_LC_ANY,                   "I",            NULL),
+    LC_DESC (LC_LOAD_WEAK_DYLIB,          sizeof (mach_dylib_command_t),         MACH_LC_DYLIB,                 "IIII",         mach_lc_check_dylib),
+    LC_DESC (LC_SEGMENT_64,               sizeof (mach_segment_command_64_t),    MACH_LC_64 | MACH_LC_SEGMENT,  "16sQQQQiiII",  mach_lc_check_segment_64),
+    LC_DESC (LC_ROUTINES_64,              72,                                    MACH_LC_64,                    "8Q",           NULL),
+    LC_DESC (LC_UUID,                     sizeof (mach_uuid_command_t),          MACH_LC_ANY,                   "16s",          NULL),
+    LC_DESC (LC_RPATH,                    sizeof (mach_rpath_command_t),         MACH_LC_ANY,                   "I",            mach_lc_check_str),
+    LC_DESC (LC_CODE_SIGNATURE,           sizeof (mach_linkedit_data_command_t), MACH_LC_ANY,                   "II",           mach_lc_check_linkedit_data),
+    LC_DESC (LC_SEGMENT_SPLIT_INFO,       sizeof (mach_linkedit_data_command_t), MACH_LC_ANY,                   "II",           mach_lc_check_linkedit_data),
+    LC_DESC (LC_REEXPORT_DYLIB,           sizeof (mach_dylib_command_t),         MACH_LC_DYLIB,                 "IIII",         mach_lc_check_dylib),
+    LC_DESC (LC_LAZY_LOAD_DYLIB,          sizeof (mach_dylib_command_t),         MACH_LC_DYLIB,                 "IIII",         mach_lc_check_dylib),
+    LC_DESC (LC_ENCRYPTION_INFO,          20,                                    MACH_LC_32,                    "III",          NULL),
+    LC_DESC (LC_DYLD_INFO,                sizeof (mach_dyld_info_command_t),     MACH_LC_ANY,                   "10I",          mach_lc_check_dyld_info),
+    LC_DESC (LC_LOAD_UPWARD_DYLIB,        sizeof (mach_dylib_command_t),         MACH_LC_DYLIB,                 "IIII",         mach_lc_check_dylib),
+    LC_DESC (LC_VERSION_MIN_MACOSX,       16,                                    MACH_LC_ANY,                   "II",           NULL),
+    LC_DESC (LC_VERSION_MIN_IPHONEOS,     16,                                    MACH_LC_ANY,                   "II",           NULL),
+    LC_DESC (LC_FUNCTION_STARTS,          sizeof (mach_linkedit_data_command_t), MACH_LC_ANY,                   "II",           mach_lc_check_linkedit_data),
+    LC_DESC (LC_DYLD_ENVIRONMENT,         sizeof (mach_dylinker_command_t),      MACH_LC_ANY,                   "I",            mach_lc_check_str),
+    LC_DESC (LC_MAIN,                     sizeof (mach_entry_point_command_t),   MACH_LC_ANY,                   "QQ",           NULL),
+    LC_DESC (LC_DATA_IN_CODE,             sizeof (mach_linkedit_data_command_t), MACH_LC_ANY,                   "II",           mach_lc_check_linkedit_data),
+    LC_DESC (LC_SOURCE_VERSION,           sizeof (mach_source_version_command_t), MACH_LC_ANY,                  "Q",            NULL),
+    LC_DESC (LC_DYLIB_CODE_SIGN_DRS,      sizeof (mach_linkedit_data_command_t), MACH_LC_ANY,                   "II",           mach_lc_check_linkedit_data),
+    LC_DESC (LC_ENCRYPTION_INFO_64,       24,                                    MACH_LC_64,                    "IIII",         NULL),
+    LC_DESC (LC_LINKER_OPTION,            12,                                    MACH_LC_ANY,                   "I",            NULL),
+    LC_DESC (LC_LINKER_OPTIMIZATION_HINT, sizeof (mach_linkedit_data_command_t), MACH_LC_ANY,                   "II",           mach_lc_check_linkedit_data),
+    LC_DESC (LC_VERSION_MIN_TVOS,         16,                                    MACH_LC_ANY,                   "II",           NULL),
+    LC_DESC (LC_VERSION_MIN_WATCHOS,      16,                                    MACH_LC_ANY,                   "II",           NULL),
+    LC_DESC (LC_NOTE,                     40,                                    MACH_LC_ANY,                   "16sQQ",        NULL),
+    LC_DESC (LC_BUILD_VERSION,            sizeof (mach_build_version_command_t), MACH_LC_ANY,                   "IIII",         mach_lc_check_build_version),
+    LC_DESC (LC_DYLD_EXPORTS_TRIE,        sizeof (mach_linkedit_data_command_t), MACH_LC_ANY,                   "II",           mach_lc_check_linkedit_data),
+    LC_DESC (LC_DYLD_CHAINED_FIXUPS,      sizeof (mach_linkedit_data_command_t), MACH_LC_ANY,                   "II",           mach_lc_check_linkedit_data),
+    LC_DESC (LC_FILESET_ENTRY,            sizeof (mach_fileset_entry_t),         MACH_LC_ANY,                   "QQII",         mach_lc_check_fileset_entry),
+};
+
+/**
+ *  LC_DYLD_INFO_ONLY is the one command that only differs from another by
+ *  LC_REQ_DYLD, so it can't share the table.
+ */
+static const mach_lc_descriptor_t mach_lc_dyld_info_only =
+    { LC_DYLD_INFO_ONLY, "LC_DYLD_INFO_ONLY", sizeof (mach_dyld_info_command_t), MACH_LC_ANY, "10I", mach_lc_check_dyld_info };
+
+#undef LC_DESC
+
+
+/**
+ *  Look up the descriptor for a load command.
+ * 
+ *  @param          cmd, including LC_REQ_DYLD where it is set.
+ * 
+ *  @returns        the descriptor, or NULL for an unknown command.
+ */
+const mach_lc_descriptor_t *mach_lc_descriptor (uint32_t cmd)
+{
+    const mach_lc_descriptor_t *desc;
+
+    if (MACH_LC_INDEX (cmd) >= MACH_LC_INDEX_MAX)
+        return NULL;
+
+    desc = &mach_lc_descriptors[MACH_LC_INDEX (cmd)];
+    if (desc->cmd == cmd && desc->name)
+        return desc;
+    return (cmd == LC_DYLD_INFO_ONLY) ? &mach_lc_dyld_info_only : NULL;
+}
+
+
+/**
+ *  Check a load command against its descriptor: the minimum size, and any
+ *  ranges it refers to within a mapping of `size` bytes. Unknown commands
+ *  have nothing to check.
+ * 
+ *  @returns        1 if the command can be used, 0 otherwise.
+ */
+int mach_lc_check (const void *cmd, uint32_t cmdsize, size_t size, int is64)
+{
+    const mach_lc_descriptor_t *desc = mach_lc_descriptor (((const mach_load_command_t *) cmd)->cmd);
+
+    if (!desc)
+        return 1;
+    if (cmdsize < desc->size)
+        return 0;
+    return (desc->check) ? desc->check ((const uint8_t *) cmd, cmdsize, size, is64) : 1;
+}
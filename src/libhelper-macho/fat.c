@@ -27,6 +27,7 @@
 #include "libhelper/libhelper.h"
 #include "libhelper/libhelper-macho.h"
 #include "libhelper/libhelper-fat.h"
+#include "hlib.h"
 
 //===-----------------------------------------------------------------------===//
 /*-- FAT (Universal Binary)                              				      -*/
@@ -109,12 +110,223 @@ fat_header_t *swap_fat_header_bytes (fat_header_t *h)
 }
 
 
+/**
+ *  Function:   mach_universal_read
+ *  ----------------------------------
+ * 
+ *  Reads the header of a Universal Binary straight from a view, swapping the
+ *  fat_arch or fat_arch_64 records into `info`. Nothing is copied from the
+ *  file and nothing is allocated, and every slice is checked to lie within
+ *  the view.
+ * 
+ *  view:       The whole Universal Binary.
+ *  info:       Filled in on success.
+ * 
+ *  Returns:    FAT_SUCCESS, or FAT_FAILURE if the view is not a valid
+ *              Universal Binary.
+ */
+int mach_universal_read (lh_view_t view, fat_info_t *info)
+{
+    uint8_t archs[FAT_SLICES_MAX * sizeof (struct fat_arch_64)];
+    const fat_header_t *raw;
+    const uint8_t *table;
+    size_t archsize;
+    uint32_t magic, nfat_arch;
+
+    raw = lh_view_ptr (view, 0, sizeof (fat_header_t));
+    if (!raw || !info)
+        return FAT_FAILURE;
+
+    // the header and arch records are always big endian
+    magic = OSSwapInt32 (raw->magic);
+    nfat_arch = OSSwapInt32 (raw->nfat_arch);
+    if (magic != FAT_MAGIC && magic != FAT_MAGIC_64)
+        return FAT_FAILURE;
+
+    if (!nfat_arch || nfat_arch > FAT_SLICES_MAX) {
+        errorf ("mach_universal_read(): unsupported number of architectures: %u\n", nfat_arch);
+        return FAT_FAILURE;
+    }
+
+    archsize = (magic == FAT_MAGIC_64) ? sizeof (struct fat_arch_64) : sizeof (struct fat_arch);
+    table = lh_view_ptr (view, sizeof (fat_header_t), nfat_arch * archsize);
+    if (!table) {
+        errorf ("mach_universal_read(): architecture table runs past the end of the file\n");
+        return FAT_FAILURE;
+    }
+
+    // swap a copy of the whole table in one go, the mapping stays untouched
+    memcpy (archs, table, nfat_arch * archsize);
+    mach_swap_structs (archs, nfat_arch, (magic == FAT_MAGIC_64) ? MACH_LAYOUT_FAT_ARCH_64 : MACH_LAYOUT_FAT_ARCH);
+
+    for (uint32_t i = 0; i < nfat_arch; i++) {
+        fat_slice_t *slice = &info->slices[i];
+
+        if (magic == FAT_MAGIC_64) {
+            struct fat_arch_64 a;
+            memcpy (&a, archs + (i * archsize), sizeof (a));
+            slice->cputype = a.cputype;
+            slice->cpusubtype = a.cpusubtype;
+            slice->offset = a.offset;
+            slice->size = a.size;
+            slice->align = a.align;
+        } else {
+            struct fat_arch a;
+            memcpy (&a, archs + (i * archsize), sizeof (a));
+            slice->cputype = a.cputype;
+            slice->cpusubtype = a.cpusubtype;
+            slice->offset = a.offset;
+            slice->size = a.size;
+            slice->align = a.align;
+        }
+
+        if (slice->offset > view.size || slice->size > view.size - slice->offset) {
+            errorf ("mach_universal_read(): slice %u lies outside of the file\n", i);
+            return FAT_FAILURE;
+        }
+    }
+
+    info->view = view;
+    info->magic = magic;
+    info->nslices = nfat_arch;
+    return FAT_SUCCESS;
+}
+
+
+/**
+ *  Function:   mach_universal_find_slice
+ *  ----------------------------------
+ * 
+ *  Finds the slice for a given architecture. Feature bits in the subtype
+ *  are ignored, and CPU_TYPE_ANY or CPU_SUBTYPE_ANY match anything.
+ * 
+ *  Returns:    The first matching slice, or NULL.
+ */
+const fat_slice_t *mach_universal_find_slice (const fat_info_t *info, cpu_type_t cputype, cpu_subtype_t cpusubtype)
+{
+    if (!info)
+        return NULL;
+
+    for (uint32_t i = 0; i < info->nslices; i++) {
+        const fat_slice_t *slice = &info->slices[i];
+
+        if (cputype != CPU_TYPE_ANY && slice->cputype != cputype)
+            continue;
+        if (cpusubtype != CPU_SUBTYPE_ANY &&
+            (slice->cpusubtype & ~CPU_SUBTYPE_MASK) != (cpusubtype & ~CPU_SUBTYPE_MASK))
+            continue;
+        return slice;
+    }
+    return NULL;
+}
+
+
+static void *macho_load_fat_slice (file_t *file, const fat_slice_t *slice)
+{
+    macho_t *macho = macho_load_from_view (file_get_view (file, slice->offset, slice->size));
+    if (macho)
+        macho->path = file->path;
+    return macho;
+}
+
+
+/**
+ *  Function:   macho_load_slice
+ *  ----------------------------------
+ * 
+ *  Loads a single architecture from a file without touching the others. The
+ *  returned Mach-O views the slice in place, so the file must outlive it. A
+ *  thin Mach-O is returned as-is when its cputype matches.
+ * 
+ *  file:       The loaded file.
+ *  cputype:    The cputype to load, or CPU_TYPE_ANY.
+ *  cpusubtype: The subtype to load, or CPU_SUBTYPE_ANY.
+ * 
+ *  Returns:    The slice as a `macho_t`, or NULL.
+ */
+void *macho_load_slice (file_t *file, cpu_type_t cputype, cpu_subtype_t cpusubtype)
+{
+    const fat_slice_t *slice;
+    fat_info_t info;
+
+    if (!file || !file->data)
+        return NULL;
+
+    if (!mach_universal_read (file_get_view (file, 0, file->size), &info)) {
+        const mach_header_t *hdr = lh_view_ptr (file_get_view (file, 0, file->size), 0, sizeof (mach_header_32_t));
+        fat_slice_t thin;
+
+        if (!hdr)
+            return NULL;
+
+        thin.cputype = hdr->cputype;
+        thin.cpusubtype = hdr->cpusubtype;
+        thin.offset = 0;
+        thin.size = file->size;
+        thin.align = 0;
+
+        info.nslices = 1;
+        info.slices[0] = thin;
+    }
+
+    slice = mach_universal_find_slice (&info, cputype, cpusubtype);
+    if (!slice) {
+        debugf ("fat.c: macho_load_slice(): %s: no slice for cputype 0x%x, subtype 0x%x\n", file->path, cputype, cpusubtype);
+        return NULL;
+    }
+    return macho_load_fat_slice (file, slice);
+}
+
+
+struct __libhelper_fat_load {
+    file_t          *file;
+    fat_info_t      *info;
+    void           **machos;
+};
+
+static void macho_load_slices_job (void *ctx, size_t index)
+{
+    struct __libhelper_fat_load *load = (struct __libhelper_fat_load *) ctx;
+    load->machos[index] = macho_load_fat_slice (load->file, &load->info->slices[index]);
+}
+
+
+/**
+ *  Function:   macho_load_slices
+ *  ----------------------------------
+ * 
+ *  Loads every slice of a Universal Binary, parsing the slices in parallel
+ *  on `nthreads` threads (zero for one per core). `machos[i]` is set to the
+ *  Mach-O for slice `i`, or NULL if that slice failed to parse.
+ * 
+ *  Returns:    The number of slices written to `machos`, at most `count`.
+ */
+size_t macho_load_slices (file_t *file, void **machos, size_t count, int nthreads)
+{
+    struct __libhelper_fat_load load;
+    fat_info_t info;
+    size_t n;
+
+    if (!file || !machos || !mach_universal_read (file_get_view (file, 0, file->size), &info))
+        return 0;
+
+    n = MIN ((size_t) info.nslices, count);
+    load.file = file;
+    load.info = &info;
+    load.machos = machos;
+    lh_parallel_for (n, macho_load_slices_job, &load, nthreads);
+    return n;
+}
+
+
 /**
  *  Function:   mach_universal_load
  *  ----------------------------------
  * 
  *  Loads a raw Universal Mach-O Header from a given offset in a verified file, and
- *  returns the resulting structure.
+ *  returns the resulting structure. The header and every fat_arch are swapped
+ *  copies owned by the returned struct. Prefer `mach_universal_read()`, which
+ *  does not allocate.
  *  
  *  file:       The verified file.
  * 
@@ -122,47 +334,34 @@ fat_header_t *swap_fat_header_bytes (fat_header_t *h)
  */
 fat_header_info_t *mach_universal_load (file_t *file)
 {
+    fat_header_info_t *ret;
+    fat_info_t info;
 
-    // Create the FAT header so we can read some data from
-    // the file. The header starts at 0x0 in the file. It
-    // is also in Little-Endian form, so we have to swap
-    // the byte order.
-    fat_header_t *fat_header = file_dup_data (file, 0, sizeof (fat_header_t));
-    fat_header = swap_header_bytes (fat_header);
-
-    // Check the number of architectures
-    if (!fat_header->nfat_arch) {
-        errorf ("Empty Mach-O Universal Binary");
-        exit (0);
+    if (!file || !mach_universal_read (file_get_view (file, 0, file->size), &info)) {
+        errorf ("mach_universal_load(): not a valid Mach-O Universal Binary\n");
+        return NULL;
     }
 
-    if (fat_header->nfat_arch > 1) 
-        debugf ("fat.c: mach_universal_load(): %s: Mach-O Universal Binary. Found %d architectures.\n", file->path, fat_header->nfat_arch);
+    if (info.nslices > 1)
+        debugf ("fat.c: mach_universal_load(): %s: Mach-O Universal Binary. Found %d architectures.\n", file->path, info.nslices);
 
-    // Arch list
-    HSList *archs = NULL;
+    ret = calloc (1, sizeof (fat_header_info_t));
+    ret->header = malloc (sizeof (fat_header_t));
+    ret->header->magic = info.magic;
+    ret->header->nfat_arch = info.nslices;
 
-    // Create an offset to move through the archs.
-    uint32_t offset = sizeof(fat_header_t);
-    for (uint32_t i = 0; i < fat_header->nfat_arch; i++) {
+    for (uint32_t i = 0; i < info.nslices; i++) {
+        struct fat_arch *arch = malloc (sizeof (struct fat_arch));
 
-        // Current arch. Also needs to swap the bytes.
-        struct fat_arch *arch = file_dup_data (file, offset, sizeof (struct fat_arch));
+        // fat_arch can't hold 64 bit offsets, use mach_universal_read() for those
+        arch->cputype = info.slices[i].cputype;
+        arch->cpusubtype = info.slices[i].cpusubtype;
+        arch->offset = (uint32_t) info.slices[i].offset;
+        arch->size = (uint32_t) info.slices[i].size;
+        arch->align = info.slices[i].align;
 
-        arch = swap_fat_arch_bytes (arch);
-
-        // Add to the list
-        archs = h_slist_append (archs, arch);
-
-        // Increment the offset
-        offset += sizeof(struct fat_arch);
-        free (arch);
+        ret->archs = h_slist_append (ret->archs, arch);
     }
 
-    fat_header_info_t *ret = malloc (sizeof(fat_header_info_t));
-    ret->header = fat_header;
-    ret->archs = archs;
-
-    free (fat_header);
     return ret;
-}
\ No newline at end of file
+}
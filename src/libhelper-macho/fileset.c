@@ -0,0 +1,253 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Mach-O Filesets                      								 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Parse a single fileset entry as a Mach-O, in place over the fileset's
+ *  mapping. Nothing is copied; the image borrows the fileset's data and
+ *  backing file, so it must not outlive them.
+ * 
+ *  @param          macho of the fileset.
+ *  @param          entry to parse.
+ * 
+ *  @returns        the entry's `macho_t`, or NULL on failure.
+ */
+macho_t *macho_fileset_entry_load (macho_t *macho, const macho_fileset_entry_t *entry)
+{
+    const mach_header_t *hdr;
+    macho_t *image;
+
+    if (!macho || !entry || entry->fileoff > UINT32_MAX)
+        return NULL;
+
+    hdr = lh_view_ptr (macho_get_view (macho, (uint32_t) entry->fileoff, sizeof (mach_header_t)), 0, sizeof (mach_header_t));
+    if (!hdr || hdr->magic != MACH_MAGIC_64) {
+        errorf ("macho_fileset_entry_load(): %s: no 64 bit Mach-O at offset 0x%llx\n",
+                entry->entry_id, (unsigned long long) entry->fileoff);
+        return NULL;
+    }
+
+    // segment fileoffs within an entry are relative to the fileset, so the
+    //  image keeps the fileset's data and only its header is moved. It is
+    //  validated against the whole fileset.
+    image = macho_64_create_from_view (macho_get_mapping (macho), (uint32_t) entry->fileoff);
+    if (!image)
+        return NULL;
+
+    image->file = macho->file;
+    image->path = entry->entry_id;
+    if (!image->file && image->size > macho->size)
+        image->size = macho->size;
+
+    return image;
+}
+
+
+struct __libhelper_fileset_order {
+    const char      *entry_id;
+    uint32_t         index;
+};
+
+static int macho_fileset_order_compare (const void *a, const void *b)
+{
+    const struct __libhelper_fileset_order *x = a, *y = b;
+    return strcmp (x->entry_id, y->entry_id);
+}
+
+
+/**
+ *  Enumerate the LC_FILESET_ENTRY commands of an MH_FILESET Mach-O. The
+ *  entries are not parsed yet, see `macho_fileset_load_all()` and
+ *  `macho_fileset_find()`.
+ * 
+ *  @param          macho of the fileset, e.g. a kernelcache.
+ * 
+ *  @returns        the fileset, or NULL if `macho` is not a fileset.
+ */
+macho_fileset_t *macho_fileset_load (macho_t *macho)
+{
+    struct __libhelper_fileset_order *order = NULL;
+    macho_fileset_t *fileset;
+    size_t n = 0, total = 0;
+
+    if (!macho || !macho->header || macho->header->magic != MACH_MAGIC_64) {
+        errorf ("macho_fileset_load(): filesets must be 64 bit\n");
+        return NULL;
+    }
+    if (macho->header->filetype != MACH_TYPE_FILESET) {
+        errorf ("macho_fileset_load(): Mach-O is not a fileset: filetype 0x%x\n", macho->header->filetype);
+        return NULL;
+    }
+
+    for (HSList *l = macho->lcmds; l; l = l->next)
+        if (((mach_load_command_info_t *) l->data)->lc->cmd == LC_FILESET_ENTRY)
+            total++;
+
+    fileset = calloc (1, sizeof (macho_fileset_t));
+    if (!fileset)
+        return NULL;
+
+    fileset->macho = macho;
+    fileset->entries = calloc (total ? total : 1, sizeof (macho_fileset_entry_t));
+    fileset->images = calloc (total ? total : 1, sizeof (macho_t *));
+    fileset->by_id = calloc (total ? total : 1, sizeof (uint32_t));
+    order = calloc (total ? total : 1, sizeof (struct __libhelper_fileset_order));
+    if (!fileset->entries || !fileset->images || !fileset->by_id || !order)
+        goto fileset_failed;
+
+    for (HSList *l = macho->lcmds; l; l = l->next) {
+        mach_load_command_info_t *info = (mach_load_command_info_t *) l->data;
+        mach_fileset_entry_t *cmd;
+        char *entry_id;
+
+        if (info->lc->cmd != LC_FILESET_ENTRY)
+            continue;
+
+        cmd = (mach_fileset_entry_t *) lh_view_ptr (macho_get_view (macho, info->offset, sizeof (mach_fileset_entry_t)),
+                                                    0, sizeof (mach_fileset_entry_t));
+        entry_id = (cmd) ? mach_lc_load_fileset_entry_name (macho, cmd, info->offset) : NULL;
+        if (!entry_id) {
+            warningf ("macho_fileset_load(): skipping malformed LC_FILESET_ENTRY at offset: 0x%08x\n", info->offset);
+            continue;
+        }
+
+        fileset->entries[n].entry_id = entry_id;
+        fileset->entries[n].vmaddr = cmd->vmaddr;
+        fileset->entries[n].fileoff = cmd->fileoff;
+        fileset->entries[n].offset = info->offset;
+
+        order[n].entry_id = entry_id;
+        order[n].index = (uint32_t) n;
+        n++;
+    }
+    fileset->count = n;
+
+    // entry_id -> entry lookups are a binary search over the sorted order
+    qsort (order, n, sizeof (struct __libhelper_fileset_order), macho_fileset_order_compare);
+    for (size_t i = 0; i < n; i++)
+        fileset->by_id[i] = order[i].index;
+
+    free (order);
+    return fileset;
+
+fileset_failed:
+    free (order);
+    macho_fileset_free (fileset);
+    return NULL;
+}
+
+
+static void macho_fileset_load_job (void *ctx, size_t index)
+{
+    macho_fileset_t *fileset = (macho_fileset_t *) ctx;
+
+    if (!fileset->images[index])
+        fileset->images[index] = macho_fileset_entry_load (fileset->macho, &fileset->entries[index]);
+}
+
+
+/**
+ *  Parse every entry that is not loaded yet, spread over `nthreads` threads
+ *  (zero for one per core). Each entry is independent, and only reads the
+ *  shared mapping, so hundreds of kexts parse side by side.
+ * 
+ *  @returns        number of entries that are loaded.
+ */
+size_t macho_fileset_load_all (macho_fileset_t *fileset, int nthreads)
+{
+    size_t loaded = 0;
+
+    if (!fileset)
+        return 0;
+
+    lh_parallel_for (fileset->count, macho_fileset_load_job, fileset, nthreads);
+
+    for (size_t i = 0; i < fileset->count; i++)
+        if (fileset->images[i])
+            loaded++;
+    return loaded;
+}
+
+
+/**
+ *  Find an entry by its entry_id, e.g. "com.apple.kernel", and return its
+ *  image, parsing it first if needed. Lookups that may parse must not race
+ *  with each other or with `macho_fileset_load_all()`.
+ * 
+ *  @returns        the entry's image, or NULL if there is no such entry.
+ */
+macho_t *macho_fileset_find (macho_fileset_t *fileset, const char *entry_id)
+{
+    size_t lo = 0, hi;
+
+    if (!fileset || !entry_id)
+        return NULL;
+
+    hi = fileset->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t index = fileset->by_id[mid];
+        int cmp = strcmp (entry_id, fileset->entries[index].entry_id);
+
+        if (!cmp) {
+            macho_fileset_load_job (fileset, index);
+            return fileset->images[index];
+        }
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return NULL;
+}
+
+
+/**
+ *  Free a fileset and every image parsed from it. The fileset's own
+ *  `macho_t` is left alone.
+ * 
+ */
+void macho_fileset_free (macho_fileset_t *fileset)
+{
+    if (!fileset)
+        return;
+
+    if (fileset->images)
+        for (size_t i = 0; i < fileset->count; i++)
+            macho_free (fileset->images[i]);
+
+    free (fileset->images);
+    free (fileset->entries);
+    free (fileset->by_id);
+    free (fileset);
+}
@@ -0,0 +1,156 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Mach-O Content Hashing                								 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Hash the whole Mach-O image.
+ *
+ *  @returns        LH_HASH_SUCCESS, or LH_HASH_FAILURE.
+ */
+int macho_hash (void *macho, lh_hash_type_t type, lh_hash_t *out)
+{
+    macho_t *tmp = (macho_t *) macho;
+    if (!tmp)
+        return LH_HASH_FAILURE;
+    return lh_view_hash (macho_get_view (tmp, 0, tmp->size), type, out);
+}
+
+
+static int macho_hash_is_zerofill (uint32_t flags)
+{
+    uint32_t type = flags & SECTION_TYPE;
+    return (type == S_ZEROFILL || type == S_GB_ZEROFILL || type == S_THREAD_LOCAL_ZEROFILL);
+}
+
+static void macho_hash_region_set (macho_region_hash_t *r, lh_view_t *view, void *macho,
+                                   const char *segname, const char *sectname, uint64_t offset, uint64_t size)
+{
+    strncpy (r->segname, segname, 16);
+    if (sectname)
+        strncpy (r->sectname, sectname, 16);
+    r->offset = offset;
+    r->size = size;
+
+    // regions that fall outside the mapping fail to hash rather than read past it
+    if (!size)
+        *view = lh_view_create ("", 0, NULL);
+    else if (offset > UINT32_MAX)
+        *view = LH_VIEW_NULL;
+    else
+        *view = macho_get_view (macho, (uint32_t) offset, size);
+}
+
+
+/**
+ *  Hash every segment, followed by its sections, in a single batch. The
+ *  regions are hashed in parallel from the mapping, so nothing is read
+ *  twice from disk and nothing is copied.
+ *
+ *  @param          macho to hash, 32 or 64 bit.
+ *  @param          type of hash.
+ *  @param          count is set to the number of regions.
+ *
+ *  @returns        malloc()'d array of regions, or NULL on failure.
+ */
+macho_region_hash_t *macho_hash_regions (void *macho, lh_hash_type_t type, int *count)
+{
+    macho_t *tmp = (macho_t *) macho;
+    macho_region_hash_t *regions;
+    lh_view_t *views;
+    lh_hash_t *hashes;
+    int is32, n = 0, total = 0;
+
+    if (!tmp || !tmp->header || !count)
+        return NULL;
+    is32 = (tmp->header->magic == MACH_MAGIC_32);
+
+    // count the segments and sections first, so there's a single allocation
+    for (HSList *l = tmp->scmds; l; l = l->next) {
+        total++;
+        total += (is32) ? h_slist_length (((mach_segment_info_32_t *) l->data)->sects)
+                        : h_slist_length (((mach_segment_info_t *) l->data)->sects);
+    }
+
+    regions = calloc (total ? total : 1, sizeof (macho_region_hash_t));
+    views = calloc (total ? total : 1, sizeof (lh_view_t));
+    hashes = calloc (total ? total : 1, sizeof (lh_hash_t));
+    if (!regions || !views || !hashes)
+        goto hash_failed;
+
+    for (HSList *l = tmp->scmds; l; l = l->next) {
+        if (is32) {
+            mach_segment_info_32_t *info = (mach_segment_info_32_t *) l->data;
+            mach_segment_command_32_t *seg = info->segcmd;
+
+            macho_hash_region_set (&regions[n], &views[n], tmp, seg->segname, NULL, seg->fileoff, seg->filesize);
+            n++;
+
+            for (HSList *s = info->sects; s; s = s->next, n++) {
+                mach_section_32_t *sect = (mach_section_32_t *) s->data;
+                uint64_t size = (macho_hash_is_zerofill (sect->flags)) ? 0 : sect->size;
+                macho_hash_region_set (&regions[n], &views[n], tmp, seg->segname, sect->sectname, sect->offset, size);
+            }
+        } else {
+            mach_segment_info_t *info = (mach_segment_info_t *) l->data;
+            mach_segment_command_64_t *seg = info->segcmd;
+
+            macho_hash_region_set (&regions[n], &views[n], tmp, seg->segname, NULL, seg->fileoff, seg->filesize);
+            n++;
+
+            for (HSList *s = info->sects; s; s = s->next, n++) {
+                mach_section_64_t *sect = (mach_section_64_t *) s->data;
+                uint64_t size = (macho_hash_is_zerofill (sect->flags)) ? 0 : sect->size;
+                macho_hash_region_set (&regions[n], &views[n], tmp, seg->segname, sect->sectname, sect->offset, size);
+            }
+        }
+    }
+
+    if (!lh_hash_views (views, n, type, hashes)) {
+        errorf ("macho_hash_regions(): a region lies outside of the Mach-O\n");
+        goto hash_failed;
+    }
+
+    for (int i = 0; i < n; i++)
+        regions[i].hash = hashes[i];
+
+    free (views);
+    free (hashes);
+    *count = n;
+    return regions;
+
+hash_failed:
+    free (regions);
+    free (views);
+    free (hashes);
+    return NULL;
+}
@@ -0,0 +1,663 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Mach-O Parse Index                     								 --*/
+//===-----------------------------------------------------------------------===//
+
+#define INDEX_ALIGN(x)          (((x) + 7) & ~((uint64_t) 7))
+
+/**
+ *  Identity of a binary: if any of these change, the index is stale.
+ *
+ */
+struct __libhelper_index_key {
+    uint8_t         uuid[16];
+    uint64_t        size;
+    int64_t         mtime;
+};
+
+static void index_key_from_stat (const char *path, struct __libhelper_index_key *key)
+{
+    struct stat st;
+
+    if (path && !stat (path, &st)) {
+        key->size = (uint64_t) st.st_size;
+        key->mtime = (int64_t) st.st_mtime;
+    }
+}
+
+
+/**
+ *  Find the LC_UUID of a thin Mach-O without parsing it, walking only the
+ *  load commands with bounds checks.
+ *
+ */
+static void index_key_read_uuid (file_t *f, uint8_t uuid[16])
+{
+    lh_view_t view = lh_view_create (f->data, f->size, f);
+    uint32_t magic, ncmds, offset, cmd, cmdsize;
+    int swapped;
+
+    memset (uuid, '\0', 16);
+    if (!lh_view_read_u32 (view, 0, &magic))
+        return;
+
+    swapped = (magic == MACH_CIGAM_64 || magic == MACH_CIGAM_32);
+    if (swapped)
+        magic = OSSwapInt32 (magic);
+    if (magic != MACH_MAGIC_64 && magic != MACH_MAGIC_32)
+        return;
+    if (!lh_view_read_u32 (view, offsetof (mach_header_t, ncmds), &ncmds))
+        return;
+    if (swapped)
+        ncmds = OSSwapInt32 (ncmds);
+
+    offset = (magic == MACH_MAGIC_64) ? sizeof (mach_header_t) : sizeof (mach_header_32_t);
+    for (uint32_t i = 0; i < ncmds; i++, offset += cmdsize) {
+        if (!lh_view_read_u32 (view, offset, &cmd) || !lh_view_read_u32 (view, offset + 4, &cmdsize))
+            return;
+        if (swapped) {
+            cmd = OSSwapInt32 (cmd);
+            cmdsize = OSSwapInt32 (cmdsize);
+        }
+        if (cmdsize < 8)
+            return;
+
+        if (cmd == LC_UUID) {
+            const void *ptr = lh_view_ptr (view, offset + 8, 16);
+            if (ptr)
+                memcpy (uuid, ptr, 16);
+            return;
+        }
+    }
+}
+
+
+/**
+ *  The default index location: `<binary>.lhindex` next to the binary, or
+ *  `<cache_dir>/<UUID>-<size>.lhindex` when a cache directory is given,
+ *  with the UUID formatted by `mach_lc_uuid_format()`.
+ *
+ */
+static char *index_path (const char *binary, const char *cache_dir, const struct __libhelper_index_key *key,
+                         char *buf, size_t len)
+{
+    int n;
+
+    if (!cache_dir) {
+        n = snprintf (buf, len, "%s%s", binary, MACHO_INDEX_EXTENSION);
+    } else {
+        char uuid[MACH_UUID_STRLEN];
+        mach_lc_uuid_format (key->uuid, uuid, sizeof (uuid));
+        n = snprintf (buf, len, "%s/%s-%llx%s", cache_dir, uuid, (unsigned long long) key->size, MACHO_INDEX_EXTENSION);
+    }
+
+    return (n > 0 && (size_t) n < len) ? buf : NULL;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Writing                                								 --*/
+//===-----------------------------------------------------------------------===//
+
+struct __libhelper_index_addr {
+    uint64_t        value;
+    uint32_t        index;
+};
+
+static int index_addr_compare (const void *a, const void *b)
+{
+    const struct __libhelper_index_addr *x = a, *y = b;
+    if (x->value != y->value)
+        return (x->value < y->value) ? -1 : 1;
+    return (x->index < y->index) ? -1 : (x->index > y->index);
+}
+
+static void index_bucket_insert (uint32_t *buckets, uint32_t nbuckets, const char *name, uint32_t index)
+{
+    uint32_t b = (uint32_t) lh_hash64 (name, strlen (name), 0) & (nbuckets - 1);
+
+    while (buckets[b])
+        b = (b + 1) & (nbuckets - 1);
+    buckets[b] = index + 1;
+}
+
+
+/**
+ *  Bound the whole symbol table against the mapping once, so entries can be
+ *  read from it without a check each. Returns NULL if it doesn't fit.
+ *
+ */
+static const unsigned char *index_symbol_table (macho_t *macho, mach_symtab_command_t *symtab, int is32)
+{
+    size_t size = (size_t) symtab->nsyms * ((is32) ? 12 : sizeof (nlist));
+    return lh_view_ptr (macho_get_view (macho, symtab->symoff, size), 0, size);
+}
+
+
+/**
+ *  Read symbol `i` from a table returned by `index_symbol_table()`,
+ *  widening 32 bit entries.
+ *
+ */
+static void index_read_nlist (const unsigned char *table, int is32, uint32_t i, nlist *out)
+{
+    if (is32) {
+        // 32 bit nlist has a 32 bit n_value, and is 12 bytes
+        const unsigned char *p = table + ((size_t) i * 12);
+        uint32_t value;
+
+        memcpy (out, p, 8);
+        memcpy (&value, p + 8, 4);
+        out->n_value = value;
+        return;
+    }
+
+    memcpy (out, table + ((size_t) i * sizeof (nlist)), sizeof (nlist));
+}
+
+
+/**
+ *  Flatten a parsed Mach-O into an index file at `path`. The index is
+ *  written to a temporary file first and renamed into place, so readers
+ *  never see a partial index.
+ *
+ *  @returns        MACHO_INDEX_SUCCESS, or MACHO_INDEX_FAILURE.
+ */
+int macho_index_write (void *macho, const char *path)
+{
+    macho_t *tmp = (macho_t *) macho;
+    struct __libhelper_index_key key;
+    struct __libhelper_index_addr *addrs = NULL;
+    mach_symtab_command_t *symtab;
+    mach_uuid_command_t *uuid;
+    macho_index_header_t hdr;
+    unsigned char *buf = NULL;
+    const unsigned char *symbols = NULL;
+    char tmppath[1024];
+    int is32, res = MACHO_INDEX_FAILURE;
+    uint32_t nsyms = 0, naddrs = 0, nsects = 0, nbuckets = 1;
+    uint64_t strtab_size = 0, size;
+
+    if (!tmp || !tmp->header || !path)
+        return MACHO_INDEX_FAILURE;
+    is32 = (tmp->header->magic == MACH_MAGIC_32);
+
+    memset (&key, '\0', sizeof (key));
+    key.size = (tmp->file) ? tmp->file->size : tmp->size;
+    index_key_from_stat (tmp->path, &key);
+    if ((uuid = mach_lc_find_uuid_cmd (tmp)))
+        memcpy (key.uuid, uuid->uuid, 16);
+
+    // size everything up first, so the index is built in one buffer
+    for (HSList *l = tmp->scmds; l; l = l->next)
+        nsects += h_slist_length (((mach_segment_info_t *) l->data)->sects);
+
+    symtab = mach_lc_find_symtab_cmd (tmp);
+    if (symtab && (symbols = index_symbol_table (tmp, symtab, is32))) {
+        nsyms = symtab->nsyms;
+        for (uint32_t i = 0; i < nsyms; i++) {
+            nlist sym;
+            index_read_nlist (symbols, is32, i, &sym);
+            strtab_size += strlen (mach_symtab_find_symbol_name (tmp, &sym, symtab)) + 1;
+        }
+    }
+    while (nbuckets < nsyms * 2)
+        nbuckets <<= 1;
+
+    memset (&hdr, '\0', sizeof (hdr));
+    memcpy (hdr.magic, MACHO_INDEX_MAGIC, sizeof (MACHO_INDEX_MAGIC));
+    hdr.version = MACHO_INDEX_VERSION;
+    hdr.header_size = sizeof (macho_index_header_t);
+    memcpy (hdr.uuid, key.uuid, 16);
+    hdr.file_size = key.size;
+    hdr.file_mtime = key.mtime;
+    hdr.macho_magic = tmp->header->magic;
+    hdr.cputype = tmp->header->cputype;
+    hdr.cpusubtype = tmp->header->cpusubtype;
+    hdr.filetype = tmp->header->filetype;
+    hdr.ncmds = h_slist_length (tmp->lcmds);
+    hdr.nsegments = h_slist_length (tmp->scmds);
+    hdr.nsections = nsects;
+    hdr.nsymbols = nsyms;
+    hdr.nbuckets = nbuckets;
+
+    hdr.cmds_off = INDEX_ALIGN (sizeof (hdr));
+    hdr.segments_off = INDEX_ALIGN (hdr.cmds_off + (uint64_t) hdr.ncmds * sizeof (macho_index_command_t));
+    hdr.sections_off = INDEX_ALIGN (hdr.segments_off + (uint64_t) hdr.nsegments * sizeof (macho_index_segment_t));
+    hdr.symbols_off = INDEX_ALIGN (hdr.sections_off + (uint64_t) hdr.nsections * sizeof (macho_index_section_t));
+    hdr.buckets_off = INDEX_ALIGN (hdr.symbols_off + (uint64_t) nsyms * sizeof (macho_index_symbol_t));
+    hdr.addrs_off = INDEX_ALIGN (hdr.buckets_off + (uint64_t) nbuckets * sizeof (uint32_t));
+    hdr.strtab_off = INDEX_ALIGN (hdr.addrs_off + (uint64_t) nsyms * sizeof (uint32_t));
+    hdr.strtab_size = strtab_size;
+    size = hdr.strtab_off + strtab_size;
+
+    buf = calloc (1, size);
+    addrs = calloc (nsyms ? nsyms : 1, sizeof (struct __libhelper_index_addr));
+    if (!buf || !addrs)
+        goto write_out;
+
+    // load commands
+    macho_index_command_t *cmds = (macho_index_command_t *) (buf + hdr.cmds_off);
+    for (HSList *l = tmp->lcmds; l; l = l->next, cmds++) {
+        mach_load_command_info_t *info = (mach_load_command_info_t *) l->data;
+        cmds->cmd = info->lc->cmd;
+        cmds->cmdsize = info->lc->cmdsize;
+        cmds->offset = info->offset;
+        cmds->index = info->index;
+    }
+
+    // segments and sections, 32 bit ones are widened
+    macho_index_segment_t *segs = (macho_index_segment_t *) (buf + hdr.segments_off);
+    macho_index_section_t *sects = (macho_index_section_t *) (buf + hdr.sections_off);
+    uint32_t segindex = 0, sectindex = 0;
+    for (HSList *l = tmp->scmds; l; l = l->next, segindex++) {
+        macho_index_segment_t *seg = &segs[segindex];
+        HSList *sl;
+
+        if (is32) {
+            mach_segment_info_32_t *info = (mach_segment_info_32_t *) l->data;
+            mach_segment_command_32_t *cmd = info->segcmd;
+
+            memcpy (seg->segname, cmd->segname, 16);
+            seg->vmaddr = cmd->vmaddr;
+            seg->vmsize = cmd->vmsize;
+            seg->fileoff = cmd->fileoff;
+            seg->filesize = cmd->filesize;
+            seg->maxprot = cmd->maxprot;
+            seg->initprot = cmd->initprot;
+            seg->flags = cmd->flags;
+            sl = info->sects;
+        } else {
+            mach_segment_info_t *info = (mach_segment_info_t *) l->data;
+            mach_segment_command_64_t *cmd = info->segcmd;
+
+            memcpy (seg->segname, cmd->segname, 16);
+            seg->vmaddr = cmd->vmaddr;
+            seg->vmsize = cmd->vmsize;
+            seg->fileoff = cmd->fileoff;
+            seg->filesize = cmd->filesize;
+            seg->maxprot = cmd->maxprot;
+            seg->initprot = cmd->initprot;
+            seg->flags = cmd->flags;
+            sl = info->sects;
+        }
+
+        seg->first_section = sectindex;
+        for (; sl; sl = sl->next, sectindex++) {
+            macho_index_section_t *sect = &sects[sectindex];
+
+            if (is32) {
+                mach_section_32_t *s = (mach_section_32_t *) sl->data;
+                memcpy (sect->sectname, s->sectname, 16);
+                memcpy (sect->segname, s->segname, 16);
+                sect->addr = s->addr;
+                sect->size = s->size;
+                sect->offset = s->offset;
+                sect->align = s->align;
+                sect->flags = s->flags;
+            } else {
+                mach_section_64_t *s = (mach_section_64_t *) sl->data;
+                memcpy (sect->sectname, s->sectname, 16);
+                memcpy (sect->segname, s->segname, 16);
+                sect->addr = s->addr;
+                sect->size = s->size;
+                sect->offset = s->offset;
+                sect->align = s->align;
+                sect->flags = s->flags;
+            }
+            sect->segment = segindex;
+            seg->nsects++;
+        }
+    }
+
+    // symbols, the name hash and the address index
+    macho_index_symbol_t *syms = (macho_index_symbol_t *) (buf + hdr.symbols_off);
+    uint32_t *buckets = (uint32_t *) (buf + hdr.buckets_off);
+    char *strtab = (char *) (buf + hdr.strtab_off);
+    uint64_t stroff = 0;
+
+    for (uint32_t i = 0; i < nsyms; i++) {
+        nlist sym;
+        index_read_nlist (symbols, is32, i, &sym);
+
+        const char *name = mach_symtab_find_symbol_name (tmp, &sym, symtab);
+        size_t len = strlen (name) + 1;
+
+        syms[i].value = sym.n_value;
+        syms[i].name = (uint32_t) stroff;
+        syms[i].type = sym.n_type;
+        syms[i].sect = sym.n_sect;
+        syms[i].desc = sym.n_desc;
+
+        memcpy (strtab + stroff, name, len);
+        stroff += len;
+
+        index_bucket_insert (buckets, nbuckets, name, i);
+
+        // only symbols defined in a section have a meaningful address
+        if (!(sym.n_type & N_STAB) && (sym.n_type & N_TYPE) == N_SECT) {
+            addrs[naddrs].value = sym.n_value;
+            addrs[naddrs].index = i;
+            naddrs++;
+        }
+    }
+
+    qsort (addrs, naddrs, sizeof (struct __libhelper_index_addr), index_addr_compare);
+    uint32_t *addr_index = (uint32_t *) (buf + hdr.addrs_off);
+    for (uint32_t i = 0; i < naddrs; i++)
+        addr_index[i] = addrs[i].index;
+
+    hdr.naddrs = naddrs;
+    memcpy (buf, &hdr, sizeof (hdr));
+
+    // write next to the destination and rename, so the swap is atomic
+    snprintf (tmppath, sizeof (tmppath), "%s.%d.tmp", path, (int) getpid ());
+    if ((uint64_t) file_write_new (tmppath, buf, size) != size || rename (tmppath, path)) {
+        errorf ("macho_index_write(): could not write index: %s\n", path);
+        remove (tmppath);
+        goto write_out;
+    }
+    res = MACHO_INDEX_SUCCESS;
+
+write_out:
+    free (addrs);
+    free (buf);
+    return res;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Reading                                								 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Check a table lies within the index. Counts are 32 bit, so the multiply
+ *  can't overflow.
+ *
+ */
+static int index_table_valid (file_t *f, uint64_t off, uint64_t count, uint64_t entsize)
+{
+    return (off % 8 == 0 && off <= f->size && count * entsize <= f->size - off);
+}
+
+
+/**
+ *  Map an index and check it against a binary that is already mapped. The
+ *  index takes the binary's mapping on success, on failure it is left to
+ *  the caller.
+ *
+ */
+static macho_index_t *index_open (const char *path, file_t *bin, const struct __libhelper_index_key *key)
+{
+    macho_index_t *index = NULL;
+    const macho_index_header_t *hdr;
+    file_t *f;
+
+    // a missing index is the normal case for a cold cache, so stay quiet
+    if (!path || access (path, R_OK))
+        return NULL;
+
+    f = file_load (path);
+    if (!f)
+        return NULL;
+
+    hdr = (const macho_index_header_t *) f->data;
+    if (f->size < sizeof (macho_index_header_t) || memcmp (hdr->magic, MACHO_INDEX_MAGIC, sizeof (MACHO_INDEX_MAGIC)) ||
+        hdr->version != MACHO_INDEX_VERSION || hdr->header_size != sizeof (macho_index_header_t)) {
+        debugf ("macho_index_open(): %s is not a valid index\n", path);
+        goto open_failed;
+    }
+
+    if (!index_table_valid (f, hdr->cmds_off, hdr->ncmds, sizeof (macho_index_command_t)) ||
+        !index_table_valid (f, hdr->segments_off, hdr->nsegments, sizeof (macho_index_segment_t)) ||
+        !index_table_valid (f, hdr->sections_off, hdr->nsections, sizeof (macho_index_section_t)) ||
+        !index_table_valid (f, hdr->symbols_off, hdr->nsymbols, sizeof (macho_index_symbol_t)) ||
+        !index_table_valid (f, hdr->buckets_off, hdr->nbuckets, sizeof (uint32_t)) ||
+        !index_table_valid (f, hdr->addrs_off, hdr->naddrs, sizeof (uint32_t)) ||
+        hdr->strtab_off > f->size || hdr->strtab_size > f->size - hdr->strtab_off ||
+        !hdr->nbuckets || (hdr->nbuckets & (hdr->nbuckets - 1))) {
+        warningf ("macho_index_open(): %s is corrupt\n", path);
+        goto open_failed;
+    }
+
+    if (key && (key->size != hdr->file_size || key->mtime != hdr->file_mtime || memcmp (key->uuid, hdr->uuid, 16))) {
+        debugf ("macho_index_open(): %s is stale\n", path);
+        goto open_failed;
+    }
+
+    index = calloc (1, sizeof (macho_index_t));
+    if (!index)
+        goto open_failed;
+
+    index->file = f;
+    index->binary = bin;
+    index->header = hdr;
+    index->cmds = (const macho_index_command_t *) (f->data + hdr->cmds_off);
+    index->segments = (const macho_index_segment_t *) (f->data + hdr->segments_off);
+    index->sections = (const macho_index_section_t *) (f->data + hdr->sections_off);
+    index->symbols = (const macho_index_symbol_t *) (f->data + hdr->symbols_off);
+    index->buckets = (const uint32_t *) (f->data + hdr->buckets_off);
+    index->addrs = (const uint32_t *) (f->data + hdr->addrs_off);
+    index->strtab = file_get_view (f, hdr->strtab_off, hdr->strtab_size);
+    return index;
+
+open_failed:
+    file_free (f);
+    return NULL;
+}
+
+
+/**
+ *  Map an index. When `binary` is given it is mapped as well, and the index
+ *  is only returned if it still matches the binary's UUID, size and mtime.
+ *
+ *  @returns        the index, or NULL if it is missing, corrupt or stale.
+ */
+macho_index_t *macho_index_open (const char *path, const char *binary)
+{
+    struct __libhelper_index_key key;
+    macho_index_t *index;
+    file_t *bin = NULL;
+
+    if (binary) {
+        if (!path || access (path, R_OK) || !(bin = file_load (binary)))
+            return NULL;
+
+        memset (&key, '\0', sizeof (key));
+        index_key_from_stat (binary, &key);
+        index_key_read_uuid (bin, key.uuid);
+    }
+
+    index = index_open (path, bin, (bin) ? &key : NULL);
+    if (!index)
+        file_free (bin);
+    return index;
+}
+
+
+/**
+ *  Open the index for a binary, building it first if it is missing or
+ *  stale. With a NULL `cache_dir` the index lives next to the binary.
+ *
+ *  Binaries without an LC_UUID can't be told apart in a shared cache
+ *  directory, so their index is built in the cache directory and unlinked
+ *  once it is mapped, rather than kept.
+ *
+ */
+macho_index_t *macho_index_open_cached (const char *binary, const char *cache_dir)
+{
+    static const uint8_t nouuid[16] = { 0 };
+    struct __libhelper_index_key key;
+    macho_index_t *index = NULL;
+    macho_t *macho;
+    char path[1024];
+    int keep = 1, n;
+    file_t *bin;
+
+    if (!binary || !(bin = file_load (binary)))
+        return NULL;
+
+    // the binary is mapped once, for the key, the build and the index
+    memset (&key, '\0', sizeof (key));
+    index_key_from_stat (binary, &key);
+    index_key_read_uuid (bin, key.uuid);
+
+    if (cache_dir && !memcmp (key.uuid, nouuid, 16)) {
+        debugf ("macho_index_open_cached(): %s has no LC_UUID, not caching its index\n", binary);
+        n = snprintf (path, sizeof (path), "%s/%d%s.tmp", cache_dir, (int) getpid (), MACHO_INDEX_EXTENSION);
+        if (n <= 0 || (size_t) n >= sizeof (path))
+            goto cached_out;
+        keep = 0;
+    } else {
+        if (!index_path (binary, cache_dir, &key, path, sizeof (path)))
+            goto cached_out;
+        if ((index = index_open (path, bin, &key)))
+            return index;
+    }
+
+    // cold or stale, parse the binary and write a fresh index
+    macho = macho_load_from_file (bin);
+    if (!macho)
+        goto cached_out;
+
+    if (macho_index_write (macho, path))
+        index = index_open (path, bin, &key);
+    macho_free (macho);
+
+    if (!keep)
+        remove (path);
+
+cached_out:
+    if (!index)
+        file_free (bin);
+    return index;
+}
+
+
+void macho_index_free (macho_index_t *index)
+{
+    if (!index)
+        return;
+
+    file_free (index->binary);
+    file_free (index->file);
+    free (index);
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Lookups                                								 --*/
+//===-----------------------------------------------------------------------===//
+
+const char *macho_index_symbol_name (macho_index_t *index, const macho_index_symbol_t *sym)
+{
+    if (!index || !sym)
+        return NULL;
+    return lh_view_cstr (index->strtab, sym->name);
+}
+
+
+/**
+ *  Find a symbol by name with the name hash. If a name appears more than
+ *  once, the first symbol in the symbol table wins.
+ *
+ */
+const macho_index_symbol_t *macho_index_find_symbol (macho_index_t *index, const char *name)
+{
+    uint32_t nbuckets, b;
+
+    if (!index || !name)
+        return NULL;
+
+    nbuckets = index->header->nbuckets;
+    b = (uint32_t) lh_hash64 (name, strlen (name), 0) & (nbuckets - 1);
+
+    for (uint32_t probes = 0; probes < nbuckets && index->buckets[b]; probes++) {
+        uint32_t i = index->buckets[b] - 1;
+        if (i < index->header->nsymbols) {
+            const char *str = macho_index_symbol_name (index, &index->symbols[i]);
+            if (str && !strcmp (str, name))
+                return &index->symbols[i];
+        }
+        b = (b + 1) & (nbuckets - 1);
+    }
+    return NULL;
+}
+
+
+/**
+ *  Find the symbol with the highest address at or below `addr`.
+ *
+ */
+const macho_index_symbol_t *macho_index_symbol_at (macho_index_t *index, uint64_t addr)
+{
+    const macho_index_symbol_t *best = NULL;
+    uint32_t lo = 0, hi;
+
+    if (!index)
+        return NULL;
+
+    hi = index->header->naddrs;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t i = index->addrs[mid];
+
+        if (i >= index->header->nsymbols)
+            return NULL;
+
+        if (index->symbols[i].value <= addr) {
+            best = &index->symbols[i];
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return best;
+}
+
+
+const macho_index_section_t *macho_index_find_section (macho_index_t *index, const char *segname, const char *sectname)
+{
+    if (!index || !segname || !sectname)
+        return NULL;
+
+    for (uint32_t i = 0; i < index->header->nsections; i++) {
+        const macho_index_section_t *sect = &index->sections[i];
+        if (!strncmp (sect->segname, segname, 16) && !strncmp (sect->sectname, sectname, 16))
+            return sect;
+    }
+    return NULL;
+}
@@ -27,79 +27,6 @@
 #include "libhelper/libhelper.h"
 #include "libhelper/libhelper-macho.h"
 
-/**
- *  Table translating LCs to strings
- */
-struct __libhelper_lc_string {
-    uint32_t         lc;
-    char            *str;
-};
-
-
-static struct __libhelper_lc_string lc_list[] =
-{   
-    { LC_SEGMENT,                       "LC_SEGMENT"                    },
-    { LC_SYMTAB,                        "LC_SYMTAB"                     },
-    { LC_SYMSEG,                        "LC_SYMSEG"                     },
-
-    { LC_THREAD,                        "LC_THREAD"                     },
-    { LC_UNIXTHREAD,                    "LC_UNIXTHREAD"                 },
-    { LC_LOADFVMLIB,                    "LC_LOADFVMLIB"                 },
-    { LC_IDFVMLIB,                      "LC_IDFVMLIB"                   },
-    { LC_IDENT,                         "LC_IDENT"                      },
-    { LC_FVMFILE,                       "LC_FVMFILE"                    },
-    { LC_PREPAGE,                       "LC_PREPAGE"                    },
-    { LC_DYSYMTAB,                      "LC_DYSYMTAB"                   },
-    { LC_LOAD_DYLIB,                    "LC_LOAD_DYLIB"                 },
-    { LC_ID_DYLIB,                      "LC_ID_DYLIB"                   },
-    { LC_LOAD_DYLINKER,                 "LC_LOAD_DYLINKER"              },
-    { LC_ID_DYLINKER,                   "LC_ID_DYLINKER"                },
-    { LC_PREBOUND_DYLIB,                "LC_PREBOUND_DYLIB"             },
-    { LC_ROUTINES,                      "LC_ROUTINES"                   },
-    { LC_SUB_FRAMEWORK,                 "LC_SUB_FRAMEWORK"              },
-    { LC_SUB_UMBRELLA,                  "LC_SUB_UMBRELLA"               },
-    { LC_SUB_CLIENT,                    "LC_SUB_CLIENT"                 },
-    { LC_SUB_LIBRARY,                   "LC_SUB_LIBRARY"                },
-    { LC_TWOLEVEL_HINTS,                "LC_TWOLEVEL_HINTS"             },
-    { LC_PREBIND_CKSUM,                 "LC_PREBIND_CKSUM"              },
-
-    { LC_LOAD_WEAK_DYLIB,               "LC_LOAD_WEAK_DYLIB"            },
-
-    { LC_SEGMENT_64,                    "LC_SEGMENT_64"                 },
-    { LC_ROUTINES_64,                   "LC_ROUTINES_64"                },
-    { LC_UUID,                          "LC_UUID"                       },
-    { LC_RPATH,                         "LC_RPATH"                      },
-    { LC_CODE_SIGNATURE,                "LC_CODE_SIGNATURE"             },
-    { LC_SEGMENT_SPLIT_INFO,            "LC_SEGMENT_SPLIT_INFO"         },
-    { LC_REEXPORT_DYLIB,                "LC_REEXPORT_DYLIB"             },
-    { LC_LAZY_LOAD_DYLIB,               "LC_LAZY_LOAD_DYLIB"            },
-    { LC_ENCRYPTION_INFO,               "LC_ENCRYPTION_INFO"            },
-    { LC_DYLD_INFO,                     "LC_DYLD_INFO"                  },
-    { LC_DYLD_INFO_ONLY,                "LC_DYLD_INFO_ONLY"             },
-    { LC_LOAD_UPWARD_DYLIB,             "LC_LOAD_UPWARD_DYLIB"          },
-    { LC_VERSION_MIN_MACOSX,            "LC_VERSION_MIN_MACOSX"         },
-    { LC_VERSION_MIN_IPHONEOS,          "LC_VERSION_MIN_IPHONEOS"       },
-    { LC_FUNCTION_STARTS,               "LC_FUNCTION_STARTS"            },
-    { LC_DYLD_ENVIRONMENT,              "LC_DYLD_ENVIRONMENT"           },
-    { LC_MAIN,                          "LC_MAIN"                       },
-    { LC_DATA_IN_CODE,                  "LC_DATA_IN_CODE"               },
-    { LC_SOURCE_VERSION,                "LC_SOURCE_VERSION"             },
-    { LC_DYLIB_CODE_SIGN_DRS,           "LC_DYLIB_CODE_SIGN_DRS"        },
-    { LC_ENCRYPTION_INFO_64,            "LC_ENCRYPTION_INFO_64"         },
-    { LC_LINKER_OPTION,                 "LC_LINKER_OPTION"              },
-    { LC_LINKER_OPTIMIZATION_HINT,      "LC_LINKER_OPTIMIZATION_HINT"   },
-    { LC_VERSION_MIN_TVOS,              "LC_VERSION_MIN_TVOS"           },
-    { LC_VERSION_MIN_WATCHOS,           "LC_VERSION_MIN_WATCHOS"        },
-    { LC_NOTE,                          "LC_NOTE"                       },
-    { LC_BUILD_VERSION,                 "LC_BUILD_VERSION"              },
-    { LC_DYLD_EXPORTS_TRIE,             "LC_DYLD_EXPORTS_TRIE"          },
-    { LC_DYLD_CHAINED_FIXUPS,           "LC_DYLD_CHAINED_FIXUPS"        },
-
-    { LC_FILESET_ENTRY,                 "LC_FILESET_ENTRY"              }
-};
-
-#define LIBHELPER_LC_LIST_LEN              (sizeof (lc_list) / sizeof (lc_list[0])) - 1
-
 /**
  * 
  */
@@ -133,22 +60,19 @@ mach_load_command_info_t *mach_load_command_info_load (const char *data, uint32_
 
 
 /**
+ *  Name of a load command, from its descriptor.
  * 
+ *  @returns        static string, "LC_UNKNOWN" for unknown commands.
  */
 char *mach_load_command_get_string (mach_load_command_t *lc)
 {
-    if (!lc->cmd) {
-        debugf ("load-commands.c: mach_load_command_get_string(): lc->cmd not valid\n");
-        goto lc_string_failed;
-    }
+    const mach_lc_descriptor_t *desc = mach_lc_descriptor (lc->cmd);
 
-    for (int i = 0; i < (int) LIBHELPER_LC_LIST_LEN; i++) {
-        struct __libhelper_lc_string *cur = &lc_list[i];
-        if (lc->cmd == cur->lc)
-            return cur->str;
+    if (!desc) {
+        debugf ("load-commands.c: mach_load_command_get_string(): lc->cmd not valid\n");
+        return "LC_UNKNOWN";
     }
-lc_string_failed:
-    return "LC_UNKNOWN";
+    return desc->name;
 }
 
 
@@ -163,11 +87,20 @@ lc_string_failed:
 
 mach_load_command_info_t *mach_lc_find_given_cmd (macho_t *macho, int cmd)
 {
-    uint32_t size = (uint32_t) h_slist_length (macho->lcmds);
-    debugf ("load-commands.c: mach_lc_find_given_cmd(): macho->lcmds size: %d\n", size);
+    debugf ("load-commands.c: mach_lc_find_given_cmd(): macho->lcmds size: %zu\n",
+            (macho->commands) ? macho->commands->len : 0);
+
+    // the commands are in an array, in the same order as lcmds
+    if (macho->commands) {
+        h_array_foreach (macho->commands, mach_load_command_info_t, tmp) {
+            if (tmp->lc->cmd == (uint32_t) cmd)
+                return tmp;
+        }
+        return NULL;
+    }
 
-    for (uint32_t i = 0; i < size; i++) {
-        mach_load_command_info_t *tmp = (mach_load_command_info_t *) h_slist_nth_data (macho->lcmds, (int) i);
+    for (HSList *l = macho->lcmds; l; l = l->next) {
+        mach_load_command_info_t *tmp = (mach_load_command_info_t *) l->data;
         if (tmp->lc->cmd == (uint32_t) cmd)
             return tmp;
     }
@@ -176,42 +109,87 @@ mach_load_command_info_t *mach_lc_find_given_cmd (macho_t *macho, int cmd)
 
 
 /**
- *  Find the LC_SOURCE_VERSION command from a given macho and construct a
- *  mach_source_version_command_t and return it.
+ *  Find a command of type `cmd` and return a pointer to it within the
+ *  Mach-O, provided at least `size` bytes of it are in bounds. Nothing is
+ *  copied or allocated.
+ * 
+ */
+static void *mach_lc_borrow_cmd (macho_t *macho, uint32_t cmd, size_t size)
+{
+    mach_load_command_info_t *cmdinfo = mach_lc_find_given_cmd (macho, cmd);
+    if (!cmdinfo || cmdinfo->lc->cmdsize < size)
+        return NULL;
+
+    return (void *) lh_view_ptr (macho_get_view (macho, cmdinfo->offset, size), 0, size);
+}
+
+
+/**
+ *  Find the LC_SOURCE_VERSION command from a given macho.
  * 
  *  @param          macho to search in
  * 
- *  @returns        mach_source_version_command_t created.
+ *  @returns        mach_source_version_command_t within the Mach-O. This is
+ *                  borrowed from the mapping and must not be freed.
  */
 mach_source_version_command_t *mach_lc_find_source_version_cmd (macho_t *macho)
 {
-    size_t size = sizeof (mach_source_version_command_t);
-    mach_source_version_command_t *ret = malloc (size);
-
-    HSList *cmds = macho->lcmds;
-    for (int i = 0; i < h_slist_length (cmds); i++) {
-        mach_load_command_info_t *tmp = (mach_load_command_info_t *) h_slist_nth_data (cmds, i);
-        if (tmp->lc->cmd == LC_SOURCE_VERSION) {
-            ret = (mach_source_version_command_t *) macho_load_bytes (macho, size, tmp->offset);
-            
-            if (!ret) {
-                debugf ("[*] Error: Failed to load LC_SOURCE_VERSION command from offset: 0x%llx\n");
-                return NULL;
-            } else {
-                return ret;
-            }
-        }
-    }
+    mach_source_version_command_t *ret = 
+        mach_lc_borrow_cmd (macho, LC_SOURCE_VERSION, sizeof (mach_source_version_command_t));
 
-    return NULL;
+    if (!ret)
+        debugf ("load-commands.c: mach_lc_find_source_version_cmd(): no LC_SOURCE_VERSION command\n");
+    return ret;
 }
 
 /**
+ *  Load a string that is stored within a load command, for example a dylib
+ *  or dylinker name. The string is returned in-place, and only if it is
+ *  NUL-terminated before the end of the command.
  * 
+ *  @returns        pointer into the Mach-O, or NULL. Must not be freed.
  */
 char *mach_lc_load_str (macho_t *macho, uint32_t cmdsize, uint32_t struct_size, off_t cmd_offset, off_t str_offset)
 {
-    return macho_load_bytes (macho, cmdsize - struct_size, cmd_offset + str_offset);
+    if (str_offset < (off_t) struct_size || str_offset >= (off_t) cmdsize)
+        return NULL;
+
+    lh_view_t cmd = macho_get_view (macho, (uint32_t) cmd_offset, cmdsize);
+    return (char *) lh_view_cstr (cmd, (size_t) str_offset);
+}
+
+
+/**
+ *  Format a packed A.B.C.D.E source version into `buf`. Trailing zero
+ *  components are dropped, down to A.B.
+ *
+ *  @param          version from a LC_SOURCE_VERSION command
+ *  @param          buf to write to, MACH_SOURCE_VERSION_STRLEN is always enough
+ *  @param          len of buf
+ *
+ *  @returns        buf, or NULL if it was too small.
+ */
+char *mach_lc_source_version_format (uint64_t version, char *buf, size_t len)
+{
+    unsigned long long a, b, c, d, e;
+    int n;
+
+    a = (version >> 40) & 0xffffff;
+    b = (version >> 30) & 0x3ff;
+    c = (version >> 20) & 0x3ff;
+    d = (version >> 10) & 0x3ff;
+    e = version & 0x3ff;
+
+    if (e != 0)
+        n = snprintf (buf, len, "%llu.%llu.%llu.%llu.%llu", a, b, c, d, e);
+    else if (d != 0)
+        n = snprintf (buf, len, "%llu.%llu.%llu.%llu", a, b, c, d);
+    else if (c != 0)
+        n = snprintf (buf, len, "%llu.%llu.%llu", a, b, c);
+    else
+        n = snprintf (buf, len, "%llu.%llu", a, b);
+
+    return (n < 0 || (size_t) n >= len) ? NULL : buf;
 }
 
 
@@ -220,39 +198,128 @@ char *mach_lc_load_str (macho_t *macho, uint32_t cmdsize, uint32_t struct_size,
  * 
  *  @param          svc command
  * 
- *  @returns        unpacked version string.
+ *  @returns        unpacked version string, which the caller must free. Use
+ *                  mach_lc_source_version_format() to avoid the allocation.
  */
 char *mach_lc_source_version_string (mach_source_version_command_t *svc)
 {
-    char *ret = malloc(20);
-    uint64_t a, b, c, d, e;
+    char *ret;
 
     if (svc->cmdsize != sizeof(mach_source_version_command_t)) {
         debugf ("Incorrect size\n");
     }
 
-    a = (svc->version >> 40) & 0xffffff;
-    b = (svc->version >> 30) & 0x3ff;
-    c = (svc->version >> 20) & 0x3ff;
-    d = (svc->version >> 10) & 0x3ff;
-    e = svc->version & 0x3ff;
-
-    if (e != 0) {
-        snprintf (ret, 20, "%llu.%llu.%llu.%llu.%llu", a, b, c, d, e);
-    } else if (d != 0) {
-        snprintf (ret, 16, "%llu.%llu.%llu.%llu", a, b, c, d);
-    } else if (c != 0) {
-        snprintf (ret, 12, "%llu.%llu.%llu", a, b, c);
-    } else {
-        snprintf (ret, 8, "%llu.%llu", a, b);
-    }
-
+    ret = malloc (MACH_SOURCE_VERSION_STRLEN);
+    if (ret)
+        mach_lc_source_version_format (svc->version, ret, MACH_SOURCE_VERSION_STRLEN);
     return ret;
 }
 
 
 /////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ *  Format an X.Y.Z version, encoded as xxxx.yy.zz, into `buf`. The Z
+ *  component is left out when it is zero, as otool does for minos and sdk.
+ *
+ *  @returns        buf, or NULL if it was too small.
+ */
+char *mach_lc_version_format (uint32_t vers, char *buf, size_t len)
+{
+    int n;
+
+    if (vers & 0xff)
+        n = snprintf (buf, len, "%u.%u.%u", vers >> 16, (vers >> 8) & 0xff, vers & 0xff);
+    else
+        n = snprintf (buf, len, "%u.%u", vers >> 16, (vers >> 8) & 0xff);
+
+    return (n < 0 || (size_t) n >= len) ? NULL : buf;
+}
+
+
+static char *mach_platform_names[] = {
+    [PLATFORM_MACOS]                = "macOS",
+    [PLATFORM_IOS]                  = "iOS",
+    [PLATFORM_TVOS]                 = "TvOS",
+    [PLATFORM_WATCHOS]              = "WatchOS",
+    [PLATFORM_BRIDGEOS]             = "BridgeOS",
+    [PLATFORM_MACCATALYST]          = "macOS Catalyst",
+    [PLATFORM_IOSSIMULATOR]         = "iOS Simulator",
+    [PLATFORM_TVOSSIMULATOR]        = "TvOS Simulator",
+    [PLATFORM_WATCHOSSIMULATOR]     = "WatchOS Simulator",
+    [PLATFORM_DRIVERKIT]            = "DriverKit",
+};
+
+static char *mach_tool_names[] = {
+    [TOOL_CLANG]                    = "Clang",
+    [TOOL_SWIFT]                    = "Swift",
+    [TOOL_LD]                       = "LD",
+};
+
+/**
+ *  Name of a LC_BUILD_VERSION platform.
+ *
+ *  @returns        static string, "(null)" if the platform is unknown.
+ */
+char *mach_lc_platform_string (uint32_t platform)
+{
+    if (platform >= sizeof (mach_platform_names) / sizeof (char *) || !mach_platform_names[platform])
+        return "(null)";
+    return mach_platform_names[platform];
+}
+
+
+/**
+ *  Name of a LC_BUILD_VERSION build tool.
+ *
+ *  @returns        static string, "(null)" if the tool is unknown.
+ */
+char *mach_lc_build_tool_string (uint32_t tool)
+{
+    if (tool >= sizeof (mach_tool_names) / sizeof (char *) || !mach_tool_names[tool])
+        return "(null)";
+    return mach_tool_names[tool];
+}
+
+
+/**
+ *  Decode the build tools that follow a LC_BUILD_VERSION command into a
+ *  caller provided array. The tool names are static strings, so nothing
+ *  is allocated.
+ *
+ *  @param          macho containing the LC
+ *  @param          bvc command
+ *  @param          offset of the LC in the Mach-O
+ *  @param          tools to fill, or NULL to only count them
+ *  @param          max number of entries in tools
+ *
+ *  @returns        number of tools in the command that lie within the
+ *                  Mach-O, which may be more than `max`.
+ */
+uint32_t mach_lc_build_version_tools (macho_t *macho, mach_build_version_command_t *bvc, off_t offset,
+                                      build_tool_info_t *tools, uint32_t max)
+{
+    const struct build_tool_version *btv;
+    lh_view_t map = macho_get_mapping (macho);
+    uint64_t start = (uint64_t) offset + sizeof (mach_build_version_command_t);
+    uint32_t ntools = bvc->ntools;
+
+    if (start > map.size)
+        return 0;
+    if (ntools > (map.size - start) / sizeof (struct build_tool_version)) {
+        ntools = (uint32_t) ((map.size - start) / sizeof (struct build_tool_version));
+        warningf ("mach_lc_build_version_tools(): build tool %u is out of bounds\n", ntools);
+    }
+
+    btv = (const struct build_tool_version *) (map.data + start);
+    for (uint32_t i = 0; tools && i < ntools && i < max; i++) {
+        tools[i].tool = mach_lc_build_tool_string (btv[i].tool);
+        tools[i].version = btv[i].version;
+    }
+    return ntools;
+}
+
+
 /**
  *  Constructs a `mach_build_version_info_t` structure.
  * 
@@ -264,114 +331,78 @@ char *mach_lc_source_version_string (mach_source_version_command_t *svc)
  */
 mach_build_version_info_t *mach_lc_build_version_info (mach_build_version_command_t *bvc, off_t offset, macho_t *macho)
 {
-    mach_build_version_info_t *ret = malloc (sizeof(mach_build_version_info_t));
+    mach_build_version_info_t *ret = calloc (1, sizeof(mach_build_version_info_t));
+    build_tool_info_t *tools;
 
-    // platform
-    switch (bvc->platform) {
-        case PLATFORM_MACOS:
-            ret->platform = "macOS";
-            break;
-        case PLATFORM_IOS:
-            ret->platform = "iOS";
-            break;
-        case PLATFORM_TVOS:
-            ret->platform = "TvOS";
-            break;
-        case PLATFORM_WATCHOS:
-            ret->platform = "WatchOS";
-            break;
-        case PLATFORM_BRIDGEOS:
-            ret->platform = "BridgeOS";
-            break;
-        case PLATFORM_MACCATALYST:
-            ret->platform = "macOS Catalyst";
-            break;
-        case PLATFORM_IOSSIMULATOR:
-            ret->platform = "iOS Simulator";
-            break;
-        case PLATFORM_TVOSSIMULATOR:
-            ret->platform = "TvOS Simulator";
-            break;
-        case PLATFORM_WATCHOSSIMULATOR:
-            ret->platform = "WatchOS Simulator";
-            break;
-        case PLATFORM_DRIVERKIT:
-            ret->platform = "DriverKit";
-            break;
-        default:
-            ret->platform = "(null)";
-            break;
-    }
+    if (!ret)
+        return NULL;
 
-    // minos
-    char *minos_tmp = malloc (10);
-    if ((bvc->minos & 0xff) == 0) {
-        snprintf (minos_tmp, 10, "%u.%u", bvc->minos >> 16, (bvc->minos >> 8) & 0xff);
-    } else {
-        snprintf (minos_tmp, 10, "%u.%u", bvc->minos >> 16, (bvc->minos >> 8) & 0xff);
-    }
-    ret->minos = minos_tmp;
-
-    // sdk
-    char *sdk_tmp = malloc (10);
-    if (bvc->sdk == 0) {
-        sdk_tmp = "(null)";
-    } else {
-        if ((bvc->sdk & 0xff) == 0) {
-            snprintf (sdk_tmp, 10, "%u.%u", bvc->sdk >> 16, (bvc->sdk >> 8) & 0xff);
-        } else {
-            snprintf (sdk_tmp, 10, "%u.%u.%u", bvc->sdk >> 16, (bvc->sdk >> 8) & 0xff, bvc->sdk & 0xff);
-        }
+    ret->cmd = bvc;
+    ret->platform = mach_lc_platform_string (bvc->platform);
+    mach_lc_version_format (bvc->minos, ret->minos, sizeof (ret->minos));
+
+    if (bvc->sdk == 0)
+        strncpy (ret->sdk, "(null)", sizeof (ret->sdk));
+    else
+        mach_lc_version_format (bvc->sdk, ret->sdk, sizeof (ret->sdk));
+
+    // tools are decoded in one go, then each list node gets its own copy,
+    // as callers free the nodes' data one at a time
+    ret->ntools = mach_lc_build_version_tools (macho, bvc, offset, NULL, 0);
+    ret->tools = NULL;
+    if (!ret->ntools)
+        return ret;
+
+    tools = malloc (ret->ntools * sizeof (build_tool_info_t));
+    if (!tools) {
+        ret->ntools = 0;
+        return ret;
     }
-    ret->sdk = sdk_tmp;
+    mach_lc_build_version_tools (macho, bvc, offset, tools, ret->ntools);
 
-    // tools
-    ret->ntools = bvc->ntools;
-    off_t next_off = offset + sizeof(mach_build_version_command_t);
+    HSList *tail = NULL;
     for (uint32_t i = 0; i < ret->ntools; i++) {
-
-        struct build_tool_version *btv = (struct build_tool_version *) macho_load_bytes (macho, sizeof(struct build_tool_version), next_off);
-        build_tool_info_t *inf = malloc (sizeof(build_tool_info_t));
-
-        switch (btv->tool) {
-            case TOOL_CLANG:
-                inf->tool = "Clang";
-                break;
-            case TOOL_LD:
-                inf->tool = "LD";
-                break;
-            case TOOL_SWIFT:
-                inf->tool = "Swift";
-                break;
-            default:
-                inf->tool = "(null)";
-                break;
+        build_tool_info_t *tool = malloc (sizeof (build_tool_info_t));
+        if (!tool) {
+            ret->ntools = i;
+            break;
         }
-	
-        inf->version = btv->version;
-
-        ret->tools = h_slist_append (ret->tools, inf);
-
-        next_off += sizeof(mach_build_version_command_t);
+        *tool = tools[i];
+        ret->tools = h_slist_append_tail (ret->tools, &tail, tool);
     }
 
+    free (tools);
     return ret;
 }
 
 
 /////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ *  Format a dylib version number, encoded as xxxx.yy.zz, into `buf`.
+ *
+ *  @returns        buf, or NULL if it was too small.
+ */
+char *mach_lc_dylib_version_format (uint32_t vers, char *buf, size_t len)
+{
+    int n = snprintf (buf, len, "%u.%u.%u", vers >> 16, (vers >> 8) & 0xff, vers & 0xff);
+    return (n < 0 || (size_t) n >= len) ? NULL : buf;
+}
+
+
 /**
  *  Construct a Dylib version number.
  * 
  *  @param          compressed version of the dylib
  * 
- *  @return         formatted dylib version
+ *  @return         formatted dylib version, which the caller must free. Use
+ *                  mach_lc_dylib_version_format() to avoid the allocation.
  */
 char *mach_lc_load_dylib_format_version (uint32_t vers)
 {
-    char *buf = malloc(10);
-    snprintf (buf, 10, "%d.%d.%d", vers >> 16, (vers >> 8) & 0xf, vers & 0xf);
+    char *buf = malloc (MACH_VERSION_STRLEN);
+    if (buf)
+        mach_lc_dylib_version_format (vers, buf, MACH_VERSION_STRLEN);
     return buf;
 }
 
@@ -385,23 +416,8 @@ char *mach_lc_load_dylib_format_version (uint32_t vers)
  */
 char *mach_lc_dylib_get_type_string (mach_dylib_command_t *dylib)
 {
-    switch (dylib->cmd) {
-    case LC_ID_DYLIB:
-        return "LC_ID_DYLIB";
-        break;
-    case LC_LOAD_DYLIB:
-        return "LC_LOAD_DYLIB";
-        break;
-    case LC_LOAD_WEAK_DYLIB:
-        return "LC_LOAD_WEAK_DYLIB";
-        break;
-    case LC_REEXPORT_DYLIB:
-        return "LC_REEXPORT_DYLIB";
-        break;
-    default:
-        return "(null)";
-        break;
-    }
+    const mach_lc_descriptor_t *desc = mach_lc_descriptor (dylib->cmd);
+    return (desc && (desc->flags & MACH_LC_DYLIB)) ? desc->name : "(null)";
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -413,11 +429,11 @@ char *mach_lc_dylib_get_type_string (mach_dylib_command_t *dylib)
  *  @param          dylinker command
  *  @param          offset
  * 
- *  @returns        the dynamic linkers name.
+ *  @returns        the dynamic linkers name, borrowed from the Mach-O.
  */
 char *mach_lc_load_dylinker_name (macho_t *macho, mach_dylinker_command_t *dylinker, off_t offset)
 {
-    return macho_load_bytes (macho, dylinker->cmdsize - sizeof(mach_dylinker_command_t), offset + dylinker->offset);
+    return mach_lc_load_str (macho, dylinker->cmdsize, sizeof (mach_dylinker_command_t), offset, dylinker->offset);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -429,43 +445,59 @@ char *mach_lc_load_dylinker_name (macho_t *macho, mach_dylinker_command_t *dylin
  *  @param          filesetentry command
  *  @param          offset
  * 
- *  @returns        the fileset entry command name.
+ *  @returns        the fileset entry command name, borrowed from the Mach-O.
  */
 char *mach_lc_load_fileset_entry_name (macho_t *macho, mach_fileset_entry_t *fileset, off_t offset)
 {
-    return macho_load_bytes (macho, fileset->cmdsize - sizeof (mach_fileset_entry_t), offset + fileset->offset);
+    return mach_lc_load_str (macho, fileset->cmdsize, sizeof (mach_fileset_entry_t), offset, fileset->offset);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
 
 /**
- *  Finds and creates a mach_uuid_command_t from a given mach-o.
+ *  Finds the mach_uuid_command_t in a given mach-o.
  *  
  *  @param          macho containing LC_UUID command
  * 
- *  @returns        mach_uuid_command_t created from given macho.
+ *  @returns        mach_uuid_command_t within the given macho. This is
+ *                  borrowed from the mapping and must not be freed.
  */
 mach_uuid_command_t *mach_lc_find_uuid_cmd (macho_t *macho)
 {
-    size_t size = sizeof (mach_uuid_command_t);
-    mach_uuid_command_t *ret = malloc (size);
-
-    HSList *cmds = macho->lcmds;
-    for (int i = 0; i < h_slist_length (cmds); i++) {
-        mach_load_command_info_t *tmp = (mach_load_command_info_t *) h_slist_nth_data (cmds, i);
-        if (tmp->lc->cmd == LC_UUID) {
-            ret = (mach_uuid_command_t *) macho_load_bytes (macho, size, tmp->offset);
-            
-            if (!ret) {
-                debugf ("mach_lc_find_uuid_cmd(): Failed to load LC_UUID command from offset: 0x%llx\n");
-                return NULL;
-            } else {
-                return ret;
-            }
-        }
-    }
+    mach_uuid_command_t *ret = mach_lc_borrow_cmd (macho, LC_UUID, sizeof (mach_uuid_command_t));
 
-    return NULL;
+    if (!ret)
+        debugf ("load-commands.c: mach_lc_find_uuid_cmd(): no LC_UUID command\n");
+    return ret;
+}
+
+
+/**
+ *  Format a 16 byte UUID into `buf` as upper-case hex, in the usual
+ *  8-4-4-4-12 layout.
+ *
+ *  @param          uuid bytes, for example from a LC_UUID command
+ *  @param          buf to write to, at least MACH_UUID_STRLEN bytes
+ *  @param          len of buf
+ *
+ *  @returns        buf, or NULL if it was too small.
+ */
+char *mach_lc_uuid_format (const uint8_t *uuid, char *buf, size_t len)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t n = 0;
+
+    if (!uuid || !buf || len < MACH_UUID_STRLEN)
+        return NULL;
+
+    for (int i = 0; i < 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10)
+            buf[n++] = '-';
+        buf[n++] = hex[uuid[i] >> 4];
+        buf[n++] = hex[uuid[i] & 0xf];
+    }
+    buf[n] = '\0';
+    return buf;
 }
 
 
@@ -474,66 +506,56 @@ mach_uuid_command_t *mach_lc_find_uuid_cmd (macho_t *macho)
  * 
  *  @param          UUID command
  * 
- *  @returns        Unpacked UUID.
+ *  @returns        Unpacked UUID, which the caller must free. Use
+ *                  mach_lc_uuid_format() to avoid the allocation.
  */
 char *mach_lc_uuid_string (mach_uuid_command_t *uuid)
 {
+    char *ret;
+
     if (uuid->cmdsize != sizeof(mach_uuid_command_t)) {
         debugf ("Incorrect size\n");
         return NULL;
     }
 
-    size_t size = sizeof(uint8_t) * 128;
-    char *ret = malloc (size);
-    snprintf (ret, size, "%02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X",
-                            (unsigned int)uuid->uuid[0], (unsigned int)uuid->uuid[1],
-                            (unsigned int)uuid->uuid[2],  (unsigned int)uuid->uuid[3],
-                            (unsigned int)uuid->uuid[4],  (unsigned int)uuid->uuid[5],
-                            (unsigned int)uuid->uuid[6],  (unsigned int)uuid->uuid[7],
-                            (unsigned int)uuid->uuid[8],  (unsigned int)uuid->uuid[9],
-                            (unsigned int)uuid->uuid[10], (unsigned int)uuid->uuid[11],
-                            (unsigned int)uuid->uuid[12], (unsigned int)uuid->uuid[13],
-                            (unsigned int)uuid->uuid[14], (unsigned int)uuid->uuid[15]);
-
+    ret = malloc (MACH_UUID_STRLEN);
+    if (ret)
+        mach_lc_uuid_format (uuid->uuid, ret, MACH_UUID_STRLEN);
     return ret;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
 
 /**
+ *  Find the LC_SYMTAB command in a given Mach-O. The command is borrowed
+ *  from the mapping and must not be freed.
  * 
  */
 mach_symtab_command_t *mach_lc_find_symtab_cmd (macho_t *macho)
 {
-    size_t size = sizeof (mach_symtab_command_t);
-    mach_symtab_command_t *ret = malloc (size);
-    
-    mach_load_command_info_t *cmdinfo = mach_lc_find_given_cmd (macho, LC_SYMTAB);
-    if (cmdinfo) {
-        ret = (mach_symtab_command_t *) macho_load_bytes (macho, size, cmdinfo->offset);
-    } else {
-        return NULL;
-    }
-
-    return ret;
+    return mach_lc_borrow_cmd (macho, LC_SYMTAB, sizeof (mach_symtab_command_t));
 }
 
 
 /**
+ *  Find the LC_DYSYMTAB command in a given Mach-O. The command is borrowed
+ *  from the mapping and must not be freed.
  * 
  */
 mach_dysymtab_command_t *mach_lc_find_dysymtab_cmd (macho_t *macho)
 {
-    size_t size = sizeof (mach_dysymtab_command_t);
-    mach_dysymtab_command_t *ret = malloc (size);
-    
-    mach_load_command_info_t *cmdinfo = mach_lc_find_given_cmd (macho, LC_SYMTAB);
-    ret = (mach_dysymtab_command_t *) macho_load_bytes (macho, size, cmdinfo->offset);
+    return mach_lc_borrow_cmd (macho, LC_DYSYMTAB, sizeof (mach_dysymtab_command_t));
+}
 
-    debugf ("LC_DYSYMTAB: %d\n", LC_DYSYMTAB);
-    debugf ("test symtab: 0x%llx\n", ret->cmdsize);
 
-    return ret;
+/**
+ *  Find the LC_FUNCTION_STARTS command in a given Mach-O. The command is
+ *  borrowed from the mapping and must not be freed.
+ * 
+ */
+mach_linkedit_data_command_t *mach_lc_find_function_starts_cmd (macho_t *macho)
+{
+    return mach_lc_borrow_cmd (macho, LC_FUNCTION_STARTS, sizeof (mach_linkedit_data_command_t));
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -50,25 +50,26 @@ void *macho_load (const char *filename)
         debugf ("macho.c: reading Mach-O from filename: %s\n", filename);
 
         file = file_load (filename);
-        if (!file) {
-            free (file);
+        if (!file)
             return NULL;
-        }
 
         if (file->size <= 0) {
-            errorf ("macho_load(): file could not be loaded properly: %d", file->size);
-            free (macho);
+            errorf ("macho_load(): file could not be loaded properly: %zu", file->size);
+            file_free (file);
             return NULL;
         } 
 
         debugf ("macho.c: macho_load(): creating Mach-O struct\n");
-        macho = macho_create_from_buffer ((unsigned char *) file_get_data (file, 0));
+        macho = macho_load_from_file (file);
 
         if (macho == NULL) {
             errorf ("macho_load(): error creating macho: macho == NULL\n");
+            file_free (file);
             return NULL;
         }
 
+        // the file was opened here, so it goes with the Mach-O
+        ((macho_t *) macho)->owned = file;
         debugf ("macho.c: macho_load(): all is well\n");
     } else {
         errorf ("macho_load(): no filename specified\n");
@@ -77,8 +78,85 @@ void *macho_load (const char *filename)
 }
 
 
+/**
+ *  Load a Mach-O from an already loaded file, which may wrap an in-memory
+ *  buffer (see `file_from_buffer()`). The file must outlive the Mach-O.
+ * 
+ *  @param          file to parse.
+ * 
+ *  @returns        loaded and parsed `macho_t`.
+ */
+void *macho_load_from_file (file_t *file)
+{
+    macho_t *macho;
+
+    if (!file) {
+        errorf ("macho_load_from_file(): invalid file\n");
+        return NULL;
+    }
+
+    macho = macho_load_from_view (file_get_view (file, 0, file->size));
+    if (macho)
+        macho->path = file->path;
+    return macho;
+}
+
+
+/**
+ *  Load a Mach-O from a view. Nothing is copied, so decompressed payloads
+ *  and slices of larger files can be parsed straight from memory. When the
+ *  view has no backing file, the Mach-O is bounded by the view instead.
+ * 
+ *  @param          view of the Mach-O.
+ * 
+ *  @returns        loaded and parsed `macho_t`.
+ */
+void *macho_load_from_view (lh_view_t view)
+{
+    const uint32_t *magic = lh_view_ptr (view, 0, sizeof (mach_header_32_t));
+    macho_t *macho;
+
+    if (!magic) {
+        errorf ("macho_load_from_view(): view is too small for a Mach-O\n");
+        return NULL;
+    }
+
+    // opposite-endian images are parsed from a swapped copy
+    if (*magic == MACH_CIGAM_64 || *magic == MACH_CIGAM_32) {
+        HArena *arena = h_arena_new (0);
+        unsigned char *data = macho_swap_image (view, arena);
+
+        macho = (data) ? macho_create_from_view (lh_view_create (data, view.size, NULL)) : NULL;
+        if (!macho) {
+            h_arena_free (arena);
+            return NULL;
+        }
+
+        macho->arena = arena;
+        if (macho->size > view.size)
+            macho->size = view.size;
+        return macho;
+    }
+
+    macho = macho_create_from_view (view);
+    if (!macho)
+        return NULL;
+
+    // keep the mapping around so views can be bounded against it
+    macho->file = view.file;
+    if (macho->size > view.size)
+        macho->size = view.size;
+
+    return macho;
+}
+
+
 /**
  *  Generic load a Mach-O from a given data buffer.
+ * 
+ *  Deprecated: the buffer has no known size, so none of the offsets in the
+ *  image can be checked against it. Use `macho_create_from_buffer_sized()`
+ *  or `macho_load_from_view()` instead.
  */
 void *macho_create_from_buffer (unsigned char *data)
 {
@@ -87,10 +165,41 @@ void *macho_create_from_buffer (unsigned char *data)
         errorf ("macho_create_from_buffer(): invalid data\n");
         return NULL;
     }
+    return macho_create_from_view (lh_view_create (data, SIZE_MAX - (uintptr_t) data, NULL));
+}
+
+
+/**
+ *  Generic load a Mach-O from a data buffer of `size` bytes. Every offset
+ *  in the image is validated against `size` before it is parsed.
+ */
+void *macho_create_from_buffer_sized (unsigned char *data, size_t size)
+{
+    // check the data is valid
+    if (!data || !size) {
+        errorf ("macho_create_from_buffer_sized(): invalid data\n");
+        return NULL;
+    }
+    return macho_create_from_view (lh_view_create (data, size, NULL));
+}
+
+
+/**
+ *  Create a Mach-O from a view, validating every offset it contains
+ *  against the size of the view before it is parsed.
+ */
+void *macho_create_from_view (lh_view_t view)
+{
+    unsigned char *data = (unsigned char *) lh_view_ptr (view, 0, sizeof (mach_header_32_t));
+
+    if (!data) {
+        errorf ("macho_create_from_view(): view is too small for a Mach-O\n");
+        return NULL;
+    }
 
     // check if the data is a FAT file
     if (FAT(data)) {
-        errorf ("macho_create_from_buffer(): cannot handle fat archive here\n");
+        errorf ("macho_create_from_buffer(): cannot handle fat archive here, use macho_load_slice()\n");
         return NULL;
     }
 
@@ -98,17 +207,69 @@ void *macho_create_from_buffer (unsigned char *data)
     mach_header_t *hdr = (mach_header_t *) data;
     mach_header_type_t type = mach_header_verify (hdr->magic);
 
+    // the parsers expect host order, see `macho_swap_image()`
+    if (hdr->magic == MACH_CIGAM_64 || hdr->magic == MACH_CIGAM_32) {
+        errorf ("macho_create_from_buffer(): byte swapped Mach-O, use macho_load_from_view()\n");
+        return NULL;
+    }
+
     if (type == MH_TYPE_MACHO64) {
-        return macho_64_create_from_buffer (data);
+        return macho_64_create_from_view (view, 0);
     } else if (type == MH_TYPE_MACHO32) {
-        return macho_32_create_from_buffer (data);
+        return macho_32_create_from_view (view);
     } else {
-        errorf ("macho_create_from_buffer(): cannot handle mach-o magic: 0x%08x\n", data);
+        errorf ("macho_create_from_buffer(): cannot handle mach-o magic: 0x%08x\n", hdr->magic);
         return NULL;
     }
 }
 
 
+/**
+ *  Free a Mach-O from any of the loaders, 32 or 64 bit. Load commands,
+ *  names and section data are borrowed from the mapping, so only the
+ *  parsed lists are released. The file is closed as well when it was
+ *  opened by `macho_load()`, otherwise it belongs to the caller.
+ *
+ */
+void macho_free (void *macho)
+{
+    macho_t *tmp = (macho_t *) macho;
+    HSList *l, *next;
+
+    if (!tmp)
+        return;
+
+    // segment infos have the same layout in both widths
+    for (l = tmp->scmds; l; l = next) {
+        mach_segment_info_t *info = (mach_segment_info_t *) l->data;
+        for (HSList *s = info->sects, *snext; s; s = snext) {
+            snext = s->next;
+            free (s);
+        }
+        free (info);
+        next = l->next;
+        free (l);
+    }
+    for (l = tmp->dylibs; l; l = next) {
+        next = l->next;
+        free (l->data);
+        free (l);
+    }
+    // the command infos themselves live in `commands`
+    for (l = tmp->lcmds; l; l = next) {
+        next = l->next;
+        free (l);
+    }
+    h_array_free (tmp->commands);
+
+    h_arena_free (tmp->arena);
+    file_free (tmp->owned);
+    free (tmp->valid);
+    free (tmp->header);
+    free (tmp);
+}
+
+
 /**
  *  Return the pointer to an offset within a Mach-O
  * 
@@ -120,6 +281,46 @@ void *macho_get_bytes (void *macho, uint32_t offset)
 }
 
 
+/**
+ *  Return a view of everything a Mach-O can address: the rest of the file
+ *  mapping when it was loaded from a file, otherwise the parsed size of
+ *  the image.
+ * 
+ */
+lh_view_t macho_get_mapping (void *macho)
+{
+    macho_t *tmp = (macho_t *) macho;
+
+    if (!tmp || !tmp->data)
+        return LH_VIEW_NULL;
+
+    if (tmp->file && tmp->file->data) {
+        size_t base = (size_t) (tmp->data - tmp->file->data);
+        return lh_view_create (tmp->data, tmp->file->size - base, tmp->file);
+    }
+    return lh_view_create (tmp->data, tmp->size, NULL);
+}
+
+
+/**
+ *  Return a bounded view of `size` bytes at `offset` within a Mach-O. When
+ *  the Mach-O was loaded from a file the view is checked against the file
+ *  mapping, otherwise against the parsed size of the image.
+ * 
+ *  Nothing is copied, so the view is only valid for the lifetime of the
+ *  mapping.
+ * 
+ *  @returns        the view, or an empty view if the range is out of bounds.
+ */
+lh_view_t macho_get_view (void *macho, uint32_t offset, size_t size)
+{
+    lh_view_t ret = LH_VIEW_NULL;
+
+    lh_view_sub (macho_get_mapping (macho), offset, size, &ret);
+    return ret;
+}
+
+
 /**
  *  Duplicate `size` bytes from a given Mach-O into a given buffer.
  * 
@@ -127,13 +328,14 @@ void *macho_get_bytes (void *macho, uint32_t offset)
 void macho_read_bytes (void *macho, uint32_t offset, void *buffer, size_t size)
 {
     macho_t *tmp = (macho_t *) macho;
-    memcpy (buffer, macho_get_bytes (tmp->data, offset), size);
+    memcpy (buffer, macho_get_bytes (tmp, offset), size);
 }
 
 
 
 /**
- *  Load `size` bytes into a malloc()'d buffer and return.
+ *  Load `size` bytes into a malloc()'d buffer and return. Prefer
+ *  `macho_get_view()` unless the caller really needs its own copy.
  * 
  */
 void *macho_load_bytes (void *macho, size_t size, uint32_t offset)
@@ -206,7 +408,7 @@ mach_header_t *mach_header_load (macho_t *macho)
         hdr = mach_header_create ();
 
         // copy bytes from data to hdr
-        memcpy (hdr, &data[0], sizeof (mach_header_t));
+        memcpy (hdr, &data[macho->hdroff], sizeof (mach_header_t));
 
         // verify the magic value was loaded
         if (!hdr->magic) {
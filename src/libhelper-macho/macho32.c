@@ -44,93 +44,128 @@
 /**
  *  Load a 32-bit Mach-O from a given data buffer.
  * 
+ *  Deprecated: the buffer has no known size, so only the consistency of
+ *  the load commands can be checked. Use `macho_32_create_from_view()`.
+ * 
  */
 macho_32_t *macho_32_create_from_buffer (unsigned char *data)
 {
+    return macho_32_create_from_view (lh_view_create (data, SIZE_MAX - (uintptr_t) data, NULL));
+}
+
+
+/**
+ *  Load a 32-bit Mach-O from a view, validating it against the view first.
+ * 
+ */
+macho_32_t *macho_32_create_from_view (lh_view_t view)
+{
+    uint32_t *valid;
+
+    if (!macho_validate (view, 0, &valid))
+        return NULL;
+
     // zero out some memory for macho.
     macho_32_t *macho = calloc (1, sizeof (macho_32_t));
 
-    macho->data = (uint8_t *) data;
+    macho->data = (uint8_t *) view.data;
+    macho->valid = valid;
     macho->offset = 0;
 
     // try to load the header
     macho->header = (mach_header_32_t *) mach_header_load ((macho_t *) macho);
     if (!macho->header) {
         errorf ("macho_32_create_from_buffer() mach header is NULL\n");
+        free (macho->valid);
+        free (macho);
         return NULL;
     }
 
-    uint32_t offset = sizeof (mach_header_32_t);
     HSList *scmds = NULL, *lcmds = NULL, *dylibs = NULL;
+    HSList *scmds_tail = NULL, *lcmds_tail = NULL, *dylibs_tail = NULL;
+    mach_lc_entry_t entry;
+    mach_lc_iter_t it;
+
+    macho->commands = h_array_sized_new (sizeof (mach_load_command_info_t), macho->header->ncmds);
+    if (!macho->commands) {
+        errorf ("macho_32_create_from_buffer() could not allocate %u load commands\n", macho->header->ncmds);
+        free (macho->valid);
+        free (macho->header);
+        free (macho);
+        return NULL;
+    }
+
+    mach_lc_iter_init (&it, macho->data, view.size, 0);
 
     // search through every command
-    for (int i = 0; i < (int) macho->header->ncmds; i++) {
-        mach_load_command_info_t *lc = mach_load_command_info_load ((const char *) macho->data, offset);
-        uint32_t type = lc->lc->cmd;
+    while (mach_lc_iter_next (&it, &entry)) {
+        const mach_lc_descriptor_t *desc;
+        mach_load_command_info_t *lc;
+
+        if (!MACHO_COMMAND_VALID (macho, entry.index))
+            continue;
+
+        desc = mach_lc_descriptor (entry.cmd);
 
-        debugf ("lc: %d, lcsize: %d\n", lc->lc->cmd, lc->lc->cmdsize);
+        debugf ("lc: %d, lcsize: %d\n", entry.cmd, entry.cmdsize);
 
         /**
          *  This follows the same format as in macho64.c, so only different things will
          *  be documented.
          */
-        if (type == LC_SEGMENT) {
+        if (entry.cmd == LC_SEGMENT) {
             // create a segment info struct, which requires 32bit specific functions.
-            mach_segment_info_32_t *seginf = mach_segment_info_32_load (macho->data, offset);
+            mach_segment_info_32_t *seginf = mach_segment_info_32_load (macho->data, entry.offset);
             if (seginf == NULL) {
-                warningf ("macho_32_create_from_buffer(): failed to load LC_SEGMENT at offset: 0x%08x\n", offset);
+                warningf ("macho_32_create_from_buffer(): failed to load LC_SEGMENT at offset: 0x%08x\n", entry.offset);
                 continue;
             }
 
-            scmds = h_slist_append (scmds, seginf);
+            scmds = h_slist_append_tail (scmds, &scmds_tail, seginf);
+            continue;
+        }
+
+        lc = h_array_push (macho->commands, NULL);
+        lc->lc = (mach_load_command_t *) entry.ptr;
+        lc->offset = entry.offset;
+        lc->index = entry.index;
 
-        } else if (type == LC_ID_DYLIB || type == LC_LOAD_DYLIB ||
-                   type == LC_LOAD_WEAK_DYLIB || type == LC_REEXPORT_DYLIB) {
+        if (desc && (desc->flags & MACH_LC_DYLIB)) {
 
             /**
-             * 
+             *  As with 64 bit, the command and the name are borrowed from
+             *  the mapping rather than copied.
              */
-            uint32_t dylib_inf_size = sizeof (mach_dylib_command_info_t);
-            
-            mach_dylib_command_info_t *dylibinfo = malloc (dylib_inf_size);
-            uint32_t cmdsize = lc->lc->cmdsize;
-
-            mach_dylib_command_t *raw = malloc (dylib_inf_size);
-            memcpy (raw, macho->data + offset, dylib_inf_size);
-
-            uint32_t nsize = cmdsize - sizeof (mach_dylib_command_t);
-            uint32_t noff = offset + raw->dylib.offset;
-
-            char *name = malloc (nsize);
-            memcpy (name, macho->data + noff, nsize);
+            mach_dylib_command_info_t *dylibinfo = malloc (sizeof (mach_dylib_command_info_t));
+            mach_dylib_command_t *raw = (mach_dylib_command_t *) entry.ptr;
+            char *name = (char *) entry.ptr + raw->dylib.offset;
             
             // set name, raw cmd struct and type
             dylibinfo->name = name;
             dylibinfo->dylib = raw;
-            dylibinfo->type = lc->lc->cmd;
+            dylibinfo->type = entry.cmd;
 
-            lc->offset = offset;
-
-            dylibs = h_slist_append (dylibs, dylibinfo);
-            lcmds = h_slist_append (lcmds, lc);
-        } else {
-            lc->offset = offset;
-            lcmds = h_slist_append (lcmds, lc);
+            dylibs = h_slist_append_tail (dylibs, &dylibs_tail, dylibinfo);
         }
-        offset += lc->lc->cmdsize;
+
+        lcmds = h_slist_append_tail (lcmds, &lcmds_tail, lc);
     }
 
-    // set macho offset
-    macho->offset = offset;
+    // set macho offset, the end of the last command
+    macho->offset = (uint32_t) it.offset;
 
     // set lists
     macho->lcmds = lcmds;
     macho->scmds = scmds;
     macho->dylibs = dylibs;
 
-    // fix size
-    mach_segment_info_32_t *last_seg = (mach_segment_info_32_t *) h_slist_last (macho->scmds);
-    macho->size = last_seg->segcmd->fileoff + last_seg->segcmd->filesize;
+    // fix size. The image ends where the furthest segment ends in the file.
+    macho->size = macho->offset;
+    for (HSList *l = macho->scmds; l; l = l->next) {
+        mach_segment_command_32_t *seg = ((mach_segment_info_32_t *) l->data)->segcmd;
+        if (seg->fileoff + seg->filesize > macho->size)
+            macho->size = (uint32_t) (seg->fileoff + seg->filesize);
+    }
 
     return macho;
 }
\ No newline at end of file
@@ -42,48 +42,106 @@
 /**
  *  Load a 64-bit Mach-O from a given data buffer.
  * 
+ *  Deprecated: the buffer has no known size, so only the consistency of
+ *  the load commands can be checked. Use `macho_64_create_from_view()`.
+ * 
  */
 macho_t *macho_64_create_from_buffer (unsigned char *data)
 {
+    return macho_64_create_from_view (lh_view_create (data, SIZE_MAX - (uintptr_t) data, NULL), 0);
+}
+
+
+/**
+ *  Load a 64-bit Mach-O whose header sits `hdroff` bytes into `view`. The
+ *  image is validated against the view first, see `macho_validate()`.
+ * 
+ *  A non-zero `hdroff` is how fileset entries are parsed: their load
+ *  commands live with their own header, but every file offset they contain
+ *  is relative to the start of the fileset. Keeping `data` at the start of
+ *  the fileset means those offsets resolve as they are, and load command
+ *  offsets are stored relative to `data` as well.
+ * 
+ */
+macho_t *macho_64_create_from_view (lh_view_t view, uint32_t hdroff)
+{
+    unsigned char *data = (unsigned char *) view.data;
+    uint32_t *valid;
+
+    if (!macho_validate (view, hdroff, &valid))
+        return NULL;
+
     // zero out some memory for macho.
     macho_t *macho = calloc (1, sizeof (macho_t));
 
     macho->data = (uint8_t *) data;
+    macho->hdroff = hdroff;
+    macho->valid = valid;
     macho->offset = 0;
 
     // try to load the mach header, and handle any failure
     macho->header = mach_header_load (macho);
     if (macho->header == NULL) {
         errorf ("macho_create_from_buffer: Mach header is NULL\n");
+        free (macho->valid);
         free (macho);
         return NULL;
     }
 
-    uint32_t offset = sizeof (mach_header_t);
     HSList *scmds = NULL, *lcmds = NULL, *dylibs = NULL;
+    HSList *scmds_tail = NULL, *lcmds_tail = NULL, *dylibs_tail = NULL;
+    mach_lc_entry_t entry;
+    mach_lc_iter_t it;
+
+    // the command infos live in one array, reserved up front so the list
+    //  nodes that point into it never move
+    macho->commands = h_array_sized_new (sizeof (mach_load_command_info_t), macho->header->ncmds);
+    if (!macho->commands) {
+        errorf ("macho_create_from_buffer: could not allocate %u load commands\n", macho->header->ncmds);
+        free (macho->valid);
+        free (macho->header);
+        free (macho);
+        return NULL;
+    }
+
+    mach_lc_iter_init (&it, macho->data, view.size, hdroff);
 
     // we'll search through every load command and sort them
-    for (int i = 0; i < (int) macho->header->ncmds; i++) {
-        mach_load_command_info_t *lc = mach_load_command_info_load ((const char *) macho->data, offset);
-        uint32_t type = lc->lc->cmd;
+    while (mach_lc_iter_next (&it, &entry)) {
+        const mach_lc_descriptor_t *desc;
+        mach_load_command_info_t *lc;
+
+        // commands that failed validation are left out of every list
+        if (!MACHO_COMMAND_VALID (macho, entry.index))
+            continue;
+
+        desc = mach_lc_descriptor (entry.cmd);
 
         /**
          *  Different types of Load Command are sorted into one of the three 
          *  lists defined above: scmds, lcmds and dylibs.
          */
-        if (type == LC_SEGMENT_64) {
+        if (entry.cmd == LC_SEGMENT_64) {
 
             // create a segment info struct, then add to the list
-            mach_segment_info_t *seginf = mach_segment_info_load (macho->data, offset);
+            mach_segment_info_t *seginf = mach_segment_info_load (macho->data, entry.offset);
             if (seginf == NULL) {
-                warningf ("macho_create_from_buffer(): failed to load LC_SEGMENT_64 at offset: 0x%08x\n", offset);
+                warningf ("macho_create_from_buffer(): failed to load LC_SEGMENT_64 at offset: 0x%08x\n", entry.offset);
                 continue;
             }
 
             // add to segments lists
-            scmds = h_slist_append (scmds, seginf);
-        } else if (type == LC_ID_DYLIB || type == LC_LOAD_DYLIB ||
-                   type == LC_LOAD_WEAK_DYLIB || type == LC_REEXPORT_DYLIB) {
+            scmds = h_slist_append_tail (scmds, &scmds_tail, seginf);
+            continue;
+        }
+
+        // set the offset of the command so we can find it again
+        lc = h_array_push (macho->commands, NULL);
+        lc->lc = (mach_load_command_t *) entry.ptr;
+        lc->offset = entry.offset;
+        lc->index = entry.index;
+
+        if (desc && (desc->flags & MACH_LC_DYLIB)) {
             /**
              *  Because a Mach-O  can have multiple dynamically linked libraries which
              *  means there are multiple LC_DYLIB-like commands, so it's easier that
@@ -92,54 +150,41 @@ macho_t *macho_64_create_from_buffer (unsigned char *data)
 
             // dylib info struct
             mach_dylib_command_info_t *dylibinfo = malloc (sizeof (mach_dylib_command_info_t));
-            uint32_t cmdsize = lc->lc->cmdsize;
-
-            // create the raw command
-            mach_dylib_command_t *raw = malloc (sizeof (mach_dylib_command_t));
-            memset (raw, '\0', sizeof (mach_dylib_command_t));
-            memcpy (raw, macho->data + offset, sizeof (mach_dylib_command_t));
 
-            // laod the name of the dylib. This is located after the load command
-            //  and is included in the cmdsize.
-            uint32_t nsize = cmdsize - sizeof(mach_dylib_command_t);
-            uint32_t noff = offset + raw->dylib.offset;
+            // the raw command is borrowed straight from the mapping
+            mach_dylib_command_t *raw = (mach_dylib_command_t *) entry.ptr;
 
-            char *name = malloc (nsize);
-            memset (name, '\0', nsize);
-            memcpy (name, macho->data + noff, nsize);
+            // the name of the dylib is located after the load command and is
+            //  included in the cmdsize. Validation made sure it is terminated
+            //  before the end of the command, so borrow it too.
+            char *name = (char *) entry.ptr + raw->dylib.offset;
 
             // set the name, raw cmd struct and type
             dylibinfo->name = name;
             dylibinfo->dylib = raw;
-            dylibinfo->type = lc->lc->cmd;
+            dylibinfo->type = entry.cmd;
 
-            // add the offset to the load command
-            lc->offset = offset;
-
-            // add them to both lists
-            dylibs = h_slist_append (dylibs, dylibinfo);
-            lcmds = h_slist_append (lcmds, lc);            
-
-        } else {
-            // set the offset of the command so we can find it again
-            lc->offset = offset;
-            lcmds = h_slist_append (lcmds, lc);
+            dylibs = h_slist_append_tail (dylibs, &dylibs_tail, dylibinfo);
         }
 
-        offset += lc->lc->cmdsize;
+        lcmds = h_slist_append_tail (lcmds, &lcmds_tail, lc);
     }
 
-    // set macho offset
-    macho->offset = offset;
+    // set macho offset, the end of the last command
+    macho->offset = (uint32_t) it.offset;
 
     // set LC lists
     macho->lcmds = lcmds;
     macho->scmds = scmds;
     macho->dylibs = dylibs;
 
-    // fix size
-    mach_segment_info_t *last_seg = (mach_segment_info_t *) h_slist_last (macho->scmds);
-    macho->size = last_seg->segcmd->fileoff + last_seg->segcmd->filesize;
+    // fix size. The image ends where the furthest segment ends in the file.
+    macho->size = macho->offset;
+    for (HSList *l = macho->scmds; l; l = l->next) {
+        mach_segment_command_64_t *seg = ((mach_segment_info_t *) l->data)->segcmd;
+        if (seg->fileoff + seg->filesize > macho->size)
+            macho->size = (uint32_t) (seg->fileoff + seg->filesize);
+    }
 
     return macho;
 }
\ No newline at end of file
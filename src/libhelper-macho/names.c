@@ -0,0 +1,165 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#ifndef _POSIX_C_SOURCE
+#   define _POSIX_C_SOURCE  200809L     /* strnlen() */
+#endif
+#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)
+#   define _DARWIN_C_SOURCE
+#endif
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Mach-O Name Interning                 								 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Intern the install name of every dylib the Mach-O loads, in load
+ *  order. With the same pool across a corpus, "who imports X" is a scan
+ *  for one integer.
+ *
+ *  @returns        malloc()'d array of ids, or NULL on failure or if there
+ *                  are no dylibs.
+ */
+uint32_t *macho_intern_dylibs (void *macho, lh_intern_t *pool, uint32_t *count)
+{
+    macho_t *tmp = (macho_t *) macho;
+    uint32_t *ids, n = 0;
+
+    if (!tmp || !pool || !count)
+        return NULL;
+
+    *count = 0;
+    ids = malloc ((h_slist_length (tmp->dylibs) + 1) * sizeof (uint32_t));
+    if (!ids)
+        return NULL;
+
+    for (HSList *l = tmp->dylibs; l; l = l->next) {
+        mach_dylib_command_info_t *info = (mach_dylib_command_info_t *) l->data;
+        if ((ids[n] = lh_intern_cstr (pool, info->name)) != LH_INTERN_NONE)
+            n++;
+    }
+
+    if (!n) {
+        free (ids);
+        return NULL;
+    }
+    *count = n;
+    return ids;
+}
+
+
+/**
+ *  Intern the name of every segment, in load command order. Segment names
+ *  are not always NUL terminated, so at most 16 bytes are taken.
+ *
+ *  @returns        malloc()'d array of ids, or NULL on failure or if there
+ *                  are no segments.
+ */
+uint32_t *macho_intern_segments (void *macho, lh_intern_t *pool, uint32_t *count)
+{
+    macho_t *tmp = (macho_t *) macho;
+    uint32_t *ids, n = 0;
+    int is32;
+
+    if (!tmp || !tmp->header || !pool || !count)
+        return NULL;
+
+    *count = 0;
+    is32 = (tmp->header->magic == MACH_MAGIC_32);
+    ids = malloc ((h_slist_length (tmp->scmds) + 1) * sizeof (uint32_t));
+    if (!ids)
+        return NULL;
+
+    for (HSList *l = tmp->scmds; l; l = l->next) {
+        const char *name = (is32) ? ((mach_segment_info_32_t *) l->data)->segcmd->segname
+                                  : ((mach_segment_info_t *) l->data)->segcmd->segname;
+        if ((ids[n] = lh_intern (pool, name, strnlen (name, 16))) != LH_INTERN_NONE)
+            n++;
+    }
+
+    if (!n) {
+        free (ids);
+        return NULL;
+    }
+    *count = n;
+    return ids;
+}
+
+
+/**
+ *  Intern the name of every symbol, in symbol table order, so `ids[i]` is
+ *  the name of symbol `i`. Symbols whose name lies outside the string
+ *  table get LH_INTERN_NONE.
+ *
+ *  @returns        malloc()'d array of ids, or NULL on failure or if there
+ *                  is no symbol table.
+ */
+uint32_t *macho_intern_symbols (void *macho, lh_intern_t *pool, uint32_t *count)
+{
+    macho_t *tmp = (macho_t *) macho;
+    mach_symtab_command_t *symtab;
+    lh_view_t symbols, strtab;
+    size_t entsize;
+    uint32_t *ids;
+    int is32;
+
+    if (!tmp || !tmp->header || !pool || !count)
+        return NULL;
+
+    *count = 0;
+    symtab = mach_lc_find_symtab_cmd (tmp);
+    if (!symtab || !symtab->nsyms)
+        return NULL;
+
+    // 32 bit nlist has a 32 bit n_value, and is 12 bytes
+    is32 = (tmp->header->magic == MACH_MAGIC_32);
+    entsize = (is32) ? 12 : sizeof (nlist);
+
+    symbols = macho_get_view (tmp, symtab->symoff, (size_t) symtab->nsyms * entsize);
+    strtab = macho_get_view (tmp, symtab->stroff, symtab->strsize);
+    if (!lh_view_ptr (symbols, 0, symbols.size))
+        return NULL;
+
+    ids = malloc ((size_t) symtab->nsyms * sizeof (uint32_t));
+    if (!ids)
+        return NULL;
+
+    for (uint32_t i = 0; i < symtab->nsyms; i++) {
+        uint32_t strx = 0;
+        const char *name;
+
+        lh_view_read_u32 (symbols, (size_t) i * entsize, &strx);
+        name = lh_view_cstr (strtab, strx);
+        ids[i] = (name) ? lh_intern_cstr (pool, name) : LH_INTERN_NONE;
+    }
+
+    *count = symtab->nsyms;
+    return ids;
+}
@@ -0,0 +1,808 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+#include "hlib.h"
+
+#include <unistd.h>
+
+/* indexes a recipe depends on */
+#define MACHO_PF_NEED_STRINGS       0x1
+#define MACHO_PF_NEED_XREFS         0x2
+#define MACHO_PF_NEED_GRAPH         0x4
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Memo                                  									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  A result keyed by a hash of the recipe, or of a string. This is also
+ *  the record written to the disk cache, after the header.
+ *
+ */
+struct __libhelper_pf_entry {
+    uint64_t         key;               /* never zero, zero marks a free slot */
+    uint64_t         addr;
+    uint32_t         step;
+    uint32_t         flags;
+};
+
+struct __libhelper_pf_file_header {
+    char             magic[8];          /* MACHO_PF_MAGIC */
+    uint32_t         version;           /* MACHO_PF_VERSION */
+    uint32_t         count;             /* entries that follow */
+    uint8_t          uuid[16];          /* LC_UUID the results belong to */
+};
+
+/**
+ *  Open addressed on the key, which is already a hash. The table is kept
+ *  at most half full.
+ *
+ */
+struct __libhelper_pf_memo {
+    struct __libhelper_pf_entry     *entries;
+    size_t                           count;
+    size_t                           cap;
+};
+
+static struct __libhelper_pf_entry *pf_memo_find (const struct __libhelper_pf_memo *memo, uint64_t key)
+{
+    size_t b;
+
+    if (!memo->cap)
+        return NULL;
+
+    for (b = key & (memo->cap - 1); memo->entries[b].key; b = (b + 1) & (memo->cap - 1)) {
+        if (memo->entries[b].key == key)
+            return &memo->entries[b];
+    }
+    return NULL;
+}
+
+static int pf_memo_insert (struct __libhelper_pf_memo *memo, const struct __libhelper_pf_entry *entry)
+{
+    struct __libhelper_pf_entry *slot;
+    size_t b;
+
+    if ((slot = pf_memo_find (memo, entry->key))) {
+        *slot = *entry;
+        return 1;
+    }
+
+    if ((memo->count + 1) * 2 > memo->cap) {
+        struct __libhelper_pf_memo grown;
+
+        grown.count = 0;
+        grown.cap = (memo->cap) ? memo->cap * 2 : 64;
+        grown.entries = calloc (grown.cap, sizeof (struct __libhelper_pf_entry));
+        if (!grown.entries)
+            return 0;
+
+        for (size_t i = 0; i < memo->cap; i++) {
+            if (memo->entries[i].key)
+                pf_memo_insert (&grown, &memo->entries[i]);
+        }
+        free (memo->entries);
+        *memo = grown;
+    }
+
+    for (b = entry->key & (memo->cap - 1); memo->entries[b].key; b = (b + 1) & (memo->cap - 1))
+        ;
+    memo->entries[b] = *entry;
+    memo->count++;
+    return 1;
+}
+
+
+static uint64_t pf_string_key (uint32_t op, const char *str)
+{
+    uint64_t key = lh_hash64 (str, strlen (str), op);
+    return (key) ? key : 1;
+}
+
+/**
+ *  Two recipes with the same steps share a result, whatever their names.
+ *
+ */
+static uint64_t pf_recipe_key (const macho_pf_recipe_t *recipe)
+{
+    uint64_t key = MACHO_PF_VERSION;
+
+    for (int i = 0; i < MACHO_PF_MAX_STEPS && recipe->steps[i].op != MACHO_PF_END; i++) {
+        const macho_pf_step_t *step = &recipe->steps[i];
+        uint64_t fixed[3] = { step->op, (uint64_t) (int64_t) step->n, step->value };
+
+        key = lh_hash64 (fixed, sizeof (fixed), key);
+        if (step->str)
+            key = lh_hash64 (step->str, strlen (step->str) + 1, key);
+    }
+    return (key) ? key : 1;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Disk Cache                            									 --*/
+//===-----------------------------------------------------------------------===//
+
+struct __libhelper_pf_cstrings {
+    uint64_t                 vmaddr;
+    const unsigned char     *data;
+    size_t                   size;
+};
+
+struct __libhelper_macho_patchfinder {
+    macho_t                         *macho;
+    int                              nthreads;
+
+    uint8_t                          uuid[16];
+    char                            *path;          /* disk cache, or NULL */
+    int                              dirty;
+
+    struct __libhelper_pf_memo       results;       /* by recipe */
+    struct __libhelper_pf_memo       strings;       /* by string */
+
+    /* shared indexes, built the first time a recipe needs them */
+    macho_fileset_t                 *fileset;       /* entries, when the Mach-O is a fileset */
+    int                              have_fileset;
+    struct __libhelper_pf_cstrings  *cstrings;
+    size_t                           ncstrings;
+    int                              have_cstrings;
+    macho_xref_index_t              *xrefs;
+    macho_callgraph_t               *graph;
+};
+
+
+/**
+ *  Load results from an earlier run. A missing cache is the normal case,
+ *  anything that doesn't match the binary is ignored and later replaced.
+ *
+ */
+static void pf_cache_load (macho_patchfinder_t *pf)
+{
+    const struct __libhelper_pf_file_header *hdr;
+    const struct __libhelper_pf_entry *entries;
+    file_t *f;
+
+    if (!pf->path || access (pf->path, R_OK) || !(f = file_load (pf->path)))
+        return;
+
+    hdr = (const struct __libhelper_pf_file_header *) f->data;
+    if (f->size < sizeof (*hdr) || memcmp (hdr->magic, MACHO_PF_MAGIC, sizeof (MACHO_PF_MAGIC)) ||
+        hdr->version != MACHO_PF_VERSION || memcmp (hdr->uuid, pf->uuid, 16) ||
+        (f->size - sizeof (*hdr)) / sizeof (struct __libhelper_pf_entry) != hdr->count) {
+        debugf ("pf_cache_load(): ignoring %s\n", pf->path);
+        file_free (f);
+        return;
+    }
+
+    entries = (const struct __libhelper_pf_entry *) (f->data + sizeof (*hdr));
+    for (uint32_t i = 0; i < hdr->count; i++) {
+        struct __libhelper_pf_entry entry = entries[i];
+
+        if (!entry.key)
+            continue;
+        entry.flags &= MACHO_PF_RESULT_FOUND;
+        if (!pf_memo_insert (&pf->results, &entry))
+            break;
+    }
+    file_free (f);
+}
+
+
+/**
+ *  Write every result we know of, next to the cache and then renamed over
+ *  it, so readers never see half a file.
+ *
+ */
+static void pf_cache_save (macho_patchfinder_t *pf)
+{
+    struct __libhelper_pf_file_header hdr;
+    struct __libhelper_pf_entry *entries;
+    unsigned char *buf;
+    char tmppath[1024];
+    size_t size, n = 0;
+
+    if (!pf->path || !pf->dirty)
+        return;
+
+    size = sizeof (hdr) + pf->results.count * sizeof (struct __libhelper_pf_entry);
+    buf = calloc (1, size);
+    if (!buf)
+        return;
+
+    memset (&hdr, '\0', sizeof (hdr));
+    memcpy (hdr.magic, MACHO_PF_MAGIC, sizeof (MACHO_PF_MAGIC));
+    hdr.version = MACHO_PF_VERSION;
+    hdr.count = (uint32_t) pf->results.count;
+    memcpy (hdr.uuid, pf->uuid, 16);
+    memcpy (buf, &hdr, sizeof (hdr));
+
+    entries = (struct __libhelper_pf_entry *) (buf + sizeof (hdr));
+    for (size_t i = 0; i < pf->results.cap; i++) {
+        if (pf->results.entries[i].key)
+            entries[n++] = pf->results.entries[i];
+    }
+
+    snprintf (tmppath, sizeof (tmppath), "%s.%d.tmp", pf->path, (int) getpid ());
+    if ((size_t) file_write_new (tmppath, buf, size) != size || rename (tmppath, pf->path)) {
+        warningf ("pf_cache_save(): could not write %s\n", pf->path);
+        remove (tmppath);
+    } else {
+        pf->dirty = 0;
+    }
+    free (buf);
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Strings                               									 --*/
+//===-----------------------------------------------------------------------===//
+
+static int pf_cstrings_compare (const void *a, const void *b)
+{
+    const struct __libhelper_pf_cstrings *x = a, *y = b;
+    return (x->vmaddr > y->vmaddr) - (x->vmaddr < y->vmaddr);
+}
+
+static void pf_cstrings_add (macho_t *image, HArray *regions)
+{
+    for (HSList *l = image->scmds; l; l = l->next) {
+        for (HSList *s = ((mach_segment_info_t *) l->data)->sects; s; s = s->next) {
+            mach_section_64_t *sect = (mach_section_64_t *) s->data;
+            struct __libhelper_pf_cstrings region;
+            lh_view_t view;
+
+            if ((sect->flags & SECTION_TYPE) != S_CSTRING_LITERALS || !sect->size)
+                continue;
+
+            view = macho_get_view (image, sect->offset, sect->size);
+            if (!lh_view_is_valid (view))
+                continue;
+
+            region.vmaddr = sect->addr;
+            region.data = view.data;
+            region.size = view.size;
+            h_array_push (regions, &region);
+        }
+    }
+}
+
+/**
+ *  The entries of a fileset, parsed the first time anything needs them and
+ *  shared by the strings, the xref index and the call graph. NULL when the
+ *  Mach-O isn't a fileset.
+ *
+ */
+static macho_fileset_t *pf_fileset (macho_patchfinder_t *pf)
+{
+    if (!pf->have_fileset) {
+        pf->have_fileset = 1;
+        if (pf->macho->header->filetype == MACH_TYPE_FILESET && (pf->fileset = macho_fileset_load (pf->macho)))
+            macho_fileset_load_all (pf->fileset, pf->nthreads);
+    }
+    return pf->fileset;
+}
+
+
+/**
+ *  Every C string section of the Mach-O, and of each entry when it is a
+ *  fileset, in address order. A section seen twice is only kept once.
+ *
+ */
+static void pf_cstrings_load (macho_patchfinder_t *pf)
+{
+    HArray *regions = h_array_new (sizeof (struct __libhelper_pf_cstrings));
+    macho_fileset_t *fileset = pf_fileset (pf);
+    size_t n = 0;
+
+    pf->have_cstrings = 1;
+    if (!regions)
+        return;
+
+    pf_cstrings_add (pf->macho, regions);
+    if (fileset) {
+        for (size_t i = 0; i < fileset->count; i++) {
+            if (fileset->images[i])
+                pf_cstrings_add (fileset->images[i], regions);
+        }
+    }
+
+    // the images share the fileset's mapping, so the views outlive them
+    pf->cstrings = (struct __libhelper_pf_cstrings *) regions->data;
+    qsort (pf->cstrings, regions->len, sizeof (struct __libhelper_pf_cstrings), pf_cstrings_compare);
+    for (size_t i = 0; i < regions->len; i++) {
+        if (n && pf->cstrings[i].vmaddr < pf->cstrings[n - 1].vmaddr + pf->cstrings[n - 1].size)
+            continue;
+        pf->cstrings[n++] = pf->cstrings[i];
+    }
+    pf->ncstrings = n;
+
+    regions->data = NULL;
+    h_array_free (regions);
+}
+
+
+struct __libhelper_pf_string_scan {
+    const struct __libhelper_pf_cstrings    *region;
+    uint64_t                                *found;         /* string address, or zero */
+    uint8_t                                 *exact;         /* MACHO_PF_STRING, not MACHO_PF_SUBSTRING */
+    size_t                                   remaining;
+};
+
+/**
+ *  Matches of one pattern come in address order, so the first one that
+ *  fits is the one we want. An exact pattern carries its terminator, so
+ *  it only has to start a C string. A substring match is widened to the
+ *  whole C string that holds it.
+ *
+ */
+static int pf_string_match (void *ctx, uint32_t pattern, size_t offset)
+{
+    struct __libhelper_pf_string_scan *scan = (struct __libhelper_pf_string_scan *) ctx;
+    const unsigned char *data = scan->region->data;
+
+    if (scan->found[pattern])
+        return 0;
+
+    if (scan->exact[pattern]) {
+        if (offset && data[offset - 1])
+            return 0;
+    } else {
+        while (offset && data[offset - 1])
+            offset--;
+    }
+    scan->found[pattern] = scan->region->vmaddr + offset;
+    return (--scan->remaining == 0);
+}
+
+
+/**
+ *  Find every string used by the pending recipes that hasn't been looked
+ *  up before, with a single pass over the C string sections.
+ *
+ *  @returns        0 if the strings could not be searched for.
+ */
+static int pf_find_strings (macho_patchfinder_t *pf, const macho_pf_recipe_t *recipes, size_t count,
+                            const uint8_t *pending)
+{
+    struct __libhelper_pf_memo added = { NULL, 0, 0 };
+    struct __libhelper_pf_string_scan scan;
+    bh_patterns_t *set = bh_patterns_create ();
+    HArray *keys = h_array_new (sizeof (uint64_t));
+    HArray *exact = h_array_new (sizeof (uint8_t));
+    int res = 0;
+
+    memset (&scan, 0, sizeof (scan));
+    if (!set || !keys || !exact)
+        goto strings_out;
+
+    if (!pf->have_cstrings)
+        pf_cstrings_load (pf);
+
+    for (size_t i = 0; i < count; i++) {
+        if (!pending[i])
+            continue;
+
+        for (int k = 0; k < MACHO_PF_MAX_STEPS && recipes[i].steps[k].op != MACHO_PF_END; k++) {
+            const macho_pf_step_t *step = &recipes[i].steps[k];
+            struct __libhelper_pf_entry entry = { 0, 0, 0, 0 };
+
+            uint8_t is_exact = (step->op == MACHO_PF_STRING);
+
+            if ((step->op != MACHO_PF_STRING && step->op != MACHO_PF_SUBSTRING) || !step->str)
+                continue;
+
+            entry.key = pf_string_key (step->op, step->str);
+            if (pf_memo_find (&pf->strings, entry.key) || pf_memo_find (&added, entry.key))
+                continue;
+
+            // an exact string is searched for with its terminator, a string
+            // that can't be a pattern is simply never found
+            if (!*step->str || !bh_patterns_add (set, (const unsigned char *) step->str, strlen (step->str) + is_exact)) {
+                if (!pf_memo_insert (&pf->strings, &entry))
+                    goto strings_out;
+                continue;
+            }
+            if (!h_array_push (keys, &entry.key) || !h_array_push (exact, &is_exact) || !pf_memo_insert (&added, &entry))
+                goto strings_out;
+        }
+    }
+
+    if (!keys->len) {
+        res = 1;
+        goto strings_out;
+    }
+    if (!bh_patterns_compile (set))
+        goto strings_out;
+
+    scan.found = calloc (keys->len, sizeof (uint64_t));
+    scan.exact = (uint8_t *) exact->data;
+    scan.remaining = keys->len;
+    if (!scan.found)
+        goto strings_out;
+
+    for (size_t i = 0; i < pf->ncstrings && scan.remaining; i++) {
+        scan.region = &pf->cstrings[i];
+        bh_patterns_scan (set, scan.region->data, scan.region->size, pf_string_match, &scan);
+    }
+
+    for (size_t i = 0; i < keys->len; i++) {
+        struct __libhelper_pf_entry entry = { h_array_index (keys, uint64_t, i), scan.found[i], 0, 0 };
+
+        if (scan.found[i])
+            entry.flags = MACHO_PF_RESULT_FOUND;
+        if (!pf_memo_insert (&pf->strings, &entry))
+            goto strings_out;
+    }
+    res = 1;
+
+strings_out:
+    free (scan.found);
+    free (added.entries);
+    h_array_free (keys);
+    h_array_free (exact);
+    bh_patterns_free (set);
+    return res;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Recipes                               									 --*/
+//===-----------------------------------------------------------------------===//
+
+static uint32_t pf_recipe_needs (const macho_pf_recipe_t *recipe)
+{
+    uint32_t needs = 0;
+
+    for (int i = 0; i < MACHO_PF_MAX_STEPS && recipe->steps[i].op != MACHO_PF_END; i++) {
+        switch (recipe->steps[i].op) {
+            case MACHO_PF_STRING:
+            case MACHO_PF_SUBSTRING:
+                needs |= MACHO_PF_NEED_STRINGS;
+                break;
+            case MACHO_PF_XREF:
+                needs |= MACHO_PF_NEED_XREFS;
+                break;
+            case MACHO_PF_SYMBOL:
+            case MACHO_PF_FUNCTION:
+            case MACHO_PF_BL:
+            case MACHO_PF_BL_AFTER:
+            case MACHO_PF_CALLER:
+                needs |= MACHO_PF_NEED_GRAPH;
+                break;
+        }
+    }
+    return needs;
+}
+
+
+/**
+ *  Turn `n` into an index below `count`, negative values counting back
+ *  from the end.
+ *
+ */
+static int pf_pick (int32_t n, size_t count, size_t *index)
+{
+    if (n >= 0) {
+        if ((size_t) n >= count)
+            return 0;
+        *index = (size_t) n;
+    } else {
+        if ((size_t) -(int64_t) n > count)
+            return 0;
+        *index = count - (size_t) -(int64_t) n;
+    }
+    return 1;
+}
+
+
+/**
+ *  The BLs made by the function holding `addr`. With `after`, only those
+ *  at or after `addr` are counted.
+ *
+ */
+static int pf_step_bl (const macho_callgraph_t *graph, const macho_pf_step_t *step, int after, uint64_t *addr)
+{
+    uint32_t f = macho_callgraph_function_at (graph, *addr);
+    const macho_call_t *calls;
+    size_t count, matches = 0, pick;
+
+    if (f == MACHO_CALLGRAPH_NONE)
+        return 0;
+
+    count = macho_callgraph_callees (graph, f, &calls);
+    for (size_t i = 0; i < count; i++)
+        matches += (calls[i].kind == MACHO_CALL_BL && (!after || calls[i].site >= *addr));
+
+    if (!pf_pick (step->n, matches, &pick))
+        return 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (calls[i].kind != MACHO_CALL_BL || (after && calls[i].site < *addr))
+            continue;
+        if (!pick--) {
+            *addr = calls[i].target;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int pf_step_caller (const macho_callgraph_t *graph, const macho_pf_step_t *step, uint64_t *addr)
+{
+    uint32_t f = macho_callgraph_function_at (graph, *addr);
+    const uint32_t *callers;
+    size_t count, matches = 0, pick;
+
+    if (f == MACHO_CALLGRAPH_NONE)
+        return 0;
+
+    // calls from outside any function have no caller to report
+    count = macho_callgraph_callers (graph, f, &callers);
+    for (size_t i = 0; i < count; i++)
+        matches += (graph->calls[callers[i]].caller != MACHO_CALLGRAPH_NONE);
+
+    if (!pf_pick (step->n, matches, &pick))
+        return 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t caller = graph->calls[callers[i]].caller;
+        if (caller != MACHO_CALLGRAPH_NONE && !pick--) {
+            *addr = graph->functions[caller].addr;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static int pf_step (macho_patchfinder_t *pf, const macho_pf_step_t *step, uint64_t *addr)
+{
+    const struct __libhelper_pf_entry *entry;
+    macho_xref_t xref;
+    size_t first, count, pick;
+    uint32_t f;
+
+    switch (step->op) {
+        case MACHO_PF_ADDRESS:
+            *addr = step->value;
+            return 1;
+
+        case MACHO_PF_STRING:
+        case MACHO_PF_SUBSTRING:
+            if (!step->str || !(entry = pf_memo_find (&pf->strings, pf_string_key (step->op, step->str))) ||
+                !(entry->flags & MACHO_PF_RESULT_FOUND))
+                return 0;
+            *addr = entry->addr;
+            return 1;
+
+        case MACHO_PF_SYMBOL:
+            if (!step->str || (f = macho_callgraph_find_symbol (pf->graph, step->str)) == MACHO_CALLGRAPH_NONE)
+                return 0;
+            *addr = pf->graph->functions[f].addr;
+            return 1;
+
+        case MACHO_PF_XREF:
+            if (!pf->xrefs)
+                return 0;
+            count = macho_xref_lookup (pf->xrefs, *addr, &first);
+            if (!pf_pick (step->n, count, &pick) || !macho_xref_get (pf->xrefs, first + pick, &xref))
+                return 0;
+            *addr = xref.from;
+            return 1;
+
+        case MACHO_PF_FUNCTION:
+            if ((f = macho_callgraph_function_at (pf->graph, *addr)) == MACHO_CALLGRAPH_NONE)
+                return 0;
+            *addr = pf->graph->functions[f].addr;
+            return 1;
+
+        case MACHO_PF_BL:
+        case MACHO_PF_BL_AFTER:
+            return pf->graph && pf_step_bl (pf->graph, step, step->op == MACHO_PF_BL_AFTER, addr);
+
+        case MACHO_PF_CALLER:
+            return pf->graph && pf_step_caller (pf->graph, step, addr);
+
+        case MACHO_PF_ADD:
+            *addr += step->value;
+            return 1;
+    }
+
+    warningf ("pf_step(): unknown step %u\n", step->op);
+    return 0;
+}
+
+
+static void pf_evaluate (macho_patchfinder_t *pf, const macho_pf_recipe_t *recipe, macho_pf_result_t *result)
+{
+    uint64_t addr = 0;
+    uint32_t i;
+
+    result->addr = 0;
+    result->flags = 0;
+
+    for (i = 0; i < MACHO_PF_MAX_STEPS && recipe->steps[i].op != MACHO_PF_END; i++) {
+        if (!pf_step (pf, &recipe->steps[i], &addr))
+            break;
+    }
+
+    result->step = i;
+    if (i && (i == MACHO_PF_MAX_STEPS || recipe->steps[i].op == MACHO_PF_END)) {
+        result->addr = addr;
+        result->flags = MACHO_PF_RESULT_FOUND;
+    }
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Patchfinder                           									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Create a patchfinder for an arm64 Mach-O or fileset, which must outlive
+ *  it. Nothing is scanned until a recipe needs it. A patchfinder must not
+ *  be used by more than one thread at a time.
+ *
+ *  @param          macho to search.
+ *  @param          cache_dir to keep results in as `<UUID>.lhpf`, or NULL.
+ *  @param          nthreads to build the indexes with, or 0 for all.
+ *
+ *  @returns        the patchfinder, or NULL on failure.
+ */
+macho_patchfinder_t *macho_patchfinder_create (void *macho, const char *cache_dir, int nthreads)
+{
+    macho_t *tmp = (macho_t *) macho;
+    mach_uuid_command_t *uuid;
+    macho_patchfinder_t *pf;
+
+    if (!tmp || !tmp->header || tmp->header->magic != MACH_MAGIC_64 || tmp->header->cputype != CPU_TYPE_ARM64) {
+        errorf ("macho_patchfinder_create(): only arm64 Mach-O's are supported\n");
+        return NULL;
+    }
+
+    pf = calloc (1, sizeof (macho_patchfinder_t));
+    if (!pf)
+        return NULL;
+
+    pf->macho = tmp;
+    pf->nthreads = nthreads;
+
+    // without a UUID there is nothing to tell one build's results from another
+    if (cache_dir && (uuid = mach_lc_find_uuid_cmd (tmp))) {
+        char name[MACH_UUID_STRLEN];
+        size_t len = strlen (cache_dir) + sizeof (name) + sizeof (MACHO_PF_EXTENSION) + 1;
+
+        memcpy (pf->uuid, uuid->uuid, 16);
+        mach_lc_uuid_format (pf->uuid, name, sizeof (name));
+
+        pf->path = malloc (len);
+        if (pf->path) {
+            snprintf (pf->path, len, "%s/%s%s", cache_dir, name, MACHO_PF_EXTENSION);
+            pf_cache_load (pf);
+        }
+    }
+    return pf;
+}
+
+
+void macho_patchfinder_free (macho_patchfinder_t *pf)
+{
+    if (!pf)
+        return;
+
+    macho_xref_index_free (pf->xrefs);
+    macho_callgraph_free (pf->graph);
+    macho_fileset_free (pf->fileset);
+    free (pf->cstrings);
+    free (pf->results.entries);
+    free (pf->strings.entries);
+    free (pf->path);
+    free (pf);
+}
+
+
+/**
+ *  Run a batch of recipes. Results already known, from this patchfinder or
+ *  the disk cache, are returned straight away. For the rest the strings
+ *  they use are found in one pass and the xref index and call graph are
+ *  built at most once, only if a recipe needs them. New results are added
+ *  to the disk cache.
+ *
+ *  @param          pf to run the recipes with.
+ *  @param          recipes to run.
+ *  @param          count of recipes.
+ *  @param          results, one for each recipe.
+ *
+ *  @returns        number of recipes that found an address.
+ */
+size_t macho_patchfinder_run (macho_patchfinder_t *pf, const macho_pf_recipe_t *recipes, size_t count,
+                              macho_pf_result_t *results)
+{
+    uint8_t *pending;
+    uint32_t needs = 0, missing = 0;
+    size_t found = 0;
+
+    if (!pf || !recipes || !results || !count)
+        return 0;
+
+    pending = calloc (count, sizeof (uint8_t));
+    if (!pending)
+        return 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const struct __libhelper_pf_entry *entry = pf_memo_find (&pf->results, pf_recipe_key (&recipes[i]));
+
+        if (entry) {
+            results[i].addr = entry->addr;
+            results[i].step = entry->step;
+            results[i].flags = entry->flags | MACHO_PF_RESULT_CACHED;
+            continue;
+        }
+        pending[i] = 1;
+        needs |= pf_recipe_needs (&recipes[i]);
+    }
+
+    // each index is shared by every recipe, and kept for the next run
+    if ((needs & MACHO_PF_NEED_STRINGS) && !pf_find_strings (pf, recipes, count, pending))
+        missing |= MACHO_PF_NEED_STRINGS;
+    if ((needs & MACHO_PF_NEED_XREFS) && !pf->xrefs &&
+        !(pf->xrefs = macho_fileset_xref_index_create (pf->macho, pf_fileset (pf), pf->nthreads)))
+        missing |= MACHO_PF_NEED_XREFS;
+    if ((needs & MACHO_PF_NEED_GRAPH) && !pf->graph &&
+        !(pf->graph = macho_fileset_callgraph_create (pf->macho, pf_fileset (pf), pf->nthreads)))
+        missing |= MACHO_PF_NEED_GRAPH;
+
+    for (size_t i = 0; i < count; i++) {
+        struct __libhelper_pf_entry entry;
+
+        if (!pending[i])
+            continue;
+        pf_evaluate (pf, &recipes[i], &results[i]);
+
+        // a result is only final if everything it needed was there
+        if (pf_recipe_needs (&recipes[i]) & missing)
+            continue;
+
+        entry.key = pf_recipe_key (&recipes[i]);
+        entry.addr = results[i].addr;
+        entry.step = results[i].step;
+        entry.flags = results[i].flags;
+        if (pf_memo_insert (&pf->results, &entry))
+            pf->dirty = 1;
+    }
+
+    pf_cache_save (pf);
+
+    for (size_t i = 0; i < count; i++)
+        found += (results[i].flags & MACHO_PF_RESULT_FOUND) != 0;
+
+    free (pending);
+    return found;
+}
@@ -0,0 +1,396 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Mach-O Searching                      									 --*/
+//===-----------------------------------------------------------------------===//
+
+static int macho_region_is_zerofill (uint32_t flags)
+{
+    uint32_t type = flags & SECTION_TYPE;
+    return (type == S_ZEROFILL || type == S_GB_ZEROFILL || type == S_THREAD_LOCAL_ZEROFILL);
+}
+
+/**
+ *  Find the file range of a segment, or of a section in it. With no
+ *  `segname` the range is the whole Mach-O, and with no `sectname` it is
+ *  the whole segment. Zero-fill sections have an empty range.
+ *
+ *  @returns        MACHO_SEARCH_SUCCESS, or MACHO_SEARCH_FAILURE if there is
+ *                  no such region.
+ */
+int macho_find_region (void *macho, const char *segname, const char *sectname, uint64_t *offset, uint64_t *size)
+{
+    macho_t *tmp = (macho_t *) macho;
+    int is32;
+
+    if (!tmp || !tmp->header || !offset || !size)
+        return MACHO_SEARCH_FAILURE;
+
+    if (!segname) {
+        *offset = 0;
+        *size = tmp->size;
+        return MACHO_SEARCH_SUCCESS;
+    }
+    is32 = (tmp->header->magic == MACH_MAGIC_32);
+
+    for (HSList *l = tmp->scmds; l; l = l->next) {
+        if (is32) {
+            mach_segment_info_32_t *info = (mach_segment_info_32_t *) l->data;
+            if (strncmp (info->segcmd->segname, segname, 16))
+                continue;
+
+            if (!sectname) {
+                *offset = info->segcmd->fileoff;
+                *size = info->segcmd->filesize;
+                return MACHO_SEARCH_SUCCESS;
+            }
+            for (HSList *s = info->sects; s; s = s->next) {
+                mach_section_32_t *sect = (mach_section_32_t *) s->data;
+                if (strncmp (sect->sectname, sectname, 16))
+                    continue;
+
+                *offset = sect->offset;
+                *size = (macho_region_is_zerofill (sect->flags)) ? 0 : sect->size;
+                return MACHO_SEARCH_SUCCESS;
+            }
+        } else {
+            mach_segment_info_t *info = (mach_segment_info_t *) l->data;
+            if (strncmp (info->segcmd->segname, segname, 16))
+                continue;
+
+            if (!sectname) {
+                *offset = info->segcmd->fileoff;
+                *size = info->segcmd->filesize;
+                return MACHO_SEARCH_SUCCESS;
+            }
+            for (HSList *s = info->sects; s; s = s->next) {
+                mach_section_64_t *sect = (mach_section_64_t *) s->data;
+                if (strncmp (sect->sectname, sectname, 16))
+                    continue;
+
+                *offset = sect->offset;
+                *size = (macho_region_is_zerofill (sect->flags)) ? 0 : sect->size;
+                return MACHO_SEARCH_SUCCESS;
+            }
+        }
+    }
+    return MACHO_SEARCH_FAILURE;
+}
+
+
+static macho_region_t *macho_find_own_exec_regions (macho_t *macho, int *count);
+
+/**
+ *  A fileset without sections of its own, such as a kernelcache that only
+ *  has segments at the top level, has its code in the sections of its
+ *  entries. Entry section offsets are relative to the fileset, so the
+ *  regions can be read straight from the fileset.
+ *
+ */
+static macho_region_t *macho_find_entry_exec_regions (const macho_fileset_t *fileset, int *count)
+{
+    macho_region_t *regions = NULL;
+    int total = 0;
+
+    for (size_t i = 0; i < fileset->count; i++) {
+        macho_region_t *found, *tmp;
+        int n = 0;
+
+        if (!fileset->images[i] || !(found = macho_find_own_exec_regions (fileset->images[i], &n)))
+            continue;
+
+        tmp = realloc (regions, (total + n) * sizeof (macho_region_t));
+        if (!tmp) {
+            free (found);
+            continue;
+        }
+        regions = tmp;
+        memcpy (regions + total, found, n * sizeof (macho_region_t));
+        total += n;
+        free (found);
+    }
+
+    *count = total;
+    return regions;
+}
+
+
+/**
+ *  Find every section that holds instructions. On a fileset these are the
+ *  sections of the fileset itself, which cover every entry, or else the
+ *  sections of each entry in turn.
+ *
+ *  @returns        malloc()'d array of regions, in load command order, or
+ *                  NULL if there are none.
+ */
+macho_region_t *macho_find_exec_regions (void *macho, int *count)
+{
+    return macho_fileset_find_exec_regions (macho, NULL, count);
+}
+
+
+/**
+ *  `macho_find_exec_regions()` for a caller that already has the fileset
+ *  loaded, e.g. with `macho_fileset_load_all()`, so its entries are used
+ *  as they are rather than loaded again. With a NULL `fileset` one is
+ *  loaded when it is needed.
+ *
+ */
+macho_region_t *macho_fileset_find_exec_regions (void *macho, macho_fileset_t *fileset, int *count)
+{
+    macho_t *tmp = (macho_t *) macho;
+    macho_fileset_t *loaded = NULL;
+    macho_region_t *regions;
+
+    if (!tmp || !tmp->header || !count)
+        return NULL;
+    *count = 0;
+
+    regions = macho_find_own_exec_regions (tmp, count);
+    if (regions || tmp->header->filetype != MACH_TYPE_FILESET || tmp->header->magic != MACH_MAGIC_64)
+        return regions;
+
+    if (!fileset) {
+        if (!(fileset = loaded = macho_fileset_load (tmp)))
+            return NULL;
+        macho_fileset_load_all (fileset, 0);
+    }
+
+    regions = macho_find_entry_exec_regions (fileset, count);
+    macho_fileset_free (loaded);
+    return regions;
+}
+
+static macho_region_t *macho_find_own_exec_regions (macho_t *macho, int *count)
+{
+    macho_t *tmp = macho;
+    macho_region_t *regions;
+    int is32, n = 0, total = 0;
+
+    if (!tmp->header)
+        return NULL;
+    is32 = (tmp->header->magic == MACH_MAGIC_32);
+
+    for (HSList *l = tmp->scmds; l; l = l->next)
+        total += (is32) ? h_slist_length (((mach_segment_info_32_t *) l->data)->sects)
+                        : h_slist_length (((mach_segment_info_t *) l->data)->sects);
+    if (!total)
+        return NULL;
+
+    regions = calloc (total, sizeof (macho_region_t));
+    if (!regions)
+        return NULL;
+
+    for (HSList *l = tmp->scmds; l; l = l->next) {
+        if (is32) {
+            for (HSList *s = ((mach_segment_info_32_t *) l->data)->sects; s; s = s->next) {
+                mach_section_32_t *sect = (mach_section_32_t *) s->data;
+                if (!(sect->flags & (S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS)) || macho_region_is_zerofill (sect->flags))
+                    continue;
+
+                strncpy (regions[n].segname, sect->segname, 16);
+                strncpy (regions[n].sectname, sect->sectname, 16);
+                regions[n].offset = sect->offset;
+                regions[n].size = sect->size;
+                regions[n].vmaddr = sect->addr;
+                n++;
+            }
+        } else {
+            for (HSList *s = ((mach_segment_info_t *) l->data)->sects; s; s = s->next) {
+                mach_section_64_t *sect = (mach_section_64_t *) s->data;
+                if (!(sect->flags & (S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS)) || macho_region_is_zerofill (sect->flags))
+                    continue;
+
+                strncpy (regions[n].segname, sect->segname, 16);
+                strncpy (regions[n].sectname, sect->sectname, 16);
+                regions[n].offset = sect->offset;
+                regions[n].size = sect->size;
+                regions[n].vmaddr = sect->addr;
+                n++;
+            }
+        }
+    }
+
+    if (!n) {
+        free (regions);
+        return NULL;
+    }
+    *count = n;
+    return regions;
+}
+
+
+/**
+ *  Get a view over a region, as found by `macho_find_region()`.
+ *
+ */
+static int macho_region_view (void *macho, const char *segname, const char *sectname, lh_view_t *view, uint64_t *offset)
+{
+    uint64_t size;
+
+    if (!macho_find_region (macho, segname, sectname, offset, &size)) {
+        errorf ("macho_region_view(): no region %s,%s\n", (segname) ? segname : "", (sectname) ? sectname : "");
+        return MACHO_SEARCH_FAILURE;
+    }
+
+    if (!size) {
+        *view = lh_view_create ("", 0, NULL);
+        return MACHO_SEARCH_SUCCESS;
+    }
+    if (*offset > UINT32_MAX)
+        return MACHO_SEARCH_FAILURE;
+
+    // regions that fall outside the mapping aren't searched
+    *view = macho_get_view (macho, (uint32_t) *offset, size);
+    if (!view->data) {
+        errorf ("macho_region_view(): %s,%s lies outside of the Mach-O\n", (segname) ? segname : "", (sectname) ? sectname : "");
+        return MACHO_SEARCH_FAILURE;
+    }
+    return MACHO_SEARCH_SUCCESS;
+}
+
+
+/**
+ *  Matches are found relative to the start of the region, and reported
+ *  relative to the start of the Mach-O.
+ *
+ */
+struct __libhelper_macho_scan {
+    bh_patterns_func_t       func;
+    void                    *ctx;
+    uint64_t                 base;
+};
+
+static int macho_patterns_match (void *ctx, uint32_t pattern, size_t offset)
+{
+    struct __libhelper_macho_scan *scan = (struct __libhelper_macho_scan *) ctx;
+    return scan->func (scan->ctx, pattern, scan->base + offset);
+}
+
+
+/**
+ *  Find every pattern of a compiled set in one pass over a Mach-O, or over
+ *  one of its segments or sections. Offsets passed to `func` are file
+ *  offsets into the Mach-O.
+ *
+ *  @param          macho to scan, 32 or 64 bit.
+ *  @param          set of compiled patterns.
+ *  @param          segname to restrict the scan to, or NULL for everything.
+ *  @param          sectname to restrict the scan to, or NULL for the whole segment.
+ *
+ *  @returns        number of matches reported.
+ */
+size_t macho_patterns_scan (void *macho, const bh_patterns_t *set, const char *segname, const char *sectname,
+                            bh_patterns_func_t func, void *ctx)
+{
+    struct __libhelper_macho_scan scan;
+    lh_view_t view;
+
+    if (!set || !func || !macho_region_view (macho, segname, sectname, &view, &scan.base))
+        return 0;
+
+    scan.func = func;
+    scan.ctx = ctx;
+    return bh_patterns_scan (set, view.data, view.size, macho_patterns_match, &scan);
+}
+
+
+static int macho_offset_compare (const void *a, const void *b)
+{
+    size_t x = *(const size_t *) a, y = *(const size_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ *  Find every match of a masked pattern in a Mach-O. With no `segname`
+ *  only the executable sections are searched, which is where instruction
+ *  signatures live, otherwise only the given segment or section. Each
+ *  region is split across `nthreads` threads.
+ *
+ *  @returns        malloc()'d array of file offsets in ascending order, or
+ *                  NULL if there were no matches.
+ */
+size_t *macho_masked_find_all (void *macho, const bh_masked_t *pat, const char *segname, const char *sectname,
+                               int nthreads, size_t *count)
+{
+    macho_region_t *regions, single;
+    size_t *out = NULL, total = 0;
+    int nregions = 0;
+
+    if (!count)
+        return NULL;
+    *count = 0;
+    if (!macho || !pat)
+        return NULL;
+
+    if (segname) {
+        if (!macho_find_region (macho, segname, sectname, &single.offset, &single.size))
+            return NULL;
+        regions = &single;
+        nregions = 1;
+    } else {
+        regions = macho_find_exec_regions (macho, &nregions);
+    }
+
+    for (int i = 0; i < nregions; i++) {
+        lh_view_t view;
+        size_t n, *found, *tmp;
+
+        if (!regions[i].size || regions[i].offset > UINT32_MAX)
+            continue;
+
+        view = macho_get_view (macho, (uint32_t) regions[i].offset, regions[i].size);
+        found = bh_masked_find_all (pat, view.data, view.size, nthreads, &n);
+        if (!found)
+            continue;
+
+        tmp = realloc (out, (total + n) * sizeof (size_t));
+        if (!tmp) {
+            free (found);
+            break;
+        }
+        out = tmp;
+
+        for (size_t k = 0; k < n; k++)
+            out[total + k] = regions[i].offset + found[k];
+        total += n;
+        free (found);
+    }
+
+    // sections are normally in file order already, but nothing says so
+    if (total)
+        qsort (out, total, sizeof (size_t), macho_offset_compare);
+
+    if (regions != &single)
+        free (regions);
+    *count = total;
+    return out;
+}
@@ -68,16 +68,15 @@ mach_section_64_t *mach_section_from_segment_info (mach_segment_info_t *info, ch
         return NULL;
     }
 
-    // Check the length of the sections
-    int c = h_slist_length (info->sects);
-    if (!c) {
+    // Check there are any sections
+    if (!info->sects) {
         debugf ("section.c: mach_section_from_segment_info(): no sections\n");
         return NULL;
     }
 
     // Go through each of them, look for `sectname`
-    for (int i = 0; i < c; i++) {
-        mach_section_64_t *tmp = (mach_section_64_t *) h_slist_nth_data (info->sects, i);
+    for (HSList *l = info->sects; l; l = l->next) {
+        mach_section_64_t *tmp = (mach_section_64_t *) l->data;
         if (!strcmp(tmp->sectname, sectname)) return tmp;
     }
 
@@ -92,12 +91,12 @@ mach_section_64_t *mach_section_from_segment_info (mach_segment_info_t *info, ch
 mach_section_64_t *mach_find_section_command_at_index (HSList *segments, int index)
 {
     int count = 0;
-    for (int i = 0; i < h_slist_length (segments); i++) {
-        mach_segment_info_t *seg = (mach_segment_info_t *) h_slist_nth_data (segments, i);
-        for (int k = 0; k < (int) seg->segcmd->nsects; k++) {
+    for (HSList *l = segments; l; l = l->next) {
+        mach_segment_info_t *seg = (mach_segment_info_t *) l->data;
+        for (HSList *s = seg->sects; s; s = s->next) {
             count++;
             if (count == index) {
-                return (mach_section_64_t *) h_slist_nth_data (seg->sects, k);
+                return (mach_section_64_t *) s->data;
             }
         }
     }
@@ -165,16 +164,15 @@ mach_section_32_t *mach_section_32_from_segment_info_32 (mach_segment_info_32_t
         return NULL;
     }
 
-    // Check the length of the sections
-    int c = h_slist_length (info->sects);
-    if (!c) {
+    // Check there are any sections
+    if (!info->sects) {
         debugf ("section.c: mach_section_32_from_segment_info_32(): no sections\n");
         return NULL;
     }
 
     // Go through each of them, look for `sectname`
-    for (int i = 0; i < c; i++) {
-        mach_section_32_t *tmp = (mach_section_32_t *) h_slist_nth_data (info->sects, i);
+    for (HSList *l = info->sects; l; l = l->next) {
+        mach_section_32_t *tmp = (mach_section_32_t *) l->data;
         if (!strcmp(tmp->sectname, sectname)) return tmp;
     }
 
@@ -189,12 +187,12 @@ mach_section_32_t *mach_section_32_from_segment_info_32 (mach_segment_info_32_t
 mach_section_32_t *mach_find_section_command_32_at_index (HSList *segments, int index)
 {
     int count = 0;
-    for (int i = 0; i < h_slist_length (segments); i++) {
-        mach_segment_info_32_t *seg = (mach_segment_info_32_t *) h_slist_nth_data (segments, i);
-        for (int k = 0; k < (int) seg->segcmd->nsects; k++) {
+    for (HSList *l = segments; l; l = l->next) {
+        mach_segment_info_32_t *seg = (mach_segment_info_32_t *) l->data;
+        for (HSList *s = seg->sects; s; s = s->next) {
             count++;
             if (count == index) {
-                return (mach_section_32_t *) h_slist_nth_data (seg->sects, k);
+                return (mach_section_32_t *) s->data;
             }
         }
     }
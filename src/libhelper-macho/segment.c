@@ -71,10 +71,11 @@ mach_segment_info_t *mach_segment_info_load (unsigned char *data, uint32_t offse
 
     // the section commands are placed directly after the segment command
     uint32_t sectoff = offset + sizeof (mach_segment_command_64_t);
+    HSList *tail = NULL;
     //debugf ("mach_segment_info_load(): seg->nsect: %d\n", seg->nsects);
     for (uint32_t i = 0; i < seg->nsects; i++) {
         mach_section_64_t *sect = mach_section_load (data, sectoff);
-        seg_inf->sects = h_slist_append (seg_inf->sects, sect);
+        seg_inf->sects = h_slist_append_tail (seg_inf->sects, &tail, sect);
         sectoff += sizeof (mach_section_64_t);
     }
 
@@ -91,17 +92,17 @@ mach_segment_info_t *mach_segment_info_load (unsigned char *data, uint32_t offse
 HSList *mach_segment_get_list (macho_t *mach)
 {
     // Create a new list, this'll be returned
-    HSList *r = NULL;
+    HSList *r = NULL, *tail = NULL;
 
     // Go through all of them, add them to the list
-    for (int i = 0; i < (int) h_slist_length (mach->scmds); i++) {
+    for (HSList *l = mach->scmds; l; l = l->next) {
         
         // Load the segment from the info struct, and add it to the list
-        mach_segment_info_t *si = (mach_segment_info_t *) h_slist_nth_data (mach->scmds, i);
+        mach_segment_info_t *si = (mach_segment_info_t *) l->data;
         mach_segment_command_64_t *s = (mach_segment_command_64_t *) si->segcmd;
 
         // Add to the list
-        r = h_slist_append (r, s);
+        r = h_slist_append_tail (r, &tail, s);
     }
 
     // Return the list
@@ -121,18 +122,17 @@ mach_segment_info_t *mach_segment_info_search (HSList *segments, char *segname)
         exit (0);
     }
 
-    // Get the amount of segment commands and check its more than 0
-    int c = h_slist_length (segments);
-    if (!c) {
+    // Check there is at least one segment command
+    if (!segments) {
         debugf ("[*] Error: No Segment Commands\n");
         exit (0);
     }
 
     // Now go through each of them
-    for (int i = 0; i < c; i++) {
+    for (HSList *l = segments; l; l = l->next) {
         
         // Grab the segment info
-        mach_segment_info_t *si = (mach_segment_info_t *) h_slist_nth_data (segments, i);
+        mach_segment_info_t *si = (mach_segment_info_t *) l->data;
         mach_segment_command_64_t *s = si->segcmd;
 
         // Check if they match
@@ -193,9 +193,10 @@ mach_segment_info_32_t *mach_segment_info_32_load (unsigned char *data, uint32_t
 
     // the section commands are placed directly after the segment command, and included in the size.
     uint32_t sectoff = offset + sizeof (mach_segment_command_32_t);
+    HSList *tail = NULL;
     for (uint32_t i = 0; i < seg->nsects; i++) {
         mach_section_32_t *sect = mach_section_32_load (data, sectoff);
-        seg_inf->sects = h_slist_append (seg_inf->sects, sect);
+        seg_inf->sects = h_slist_append_tail (seg_inf->sects, &tail, sect);
         sectoff += sizeof (mach_section_32_t);
     }
 
@@ -212,17 +213,17 @@ mach_segment_info_32_t *mach_segment_info_32_load (unsigned char *data, uint32_t
 HSList *mach_segment_32_get_list (macho_32_t *mach)
 {
     // Create a new list, this'll be returned
-    HSList *r = NULL;
+    HSList *r = NULL, *tail = NULL;
 
     // Go through all of them, add them to the list
-    for (int i = 0; i < (int) h_slist_length (mach->scmds); i++) {
+    for (HSList *l = mach->scmds; l; l = l->next) {
         
         // Load the segment from the info struct, and add it to the list
-        mach_segment_info_32_t *si = (mach_segment_info_32_t *) h_slist_nth_data (mach->scmds, i);
+        mach_segment_info_32_t *si = (mach_segment_info_32_t *) l->data;
         mach_segment_command_32_t *s = (mach_segment_command_32_t *) si->segcmd;
 
         // Add to the list
-        r = h_slist_append (r, s);
+        r = h_slist_append_tail (r, &tail, s);
     }
 
     // Return the list
@@ -242,18 +243,17 @@ mach_segment_info_32_t *mach_segment_info_32_search (HSList *segments, char *seg
         exit (0);
     }
 
-    // Get the amount of segment commands and check its more than 0
-    int c = h_slist_length (segments);
-    if (!c) {
+    // Check there is at least one segment command
+    if (!segments) {
         debugf ("mach_segment_info_32_search(): no segment commands\n");
         exit (0);
     }
 
     // Now go through each of them
-    for (int i = 0; i < c; i++) {
+    for (HSList *l = segments; l; l = l->next) {
         
         // Grab the segment info
-        mach_segment_info_t *si = (mach_segment_info_t *) h_slist_nth_data (segments, i);
+        mach_segment_info_t *si = (mach_segment_info_t *) l->data;
         mach_segment_command_64_t *s = si->segcmd;
 
         // Check if they match
@@ -282,30 +282,18 @@ mach_segment_command_32_t *mach_segment_command_32_from_info (mach_segment_info_
 //===-----------------------------------------------------------------------===//
 
 
+static char *mach_segment_prot_strings[] = {
+    "---", "r--", "-w-", "rw-", "--x", "r-x", "-wx", "rwx",
+};
+
 /**
- * 
+ *  Format VM protection flags as "rwx", with a dash for each missing bit.
+ *
+ *  @returns        static string, must not be freed.
  */
 char *mach_segment_vm_protection (vm_prot_t prot)
 {
-    HString *str = h_string_new ("");
-    
-    if ((prot & VM_PROT_READ) == VM_PROT_READ)
-        str = h_string_append_c (str, 'r');
-    else
-        str = h_string_append_c (str, '-');
-
-    if ((prot & VM_PROT_WRITE) == VM_PROT_WRITE)
-        str = h_string_append_c (str, 'w');
-    else
-        str = h_string_append_c (str, '-');
-
-    if ((prot & VM_PROT_EXEC) == VM_PROT_EXEC)
-        str = h_string_append_c (str, 'x');
-    else
-        str = h_string_append_c (str, '-');
-
-    str = h_string_append_c (str, '\0');
-    return str->str;
+    return mach_segment_prot_strings[prot & (VM_PROT_READ | VM_PROT_WRITE | VM_PROT_EXEC)];
 }
 
 
@@ -0,0 +1,599 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+#include "hlib.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+//===-----------------------------------------------------------------------===//
+/*-- Mach-O Streaming Parser            									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  The stream moves through three states. Bytes are collected into `head`
+ *  until the full header and load command area has arrived, at which point
+ *  the commands are parsed and reported. Everything after that is the body,
+ *  which is never kept unless it falls within a requested range.
+ *
+ */
+#define STREAM_STATE_HEADER         0
+#define STREAM_STATE_COMMANDS       1
+#define STREAM_STATE_BODY           2
+#define STREAM_STATE_ERROR          3
+
+#define STREAM_READ_SIZE            (64 * 1024)
+
+struct __libhelper_stream_range {
+    char                 segname[17];   /* segment to resolve, or empty */
+    int                  resolved;      /* offset and size are known */
+    int                  done;          /* all bytes have arrived */
+
+    uint64_t             offset;        /* offset of the range in the stream */
+    uint64_t             size;          /* size of the range */
+    uint64_t             filled;        /* bytes copied so far */
+    unsigned char       *data;          /* buffered bytes */
+};
+
+struct __libhelper_macho_stream {
+    macho_stream_callbacks_t         cb;
+    void                            *ctx;
+
+    int                              state;
+    uint64_t                         pos;           /* bytes consumed so far */
+
+    /* header and load commands */
+    unsigned char                   *head;
+    size_t                           head_len;
+    size_t                           head_need;
+    size_t                           head_cap;
+    uint32_t                         header_size;
+    mach_header_t                    header;
+
+    /* requested ranges */
+    struct __libhelper_stream_range *ranges;
+    int                              nranges;
+    int                              cap;
+};
+
+
+/**
+ *  Create a new stream. The callbacks are copied, so the caller does not
+ *  need to keep them around.
+ *
+ */
+macho_stream_t *macho_stream_create (const macho_stream_callbacks_t *callbacks, void *ctx)
+{
+    macho_stream_t *stream = calloc (1, sizeof (macho_stream_t));
+    if (!stream)
+        return NULL;
+
+    if (callbacks)
+        stream->cb = *callbacks;
+    stream->ctx = ctx;
+    stream->state = STREAM_STATE_HEADER;
+
+    // the magic is enough to tell the header size, start with the smaller one
+    stream->head_need = sizeof (mach_header_32_t);
+    return stream;
+}
+
+
+/**
+ *  Free a stream and all of the ranges it buffered. Views returned by
+ *  `macho_stream_get_range()` are invalid after this.
+ *
+ */
+void macho_stream_free (macho_stream_t *stream)
+{
+    if (!stream)
+        return;
+
+    for (int i = 0; i < stream->nranges; i++)
+        free (stream->ranges[i].data);
+    free (stream->ranges);
+    free (stream->head);
+    free (stream);
+}
+
+
+/**
+ *  Add an empty range slot to the stream.
+ *
+ */
+static struct __libhelper_stream_range *stream_range_add (macho_stream_t *stream, int *index)
+{
+    if (stream->nranges == stream->cap) {
+        int cap = (stream->cap) ? stream->cap * 2 : 4;
+        void *tmp = realloc (stream->ranges, cap * sizeof (struct __libhelper_stream_range));
+        if (!tmp)
+            return NULL;
+
+        stream->ranges = tmp;
+        stream->cap = cap;
+    }
+
+    *index = stream->nranges++;
+    memset (&stream->ranges[*index], '\0', sizeof (struct __libhelper_stream_range));
+    return &stream->ranges[*index];
+}
+
+
+/**
+ *  Mark a range complete and let the caller know.
+ *
+ */
+static void stream_range_complete (macho_stream_t *stream, int index)
+{
+    struct __libhelper_stream_range *r = &stream->ranges[index];
+
+    r->done = 1;
+    if (stream->cb.range)
+        stream->cb.range (stream->ctx, index, lh_view_create (r->data, r->size, NULL));
+}
+
+
+/**
+ *  Give a range its final offset and size, allocate its buffer, and fill
+ *  in anything that has already streamed past. Only the header and load
+ *  commands are kept, so a range that needs body bytes we have already
+ *  discarded, `[head_len, pos)`, cannot be satisfied.
+ *
+ */
+static int stream_range_resolve (macho_stream_t *stream, int index, uint64_t offset, uint64_t size)
+{
+    struct __libhelper_stream_range *r = &stream->ranges[index];
+
+    r->offset = offset;
+    r->size = size;
+    r->resolved = 1;
+
+    if (stream->pos > stream->head_len && offset < stream->pos && offset + size > stream->head_len) {
+        errorf ("macho_stream: range 0x%llx-0x%llx has already been discarded\n",
+                (unsigned long long) offset, (unsigned long long) (offset + size));
+        return MACHO_STREAM_FAILURE;
+    }
+
+    if (size) {
+        r->data = malloc (size);
+        if (!r->data)
+            return MACHO_STREAM_FAILURE;
+    }
+
+    // backfill from the header and load commands
+    if (offset < stream->pos) {
+        uint64_t end = MIN (offset + size, (uint64_t) stream->head_len);
+        memcpy (r->data, stream->head + offset, end - offset);
+        r->filled = end - offset;
+    }
+
+    if (r->filled == r->size)
+        stream_range_complete (stream, index);
+    return MACHO_STREAM_SUCCESS;
+}
+
+
+/**
+ *  Request that `size` bytes at `offset` are buffered as they arrive.
+ *
+ *  @returns        index of the range, or -1 on failure.
+ */
+int macho_stream_request_range (macho_stream_t *stream, uint64_t offset, uint64_t size)
+{
+    int index;
+
+    if (!stream || offset + size < offset)
+        return -1;
+
+    if (!stream_range_add (stream, &index))
+        return -1;
+
+    if (!stream_range_resolve (stream, index, offset, size))
+        return -1;
+    return index;
+}
+
+
+/**
+ *  Request that the file contents of a segment, e.g. "__LINKEDIT", are
+ *  buffered. The range is resolved once the load commands have arrived.
+ *
+ *  @returns        index of the range, or -1 on failure.
+ */
+int macho_stream_request_segment (macho_stream_t *stream, const char *segname)
+{
+    struct __libhelper_stream_range *r;
+    int index;
+
+    if (!stream || !segname || strlen (segname) > 16)
+        return -1;
+
+    // once the commands have been parsed, the segment can't be resolved.
+    if (stream->state >= STREAM_STATE_BODY) {
+        errorf ("macho_stream_request_segment(): load commands have already been parsed\n");
+        return -1;
+    }
+
+    if (!(r = stream_range_add (stream, &index)))
+        return -1;
+
+    strncpy (r->segname, segname, 16);
+    return index;
+}
+
+
+/**
+ *  Copy any part of [at, at + size) that overlaps a resolved range.
+ *
+ */
+static void stream_deliver (macho_stream_t *stream, const unsigned char *buf, uint64_t at, size_t size)
+{
+    for (int i = 0; i < stream->nranges; i++) {
+        struct __libhelper_stream_range *r = &stream->ranges[i];
+        if (!r->resolved || r->done)
+            continue;
+
+        uint64_t start = MAX (r->offset + r->filled, at);
+        uint64_t end = MIN (r->offset + r->size, at + size);
+        if (start >= end)
+            continue;
+
+        memcpy (r->data + (start - r->offset), buf + (start - at), end - start);
+        r->filled += end - start;
+
+        if (r->filled == r->size)
+            stream_range_complete (stream, i);
+    }
+}
+
+
+/**
+ *  Resolve segment-name requests against a segment command.
+ *
+ */
+static int stream_resolve_segment (macho_stream_t *stream, const mach_segment_command_64_t *seg)
+{
+    for (int i = 0; i < stream->nranges; i++) {
+        struct __libhelper_stream_range *r = &stream->ranges[i];
+        if (r->resolved || !r->segname[0] || strncmp (r->segname, seg->segname, 16))
+            continue;
+
+        if (!stream_range_resolve (stream, i, seg->fileoff, seg->filesize))
+            return MACHO_STREAM_FAILURE;
+    }
+    return MACHO_STREAM_SUCCESS;
+}
+
+
+/**
+ *  Widen a 32 bit segment or section so callers only deal with one layout.
+ *
+ */
+static void stream_widen_segment (const mach_segment_command_32_t *in, mach_segment_command_64_t *out)
+{
+    out->cmd = in->cmd;
+    out->cmdsize = in->cmdsize;
+    memcpy (out->segname, in->segname, 16);
+    out->vmaddr = in->vmaddr;
+    out->vmsize = in->vmsize;
+    out->fileoff = in->fileoff;
+    out->filesize = in->filesize;
+    out->maxprot = in->maxprot;
+    out->initprot = in->initprot;
+    out->nsects = in->nsects;
+    out->flags = in->flags;
+}
+
+static void stream_widen_section (const mach_section_32_t *in, mach_section_64_t *out)
+{
+    memcpy (out->sectname, in->sectname, 16);
+    memcpy (out->segname, in->segname, 16);
+    out->addr = in->addr;
+    out->size = in->size;
+    out->offset = in->offset;
+    out->align = in->align;
+    out->reloff = in->reloff;
+    out->nreloc = in->nreloc;
+    out->flags = in->flags;
+    out->reserved1 = in->reserved1;
+    out->reserved2 = in->reserved2;
+    out->reserved3 = 0;
+}
+
+
+/**
+ *  Parse the header once it has fully arrived, and work out how many more
+ *  bytes are needed before the load commands can be parsed.
+ *
+ */
+static int stream_parse_header (macho_stream_t *stream)
+{
+    uint32_t magic;
+    memcpy (&magic, stream->head, sizeof (uint32_t));
+
+    if (magic != MACH_MAGIC_64 && magic != MACH_MAGIC_32) {
+        errorf ("macho_stream: unsupported magic: 0x%08x\n", magic);
+        return MACHO_STREAM_FAILURE;
+    }
+
+    // now the magic is known, we might need the extra 4 bytes of the 64 bit header
+    stream->header_size = (magic == MACH_MAGIC_64) ? sizeof (mach_header_t) : sizeof (mach_header_32_t);
+    if (stream->head_len < stream->header_size) {
+        stream->head_need = stream->header_size;
+        return MACHO_STREAM_SUCCESS;
+    }
+
+    memset (&stream->header, '\0', sizeof (mach_header_t));
+    memcpy (&stream->header, stream->head, stream->header_size);
+
+    if (stream->cb.header)
+        stream->cb.header (stream->ctx, &stream->header);
+
+    stream->head_need = stream->header_size + stream->header.sizeofcmds;
+    stream->state = STREAM_STATE_COMMANDS;
+    return MACHO_STREAM_SUCCESS;
+}
+
+
+/**
+ *  Walk the load commands, reporting each one and resolving any ranges
+ *  that were requested by segment name.
+ *
+ */
+static int stream_parse_commands (macho_stream_t *stream)
+{
+    uint32_t offset = stream->header_size;
+    uint32_t end = stream->header_size + stream->header.sizeofcmds;
+    uint32_t segindex = 0;
+
+    for (uint32_t i = 0; i < stream->header.ncmds; i++) {
+        mach_load_command_t lc;
+
+        if (offset + sizeof (mach_load_command_t) > end) {
+            errorf ("macho_stream: load command %d is out of bounds\n", i);
+            return MACHO_STREAM_FAILURE;
+        }
+
+        memcpy (&lc, stream->head + offset, sizeof (mach_load_command_t));
+        if (lc.cmdsize < sizeof (mach_load_command_t) || lc.cmdsize > end - offset) {
+            errorf ("macho_stream: load command %d has a bad size: 0x%x\n", i, lc.cmdsize);
+            return MACHO_STREAM_FAILURE;
+        }
+
+        const unsigned char *ptr = stream->head + offset;
+        if (stream->cb.load_command)
+            stream->cb.load_command (stream->ctx, (const mach_load_command_t *) ptr, offset);
+
+        if (lc.cmd == LC_SEGMENT_64 || lc.cmd == LC_SEGMENT) {
+            mach_segment_command_64_t seg;
+            size_t segsize, sectsize;
+
+            if (lc.cmd == LC_SEGMENT_64) {
+                segsize = sizeof (mach_segment_command_64_t);
+                sectsize = sizeof (mach_section_64_t);
+                if (lc.cmdsize >= segsize)
+                    memcpy (&seg, ptr, segsize);
+            } else {
+                segsize = sizeof (mach_segment_command_32_t);
+                sectsize = sizeof (mach_section_32_t);
+                if (lc.cmdsize >= segsize)
+                    stream_widen_segment ((const mach_segment_command_32_t *) ptr, &seg);
+            }
+
+            if (lc.cmdsize < segsize || (lc.cmdsize - segsize) / sectsize < seg.nsects) {
+                errorf ("macho_stream: segment command %d is truncated\n", i);
+                return MACHO_STREAM_FAILURE;
+            }
+
+            if (stream->cb.segment)
+                stream->cb.segment (stream->ctx, &seg, segindex);
+
+            for (uint32_t k = 0; stream->cb.section && k < seg.nsects; k++) {
+                mach_section_64_t sect;
+                const unsigned char *sptr = ptr + segsize + (k * sectsize);
+
+                if (lc.cmd == LC_SEGMENT_64)
+                    memcpy (&sect, sptr, sizeof (mach_section_64_t));
+                else
+                    stream_widen_section ((const mach_section_32_t *) sptr, &sect);
+
+                stream->cb.section (stream->ctx, &sect, segindex);
+            }
+
+            if (!stream_resolve_segment (stream, &seg))
+                return MACHO_STREAM_FAILURE;
+            segindex++;
+        }
+
+        offset += lc.cmdsize;
+    }
+
+    // anything still unresolved names a segment that doesn't exist
+    for (int i = 0; i < stream->nranges; i++) {
+        if (!stream->ranges[i].resolved)
+            warningf ("macho_stream: no segment named %s\n", stream->ranges[i].segname);
+    }
+
+    stream->state = STREAM_STATE_BODY;
+    return MACHO_STREAM_SUCCESS;
+}
+
+
+/**
+ *  Push `size` bytes into the stream. The bytes are parsed immediately, so
+ *  callbacks may fire from within this call.
+ *
+ */
+int macho_stream_feed (macho_stream_t *stream, const void *buf, size_t size)
+{
+    const unsigned char *ptr = (const unsigned char *) buf;
+
+    if (!stream || stream->state == STREAM_STATE_ERROR)
+        return MACHO_STREAM_FAILURE;
+
+    while (size) {
+        size_t n = size;
+
+        // collect the header and load commands
+        if (stream->state != STREAM_STATE_BODY) {
+            if (stream->head_need > stream->head_cap) {
+                void *tmp = realloc (stream->head, stream->head_need);
+                if (!tmp)
+                    goto stream_failed;
+                stream->head = tmp;
+                stream->head_cap = stream->head_need;
+            }
+
+            n = MIN (size, stream->head_need - stream->head_len);
+            memcpy (stream->head + stream->head_len, ptr, n);
+            stream->head_len += n;
+        }
+
+        stream_deliver (stream, ptr, stream->pos, n);
+        stream->pos += n;
+        ptr += n;
+        size -= n;
+
+        if (stream->state == STREAM_STATE_HEADER && stream->head_len == stream->head_need) {
+            if (!stream_parse_header (stream))
+                goto stream_failed;
+        }
+        if (stream->state == STREAM_STATE_COMMANDS && stream->head_len == stream->head_need) {
+            if (!stream_parse_commands (stream))
+                goto stream_failed;
+        }
+    }
+    return MACHO_STREAM_SUCCESS;
+
+stream_failed:
+    stream->state = STREAM_STATE_ERROR;
+    return MACHO_STREAM_FAILURE;
+}
+
+
+/**
+ *  Signal the end of the stream.
+ *
+ *  @returns        MACHO_STREAM_SUCCESS if the load commands were parsed and
+ *                  every requested range arrived in full.
+ */
+int macho_stream_finish (macho_stream_t *stream)
+{
+    if (!stream || stream->state != STREAM_STATE_BODY) {
+        errorf ("macho_stream_finish(): stream ended before the load commands\n");
+        return MACHO_STREAM_FAILURE;
+    }
+
+    for (int i = 0; i < stream->nranges; i++) {
+        if (!stream->ranges[i].done) {
+            errorf ("macho_stream_finish(): range %d is incomplete\n", i);
+            return MACHO_STREAM_FAILURE;
+        }
+    }
+    return MACHO_STREAM_SUCCESS;
+}
+
+
+/**
+ *  Pull the whole stream through `read_func` until it reports the end.
+ *
+ */
+int macho_stream_run (macho_stream_t *stream, macho_stream_read_func_t read_func, void *ctx)
+{
+    unsigned char *buf = malloc (STREAM_READ_SIZE);
+    long n;
+
+    if (!buf)
+        return MACHO_STREAM_FAILURE;
+
+    while ((n = read_func (ctx, buf, STREAM_READ_SIZE)) > 0) {
+        if (!macho_stream_feed (stream, buf, (size_t) n)) {
+            free (buf);
+            return MACHO_STREAM_FAILURE;
+        }
+    }
+    free (buf);
+
+    if (n < 0) {
+        errorf ("macho_stream_run(): read failed\n");
+        return MACHO_STREAM_FAILURE;
+    }
+    return macho_stream_finish (stream);
+}
+
+
+static long stream_read_fd (void *ctx, void *buf, size_t size)
+{
+    int fd = *(int *) ctx;
+    ssize_t n;
+
+    do {
+        n = read (fd, buf, size);
+    } while (n < 0 && errno == EINTR);
+    return (long) n;
+}
+
+
+/**
+ *  Pull the whole stream from a file descriptor, e.g. a pipe.
+ *
+ */
+int macho_stream_run_fd (macho_stream_t *stream, int fd)
+{
+    return macho_stream_run (stream, stream_read_fd, &fd);
+}
+
+
+/**
+ *  Accessors for what the stream has parsed so far.
+ *
+ */
+const mach_header_t *macho_stream_get_header (macho_stream_t *stream)
+{
+    return (stream && stream->state >= STREAM_STATE_COMMANDS && stream->state != STREAM_STATE_ERROR)
+        ? &stream->header : NULL;
+}
+
+lh_view_t macho_stream_get_load_commands (macho_stream_t *stream)
+{
+    if (!stream || stream->state != STREAM_STATE_BODY)
+        return LH_VIEW_NULL;
+    return lh_view_create (stream->head + stream->header_size, stream->header.sizeofcmds, NULL);
+}
+
+lh_view_t macho_stream_get_range (macho_stream_t *stream, int index)
+{
+    if (!stream || index < 0 || index >= stream->nranges || !stream->ranges[index].done)
+        return LH_VIEW_NULL;
+    return lh_view_create (stream->ranges[index].data, stream->ranges[index].size, NULL);
+}
+
+uint64_t macho_stream_get_position (macho_stream_t *stream)
+{
+    return (stream) ? stream->pos : 0;
+}
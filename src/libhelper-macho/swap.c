@@ -0,0 +1,452 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <immintrin.h>
+#   define LIBHELPER_SWAP_SSSE3     1
+#elif defined(__aarch64__)
+#   include <arm_neon.h>
+#   define LIBHELPER_SWAP_NEON      1
+#endif
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Mach-O Byte Swapping                 								 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Arrays are swapped with byte shuffles. A layout becomes a permutation of
+ *  one struct, which is repeated over lcm(struct size, 16) bytes so that
+ *  every 16 byte lane has its own shuffle mask. Fields never straddle a
+ *  lane as long as they are naturally aligned, which holds for every
+ *  Mach-O structure; layouts where that isn't true are swapped one struct
+ *  at a time instead.
+ * 
+ */
+#define MACH_SWAP_STRUCT_MAX        256
+#define MACH_SWAP_PERIOD_MAX        4096
+
+struct __libhelper_swap_plan {
+    size_t          size;                           /* struct size */
+    size_t          period;                         /* bytes per mask repeat */
+    int             lanes;                          /* fields stay within 16 byte lanes */
+    uint8_t         perm[MACH_SWAP_STRUCT_MAX];     /* source byte for each byte of a struct */
+    uint8_t         mask[MACH_SWAP_PERIOD_MAX];     /* per-lane shuffle masks */
+};
+
+
+static int mach_swap_plan_build (struct __libhelper_swap_plan *plan, const char *layout)
+{
+    size_t size = 0, a, b;
+    const char *p = layout;
+
+    while (*p) {
+        size_t field = 0, count = 0;
+
+        while (*p >= '0' && *p <= '9')
+            count = (count * 10) + (size_t) (*p++ - '0');
+
+        switch (*p++) {
+            case 'B': case 'b': field = 1; break;
+            case 'H': case 'h': field = 2; break;
+            case 'I': case 'i': field = 4; break;
+            case 'Q': case 'q': field = 8; break;
+            case 's':
+                if (!count || size + count > MACH_SWAP_STRUCT_MAX)
+                    return 0;
+                for (size_t i = 0; i < count; i++, size++)
+                    plan->perm[size] = (uint8_t) size;
+                continue;
+            default:
+                return 0;
+        }
+
+        count = (count) ? count : 1;
+        if (size + (count * field) > MACH_SWAP_STRUCT_MAX)
+            return 0;
+
+        for (size_t n = 0; n < count; n++, size += field)
+            for (size_t i = 0; i < field; i++)
+                plan->perm[size + i] = (uint8_t) (size + field - 1 - i);
+    }
+
+    if (!size)
+        return 0;
+    plan->size = size;
+
+    // period = lcm (size, 16)
+    for (a = size, b = 16; b; ) {
+        size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    plan->period = (size / a) * 16;
+    plan->lanes = (plan->period <= MACH_SWAP_PERIOD_MAX);
+
+    for (size_t i = 0; plan->lanes && i < plan->period; i++) {
+        size_t src = ((i / size) * size) + plan->perm[i % size];
+        size_t lane = i & ~(size_t) 15;
+
+        if (src < lane || src >= lane + 16)
+            plan->lanes = 0;
+        else
+            plan->mask[i] = (uint8_t) (src - lane);
+    }
+    return 1;
+}
+
+
+/**
+ *  Shuffle `len` bytes (a multiple of 16) with masks that repeat every
+ *  `period` bytes.
+ * 
+ */
+static void mach_swap_lanes_scalar (uint8_t *data, size_t len, const uint8_t *mask, size_t period)
+{
+    uint8_t tmp[16];
+
+    for (size_t off = 0; off < len; off += 16) {
+        const uint8_t *m = mask + (off % period);
+        memcpy (tmp, data + off, 16);
+        for (int i = 0; i < 16; i++)
+            data[off + i] = tmp[m[i]];
+    }
+}
+
+#if LIBHELPER_SWAP_SSSE3
+__attribute__ ((target ("ssse3")))
+static void mach_swap_lanes_ssse3 (uint8_t *data, size_t len, const uint8_t *mask, size_t period)
+{
+    for (size_t off = 0; off < len; off += 16) {
+        __m128i v = _mm_loadu_si128 ((const __m128i *) (data + off));
+        __m128i m = _mm_loadu_si128 ((const __m128i *) (mask + (off % period)));
+        _mm_storeu_si128 ((__m128i *) (data + off), _mm_shuffle_epi8 (v, m));
+    }
+}
+#elif LIBHELPER_SWAP_NEON
+static void mach_swap_lanes_neon (uint8_t *data, size_t len, const uint8_t *mask, size_t period)
+{
+    for (size_t off = 0; off < len; off += 16) {
+        uint8x16_t v = vld1q_u8 (data + off);
+        uint8x16_t m = vld1q_u8 (mask + (off % period));
+        vst1q_u8 (data + off, vqtbl1q_u8 (v, m));
+    }
+}
+#endif
+
+static void mach_swap_lanes (uint8_t *data, size_t len, const uint8_t *mask, size_t period)
+{
+#if LIBHELPER_SWAP_SSSE3
+    static int ssse3 = -1;
+    if (ssse3 < 0)
+        ssse3 = __builtin_cpu_supports ("ssse3") ? 1 : 0;
+    if (ssse3) {
+        mach_swap_lanes_ssse3 (data, len, mask, period);
+        return;
+    }
+#elif LIBHELPER_SWAP_NEON
+    mach_swap_lanes_neon (data, len, mask, period);
+    return;
+#endif
+    mach_swap_lanes_scalar (data, len, mask, period);
+}
+
+
+/**
+ *  Swap an array of `count` structs in place, following `layout` (see the
+ *  MACH_LAYOUT_* macros). Whole 16 byte lanes go through the SIMD kernel,
+ *  the tail is finished off one struct at a time.
+ * 
+ *  @returns        MACH_SWAP_SUCCESS, or MACH_SWAP_FAILURE for a bad layout.
+ */
+int mach_swap_structs (void *data, size_t count, const char *layout)
+{
+    struct __libhelper_swap_plan plan;
+    uint8_t *p = (uint8_t *) data;
+    uint8_t tmp[MACH_SWAP_STRUCT_MAX];
+    size_t done = 0;
+
+    if (!data || !layout || !mach_swap_plan_build (&plan, layout))
+        return MACH_SWAP_FAILURE;
+
+    if (plan.lanes) {
+        size_t len = ((count * plan.size) / plan.period) * plan.period;
+        mach_swap_lanes (p, len, plan.mask, plan.period);
+        done = len / plan.size;
+    }
+
+    for (size_t n = done; n < count; n++) {
+        uint8_t *s = p + (n * plan.size);
+        memcpy (tmp, s, plan.size);
+        for (size_t i = 0; i < plan.size; i++)
+            s[i] = tmp[plan.perm[i]];
+    }
+    return MACH_SWAP_SUCCESS;
+}
+
+
+/**
+ *  Swap relocation entries from big endian. Both words are byte swapped,
+ *  then the bitfields of plain entries are moved to where a little endian
+ *  compiler expects them. Scattered entries happen to use the same bit
+ *  positions on either side, so only need the byte swap.
+ * 
+ */
+void mach_swap_relocations (void *data, size_t count)
+{
+    uint32_t *words = (uint32_t *) data;
+
+    if (!data || !mach_swap_structs (data, count * 2, "I"))
+        return;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t w = words[(i * 2) + 1];
+
+        // R_SCATTERED
+        if (words[i * 2] & 0x80000000)
+            continue;
+
+        words[(i * 2) + 1] = (w >> 8)                  /* r_symbolnum */
+                           | (((w >> 7) & 0x1) << 24)  /* r_pcrel */
+                           | (((w >> 5) & 0x3) << 25)  /* r_length */
+                           | (((w >> 4) & 0x1) << 27)  /* r_extern */
+                           | ((w & 0xf) << 28);        /* r_type */
+    }
+}
+
+
+static size_t mach_swap_layout_size (const char *layout)
+{
+    struct __libhelper_swap_plan plan;
+    return (mach_swap_plan_build (&plan, layout)) ? plan.size : 0;
+}
+
+
+/**
+ *  Swap `count` structs at `offset` in the copy, if they lie within it.
+ * 
+ */
+static void mach_swap_region (uint8_t *data, size_t size, uint64_t offset, uint64_t count, size_t stride, const char *layout)
+{
+    if (!count || offset > size || count > (size - offset) / stride) {
+        if (count)
+            warningf ("macho_swap_image(): table at offset 0x%llx lies outside of the image\n", (unsigned long long) offset);
+        return;
+    }
+
+    if (layout)
+        mach_swap_structs (data + offset, (size_t) count, layout);
+    else
+        mach_swap_relocations (data + offset, (size_t) count);
+}
+
+
+/**
+ *  Register state in LC_THREAD and LC_UNIXTHREAD is a list of flavor,
+ *  count and state, where count is in 32 bit words. Flavors are numbered
+ *  per CPU, and 64 bit states mix 64 and 32 bit fields, so the layout has
+ *  to come from the CPU type and flavor. PowerPC is listed because it is
+ *  where nearly every big endian Mach-O comes from.
+ *
+ */
+#define MACH_SWAP_CPU_TYPE_POWERPC64    ((cpu_type_t) (18 | CPU_ARCH_ABI64))
+
+static const struct __libhelper_swap_thread_state {
+    cpu_type_t          cputype;
+    uint32_t            flavor;
+    uint32_t            nregs;          /* leading 64 bit registers */
+    const char         *layout;         /* fields after the registers, or NULL */
+} mach_swap_thread_states[] = {
+    { CPU_TYPE_ARM64,               6,  33, "II" },     /* ARM_THREAD_STATE64 */
+    { CPU_TYPE_ARM64,               7,  1,  "II" },     /* ARM_EXCEPTION_STATE64 */
+    { CPU_TYPE_X86_64,              4,  21, NULL },     /* x86_THREAD_STATE64 */
+    { CPU_TYPE_X86_64,              6,  0,  "HHIQ" },   /* x86_EXCEPTION_STATE64 */
+    { MACH_SWAP_CPU_TYPE_POWERPC64, 5,  34, "I3QI" },   /* PPC_THREAD_STATE64 */
+    { MACH_SWAP_CPU_TYPE_POWERPC64, 6,  1,  "6I" },     /* PPC_EXCEPTION_STATE64 */
+};
+
+/**
+ *  Swap the body of a thread command. States of 32 bit CPUs are swapped as
+ *  32 bit words, which is right for their register states. For 64 bit CPUs
+ *  only the flavors above are swapped, others are left as they are.
+ *
+ */
+static void mach_swap_thread_command (uint8_t *body, uint32_t size, cpu_type_t cputype)
+{
+    uint32_t offset = 0;
+
+    while (size - offset >= 8) {
+        const struct __libhelper_swap_thread_state *state = NULL;
+        uint32_t *fc = (uint32_t *) (body + offset);
+        uint32_t bytes;
+
+        mach_swap_structs (fc, 2, "I");
+        if (fc[1] > (size - offset - 8) / 4) {
+            warningf ("macho_swap_image(): thread state flavor %u runs past its command\n", fc[0]);
+            return;
+        }
+        bytes = fc[1] * 4;
+        offset += 8;
+
+        for (size_t i = 0; i < sizeof (mach_swap_thread_states) / sizeof (mach_swap_thread_states[0]); i++) {
+            const struct __libhelper_swap_thread_state *s = &mach_swap_thread_states[i];
+            if (s->cputype == cputype && s->flavor == fc[0] &&
+                (s->nregs * 8) + ((s->layout) ? mach_swap_layout_size (s->layout) : 0) == bytes)
+                state = s;
+        }
+
+        if (state) {
+            mach_swap_structs (body + offset, state->nregs, "Q");
+            if (state->layout)
+                mach_swap_structs (body + offset + (state->nregs * 8), 1, state->layout);
+        } else if (!(cputype & CPU_ARCH_ABI64)) {
+            mach_swap_structs (body + offset, bytes / 4, "I");
+        } else {
+            debugf ("swap.c: macho_swap_image(): leaving thread state flavor %u as-is\n", fc[0]);
+        }
+
+        offset += bytes;
+    }
+}
+
+
+/**
+ *  Copy an opposite-endian Mach-O into `arena` and swap it to host order:
+ *  the header, every load command, sections, the symbol table, indirect
+ *  symbols and relocations. Thread state is swapped by flavor, see
+ *  `mach_swap_thread_command()`. Other data, e.g. code, strings and the dyld
+ *  info blobs, is copied as-is.
+ * 
+ *  @param          view of an MH_CIGAM or MH_CIGAM_64 image.
+ *  @param          arena to copy into.
+ * 
+ *  @returns        the swapped copy, or NULL on failure.
+ */
+unsigned char *macho_swap_image (lh_view_t view, HArena *arena)
+{
+    const uint32_t *magic = lh_view_ptr (view, 0, sizeof (uint32_t));
+    uint32_t offset, end, hdrsize;
+    mach_header_t *hdr;
+    uint8_t *data;
+    int is64;
+
+    if (!magic || (*magic != MACH_CIGAM_64 && *magic != MACH_CIGAM_32) || !arena)
+        return NULL;
+
+    is64 = (*magic == MACH_CIGAM_64);
+    hdrsize = (is64) ? sizeof (mach_header_t) : sizeof (mach_header_32_t);
+    if (view.size < hdrsize || view.size > UINT32_MAX) {
+        errorf ("macho_swap_image(): unsupported image size: %zu\n", view.size);
+        return NULL;
+    }
+
+    data = h_arena_alloc (arena, view.size);
+    if (!data)
+        return NULL;
+    memcpy (data, view.data, view.size);
+
+    hdr = (mach_header_t *) data;
+    mach_swap_structs (hdr, 1, (is64) ? "IiiIIIII" : "IiiIIII");
+
+    offset = hdrsize;
+    end = (hdr->sizeofcmds > view.size - hdrsize) ? (uint32_t) view.size : hdrsize + hdr->sizeofcmds;
+
+    for (uint32_t i = 0; i < hdr->ncmds; i++) {
+        const mach_lc_descriptor_t *desc;
+        mach_load_command_t *lc;
+        const char *layout;
+        size_t fixed;
+
+        if (end - offset < sizeof (mach_load_command_t)) {
+            errorf ("macho_swap_image(): load commands run past sizeofcmds\n");
+            return NULL;
+        }
+
+        lc = (mach_load_command_t *) (data + offset);
+        mach_swap_structs (lc, 1, "II");
+        if (lc->cmdsize < sizeof (mach_load_command_t) || lc->cmdsize > end - offset) {
+            errorf ("macho_swap_image(): invalid cmdsize 0x%x at offset 0x%08x\n", lc->cmdsize, offset);
+            return NULL;
+        }
+
+        if (lc->cmd == LC_THREAD || lc->cmd == LC_UNIXTHREAD) {
+            mach_swap_thread_command (data + offset + sizeof (mach_load_command_t),
+                                      lc->cmdsize - sizeof (mach_load_command_t), hdr->cputype);
+            offset += lc->cmdsize;
+            continue;
+        }
+
+        // commands without a layout only have their header swapped
+        desc = mach_lc_descriptor (lc->cmd);
+        layout = (desc) ? desc->layout : NULL;
+        fixed = (layout) ? mach_swap_layout_size (layout) : 0;
+        if (!layout || sizeof (mach_load_command_t) + fixed > lc->cmdsize) {
+            debugf ("swap.c: macho_swap_image(): leaving body of command 0x%x as-is\n", lc->cmd);
+            offset += lc->cmdsize;
+            continue;
+        }
+        mach_swap_structs (data + offset + sizeof (mach_load_command_t), 1, layout);
+
+        if (lc->cmd == LC_SEGMENT_64 || lc->cmd == LC_SEGMENT) {
+            size_t segsize = (is64) ? sizeof (mach_segment_command_64_t) : sizeof (mach_segment_command_32_t);
+            size_t sectsize = (is64) ? sizeof (mach_section_64_t) : sizeof (mach_section_32_t);
+            uint32_t nsects = (is64) ? ((mach_segment_command_64_t *) lc)->nsects : ((mach_segment_command_32_t *) lc)->nsects;
+
+            if (nsects > (lc->cmdsize - segsize) / sectsize) {
+                errorf ("macho_swap_image(): too many sections for segment at offset 0x%08x\n", offset);
+                return NULL;
+            }
+            mach_swap_structs (data + offset + segsize, nsects, (is64) ? MACH_LAYOUT_SECTION_64 : MACH_LAYOUT_SECTION);
+
+            for (uint32_t s = 0; s < nsects; s++) {
+                uint8_t *sect = data + offset + segsize + (s * sectsize);
+                uint32_t reloff = (is64) ? ((mach_section_64_t *) sect)->reloff : ((mach_section_32_t *) sect)->reloff;
+                uint32_t nreloc = (is64) ? ((mach_section_64_t *) sect)->nreloc : ((mach_section_32_t *) sect)->nreloc;
+                mach_swap_region (data, view.size, reloff, nreloc, 8, NULL);
+            }
+        } else if (lc->cmd == LC_SYMTAB) {
+            mach_symtab_command_t *symtab = (mach_symtab_command_t *) lc;
+            mach_swap_region (data, view.size, symtab->symoff, symtab->nsyms, (is64) ? 16 : 12,
+                              (is64) ? MACH_LAYOUT_NLIST_64 : MACH_LAYOUT_NLIST);
+        } else if (lc->cmd == LC_DYSYMTAB) {
+            mach_dysymtab_command_t *dysymtab = (mach_dysymtab_command_t *) lc;
+            mach_swap_region (data, view.size, dysymtab->indirectsymoff, dysymtab->nindirectsyms, 4, "I");
+            mach_swap_region (data, view.size, dysymtab->extreloff, dysymtab->nextrel, 8, NULL);
+            mach_swap_region (data, view.size, dysymtab->locreloff, dysymtab->nlocrel, 8, NULL);
+        } else if (lc->cmd == LC_BUILD_VERSION) {
+            uint32_t ntools = ((mach_build_version_command_t *) lc)->ntools;
+            if (ntools <= (lc->cmdsize - sizeof (mach_build_version_command_t)) / 8)
+                mach_swap_structs (data + offset + sizeof (mach_build_version_command_t), ntools, "II");
+        }
+
+        offset += lc->cmdsize;
+    }
+
+    return data;
+}
@@ -42,8 +42,8 @@ mach_symtab_command_t *mach_symtab_command_create ()
  */
 mach_symtab_command_t *mach_symtab_command_load (macho_t *macho, uint32_t offset)
 {
-    mach_symtab_command_t *sym = mach_symtab_command_create ();
-    sym = (mach_symtab_command_t *) macho_load_bytes (macho, sizeof (mach_symtab_command_t), offset);
+    size_t size = sizeof (mach_symtab_command_t);
+    mach_symtab_command_t *sym = (mach_symtab_command_t *) lh_view_ptr (macho_get_view (macho, offset, size), 0, size);
 
     if (!sym) {
         errorf ("mach_symtab_command_load(): problem loading mach symbol table at offset: 0x%08x\n", offset);
@@ -53,33 +53,17 @@ mach_symtab_command_t *mach_symtab_command_load (macho_t *macho, uint32_t offset
 }
 
 /**
+ *  Find the name of a symbol in the string table. The name is returned
+ *  in-place, so it is only valid for as long as the Mach-O is mapped.
  * 
  */
 char *mach_symtab_find_symbol_name (macho_t *macho, nlist *sym, mach_symtab_command_t *cmd)
 {
     // offset of the symbol table name is symbol->off + nlist->n_strx;
-    uint32_t size = cmd->strsize - sym->n_strx;
-    uint32_t offset = cmd->stroff + sym->n_strx;
-
-    HString *curr = h_string_new ("");
-    uint32_t found = 0, i = 0;
-    char *tmp = malloc (size);
-
-    memcpy (tmp, macho->data + offset, size);
-    while (!found) {
-        if (i >= size) break;
-        if (tmp[i] != 0x0) {
-            curr = h_string_append_c (curr, tmp[i]);
-            i++;
-        } else {
-            if (curr->str && curr->len > 0) {
-                found = 1;
-                return curr->str;
-            }
-            break;
-        }
-    }
-    return "(no name)";
+    lh_view_t strtab = macho_get_view (macho, cmd->stroff, cmd->strsize);
+    const char *name = lh_view_cstr (strtab, sym->n_strx);
+
+    return (name && *name) ? (char *) name : "(no name)";
 }
 
 /**
@@ -123,10 +107,17 @@ mach_symbol_table_t *mach_symtab_load_symbols (macho_t *macho, mach_symtab_comma
     debugf ("\nsymbol.c:mach_symtab_load_symbols(): Trying to load symbol table:\n\n");
 
     size_t s = symbol_table->nsyms;
-    off_t off = symbol_table->symoff;
+
+    // the table is bounded once, rather than per entry. Mach-O's created
+    //  without a size were never validated, so this check is all they get.
+    nlist *syms = (nlist *) lh_view_ptr (macho_get_view (macho, symbol_table->symoff, s * sizeof (nlist)), 0, s * sizeof (nlist));
+    if (!syms) {
+        warningf ("mach_symtab_load_symbols(): symbol table is out of bounds\n");
+        return NULL;
+    }
 
     for (size_t i = 0; i < s; i++) {
-        nlist *tmp = (nlist *) macho_load_bytes (macho, sizeof(nlist), off);
+        nlist *tmp = &syms[i];
 
         char *name = mach_symtab_find_symbol_name (macho, tmp, symbol_table);
 
@@ -171,7 +162,6 @@ mach_symbol_table_t *mach_symtab_load_symbols (macho_t *macho, mach_symtab_comma
         //debugf ("symbol.c:mach_symtab_load_symbols(): sym desc: %d\n", tmp->n_desc);
         //debugf ("symbol.c:mach_symtab_load_symbols(): sym val: %lu\n", tmp->n_value);
 
-        off += sizeof(nlist);
     }
 
     return NULL;
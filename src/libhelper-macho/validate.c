@@ -0,0 +1,117 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Mach-O Validation                   								 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Every offset a Mach-O contains is checked once, here, before anything is
+ *  parsed. Load commands that refer to data outside of the mapping are
+ *  left out of the validity bitmap, and the parsers skip them, so the
+ *  accessors that run afterwards can read straight from the mapping. The
+ *  checks for each command type live with its descriptor, see
+ *  mach_lc_check().
+ * 
+ */
+
+static int mach_validate_range (size_t size, uint64_t offset, uint64_t len)
+{
+    return offset <= size && len <= size - offset;
+}
+
+/**
+ *  Validate a Mach-O whose header is `hdroff` bytes into `view`, against
+ *  the size of the view. The header and the load command table have to be
+ *  sound for the image to be parsed at all; beyond that, each command gets
+ *  a bit in `valid` that is only set if the command and every range it
+ *  refers to lie within the view.
+ * 
+ *  @param          view of the mapping.
+ *  @param          hdroff of the header within the view.
+ *  @param          valid is set to a malloc()'d bitmap, one bit per command.
+ * 
+ *  @returns        MACHO_VALID_SUCCESS, or MACHO_VALID_FAILURE if the load
+ *                  commands can't be walked.
+ */
+int macho_validate (lh_view_t view, uint32_t hdroff, uint32_t **valid)
+{
+    const mach_header_t *hdr;
+    const uint8_t *base;
+    uint64_t offset, end;
+    uint32_t *bitmap;
+    size_t hdrsize;
+    int is64;
+
+    if (!valid)
+        return MACHO_VALID_FAILURE;
+    *valid = NULL;
+
+    hdr = lh_view_ptr (view, hdroff, sizeof (mach_header_32_t));
+    if (!hdr)
+        return MACHO_VALID_FAILURE;
+
+    is64 = (hdr->magic == MACH_MAGIC_64);
+    hdrsize = (is64) ? sizeof (mach_header_t) : sizeof (mach_header_32_t);
+    if (!mach_validate_range (view.size, hdroff, hdrsize + (uint64_t) hdr->sizeofcmds)) {
+        errorf ("macho_validate(): load commands run past the end of the file\n");
+        return MACHO_VALID_FAILURE;
+    }
+
+    bitmap = calloc ((hdr->ncmds / 32) + 1, sizeof (uint32_t));
+    if (!bitmap)
+        return MACHO_VALID_FAILURE;
+
+    base = (const uint8_t *) view.data;
+    offset = hdroff + hdrsize;
+    end = offset + hdr->sizeofcmds;
+
+    for (uint32_t i = 0; i < hdr->ncmds; i++) {
+        const mach_load_command_t *lc = (const mach_load_command_t *) (base + offset);
+
+        if (end - offset < sizeof (mach_load_command_t) || lc->cmdsize < sizeof (mach_load_command_t) ||
+            lc->cmdsize > end - offset) {
+            errorf ("macho_validate(): load command %u at offset 0x%llx is malformed\n", i, (unsigned long long) offset);
+            free (bitmap);
+            return MACHO_VALID_FAILURE;
+        }
+
+        if (mach_lc_check (base + offset, lc->cmdsize, view.size, is64))
+            bitmap[i / 32] |= (1u << (i % 32));
+        else
+            warningf ("macho_validate(): %s at offset 0x%llx refers to data outside of the file\n",
+                      mach_load_command_get_string ((mach_load_command_t *) lc), (unsigned long long) offset);
+
+        offset += lc->cmdsize;
+    }
+
+    *valid = bitmap;
+    return MACHO_VALID_SUCCESS;
+}
@@ -0,0 +1,590 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+
+#include "libhelper/libhelper.h"
+#include "libhelper/libhelper-macho.h"
+#include "hlib.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MACHO_XREF_X86          1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define MACHO_XREF_NEON         1
+#endif
+
+/* instructions handed to each thread */
+#define MACHO_XREF_CHUNK        (256 * 1024)
+
+/* instructions an ADRP result is assumed to stay live for */
+#define MACHO_XREF_WINDOW       32
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Instruction decoding                  									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Only ADRP, ADR and literal loads can start a reference. Anything else
+ *  only matters while an ADRP is live, so the scan skips straight from one
+ *  of these to the next.
+ *
+ */
+#define MACHO_XREF_IS_ADR(insn)         (((insn) & 0x1f000000) == 0x10000000)
+#define MACHO_XREF_IS_LITERAL(insn)     (((insn) & 0x3b000000) == 0x18000000)
+#define MACHO_XREF_IS_START(insn)       (MACHO_XREF_IS_ADR (insn) || MACHO_XREF_IS_LITERAL (insn))
+
+static inline uint32_t macho_xref_insn (const unsigned char *code, size_t i)
+{
+    uint32_t insn;
+    memcpy (&insn, code + (i << 2), sizeof (insn));
+    return insn;
+}
+
+static inline int64_t macho_xref_sext (uint64_t value, int bits)
+{
+    return (int64_t) (value << (64 - bits)) >> (64 - bits);
+}
+
+/* immhi:immlo of ADR and ADRP */
+static inline int64_t macho_xref_adr_imm (uint32_t insn)
+{
+    return macho_xref_sext ((((insn >> 5) & 0x7ffff) << 2) | ((insn >> 29) & 0x3), 21);
+}
+
+
+typedef size_t (*macho_xref_next_func_t) (const unsigned char *code, size_t from, size_t to);
+
+static size_t macho_xref_next_scalar (const unsigned char *code, size_t from, size_t to)
+{
+    for (size_t i = from; i < to; i++) {
+        uint32_t insn = macho_xref_insn (code, i);
+        if (MACHO_XREF_IS_START (insn))
+            return i;
+    }
+    return to;
+}
+
+#ifdef MACHO_XREF_X86
+
+__attribute__((target("avx2")))
+static size_t macho_xref_next_avx2 (const unsigned char *code, size_t from, size_t to)
+{
+    const __m256i adr_mask = _mm256_set1_epi32 (0x1f000000);
+    const __m256i adr_bits = _mm256_set1_epi32 (0x10000000);
+    const __m256i lit_mask = _mm256_set1_epi32 (0x3b000000);
+    const __m256i lit_bits = _mm256_set1_epi32 (0x18000000);
+    size_t i = from;
+
+    for (; i + 8 <= to; i += 8) {
+        __m256i w = _mm256_loadu_si256 ((const __m256i *) (code + (i << 2)));
+        __m256i hit = _mm256_or_si256 (_mm256_cmpeq_epi32 (_mm256_and_si256 (w, adr_mask), adr_bits),
+                                       _mm256_cmpeq_epi32 (_mm256_and_si256 (w, lit_mask), lit_bits));
+        int mask = _mm256_movemask_ps (_mm256_castsi256_ps (hit));
+
+        if (mask)
+            return i + (size_t) __builtin_ctz ((unsigned) mask);
+    }
+    return macho_xref_next_scalar (code, i, to);
+}
+
+#endif /* MACHO_XREF_X86 */
+
+#ifdef MACHO_XREF_NEON
+
+static size_t macho_xref_next_neon (const unsigned char *code, size_t from, size_t to)
+{
+    const uint32x4_t adr_mask = vdupq_n_u32 (0x1f000000);
+    const uint32x4_t adr_bits = vdupq_n_u32 (0x10000000);
+    const uint32x4_t lit_mask = vdupq_n_u32 (0x3b000000);
+    const uint32x4_t lit_bits = vdupq_n_u32 (0x18000000);
+    size_t i = from;
+
+    for (; i + 4 <= to; i += 4) {
+        uint32x4_t w = vreinterpretq_u32_u8 (vld1q_u8 (code + (i << 2)));
+        uint32x4_t hit = vorrq_u32 (vceqq_u32 (vandq_u32 (w, adr_mask), adr_bits),
+                                    vceqq_u32 (vandq_u32 (w, lit_mask), lit_bits));
+
+        if (vmaxvq_u32 (hit))
+            return macho_xref_next_scalar (code, i, i + 4);
+    }
+    return macho_xref_next_scalar (code, i, to);
+}
+
+#endif /* MACHO_XREF_NEON */
+
+static macho_xref_next_func_t macho_xref_resolve ()
+{
+#if defined(MACHO_XREF_X86)
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+        return macho_xref_next_avx2;
+#elif defined(MACHO_XREF_NEON)
+    return macho_xref_next_neon;
+#endif
+    return macho_xref_next_scalar;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Scanning                              									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Index entries only keep the referencing address as an offset from the
+ *  lowest executable address, which keeps them to 16 bytes.
+ *
+ */
+struct __libhelper_xref_entry {
+    uint64_t        target;
+    uint32_t        from;
+    uint32_t        kind;
+};
+
+struct __libhelper_macho_xref_index {
+    uint64_t                         base;      /* lowest executable address */
+    size_t                           count;
+    struct __libhelper_xref_entry   *entries;   /* sorted by target, then from */
+};
+
+struct __libhelper_xref_chunk {
+    const unsigned char     *code;
+    uint64_t                 vmaddr;            /* address of the region */
+    size_t                   from;              /* instructions owned by the chunk */
+    size_t                   to;
+};
+
+struct __libhelper_xref_job {
+    struct __libhelper_xref_chunk   *chunks;
+    HArray                         **results;   /* per chunk, NULL if it failed */
+    macho_xref_next_func_t           next;
+    uint64_t                         base;
+};
+
+static int macho_xref_compare (const void *a, const void *b)
+{
+    const struct __libhelper_xref_entry *x = a, *y = b;
+    if (x->target != y->target)
+        return (x->target > y->target) ? 1 : -1;
+    return (x->from > y->from) - (x->from < y->from);
+}
+
+
+/**
+ *  Scan one chunk. A register set by ADRP is live until it is overwritten
+ *  by the ADD or load that consumes it, control flow leaves the block, or
+ *  MACHO_XREF_WINDOW instructions go by. Other writes to the register
+ *  aren't decoded, the window covers them.
+ *
+ *  The chunk starts decoding a window early, so an ADRP before the chunk
+ *  pairs with a consumer inside it exactly as a single pass would, but
+ *  only references completed inside the chunk are recorded.
+ *
+ */
+static void macho_xref_chunk (void *ctx, size_t index)
+{
+    struct __libhelper_xref_job *job = (struct __libhelper_xref_job *) ctx;
+    struct __libhelper_xref_chunk *chunk = &job->chunks[index];
+    HArray *found = h_array_new (sizeof (struct __libhelper_xref_entry));
+    uint64_t page[32];
+    size_t at[32], newest = 0;
+    uint32_t live = 0;
+    size_t i;
+
+    if (!found)
+        return;
+
+    i = (chunk->from > MACHO_XREF_WINDOW) ? chunk->from - MACHO_XREF_WINDOW : 0;
+    for (; i < chunk->to; i++) {
+        struct __libhelper_xref_entry e;
+        uint64_t pc;
+        uint32_t insn;
+
+        if (live && i - newest > MACHO_XREF_WINDOW)
+            live = 0;
+        if (!live) {
+            i = job->next (chunk->code, i, chunk->to);
+            if (i >= chunk->to)
+                break;
+        }
+
+        insn = macho_xref_insn (chunk->code, i);
+        pc = chunk->vmaddr + (i << 2);
+        e.kind = 0;
+
+        if ((insn & 0x9f000000) == 0x90000000) {
+            // ADRP
+            uint32_t rd = insn & 0x1f;
+            if (rd != 31) {
+                page[rd] = (pc & ~0xfffULL) + (uint64_t) (macho_xref_adr_imm (insn) * 4096);
+                at[rd] = newest = i;
+                live |= 1u << rd;
+            }
+        } else if ((insn & 0x9f000000) == 0x10000000) {
+            // ADR
+            e.target = pc + (uint64_t) macho_xref_adr_imm (insn);
+            e.kind = MACHO_XREF_ADR;
+        } else if (MACHO_XREF_IS_LITERAL (insn)) {
+            // LDR (literal)
+            e.target = pc + (uint64_t) (macho_xref_sext ((insn >> 5) & 0x7ffff, 19) * 4);
+            e.kind = MACHO_XREF_LDR_LITERAL;
+        } else if ((insn & 0xff000000) == 0x91000000) {
+            // ADD (immediate), 64-bit
+            uint32_t rd = insn & 0x1f, rn = (insn >> 5) & 0x1f;
+            uint64_t imm = (insn >> 10) & 0xfff;
+
+            if ((live & (1u << rn)) && i - at[rn] <= MACHO_XREF_WINDOW) {
+                e.target = page[rn] + ((insn & (1u << 22)) ? imm << 12 : imm);
+                e.kind = MACHO_XREF_ADRP_ADD;
+            }
+            live &= ~(1u << rd);
+        } else if ((insn & 0x3b000000) == 0x39000000) {
+            // LDR/STR (unsigned immediate)
+            uint32_t rt = insn & 0x1f, rn = (insn >> 5) & 0x1f;
+            uint32_t scale = insn >> 30, vector = (insn >> 26) & 1, opc = (insn >> 22) & 3;
+
+            if (vector && !scale && (opc & 2))
+                scale = 4;
+            if ((live & (1u << rn)) && i - at[rn] <= MACHO_XREF_WINDOW) {
+                e.target = page[rn] + ((uint64_t) ((insn >> 10) & 0xfff) << scale);
+                e.kind = MACHO_XREF_ADRP_LDR;
+            }
+            if (!vector && opc)
+                live &= ~(1u << rt);
+        } else if (insn == 0xd65f03c0 || (insn & 0xfc000000) == 0x14000000 || (insn & 0xfffffc1f) == 0xd61f0000) {
+            // RET, B and BR end the block
+            live = 0;
+        } else if ((insn & 0xfc000000) == 0x94000000) {
+            // BL clobbers the argument and scratch registers
+            live &= ~0x7ffffu;
+        }
+
+        if (e.kind && i >= chunk->from) {
+            e.from = (uint32_t) (pc - job->base);
+            if (!h_array_push (found, &e)) {
+                h_array_free (found);
+                return;
+            }
+        }
+    }
+
+    // each chunk sorts its own entries, then the chunks are merged
+    if (found->len)
+        qsort (found->data, found->len, sizeof (struct __libhelper_xref_entry), macho_xref_compare);
+    job->results[index] = found;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Merging                               									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Sorted runs are merged pairwise, one round at a time, with each pair
+ *  of a round merged on its own thread. `bounds` holds `runs + 1` offsets
+ *  into `src`.
+ *
+ */
+struct __libhelper_xref_merge {
+    const struct __libhelper_xref_entry     *src;
+    struct __libhelper_xref_entry           *dst;
+    const size_t                            *bounds;
+    size_t                                   runs;
+};
+
+static void macho_xref_merge_pair (void *ctx, size_t index)
+{
+    struct __libhelper_xref_merge *m = (struct __libhelper_xref_merge *) ctx;
+    size_t lo = m->bounds[index * 2];
+    size_t mid = m->bounds[index * 2 + 1];
+    size_t hi = (index * 2 + 2 <= m->runs) ? m->bounds[index * 2 + 2] : mid;
+    size_t a = lo, b = mid, n = lo;
+
+    while (a < mid && b < hi)
+        m->dst[n++] = (macho_xref_compare (&m->src[b], &m->src[a]) < 0) ? m->src[b++] : m->src[a++];
+    memcpy (m->dst + n, m->src + a, (mid - a) * sizeof (*m->dst));
+    n += mid - a;
+    memcpy (m->dst + n, m->src + b, (hi - b) * sizeof (*m->dst));
+}
+
+static struct __libhelper_xref_entry *macho_xref_merge (struct __libhelper_xref_entry *entries, size_t count,
+                                                        size_t *bounds, size_t runs, int nthreads)
+{
+    struct __libhelper_xref_entry *tmp;
+    struct __libhelper_xref_merge m;
+
+    if (runs < 2)
+        return entries;
+
+    tmp = malloc (count * sizeof (struct __libhelper_xref_entry));
+    if (!tmp) {
+        qsort (entries, count, sizeof (struct __libhelper_xref_entry), macho_xref_compare);
+        return entries;
+    }
+
+    m.src = entries;
+    m.dst = tmp;
+    m.bounds = bounds;
+
+    while (runs > 1) {
+        m.runs = runs;
+        lh_parallel_for ((runs + 1) / 2, macho_xref_merge_pair, &m, nthreads);
+
+        // the merged runs start where every other run did
+        for (size_t k = 0; k * 2 <= runs; k++)
+            bounds[k] = bounds[k * 2];
+        bounds[(runs + 1) / 2] = count;
+        runs = (runs + 1) / 2;
+
+        m.src = m.dst;
+        m.dst = (m.dst == tmp) ? entries : tmp;
+    }
+
+    if (m.src == tmp) {
+        free (entries);
+        return tmp;
+    }
+    free (tmp);
+    return entries;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Cross Reference Index                 									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Build the cross reference index of every executable section, in one
+ *  pass, on `nthreads` threads or `lh_thread_count()` when zero. ADRP
+ *  followed by ADD or a load or store, ADR and literal loads are decoded.
+ *
+ *  @returns        the index, or NULL on failure or if the Mach-O isn't
+ *                  arm64.
+ */
+macho_xref_index_t *macho_xref_index_create (void *macho, int nthreads)
+{
+    return macho_fileset_xref_index_create (macho, NULL, nthreads);
+}
+
+
+/**
+ *  `macho_xref_index_create()` for a caller that already has the fileset
+ *  loaded, so its entries aren't parsed again. With a NULL `fileset` one
+ *  is loaded when it is needed.
+ *
+ */
+macho_xref_index_t *macho_fileset_xref_index_create (void *macho, macho_fileset_t *fileset, int nthreads)
+{
+    macho_t *tmp = (macho_t *) macho;
+    macho_xref_index_t *index = NULL;
+    struct __libhelper_xref_job job;
+    macho_region_t *regions;
+    size_t nchunks = 0, total = 0, n = 0, *bounds = NULL;
+    uint64_t base = UINT64_MAX, end = 0;
+    int nregions = 0;
+
+    if (!tmp || !tmp->header || tmp->header->magic != MACH_MAGIC_64 || tmp->header->cputype != CPU_TYPE_ARM64) {
+        errorf ("macho_xref_index_create(): only arm64 Mach-O's are supported\n");
+        return NULL;
+    }
+
+    regions = macho_fileset_find_exec_regions (macho, fileset, &nregions);
+    if (!regions) {
+        // nothing executable, so nothing references anything
+        return calloc (1, sizeof (macho_xref_index_t));
+    }
+
+    for (int i = 0; i < nregions; i++) {
+        base = MIN (base, regions[i].vmaddr);
+        end = MAX (end, regions[i].vmaddr + regions[i].size);
+        nchunks += (regions[i].size / 4 + MACHO_XREF_CHUNK - 1) / MACHO_XREF_CHUNK;
+    }
+    if (end - base > UINT32_MAX) {
+        errorf ("macho_xref_index_create(): executable sections span more than 4GB\n");
+        free (regions);
+        return NULL;
+    }
+
+    memset (&job, 0, sizeof (job));
+    job.chunks = calloc (nchunks ? nchunks : 1, sizeof (struct __libhelper_xref_chunk));
+    job.results = calloc (nchunks ? nchunks : 1, sizeof (HArray *));
+    job.next = macho_xref_resolve ();
+    job.base = base;
+    if (!job.chunks || !job.results)
+        goto xref_failed;
+
+    nchunks = 0;
+    for (int i = 0; i < nregions; i++) {
+        size_t insns = regions[i].size / 4;
+        lh_view_t view;
+
+        if (!insns || regions[i].offset > UINT32_MAX)
+            continue;
+
+        // sections that fall outside the mapping aren't scanned
+        view = macho_get_view (macho, (uint32_t) regions[i].offset, insns * 4);
+        if (!lh_view_is_valid (view))
+            continue;
+
+        for (size_t from = 0; from < insns; from += MACHO_XREF_CHUNK) {
+            struct __libhelper_xref_chunk *chunk = &job.chunks[nchunks++];
+            chunk->code = view.data;
+            chunk->vmaddr = regions[i].vmaddr;
+            chunk->from = from;
+            chunk->to = MIN (from + MACHO_XREF_CHUNK, insns);
+        }
+    }
+
+    lh_parallel_for (nchunks, macho_xref_chunk, &job, nthreads);
+
+    index = calloc (1, sizeof (macho_xref_index_t));
+    bounds = malloc ((nchunks + 1) * sizeof (size_t));
+    if (!index || !bounds)
+        goto xref_failed;
+
+    for (size_t i = 0; i < nchunks; i++) {
+        if (!job.results[i])
+            goto xref_failed;
+        total += job.results[i]->len;
+    }
+
+    index->base = base;
+    index->entries = malloc ((total ? total : 1) * sizeof (struct __libhelper_xref_entry));
+    if (!index->entries)
+        goto xref_failed;
+
+    for (size_t i = 0; i < nchunks; i++) {
+        bounds[i] = n;
+        if (job.results[i]->len)
+            memcpy (index->entries + n, job.results[i]->data, job.results[i]->len * sizeof (struct __libhelper_xref_entry));
+        n += job.results[i]->len;
+    }
+    bounds[nchunks] = n;
+
+    index->entries = macho_xref_merge (index->entries, n, bounds, nchunks, nthreads);
+    index->count = n;
+
+    for (size_t i = 0; i < nchunks; i++)
+        h_array_free (job.results[i]);
+    free (job.results);
+    free (job.chunks);
+    free (bounds);
+    free (regions);
+    return index;
+
+xref_failed:
+    if (job.results) {
+        for (size_t i = 0; i < nchunks; i++)
+            h_array_free (job.results[i]);
+    }
+    free (job.results);
+    free (job.chunks);
+    free (bounds);
+    free (regions);
+    macho_xref_index_free (index);
+    return NULL;
+}
+
+
+void macho_xref_index_free (macho_xref_index_t *index)
+{
+    if (!index)
+        return;
+    free (index->entries);
+    free (index);
+}
+
+
+size_t macho_xref_index_count (const macho_xref_index_t *index)
+{
+    return (index) ? index->count : 0;
+}
+
+
+static size_t macho_xref_lower_bound (const macho_xref_index_t *index, uint64_t target)
+{
+    size_t lo = 0, hi = index->count;
+
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) >> 1);
+        if (index->entries[mid].target < target)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+/**
+ *  Find the references to any address in [start, end), such as anywhere
+ *  in a structure. Matching entries are contiguous in the index, `first`
+ *  is set to the position of the first of them.
+ *
+ *  @returns        number of references.
+ */
+size_t macho_xref_lookup_range (const macho_xref_index_t *index, uint64_t start, uint64_t end, size_t *first)
+{
+    size_t lo, hi;
+
+    if (!index || start >= end)
+        return 0;
+
+    lo = macho_xref_lower_bound (index, start);
+    hi = macho_xref_lower_bound (index, end);
+    if (first)
+        *first = lo;
+    return hi - lo;
+}
+
+
+/**
+ *  Find the references to `target`, see `macho_xref_lookup_range()`.
+ *
+ */
+size_t macho_xref_lookup (const macho_xref_index_t *index, uint64_t target, size_t *first)
+{
+    return (target == UINT64_MAX) ? 0 : macho_xref_lookup_range (index, target, target + 1, first);
+}
+
+
+/**
+ *  Read entry `i` of the index.
+ *
+ *  @returns        MACHO_XREF_SUCCESS, or MACHO_XREF_FAILURE if `i` is out
+ *                  of range.
+ */
+int macho_xref_get (const macho_xref_index_t *index, size_t i, macho_xref_t *out)
+{
+    if (!index || !out || i >= index->count)
+        return MACHO_XREF_FAILURE;
+
+    out->target = index->entries[i].target;
+    out->from = index->base + index->entries[i].from;
+    out->kind = index->entries[i].kind;
+    return MACHO_XREF_SUCCESS;
+}
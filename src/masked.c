@@ -0,0 +1,434 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "hlib.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BH_MASKED_X86           1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define BH_MASKED_NEON          1
+#endif
+
+/* bytes handed to each thread, big enough to amortise starting it */
+#define BH_MASKED_CHUNK         (1024 * 1024)
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Matching                              									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Compare the whole pattern at `data`. The pattern bytes are stored
+ *  already masked, so each byte is one and and one compare.
+ *
+ */
+static inline int bh_masked_match (const bh_masked_t *pat, const unsigned char *data)
+{
+    size_t k = 0;
+
+    for (; k + 8 <= pat->len; k += 8) {
+        uint64_t d, m, b;
+        memcpy (&d, data + k, 8);
+        memcpy (&m, pat->mask + k, 8);
+        memcpy (&b, pat->bytes + k, 8);
+        if ((d & m) != b)
+            return 0;
+    }
+    for (; k < pat->len; k++)
+        if ((data[k] & pat->mask[k]) != pat->bytes[k])
+            return 0;
+    return 1;
+}
+
+static inline int bh_masked_anchor (const bh_masked_t *pat, const unsigned char *data)
+{
+    if (pat->anchor_width == 4) {
+        uint32_t d;
+        memcpy (&d, data + pat->anchor, 4);
+        return (d & pat->anchor_mask) == pat->anchor_value;
+    }
+    return (data[pat->anchor] & pat->anchor_mask) == pat->anchor_value;
+}
+
+
+/**
+ *  Every search takes the range of start positions [from, to), where
+ *  `from` is aligned and `to + len - 1` is within the data, and returns the
+ *  first match, or BH_MASKED_NONE.
+ *
+ */
+static size_t bh_masked_next_scalar (const bh_masked_t *pat, const unsigned char *data, size_t from, size_t to)
+{
+    for (size_t p = from; p < to; p += pat->align)
+        if (bh_masked_anchor (pat, data + p) && bh_masked_match (pat, data + p))
+            return p;
+    return BH_MASKED_NONE;
+}
+
+/**
+ *  Which lanes of a block are aligned start positions. A block starts at
+ *  an aligned position, so this is the same for every block.
+ *
+ */
+static uint32_t bh_masked_lanes (const bh_masked_t *pat, unsigned lanes, unsigned lane_size)
+{
+    uint32_t mask = 0;
+
+    for (unsigned j = 0; j < lanes; j++)
+        if (((size_t) j * lane_size) % pat->align == 0)
+            mask |= 1u << j;
+    return mask;
+}
+
+#define BH_MASKED_VERIFY(bits, lane_size)                                           \
+    while (bits) {                                                                  \
+        size_t q = p + (size_t) __builtin_ctz (bits) * (lane_size);                 \
+        if (bh_masked_match (pat, data + q))                                        \
+            return q;                                                               \
+        bits &= bits - 1;                                                           \
+    }
+
+#ifdef BH_MASKED_X86
+
+/**
+ *  Compare-under-mask of 8 candidate words, or 32 candidate bytes, at
+ *  once. For A64 every lane is one instruction. Only the anchor is
+ *  compared here, and only lanes that pass it are verified in full.
+ *
+ */
+__attribute__((target("avx2")))
+static size_t bh_masked_next_avx2 (const bh_masked_t *pat, const unsigned char *data, size_t from, size_t to)
+{
+    size_t p = from;
+
+    if (pat->anchor_width == 4) {
+        const __m256i mask = _mm256_set1_epi32 ((int) pat->anchor_mask);
+        const __m256i value = _mm256_set1_epi32 ((int) pat->anchor_value);
+        const uint32_t lanes = bh_masked_lanes (pat, 8, 4);
+
+        for (; p + 32 <= to; p += 32) {
+            __m256i v = _mm256_loadu_si256 ((const __m256i *) (data + p + pat->anchor));
+            uint32_t bits = (uint32_t) _mm256_movemask_ps (_mm256_castsi256_ps (
+                                _mm256_cmpeq_epi32 (_mm256_and_si256 (v, mask), value))) & lanes;
+            BH_MASKED_VERIFY (bits, 4);
+        }
+    } else {
+        const __m256i mask = _mm256_set1_epi8 ((char) pat->anchor_mask);
+        const __m256i value = _mm256_set1_epi8 ((char) pat->anchor_value);
+        const uint32_t lanes = bh_masked_lanes (pat, 32, 1);
+
+        for (; p + 32 <= to; p += 32) {
+            __m256i v = _mm256_loadu_si256 ((const __m256i *) (data + p + pat->anchor));
+            uint32_t bits = (uint32_t) _mm256_movemask_epi8 (
+                                _mm256_cmpeq_epi8 (_mm256_and_si256 (v, mask), value)) & lanes;
+            BH_MASKED_VERIFY (bits, 1);
+        }
+    }
+
+    return bh_masked_next_scalar (pat, data, p, to);
+}
+
+#endif /* BH_MASKED_X86 */
+
+#ifdef BH_MASKED_NEON
+
+static size_t bh_masked_next_neon (const bh_masked_t *pat, const unsigned char *data, size_t from, size_t to)
+{
+    static const uint32_t word_bits[4] = { 1, 2, 4, 8 };
+    size_t p = from;
+
+    if (pat->anchor_width == 4) {
+        const uint32x4_t mask = vdupq_n_u32 (pat->anchor_mask);
+        const uint32x4_t value = vdupq_n_u32 (pat->anchor_value);
+        const uint32x4_t weights = vld1q_u32 (word_bits);
+        const uint32_t lanes = bh_masked_lanes (pat, 4, 4);
+
+        for (; p + 16 <= to; p += 16) {
+            uint32x4_t v = vreinterpretq_u32_u8 (vld1q_u8 (data + p + pat->anchor));
+            uint32_t bits = vaddvq_u32 (vandq_u32 (vceqq_u32 (vandq_u32 (v, mask), value), weights)) & lanes;
+            BH_MASKED_VERIFY (bits, 4);
+        }
+    } else {
+        const uint8x16_t mask = vdupq_n_u8 ((uint8_t) pat->anchor_mask);
+        const uint8x16_t value = vdupq_n_u8 ((uint8_t) pat->anchor_value);
+        const uint32_t lanes = bh_masked_lanes (pat, 16, 1);
+
+        for (; p + 16 <= to; p += 16) {
+            uint8x16_t eq = vceqq_u8 (vandq_u8 (vld1q_u8 (data + p + pat->anchor), mask), value);
+            uint64_t nibbles = vget_lane_u64 (vreinterpret_u64_u8 (vshrn_n_u16 (vreinterpretq_u16_u8 (eq), 4)), 0);
+            uint32_t bits = 0;
+
+            // one nibble per byte, there is no movemask
+            for (unsigned j = 0; nibbles; j++, nibbles >>= 4)
+                if (nibbles & 0xf)
+                    bits |= 1u << j;
+            bits &= lanes;
+            BH_MASKED_VERIFY (bits, 1);
+        }
+    }
+
+    return bh_masked_next_scalar (pat, data, p, to);
+}
+
+#endif /* BH_MASKED_NEON */
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Compiling                             									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Pick what the vector filter compares. Word aligned patterns compare the
+ *  4-byte word with the most mask bits, which for A64 is the most specific
+ *  instruction. Otherwise it is the single most specific byte.
+ *
+ */
+static void bh_masked_pick_anchor (bh_masked_t *pat)
+{
+    int best = -1;
+
+    pat->anchor = 0;
+    if (pat->align % 4 == 0 && pat->len >= 4) {
+        pat->anchor_width = 4;
+        for (size_t k = 0; k + 4 <= pat->len; k += 4) {
+            uint32_t m;
+            memcpy (&m, pat->mask + k, 4);
+            if (__builtin_popcount (m) > best) {
+                best = __builtin_popcount (m);
+                pat->anchor = k;
+            }
+        }
+        memcpy (&pat->anchor_mask, pat->mask + pat->anchor, 4);
+        memcpy (&pat->anchor_value, pat->bytes + pat->anchor, 4);
+        return;
+    }
+
+    pat->anchor_width = 1;
+    for (size_t k = 0; k < pat->len; k++) {
+        if (__builtin_popcount (pat->mask[k]) > best) {
+            best = __builtin_popcount (pat->mask[k]);
+            pat->anchor = k;
+        }
+    }
+    pat->anchor_mask = pat->mask[pat->anchor];
+    pat->anchor_value = pat->bytes[pat->anchor];
+}
+
+
+/**
+ *  Prepare a masked pattern. A byte of data matches when it equals the
+ *  pattern byte in every bit set in the mask. Matches are only reported
+ *  at offsets that are a multiple of `align`.
+ *
+ *  @param          pat to initialise.
+ *  @param          bytes of the pattern.
+ *  @param          mask for each byte, or NULL to match every bit.
+ *  @param          len of the pattern, at most BH_MASKED_MAX.
+ *  @param          align of matches, a power of two. 0 is the same as 1.
+ *
+ *  @returns        BH_MASKED_SUCCESS, or BH_MASKED_FAILURE.
+ */
+int bh_masked_init (bh_masked_t *pat, const unsigned char *bytes, const unsigned char *mask, size_t len, size_t align)
+{
+    if (!pat || !bytes || !len || len > BH_MASKED_MAX)
+        return BH_MASKED_FAILURE;
+    if (!align)
+        align = 1;
+    if (align & (align - 1))
+        return BH_MASKED_FAILURE;
+
+    memset (pat, '\0', sizeof (bh_masked_t));
+    pat->len = len;
+    pat->align = align;
+    for (size_t k = 0; k < len; k++) {
+        pat->mask[k] = (mask) ? mask[k] : 0xff;
+        pat->bytes[k] = bytes[k] & pat->mask[k];
+    }
+    bh_masked_pick_anchor (pat);
+
+#if defined(BH_MASKED_X86)
+    __builtin_cpu_init ();
+    pat->next = (__builtin_cpu_supports ("avx2")) ? bh_masked_next_avx2 : bh_masked_next_scalar;
+#elif defined(BH_MASKED_NEON)
+    pat->next = bh_masked_next_neon;
+#else
+    pat->next = bh_masked_next_scalar;
+#endif
+
+    // the vector filters can only step over blocks they fully cover
+    if (align > 32)
+        pat->next = bh_masked_next_scalar;
+
+    return BH_MASKED_SUCCESS;
+}
+
+
+/**
+ *  Prepare a pattern of A64 instructions, each with a mask of the bits
+ *  that must match. For example a BL to anywhere is 0x94000000 with the
+ *  mask 0xfc000000. Matches are 4-byte aligned.
+ *
+ *  @returns        BH_MASKED_SUCCESS, or BH_MASKED_FAILURE.
+ */
+int bh_masked_init_insns (bh_masked_t *pat, const uint32_t *insns, const uint32_t *masks, size_t count)
+{
+    unsigned char bytes[BH_MASKED_MAX], mask[BH_MASKED_MAX];
+
+    if (!insns || !count || count > BH_MASKED_MAX / 4)
+        return BH_MASKED_FAILURE;
+
+    // A64 instructions are always little endian
+    for (size_t i = 0; i < count; i++) {
+        for (int b = 0; b < 4; b++) {
+            bytes[i * 4 + b] = (unsigned char) (insns[i] >> (b * 8));
+            mask[i * 4 + b] = (unsigned char) (((masks) ? masks[i] : 0xffffffff) >> (b * 8));
+        }
+    }
+    return bh_masked_init (pat, bytes, mask, count * 4, 4);
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Searching                             									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Find the first match in `len` bytes of `data`. Alignment is relative
+ *  to the start of `data`.
+ *
+ *  @returns        pointer to the match, or NULL.
+ */
+unsigned char *bh_masked_find (const bh_masked_t *pat, const unsigned char *data, size_t len)
+{
+    size_t p;
+
+    if (!pat || !data || len < pat->len)
+        return NULL;
+
+    p = pat->next (pat, data, 0, len - pat->len + 1);
+    return (p == BH_MASKED_NONE) ? NULL : (unsigned char *) data + p;
+}
+
+
+/**
+ *  Each chunk owns the start positions in its range and reads up to
+ *  `len - 1` bytes past it, so a match straddling two chunks is found
+ *  exactly once, by the chunk it starts in. Chunks are a multiple of the
+ *  alignment, so every chunk starts on an aligned position.
+ *
+ */
+struct __libhelper_masked_job {
+    const bh_masked_t       *pat;
+    const unsigned char     *data;
+    size_t                   positions;     /* number of start positions */
+    size_t                   chunk;
+    HArray                 **results;       /* per chunk, NULL if it failed */
+};
+
+static void bh_masked_chunk (void *ctx, size_t index)
+{
+    struct __libhelper_masked_job *job = (struct __libhelper_masked_job *) ctx;
+    size_t from = index * job->chunk;
+    size_t to = MIN (from + job->chunk, job->positions);
+    HArray *found = h_array_new (sizeof (size_t));
+
+    if (!found)
+        return;
+
+    while (from < to) {
+        size_t p = job->pat->next (job->pat, job->data, from, to);
+        if (p == BH_MASKED_NONE)
+            break;
+        if (!h_array_push (found, &p)) {
+            h_array_free (found);
+            return;
+        }
+        from = p + job->pat->align;
+    }
+    job->results[index] = found;
+}
+
+
+/**
+ *  Find every match in `len` bytes of `data`, splitting the data into
+ *  chunks searched on `nthreads` threads, or `lh_thread_count()` when
+ *  zero. The result is the same however many threads are used.
+ *
+ *  @returns        malloc()'d array of offsets in ascending order, or NULL
+ *                  if there were no matches or on failure.
+ */
+size_t *bh_masked_find_all (const bh_masked_t *pat, const unsigned char *data, size_t len, int nthreads, size_t *count)
+{
+    struct __libhelper_masked_job job;
+    size_t nchunks, total = 0, n = 0;
+    size_t *out = NULL;
+    int failed = 0;
+
+    if (!count)
+        return NULL;
+    *count = 0;
+    if (!pat || !data || len < pat->len)
+        return NULL;
+
+    job.pat = pat;
+    job.data = data;
+    job.positions = len - pat->len + 1;
+    job.chunk = (BH_MASKED_CHUNK + pat->align - 1) & ~(pat->align - 1);
+
+    nchunks = (job.positions + job.chunk - 1) / job.chunk;
+    job.results = calloc (nchunks, sizeof (HArray *));
+    if (!job.results)
+        return NULL;
+
+    lh_parallel_for (nchunks, bh_masked_chunk, &job, nthreads);
+
+    // chunks are in order, so joining them in order keeps the offsets sorted
+    for (size_t i = 0; i < nchunks; i++) {
+        if (job.results[i])
+            total += job.results[i]->len;
+        else
+            failed = 1;
+    }
+
+    if (total && !failed)
+        out = malloc (total * sizeof (size_t));
+
+    for (size_t i = 0; i < nchunks; i++) {
+        if (out && job.results[i]->len) {
+            memcpy (out + n, job.results[i]->data, job.results[i]->len * sizeof (size_t));
+            n += job.results[i]->len;
+        }
+        h_array_free (job.results[i]);
+    }
+    free (job.results);
+
+    if (out)
+        *count = n;
+    return out;
+}
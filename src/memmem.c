@@ -0,0 +1,572 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "hlib.h"
+
+#include <stdatomic.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BH_MEMMEM_X86       1
+#define BH_MEMMEM_SIMD      1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define BH_MEMMEM_NEON      1
+#define BH_MEMMEM_SIMD      1
+#endif
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Scalar search                         									 --*/
+//===-----------------------------------------------------------------------===//
+
+static void
+bh_skip_table (size_t *bad_char_skip, const unsigned char *needle, size_t nlen)
+{
+    size_t scan, last = nlen - 1;
+
+    /* When a character is encountered that does not occur
+     * in the needle, we can safely skip ahead for the whole
+     * length of the needle.
+     */
+    for (scan = 0; scan <= __UCHAR_MAX; scan = scan + 1)
+        bad_char_skip[scan] = nlen;
+
+    /* Then populate it with the analysis of the needle */
+    for (scan = 0; scan < last; scan = scan + 1)
+        bad_char_skip[needle[scan]] = last - scan;
+}
+
+static unsigned char *
+bh_horspool (const unsigned char *haystack, size_t hlen,
+             const unsigned char *needle,   size_t nlen,
+             const size_t *bad_char_skip)
+{
+    size_t scan, last = nlen - 1;
+
+    /* Search the haystack, while the needle can still be within it. */
+    while (hlen >= nlen)
+    {
+        /* scan from the end of the needle */
+        for (scan = last; haystack[scan] == needle[scan]; scan = scan - 1)
+            if (scan == 0) /* If the first byte matches, we've found it. */
+                return (unsigned char *) haystack;
+
+        /* otherwise, skip based on the last byte of the window, no matter
+           where the mismatch was. */
+        hlen     -= bad_char_skip[haystack[last]];
+        haystack += bad_char_skip[haystack[last]];
+    }
+
+    return NULL;
+}
+
+#ifdef BH_MEMMEM_SIMD
+
+/**
+ *  The tails left over by the vector loops aren't worth a skip table:
+ *  jump between first bytes with memchr() instead.
+ */
+static unsigned char *
+bh_memchr_search (const unsigned char *haystack, size_t hlen,
+                  const unsigned char *needle,   size_t nlen)
+{
+    const unsigned char *end = haystack + hlen;
+
+    while ((size_t) (end - haystack) >= nlen) {
+        haystack = memchr (haystack, needle[0], (end - haystack) - nlen + 1);
+        if (!haystack)
+            return NULL;
+        if (!memcmp (haystack + 1, needle + 1, nlen - 1))
+            return (unsigned char *) haystack;
+        haystack++;
+    }
+    return NULL;
+}
+
+#endif /* BH_MEMMEM_SIMD */
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Vector search                         									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  All of the vector searches work the same way. Compare a block of the
+ *  haystack against the first byte of the needle, and the block `nlen - 1`
+ *  further on against the last byte. Only positions where both match are
+ *  compared in full, which on real data is almost never.
+ *
+ */
+typedef unsigned char *(*bh_search_func_t) (const unsigned char *haystack, size_t hlen,
+                                            const unsigned char *needle,   size_t nlen);
+
+/**
+ *  Check every candidate in `mask`, lowest first. Each position has
+ *  `1 << shift` bits in the mask.
+ */
+#define BH_VERIFY_MASK(mask, shift)                                                 \
+    while (mask) {                                                                  \
+        size_t bit = (size_t) __builtin_ctzll (mask) >> (shift);                    \
+        if (!memcmp (haystack + i + bit + 1, needle + 1, nlen - 2))                 \
+            return (unsigned char *) haystack + i + bit;                            \
+        mask &= ~((uint64_t) ((1u << (1u << (shift))) - 1) << (bit << (shift)));    \
+    }
+
+#ifdef BH_MEMMEM_X86
+
+__attribute__((target("avx2")))
+static unsigned char *
+bh_memmem_avx2 (const unsigned char *haystack, size_t hlen,
+                const unsigned char *needle,   size_t nlen)
+{
+    const __m256i first = _mm256_set1_epi8 ((char) needle[0]);
+    const __m256i last = _mm256_set1_epi8 ((char) needle[nlen - 1]);
+    size_t i = 0;
+
+    for (; i + 32 + nlen - 1 <= hlen; i += 32) {
+        __m256i bf = _mm256_loadu_si256 ((const __m256i *) (haystack + i));
+        __m256i bl = _mm256_loadu_si256 ((const __m256i *) (haystack + i + nlen - 1));
+        uint64_t mask = (uint32_t) _mm256_movemask_epi8 (
+                            _mm256_and_si256 (_mm256_cmpeq_epi8 (first, bf), _mm256_cmpeq_epi8 (last, bl)));
+
+        BH_VERIFY_MASK (mask, 0);
+    }
+
+    return bh_memchr_search (haystack + i, hlen - i, needle, nlen);
+}
+
+static unsigned char *
+bh_memmem_sse2 (const unsigned char *haystack, size_t hlen,
+                const unsigned char *needle,   size_t nlen)
+{
+    const __m128i first = _mm_set1_epi8 ((char) needle[0]);
+    const __m128i last = _mm_set1_epi8 ((char) needle[nlen - 1]);
+    size_t i = 0;
+
+    for (; i + 16 + nlen - 1 <= hlen; i += 16) {
+        __m128i bf = _mm_loadu_si128 ((const __m128i *) (haystack + i));
+        __m128i bl = _mm_loadu_si128 ((const __m128i *) (haystack + i + nlen - 1));
+        uint64_t mask = (uint32_t) _mm_movemask_epi8 (
+                            _mm_and_si128 (_mm_cmpeq_epi8 (first, bf), _mm_cmpeq_epi8 (last, bl)));
+
+        BH_VERIFY_MASK (mask, 0);
+    }
+
+    return bh_memchr_search (haystack + i, hlen - i, needle, nlen);
+}
+
+#endif /* BH_MEMMEM_X86 */
+
+#ifdef BH_MEMMEM_NEON
+
+static unsigned char *
+bh_memmem_neon (const unsigned char *haystack, size_t hlen,
+                const unsigned char *needle,   size_t nlen)
+{
+    const uint8x16_t first = vdupq_n_u8 (needle[0]);
+    const uint8x16_t last = vdupq_n_u8 (needle[nlen - 1]);
+    size_t i = 0;
+
+    for (; i + 16 + nlen - 1 <= hlen; i += 16) {
+        uint8x16_t eq = vandq_u8 (vceqq_u8 (first, vld1q_u8 (haystack + i)),
+                                  vceqq_u8 (last, vld1q_u8 (haystack + i + nlen - 1)));
+
+        // narrow to a nibble per byte, as there is no movemask
+        uint64_t mask = vget_lane_u64 (vreinterpret_u64_u8 (vshrn_n_u16 (vreinterpretq_u16_u8 (eq), 4)), 0);
+
+        BH_VERIFY_MASK (mask, 2);
+    }
+
+    return bh_memchr_search (haystack + i, hlen - i, needle, nlen);
+}
+
+#endif /* BH_MEMMEM_NEON */
+
+
+/**
+ *  The vector search only tests the first and last byte, so its speed
+ *  doesn't grow with the needle. Horspool skips up to a needle length at a
+ *  time, and overtakes it from about 32 bytes.
+ *
+ */
+#define BH_MEMMEM_SIMD_MAX      32
+
+/**
+ *  Pick the widest search the CPU supports. This is only worked out once,
+ *  the first time a search runs. Without a vector unit there is nothing to
+ *  pick, and Horspool is used instead.
+ *
+ */
+static _Atomic (bh_search_func_t) bh_search_impl = NULL;
+
+static bh_search_func_t bh_search_resolve ()
+{
+    bh_search_func_t impl = atomic_load_explicit (&bh_search_impl, memory_order_relaxed);
+    if (impl)
+        return impl;
+
+#if defined(BH_MEMMEM_X86)
+    __builtin_cpu_init ();
+    impl = (__builtin_cpu_supports ("avx2")) ? bh_memmem_avx2 : bh_memmem_sse2;
+#elif defined(BH_MEMMEM_NEON)
+    impl = bh_memmem_neon;
+#else
+    return NULL;
+#endif
+
+    atomic_store_explicit (&bh_search_impl, impl, memory_order_relaxed);
+    return impl;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Compiled needles                      									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Prepare `needle` for repeated searches. The needle bytes are not copied
+ *  and must outlive `compiled`.
+ *
+ *  @returns        BH_NEEDLE_SUCCESS, or BH_NEEDLE_FAILURE for an empty needle.
+ */
+int bh_needle_init (bh_needle_t *compiled, const unsigned char *needle, size_t nlen)
+{
+    if (!compiled || !needle || !nlen)
+        return BH_NEEDLE_FAILURE;
+
+    compiled->needle = needle;
+    compiled->len = nlen;
+    compiled->search = (nlen < BH_MEMMEM_SIMD_MAX) ? bh_search_resolve () : NULL;
+    bh_skip_table (compiled->skip, needle, nlen);
+
+    return BH_NEEDLE_SUCCESS;
+}
+
+
+/**
+ *  Find `compiled` in `hlen` bytes of `haystack`. Everything that depends
+ *  only on the needle was done by `bh_needle_init()`.
+ *
+ *  @returns        pointer to the first match, or NULL.
+ */
+unsigned char *bh_needle_find (const bh_needle_t *compiled, const unsigned char *haystack, size_t hlen)
+{
+    if (!compiled || !haystack || hlen < compiled->len)
+        return NULL;
+
+    if (compiled->len == 1)
+        return memchr (haystack, compiled->needle[0], hlen);
+
+    if (compiled->search)
+        return compiled->search (haystack, hlen, compiled->needle, compiled->len);
+    return bh_horspool (haystack, hlen, compiled->needle, compiled->len, compiled->skip);
+}
+
+
+unsigned char *
+bh_memmem (const unsigned char *haystack, size_t hlen,
+           const unsigned char *needle,   size_t nlen)
+{
+    size_t bad_char_skip[__UCHAR_MAX + 1];
+    bh_search_func_t impl;
+
+    /* Sanity checks on the parameters */
+    if (nlen <= 0 || !haystack || !needle || hlen < nlen)
+        return NULL;
+
+    if (nlen == 1)
+        return memchr (haystack, needle[0], hlen);
+
+    impl = (nlen < BH_MEMMEM_SIMD_MAX) ? bh_search_resolve () : NULL;
+    if (impl)
+        return impl (haystack, hlen, needle, nlen);
+
+    /*  Long needle or no vector unit, so fall back to Horspool. The skip
+     *  table is built on every call, use a bh_needle_t to build it once.
+     */
+    bh_skip_table (bad_char_skip, needle, nlen);
+    return bh_horspool (haystack, hlen, needle, nlen, bad_char_skip);
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Parallel search                       									 --*/
+//===-----------------------------------------------------------------------===//
+
+/* bytes handed to each thread, big enough to amortise the paging hint */
+#define BH_PARALLEL_CHUNK       (4 * 1024 * 1024)
+
+#define BH_PARALLEL_NONE        ((size_t) -1)
+
+/**
+ *  Each chunk owns the start positions in its range and reads `len - 1`
+ *  bytes past it, so a match straddling two chunks is found exactly once,
+ *  by the chunk it starts in.
+ *
+ *  Workers take chunks in order, so while one chunk is searched the chunk
+ *  `nthreads` ahead is the next one a thread will pick up. Asking for it
+ *  early keeps the disk busy while the cores are, when the haystack is a
+ *  cold mapping.
+ *
+ */
+struct __libhelper_parallel_job {
+    const bh_needle_t       *needle;
+    const unsigned char     *haystack;
+    size_t                   positions;     /* number of start positions */
+    size_t                   chunks;
+    size_t                   ahead;         /* chunks between a worker and its next */
+
+    /* first match */
+    atomic_size_t            first;         /* lowest chunk with a match */
+    size_t                  *offsets;       /* per chunk, first match or BH_PARALLEL_NONE */
+
+    /* all matches */
+    HArray                 **results;       /* per chunk, NULL if it failed */
+};
+
+static void bh_parallel_advise (struct __libhelper_parallel_job *job, size_t index)
+{
+    size_t from = index * BH_PARALLEL_CHUNK;
+
+    if (index < job->chunks)
+        lh_advise (job->haystack + from,
+                   MIN (BH_PARALLEL_CHUNK, job->positions - from) + job->needle->len - 1,
+                   LH_ADVISE_WILLNEED);
+}
+
+static void bh_parallel_first (void *ctx, size_t index)
+{
+    struct __libhelper_parallel_job *job = (struct __libhelper_parallel_job *) ctx;
+    size_t from = index * BH_PARALLEL_CHUNK;
+    size_t to = MIN (from + BH_PARALLEL_CHUNK, job->positions);
+    size_t best;
+    unsigned char *p;
+
+    job->offsets[index] = BH_PARALLEL_NONE;
+
+    // an earlier chunk has already matched, nothing here can win
+    if (index > atomic_load (&job->first))
+        return;
+
+    bh_parallel_advise (job, index + job->ahead);
+
+    p = bh_needle_find (job->needle, job->haystack + from, to - from + job->needle->len - 1);
+    if (!p)
+        return;
+    job->offsets[index] = (size_t) (p - job->haystack);
+
+    best = atomic_load (&job->first);
+    while (index < best && !atomic_compare_exchange_weak (&job->first, &best, index))
+        ;
+}
+
+static void bh_parallel_all (void *ctx, size_t index)
+{
+    struct __libhelper_parallel_job *job = (struct __libhelper_parallel_job *) ctx;
+    size_t from = index * BH_PARALLEL_CHUNK;
+    size_t to = MIN (from + BH_PARALLEL_CHUNK, job->positions);
+    size_t end = to + job->needle->len - 1;
+    HArray *found = h_array_new (sizeof (size_t));
+
+    if (!found)
+        return;
+
+    bh_parallel_advise (job, index + job->ahead);
+
+    while (from < to) {
+        unsigned char *p = bh_needle_find (job->needle, job->haystack + from, end - from);
+        size_t off;
+
+        if (!p)
+            break;
+        off = (size_t) (p - job->haystack);
+        if (!h_array_push (found, &off)) {
+            h_array_free (found);
+            return;
+        }
+        from = off + 1;
+    }
+    job->results[index] = found;
+}
+
+
+static int bh_parallel_setup (struct __libhelper_parallel_job *job, const bh_needle_t *compiled,
+                              const unsigned char *haystack, size_t hlen, int *nthreads)
+{
+    if (!compiled || !compiled->len || !haystack || hlen < compiled->len)
+        return 0;
+
+    if (*nthreads <= 0)
+        *nthreads = lh_thread_count ();
+
+    memset (job, 0, sizeof (*job));
+    job->needle = compiled;
+    job->haystack = haystack;
+    job->positions = hlen - compiled->len + 1;
+    job->chunks = (job->positions + BH_PARALLEL_CHUNK - 1) / BH_PARALLEL_CHUNK;
+    job->ahead = (size_t) *nthreads;
+    atomic_init (&job->first, BH_PARALLEL_NONE);
+
+    // the first round of chunks is wanted straight away. Only WILLNEED is
+    // used: it reads ahead once, where a policy such as SEQUENTIAL would
+    // replace whatever hint the caller had set on their mapping, and
+    // can't be put back afterwards.
+    if (job->chunks > 1) {
+        for (size_t i = 0; i < job->ahead; i++)
+            bh_parallel_advise (job, i);
+    }
+    return 1;
+}
+
+
+/**
+ *  Find the first match of `compiled` in `hlen` bytes of `haystack`, with
+ *  the haystack split into chunks searched on `nthreads` threads, or
+ *  `lh_thread_count()` when zero. Chunks after one that has matched are
+ *  skipped, and the earliest match always wins, so the result is the same
+ *  as `bh_needle_find()`.
+ *
+ *  @returns        pointer to the first match, or NULL.
+ */
+unsigned char *bh_needle_find_parallel (const bh_needle_t *compiled, const unsigned char *haystack,
+                                        size_t hlen, int nthreads)
+{
+    struct __libhelper_parallel_job job;
+    unsigned char *match = NULL;
+    size_t first;
+
+    if (!bh_parallel_setup (&job, compiled, haystack, hlen, &nthreads))
+        return NULL;
+
+    if (job.chunks == 1)
+        return bh_needle_find (compiled, haystack, hlen);
+
+    job.offsets = malloc (job.chunks * sizeof (size_t));
+    if (!job.offsets)
+        return bh_needle_find (compiled, haystack, hlen);
+
+    lh_parallel_for (job.chunks, bh_parallel_first, &job, nthreads);
+
+    first = atomic_load (&job.first);
+    if (first != BH_PARALLEL_NONE)
+        match = (unsigned char *) haystack + job.offsets[first];
+
+    free (job.offsets);
+    return match;
+}
+
+
+/**
+ *  Find every match of `compiled` in `hlen` bytes of `haystack`, chunked
+ *  the same way as `bh_needle_find_parallel()`. Overlapping matches are
+ *  all reported. The result is the same however many threads are used.
+ *
+ *  @returns        malloc()'d array of offsets in ascending order, or NULL
+ *                  if there were no matches or on failure.
+ */
+size_t *bh_needle_find_all (const bh_needle_t *compiled, const unsigned char *haystack,
+                            size_t hlen, int nthreads, size_t *count)
+{
+    struct __libhelper_parallel_job job;
+    size_t total = 0, n = 0;
+    size_t *out = NULL;
+    int failed = 0;
+
+    if (!count)
+        return NULL;
+    *count = 0;
+
+    if (!bh_parallel_setup (&job, compiled, haystack, hlen, &nthreads))
+        return NULL;
+
+    job.results = calloc (job.chunks, sizeof (HArray *));
+    if (!job.results)
+        return NULL;
+
+    lh_parallel_for (job.chunks, bh_parallel_all, &job, nthreads);
+
+    // chunks are in order, so joining them in order keeps the offsets sorted
+    for (size_t i = 0; i < job.chunks; i++) {
+        if (job.results[i])
+            total += job.results[i]->len;
+        else
+            failed = 1;
+    }
+
+    if (total && !failed)
+        out = malloc (total * sizeof (size_t));
+
+    for (size_t i = 0; i < job.chunks; i++) {
+        if (out && job.results[i]->len) {
+            memcpy (out + n, job.results[i]->data, job.results[i]->len * sizeof (size_t));
+            n += job.results[i]->len;
+        }
+        h_array_free (job.results[i]);
+    }
+    free (job.results);
+
+    if (out)
+        *count = n;
+    return out;
+}
+
+
+/**
+ *  `bh_memmem()` over `nthreads` threads, for haystacks of hundreds of
+ *  megabytes or more. Smaller haystacks are searched on the calling thread.
+ *
+ *  @returns        pointer to the first match, or NULL.
+ */
+unsigned char *
+bh_memmem_parallel (const unsigned char *haystack, size_t hlen,
+                    const unsigned char *needle,   size_t nlen, int nthreads)
+{
+    bh_needle_t compiled;
+
+    if (!bh_needle_init (&compiled, needle, nlen))
+        return NULL;
+    return bh_needle_find_parallel (&compiled, haystack, hlen, nthreads);
+}
+
+
+/**
+ *  Every offset `needle` occurs at in `haystack`, see `bh_needle_find_all()`.
+ *
+ */
+size_t *
+bh_memmem_all (const unsigned char *haystack, size_t hlen,
+               const unsigned char *needle,   size_t nlen, int nthreads, size_t *count)
+{
+    bh_needle_t compiled;
+
+    if (count)
+        *count = 0;
+    if (!bh_needle_init (&compiled, needle, nlen))
+        return NULL;
+    return bh_needle_find_all (&compiled, haystack, hlen, nthreads, count);
+}
@@ -0,0 +1,457 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+#include "hlib.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BH_PATTERNS_X86         1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define BH_PATTERNS_NEON        1
+#endif
+
+/* transitions into a state with matches carry this bit */
+#define BH_PATTERNS_MATCH       0x80000000u
+
+/* past this many distinct first bytes, skipping ahead rarely pays off */
+#define BH_PATTERNS_PREFILTER_MAX   64
+
+
+struct __libhelper_pattern {
+    size_t          offset;         /* offset of the bytes in `bytes` */
+    size_t          len;
+    uint32_t        next;           /* next pattern ending in the same state, + 1 */
+};
+
+typedef size_t (*bh_patterns_skip_func_t) (const bh_patterns_t *set, const unsigned char *data, size_t i, size_t len);
+
+/**
+ *  A compiled set is an Aho-Corasick automaton, turned into a full DFA so
+ *  every byte is exactly one table lookup. Bytes that appear in no pattern
+ *  share a single class, which keeps the rows short.
+ *
+ *  Transitions hold the row offset of the next state, rather than its
+ *  number, so the scan loop doesn't multiply. The top bit flags states
+ *  that have matches.
+ *
+ */
+struct __libhelper_patterns {
+    HArray                      *patterns;          /* struct __libhelper_pattern */
+    HArray                      *bytes;             /* pattern bytes, back to back */
+    int                          compiled;
+
+    uint8_t                      classes[256];      /* byte -> class */
+    uint32_t                     nclasses;
+    uint32_t                     nstates;
+    uint32_t                    *delta;             /* nstates * nclasses transitions */
+
+    uint32_t                    *out_start;         /* per state, into `outputs` */
+    uint32_t                    *out_count;
+    uint32_t                    *outputs;           /* pattern ids */
+
+    /* prefilter, used while the automaton is in the root state */
+    bh_patterns_skip_func_t      skip;
+    uint8_t                      first[256];        /* bytes that start a pattern */
+    uint8_t                      lo_table[16];      /* nibble tables for the SIMD test */
+    uint8_t                      hi_table[16];
+};
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Prefilter                             									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Skip to the next byte that could start a pattern. The SIMD versions
+ *  test 16 or 32 bytes at a time against the set of first bytes, with a
+ *  table lookup on each nibble. The nibble test can let through a byte
+ *  that isn't in the set, which only costs a step of the automaton.
+ *
+ */
+static size_t bh_patterns_skip_scalar (const bh_patterns_t *set, const unsigned char *data, size_t i, size_t len)
+{
+    while (i < len && !set->first[data[i]])
+        i++;
+    return i;
+}
+
+#ifdef BH_PATTERNS_X86
+
+__attribute__((target("avx2")))
+static size_t bh_patterns_skip_avx2 (const bh_patterns_t *set, const unsigned char *data, size_t i, size_t len)
+{
+    const __m256i lo_table = _mm256_broadcastsi128_si256 (_mm_loadu_si128 ((const __m128i *) set->lo_table));
+    const __m256i hi_table = _mm256_broadcastsi128_si256 (_mm_loadu_si128 ((const __m128i *) set->hi_table));
+    const __m256i nibble = _mm256_set1_epi8 (0x0f);
+    const __m256i zero = _mm256_setzero_si256 ();
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256 ((const __m256i *) (data + i));
+        __m256i lo = _mm256_shuffle_epi8 (lo_table, _mm256_and_si256 (v, nibble));
+        __m256i hi = _mm256_shuffle_epi8 (hi_table, _mm256_and_si256 (_mm256_srli_epi16 (v, 4), nibble));
+        uint32_t mask = ~(uint32_t) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_and_si256 (lo, hi), zero));
+
+        if (mask)
+            return i + __builtin_ctz (mask);
+    }
+    return bh_patterns_skip_scalar (set, data, i, len);
+}
+
+#endif /* BH_PATTERNS_X86 */
+
+#ifdef BH_PATTERNS_NEON
+
+static size_t bh_patterns_skip_neon (const bh_patterns_t *set, const unsigned char *data, size_t i, size_t len)
+{
+    const uint8x16_t lo_table = vld1q_u8 (set->lo_table);
+    const uint8x16_t hi_table = vld1q_u8 (set->hi_table);
+    const uint8x16_t nibble = vdupq_n_u8 (0x0f);
+
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8 (data + i);
+        uint8x16_t hit = vtstq_u8 (vqtbl1q_u8 (lo_table, vandq_u8 (v, nibble)),
+                                   vqtbl1q_u8 (hi_table, vshrq_n_u8 (v, 4)));
+
+        // narrow to a nibble per byte, as there is no movemask
+        uint64_t mask = vget_lane_u64 (vreinterpret_u64_u8 (vshrn_n_u16 (vreinterpretq_u16_u8 (hit), 4)), 0);
+        if (mask)
+            return i + (__builtin_ctzll (mask) >> 2);
+    }
+    return bh_patterns_skip_scalar (set, data, i, len);
+}
+
+#endif /* BH_PATTERNS_NEON */
+
+
+static bh_patterns_skip_func_t bh_patterns_skip_resolve ()
+{
+#if defined(BH_PATTERNS_X86)
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+        return bh_patterns_skip_avx2;
+#elif defined(BH_PATTERNS_NEON)
+    return bh_patterns_skip_neon;
+#endif
+    return bh_patterns_skip_scalar;
+}
+
+
+/**
+ *  Build the first byte set and its nibble tables. Each high nibble gets
+ *  one of 8 bucket bits, shared by neighbouring nibbles, and a byte passes
+ *  if its low nibble was seen with a high nibble in the same bucket.
+ *
+ */
+static void bh_patterns_prefilter_build (bh_patterns_t *set)
+{
+    unsigned count = 0;
+
+    memset (set->first, 0, sizeof (set->first));
+    memset (set->lo_table, 0, sizeof (set->lo_table));
+    memset (set->hi_table, 0, sizeof (set->hi_table));
+
+    h_array_foreach (set->patterns, struct __libhelper_pattern, p) {
+        unsigned char b = ((unsigned char *) set->bytes->data)[p->offset];
+        if (!set->first[b]) {
+            set->first[b] = 1;
+            count++;
+        }
+    }
+
+    for (unsigned b = 0; b < 256; b++) {
+        uint8_t bucket = (uint8_t) (1u << ((b >> 4) >> 1));
+
+        set->hi_table[b >> 4] = bucket;
+        if (set->first[b])
+            set->lo_table[b & 0x0f] |= bucket;
+    }
+
+    set->skip = (count <= BH_PATTERNS_PREFILTER_MAX) ? bh_patterns_skip_resolve () : NULL;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Compiling                             									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Create an empty pattern set. Add the patterns, then compile it once
+ *  with `bh_patterns_compile()`.
+ *
+ */
+bh_patterns_t *bh_patterns_create ()
+{
+    bh_patterns_t *set = calloc (1, sizeof (bh_patterns_t));
+    if (!set)
+        return NULL;
+
+    set->patterns = h_array_new (sizeof (struct __libhelper_pattern));
+    set->bytes = h_array_new (1);
+    if (!set->patterns || !set->bytes) {
+        bh_patterns_free (set);
+        return NULL;
+    }
+    return set;
+}
+
+
+/**
+ *  Add a pattern. The bytes are copied. Patterns are numbered from zero in
+ *  the order they are added, and that id is what matches report.
+ *
+ *  @returns        BH_PATTERNS_SUCCESS, or BH_PATTERNS_FAILURE.
+ */
+int bh_patterns_add (bh_patterns_t *set, const unsigned char *pattern, size_t len)
+{
+    struct __libhelper_pattern p;
+    size_t offset;
+
+    if (!set || set->compiled || !pattern || !len || set->patterns->len >= UINT32_MAX - 1)
+        return BH_PATTERNS_FAILURE;
+
+    offset = set->bytes->len;
+    if (!h_array_reserve (set->bytes, offset + len))
+        return BH_PATTERNS_FAILURE;
+    memcpy ((unsigned char *) set->bytes->data + offset, pattern, len);
+    set->bytes->len += len;
+
+    p.offset = offset;
+    p.len = len;
+    p.next = 0;
+    if (!h_array_push (set->patterns, &p)) {
+        set->bytes->len = offset;
+        return BH_PATTERNS_FAILURE;
+    }
+    return BH_PATTERNS_SUCCESS;
+}
+
+
+/**
+ *  Build the automaton. The set can't be added to after this.
+ *
+ *  @returns        BH_PATTERNS_SUCCESS, or BH_PATTERNS_FAILURE.
+ */
+int bh_patterns_compile (bh_patterns_t *set)
+{
+    const unsigned char *bytes;
+    HArray *delta = NULL, *outputs = NULL;
+    uint32_t *fail = NULL, *queue = NULL, *heads = NULL;
+    uint32_t ncls, nstates, head = 0, tail = 0;
+    int res = BH_PATTERNS_FAILURE;
+
+    if (!set || set->compiled || !set->patterns->len)
+        return BH_PATTERNS_FAILURE;
+    bytes = (const unsigned char *) set->bytes->data;
+
+    // every byte used by a pattern gets its own class, the rest share 0
+    memset (set->classes, 0, sizeof (set->classes));
+    ncls = 1;
+    for (size_t i = 0; i < set->bytes->len; i++)
+        if (!set->classes[bytes[i]])
+            set->classes[bytes[i]] = (uint8_t) ncls++;
+    // a class for all 256 bytes doesn't fit, but then none are spare
+    if (ncls > 256) {
+        for (unsigned b = 0; b < 256; b++)
+            set->classes[b] = (uint8_t) b;
+        ncls = 256;
+    }
+
+    // the trie, one row of transitions per state, 0 meaning no child yet
+    delta = h_array_sized_new (ncls * sizeof (uint32_t), set->bytes->len + 1);
+    heads = calloc (set->bytes->len + 1, sizeof (uint32_t));
+    if (!delta || !heads || !h_array_push (delta, NULL))
+        goto compile_done;
+
+    for (uint32_t id = 0; id < set->patterns->len; id++) {
+        struct __libhelper_pattern *p = &h_array_index (set->patterns, struct __libhelper_pattern, id);
+        uint32_t s = 0;
+
+        for (size_t i = 0; i < p->len; i++) {
+            uint32_t *row = (uint32_t *) delta->data + (size_t) s * ncls;
+            uint32_t c = set->classes[bytes[p->offset + i]];
+
+            if (!row[c]) {
+                row[c] = (uint32_t) delta->len;
+                if (!h_array_push (delta, NULL))
+                    goto compile_done;
+            }
+            s = ((uint32_t *) delta->data)[(size_t) s * ncls + c];
+        }
+
+        p->next = heads[s];
+        heads[s] = id + 1;
+    }
+
+    nstates = (uint32_t) delta->len;
+    if ((uint64_t) nstates * ncls >= BH_PATTERNS_MATCH)
+        goto compile_done;
+
+    fail = calloc (nstates, sizeof (uint32_t));
+    queue = malloc (nstates * sizeof (uint32_t));
+    set->out_start = calloc (nstates, sizeof (uint32_t));
+    set->out_count = calloc (nstates, sizeof (uint32_t));
+    outputs = h_array_new (sizeof (uint32_t));
+    if (!fail || !queue || !set->out_start || !set->out_count || !outputs)
+        goto compile_done;
+
+    /*  Breadth first, so a state's failure state is always finished before
+     *  the state itself. Missing transitions are filled in from the failure
+     *  state, and so are the matches.
+     */
+    queue[tail++] = 0;
+    while (head < tail) {
+        uint32_t s = queue[head++];
+        uint32_t *row = (uint32_t *) delta->data + (size_t) s * ncls;
+        uint32_t *frow = (uint32_t *) delta->data + (size_t) fail[s] * ncls;
+
+        set->out_start[s] = (uint32_t) outputs->len;
+        for (uint32_t id = heads[s]; id; id = h_array_index (set->patterns, struct __libhelper_pattern, id - 1).next) {
+            uint32_t pid = id - 1;
+            if (!h_array_push (outputs, &pid))
+                goto compile_done;
+        }
+        if (s) {
+            for (uint32_t k = 0; k < set->out_count[fail[s]]; k++) {
+                uint32_t pid = ((uint32_t *) outputs->data)[set->out_start[fail[s]] + k];
+                if (!h_array_push (outputs, &pid))
+                    goto compile_done;
+            }
+        }
+        set->out_count[s] = (uint32_t) outputs->len - set->out_start[s];
+
+        for (uint32_t c = 0; c < ncls; c++) {
+            if (row[c]) {
+                fail[row[c]] = (s) ? frow[c] : 0;
+                queue[tail++] = row[c];
+            } else {
+                row[c] = (s) ? frow[c] : 0;
+            }
+        }
+    }
+
+    // turn state numbers into row offsets, flagging states with matches
+    for (size_t i = 0; i < (size_t) nstates * ncls; i++) {
+        uint32_t t = ((uint32_t *) delta->data)[i];
+        ((uint32_t *) delta->data)[i] = (t * ncls) | ((set->out_count[t]) ? BH_PATTERNS_MATCH : 0);
+    }
+
+    set->nclasses = ncls;
+    set->nstates = nstates;
+    set->delta = delta->data;
+    set->outputs = outputs->data;
+    delta->data = NULL;
+    outputs->data = NULL;
+
+    bh_patterns_prefilter_build (set);
+    set->compiled = 1;
+    res = BH_PATTERNS_SUCCESS;
+
+compile_done:
+    if (!set->compiled) {
+        free (set->out_start);
+        free (set->out_count);
+        set->out_start = set->out_count = NULL;
+    }
+    h_array_free (delta);
+    h_array_free (outputs);
+    free (heads);
+    free (fail);
+    free (queue);
+    return res;
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Scanning                              									 --*/
+//===-----------------------------------------------------------------------===//
+
+/**
+ *  Find every occurrence of every pattern in a single pass over `len`
+ *  bytes of `data`. Matches are reported in order of where they end, with
+ *  the offset of their first byte. Overlapping matches are all reported.
+ *  `func` returns non-zero to stop the scan.
+ *
+ *  @returns        number of matches reported.
+ */
+size_t bh_patterns_scan (const bh_patterns_t *set, const unsigned char *data, size_t len,
+                         bh_patterns_func_t func, void *ctx)
+{
+    const struct __libhelper_pattern *patterns;
+    uint32_t row = 0;
+    size_t count = 0;
+
+    if (!set || !set->compiled || !data || !func)
+        return 0;
+    patterns = (const struct __libhelper_pattern *) set->patterns->data;
+
+    for (size_t i = 0; i < len; i++) {
+        uint32_t next;
+
+        if (!row && set->skip) {
+            i = set->skip (set, data, i, len);
+            if (i == len)
+                break;
+        }
+
+        next = set->delta[row + set->classes[data[i]]];
+        row = next & ~BH_PATTERNS_MATCH;
+
+        if (next & BH_PATTERNS_MATCH) {
+            uint32_t s = row / set->nclasses;
+            const uint32_t *out = set->outputs + set->out_start[s];
+
+            for (uint32_t k = 0; k < set->out_count[s]; k++) {
+                count++;
+                if (func (ctx, out[k], i + 1 - patterns[out[k]].len))
+                    return count;
+            }
+        }
+    }
+    return count;
+}
+
+
+size_t bh_patterns_count (const bh_patterns_t *set)
+{
+    return (set) ? set->patterns->len : 0;
+}
+
+
+void bh_patterns_free (bh_patterns_t *set)
+{
+    if (!set)
+        return;
+
+    h_array_free (set->patterns);
+    h_array_free (set->bytes);
+    free (set->delta);
+    free (set->out_start);
+    free (set->out_count);
+    free (set->outputs);
+    free (set);
+}
@@ -0,0 +1,399 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define LH_THREAD_MAX           64
+
+
+/**
+ *  Number of threads to use when the caller doesn't say.
+ *
+ */
+int lh_thread_count ()
+{
+    long n = sysconf (_SC_NPROCESSORS_ONLN);
+
+    if (n < 1)
+        return 1;
+    return (n > LH_THREAD_MAX) ? LH_THREAD_MAX : (int) n;
+}
+
+
+/**
+ *  Shared state for a parallel-for. Workers take the next index from the
+ *  counter until they run out, so uneven jobs still balance out.
+ *
+ */
+struct __libhelper_parallel {
+    lh_job_func_t        func;
+    void                *ctx;
+    size_t               count;
+    atomic_size_t        next;
+};
+
+static void *lh_parallel_worker (void *arg)
+{
+    struct __libhelper_parallel *p = (struct __libhelper_parallel *) arg;
+    size_t i;
+
+    while ((i = atomic_fetch_add (&p->next, 1)) < p->count)
+        p->func (p->ctx, i);
+    return NULL;
+}
+
+
+/**
+ *  Call `func (ctx, i)` for every `i` below `count`, spread over `nthreads`
+ *  threads including the caller. Returns once every job has finished. A
+ *  `nthreads` of zero uses `lh_thread_count()`.
+ *
+ */
+void lh_parallel_for (size_t count, lh_job_func_t func, void *ctx, int nthreads)
+{
+    struct __libhelper_parallel p;
+    pthread_t threads[LH_THREAD_MAX];
+    int started = 0;
+
+    if (nthreads <= 0)
+        nthreads = lh_thread_count ();
+    if (nthreads > LH_THREAD_MAX)
+        nthreads = LH_THREAD_MAX;
+    if ((size_t) nthreads > count)
+        nthreads = (int) count;
+
+    p.func = func;
+    p.ctx = ctx;
+    p.count = count;
+    atomic_init (&p.next, 0);
+
+    // if a thread can't be created, the ones we have pick up the slack
+    for (int i = 1; i < nthreads; i++) {
+        if (pthread_create (&threads[started], NULL, lh_parallel_worker, &p))
+            break;
+        started++;
+    }
+
+    lh_parallel_worker (&p);
+
+    for (int i = 0; i < started; i++)
+        pthread_join (threads[i], NULL);
+}
+
+
+//===-----------------------------------------------------------------------===//
+/*-- Work stealing pool                    									 --*/
+//===-----------------------------------------------------------------------===//
+
+struct __libhelper_pool_task {
+    lh_job_func_t        func;
+    void                *ctx;
+    size_t               index;
+};
+
+/**
+ *  Per-worker queue. Jobs are pushed at the tail, and both the owner and
+ *  thieves take from the head, so every queue runs in submission order.
+ *  Jobs are coarse (whole files), so a lock per queue is plenty and keeps
+ *  the queue easy to reason about.
+ *
+ */
+struct __libhelper_pool_queue {
+    pthread_mutex_t                      lock;
+    struct __libhelper_pool_task        *tasks;
+    size_t                               head;
+    size_t                               tail;
+    size_t                               cap;
+};
+
+struct __libhelper_pool {
+    int                                  nthreads;      /* number of queues */
+    int                                  started;       /* number of running workers */
+    pthread_t                           *threads;
+    struct __libhelper_pool_queue       *queues;
+
+    pthread_mutex_t                      lock;
+    pthread_cond_t                       work;          /* signalled when a job is queued */
+    pthread_cond_t                       idle;          /* signalled when the pool drains */
+
+    atomic_size_t                        queued;        /* jobs waiting in a queue */
+    atomic_size_t                        pending;       /* jobs not yet finished */
+    atomic_uint                          next;          /* round-robin for outside submits */
+    int                                  shutdown;
+};
+
+/* which pool and queue the current thread works for, if any */
+static _Thread_local lh_pool_t  *lh_pool_current = NULL;
+static _Thread_local int         lh_pool_worker = -1;
+
+
+static int lh_pool_queue_push (struct __libhelper_pool_queue *q, struct __libhelper_pool_task *task)
+{
+    pthread_mutex_lock (&q->lock);
+
+    if (q->tail == q->cap) {
+        // compact first, only grow when the queue really is full
+        if (q->head) {
+            memmove (q->tasks, q->tasks + q->head, (q->tail - q->head) * sizeof (*task));
+            q->tail -= q->head;
+            q->head = 0;
+        } else {
+            size_t cap = (q->cap) ? q->cap * 2 : 64;
+            void *tmp = realloc (q->tasks, cap * sizeof (*task));
+            if (!tmp) {
+                pthread_mutex_unlock (&q->lock);
+                return LH_POOL_FAILURE;
+            }
+            q->tasks = tmp;
+            q->cap = cap;
+        }
+    }
+
+    q->tasks[q->tail++] = *task;
+    pthread_mutex_unlock (&q->lock);
+    return LH_POOL_SUCCESS;
+}
+
+static int lh_pool_queue_pop (struct __libhelper_pool_queue *q, struct __libhelper_pool_task *task)
+{
+    int found = 0;
+
+    pthread_mutex_lock (&q->lock);
+    if (q->head < q->tail) {
+        *task = q->tasks[q->head++];
+        found = 1;
+    }
+    if (q->head == q->tail)
+        q->head = q->tail = 0;
+    pthread_mutex_unlock (&q->lock);
+
+    return found;
+}
+
+
+/**
+ *  Find a job: our own queue first, then steal from the others, starting
+ *  with our neighbour so thieves spread out.
+ *
+ */
+static int lh_pool_take (lh_pool_t *pool, int self, struct __libhelper_pool_task *task)
+{
+    if (lh_pool_queue_pop (&pool->queues[self], task))
+        return 1;
+
+    for (int i = 1; i < pool->nthreads; i++) {
+        int victim = (self + i) % pool->nthreads;
+        if (lh_pool_queue_pop (&pool->queues[victim], task))
+            return 1;
+    }
+    return 0;
+}
+
+struct __libhelper_pool_start {
+    lh_pool_t       *pool;
+    int              id;
+};
+
+static void *lh_pool_thread (void *arg)
+{
+    lh_pool_t *pool = ((struct __libhelper_pool_start *) arg)->pool;
+    int self = ((struct __libhelper_pool_start *) arg)->id;
+    struct __libhelper_pool_task task;
+
+    free (arg);
+    lh_pool_current = pool;
+    lh_pool_worker = self;
+
+    for (;;) {
+        if (lh_pool_take (pool, self, &task)) {
+            atomic_fetch_sub (&pool->queued, 1);
+            task.func (task.ctx, task.index);
+
+            if (atomic_fetch_sub (&pool->pending, 1) == 1) {
+                pthread_mutex_lock (&pool->lock);
+                pthread_cond_broadcast (&pool->idle);
+                pthread_mutex_unlock (&pool->lock);
+            }
+            continue;
+        }
+
+        // nothing to run or steal, sleep until something is queued
+        pthread_mutex_lock (&pool->lock);
+        while (!atomic_load (&pool->queued) && !pool->shutdown)
+            pthread_cond_wait (&pool->work, &pool->lock);
+
+        if (pool->shutdown && !atomic_load (&pool->queued)) {
+            pthread_mutex_unlock (&pool->lock);
+            break;
+        }
+        pthread_mutex_unlock (&pool->lock);
+    }
+    return NULL;
+}
+
+
+/**
+ *  Create a pool of `nthreads` workers, or `lh_thread_count()` when zero.
+ *
+ */
+lh_pool_t *lh_pool_create (int nthreads)
+{
+    lh_pool_t *pool = calloc (1, sizeof (lh_pool_t));
+    if (!pool)
+        return NULL;
+
+    if (nthreads <= 0)
+        nthreads = lh_thread_count ();
+    if (nthreads > LH_THREAD_MAX)
+        nthreads = LH_THREAD_MAX;
+
+    pool->threads = calloc (nthreads, sizeof (pthread_t));
+    pool->queues = calloc (nthreads, sizeof (struct __libhelper_pool_queue));
+    if (!pool->threads || !pool->queues) {
+        free (pool->threads);
+        free (pool->queues);
+        free (pool);
+        return NULL;
+    }
+
+    pthread_mutex_init (&pool->lock, NULL);
+    pthread_cond_init (&pool->work, NULL);
+    pthread_cond_init (&pool->idle, NULL);
+    atomic_init (&pool->queued, 0);
+    atomic_init (&pool->pending, 0);
+    atomic_init (&pool->next, 0);
+
+    pool->nthreads = nthreads;
+    for (int i = 0; i < nthreads; i++)
+        pthread_mutex_init (&pool->queues[i].lock, NULL);
+
+    // if a worker can't be started its queue is still drained by stealing
+    for (int i = 0; i < nthreads; i++) {
+        struct __libhelper_pool_start *start = malloc (sizeof (struct __libhelper_pool_start));
+        if (!start)
+            break;
+
+        start->pool = pool;
+        start->id = i;
+        if (pthread_create (&pool->threads[i], NULL, lh_pool_thread, start)) {
+            free (start);
+            break;
+        }
+        pool->started++;
+    }
+
+    if (!pool->started) {
+        lh_pool_free (pool);
+        return NULL;
+    }
+    return pool;
+}
+
+
+/**
+ *  Queue `func (ctx, index)`. Jobs submitted from a worker go on that
+ *  worker's own queue, anything else is dealt out round-robin.
+ *
+ */
+int lh_pool_submit (lh_pool_t *pool, lh_job_func_t func, void *ctx, size_t index)
+{
+    struct __libhelper_pool_task task = { func, ctx, index };
+    int target;
+
+    if (!pool || !func)
+        return LH_POOL_FAILURE;
+
+    if (lh_pool_current == pool)
+        target = lh_pool_worker;
+    else
+        target = (int) (atomic_fetch_add (&pool->next, 1) % (unsigned) pool->nthreads);
+
+    atomic_fetch_add (&pool->pending, 1);
+    atomic_fetch_add (&pool->queued, 1);
+    if (!lh_pool_queue_push (&pool->queues[target], &task)) {
+        atomic_fetch_sub (&pool->queued, 1);
+        atomic_fetch_sub (&pool->pending, 1);
+        return LH_POOL_FAILURE;
+    }
+
+    pthread_mutex_lock (&pool->lock);
+    pthread_cond_signal (&pool->work);
+    pthread_mutex_unlock (&pool->lock);
+    return LH_POOL_SUCCESS;
+}
+
+
+/**
+ *  Block until every submitted job has finished.
+ *
+ */
+void lh_pool_wait (lh_pool_t *pool)
+{
+    if (!pool)
+        return;
+
+    pthread_mutex_lock (&pool->lock);
+    while (atomic_load (&pool->pending))
+        pthread_cond_wait (&pool->idle, &pool->lock);
+    pthread_mutex_unlock (&pool->lock);
+}
+
+
+/**
+ *  Finish any queued jobs, then stop the workers and free the pool.
+ *
+ */
+void lh_pool_free (lh_pool_t *pool)
+{
+    if (!pool)
+        return;
+
+    lh_pool_wait (pool);
+
+    pthread_mutex_lock (&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast (&pool->work);
+    pthread_mutex_unlock (&pool->lock);
+
+    for (int i = 0; i < pool->started; i++)
+        pthread_join (pool->threads[i], NULL);
+
+    for (int i = 0; i < pool->nthreads; i++) {
+        pthread_mutex_destroy (&pool->queues[i].lock);
+        free (pool->queues[i].tasks);
+    }
+
+    pthread_mutex_destroy (&pool->lock);
+    pthread_cond_destroy (&pool->work);
+    pthread_cond_destroy (&pool->idle);
+    free (pool->queues);
+    free (pool->threads);
+    free (pool);
+}
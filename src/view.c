@@ -0,0 +1,187 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//	Copyright (C) 2020, Is This On?, @h3adsh0tzz
+//
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+#include "libhelper/libhelper.h"
+
+/**
+ *  Views borrow memory, they never own it. Everything in this file is
+ *  allocation free, and every accessor checks that the requested range
+ *  lies within the view before touching it.
+ *
+ */
+
+/**
+ *  Create a view over `size` bytes at `data`, optionally tagged with the
+ *  file the memory belongs to.
+ *
+ */
+lh_view_t lh_view_create (const void *data, size_t size, file_t *file)
+{
+    lh_view_t view;
+
+    view.data = (const unsigned char *) data;
+    view.size = (data) ? size : 0;
+    view.file = file;
+
+    return view;
+}
+
+
+/**
+ *  Create a view of `size` bytes at `offset` within a loaded file. If the
+ *  range does not fit within the file, an empty view is returned.
+ *
+ */
+lh_view_t file_get_view (file_t *f, size_t offset, size_t size)
+{
+    lh_view_t whole, ret = LH_VIEW_NULL;
+
+    if (!f || !f->data)
+        return ret;
+
+    whole = lh_view_create (f->data, f->size, f);
+    lh_view_sub (whole, offset, size, &ret);
+    return ret;
+}
+
+
+/**
+ *  Check whether a view points at anything.
+ *
+ */
+int lh_view_is_valid (lh_view_t view)
+{
+    return (view.data != NULL);
+}
+
+
+/**
+ *  Narrow a view to `size` bytes at `offset`. The check is written so
+ *  that `offset + size` cannot overflow.
+ *
+ *  @returns        LH_VIEW_SUCCESS and fills `out`, or LH_VIEW_FAILURE.
+ */
+int lh_view_sub (lh_view_t view, size_t offset, size_t size, lh_view_t *out)
+{
+    if (!view.data || offset > view.size || size > view.size - offset)
+        return LH_VIEW_FAILURE;
+
+    if (out) {
+        out->data = view.data + offset;
+        out->size = size;
+        out->file = view.file;
+    }
+    return LH_VIEW_SUCCESS;
+}
+
+
+/**
+ *  Return a pointer to `size` bytes at `offset` within the view, or NULL
+ *  if the range falls outside of it.
+ *
+ */
+const void *lh_view_ptr (lh_view_t view, size_t offset, size_t size)
+{
+    if (!view.data || offset > view.size || size > view.size - offset)
+        return NULL;
+    return view.data + offset;
+}
+
+
+/**
+ *  Return a pointer to a NUL-terminated string at `offset`, but only if
+ *  the terminator is found before the end of the view.
+ *
+ */
+const char *lh_view_cstr (lh_view_t view, size_t offset)
+{
+    const char *str = lh_view_ptr (view, offset, 0);
+    if (!str)
+        return NULL;
+
+    return (memchr (str, '\0', view.size - offset)) ? str : NULL;
+}
+
+
+/**
+ *  Typed reads. These use memcpy() so unaligned offsets are fine, and
+ *  compile down to a single load on the architectures we support.
+ *
+ */
+#define LH_VIEW_READ(view, offset, out)                                     \
+    do {                                                                    \
+        const void *__p = lh_view_ptr (view, offset, sizeof (*(out)));      \
+        if (!__p) return LH_VIEW_FAILURE;                                   \
+        memcpy (out, __p, sizeof (*(out)));                                 \
+        return LH_VIEW_SUCCESS;                                             \
+    } while (0)
+
+int lh_view_read_u8 (lh_view_t view, size_t offset, uint8_t *out)
+{
+    LH_VIEW_READ (view, offset, out);
+}
+
+int lh_view_read_u16 (lh_view_t view, size_t offset, uint16_t *out)
+{
+    LH_VIEW_READ (view, offset, out);
+}
+
+int lh_view_read_u32 (lh_view_t view, size_t offset, uint32_t *out)
+{
+    LH_VIEW_READ (view, offset, out);
+}
+
+int lh_view_read_u64 (lh_view_t view, size_t offset, uint64_t *out)
+{
+    LH_VIEW_READ (view, offset, out);
+}
+
+
+/**
+ *  Big-endian reads, used for FAT headers and other byte-swapped data.
+ *  Libhelper only builds for little-endian hosts (see version.h), so
+ *  these always swap.
+ *
+ */
+int lh_view_read_be32 (lh_view_t view, size_t offset, uint32_t *out)
+{
+    uint32_t tmp;
+    if (!lh_view_read_u32 (view, offset, &tmp))
+        return LH_VIEW_FAILURE;
+
+    *out = __builtin_bswap32 (tmp);
+    return LH_VIEW_SUCCESS;
+}
+
+int lh_view_read_be64 (lh_view_t view, size_t offset, uint64_t *out)
+{
+    uint64_t tmp;
+    if (!lh_view_read_u64 (view, offset, &tmp))
+        return LH_VIEW_FAILURE;
+
+    *out = __builtin_bswap64 (tmp);
+    return LH_VIEW_SUCCESS;
+}
@@ -93,15 +93,190 @@ void _libhelper_hstring_tests ()
 	
 	char *test2 = mstrappend ("%s%s", "a", "b");
 	printf ("test2: %s\n", test2);
+	free (test2);
+
+	// short strings stay in the inline buffer
+	HString local;
+	h_string_init (&local);
+	h_string_append (&local, "lc_");
+	h_string_append_c (&local, 'x');
+	printf ("local: %s (inline: %d)\n", local.str, local.str == local.inline_buf);
+
+	// longer ones move to the heap
+	for (int i = 0; i < 8; i++)
+		h_string_append_printf (&local, " 0x%08x", i);
+	printf ("local: %s (len: %zu)\n", local.str, local.len);
+
+	h_string_reset (&local);
+	h_string_append_printf (&local, "%s,%s", "__TEXT", "__text");
+	printf ("reset: %s\n", local.str);
+	h_string_clear (&local);
+
+	// split without copying
+	StringSplitIter it;
+	const char *token;
+	size_t len;
+	const char *path = "/usr/lib/libSystem.B.dylib";
+	strsplit_init (&it, path, strlen (path), "/");
+	while (strsplit_next (&it, &token, &len))
+		printf ("token: '%.*s'\n", (int) len, token);
+
+	// and into a list that is reused
+	StringList *list = strsplit ("__TEXT::__text::", "::");
+	printf ("split: %d '%s' '%s' '%s'\n", list->count, list->ptrs[0], list->ptrs[1], list->ptrs[2]);
+	strsplit_into (list, "a,b,c,d,e,f,g,h,i,j", ",");
+	printf ("split: %d '%s' '%s'\n", list->count, list->ptrs[0], list->ptrs[list->count - 1]);
+	stringlist_free (list);
+
+	h_string_append_len (test, test->str, test->len);
+	printf ("test: %s\n", test->str);
+	free (h_string_free (test, 0));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
+void _libhelper_intern_tests ()
+{
+	lh_intern_t *pool = lh_intern_create ();
+	uint32_t text = lh_intern_cstr (pool, "__TEXT");
+	uint32_t data = lh_intern_cstr (pool, "__DATA_CONST");
+
+	// the same name always gets the same id
+	printf ("intern: %s\n", (lh_intern_cstr (pool, "__TEXT") == text && text != data) ? "stable" : "broken");
+	printf ("intern string: %s\n", lh_intern_string (pool, data, NULL));
+	printf ("intern lookup: %s\n", (lh_intern_lookup (pool, "__LINKEDIT", 10) == LH_INTERN_NONE) ? "missing" : "found");
+	printf ("intern count: %zu\n", lh_intern_count (pool));
+
+	lh_intern_free (pool);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
+void _libhelper_view_tests ()
+{
+	unsigned char buf[16] = { 0xca, 0xfe, 0xba, 0xbe, 0x00, 0x00, 0x00, 0x02,
+							  'v', 'i', 'e', 'w', '\0', 0x00, 0x00, 0x00 };
+	lh_view_t view = lh_view_create (buf, sizeof (buf), NULL);
+	lh_view_t sub;
+	uint32_t magic = 0;
+
+	// typed reads
+	lh_view_read_be32 (view, 0, &magic);
+	printf ("view magic: 0x%08x\n", magic);
+
+	// sub-views and strings
+	if (lh_view_sub (view, 8, 8, &sub))
+		printf ("view string: %s\n", lh_view_cstr (sub, 0));
+
+	// out of bounds accesses must fail
+	printf ("view oob read: %s\n", lh_view_read_u32 (view, 14, &magic) ? "allowed" : "rejected");
+	printf ("view oob sub: %s\n", lh_view_sub (view, 4, (size_t) -1, &sub) ? "allowed" : "rejected");
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
+void _libhelper_hash_tests ()
+{
+	char buf[65];
+	lh_hash_t hash;
+
+	// XXH64 of "a" with seed 0 is 0xd24ec4f1a98c6e5b
+	printf ("hash64: 0x%016llx\n", (unsigned long long) lh_hash64 ("a", 1, 0));
+
+	lh_view_hash (lh_view_create ("abc", 3, NULL), LH_HASH_SHA256, &hash);
+	printf ("sha256: %s\n", lh_hash_to_string (&hash, buf, sizeof (buf)));
+
+	// large inputs are hashed as a tree over several threads
+	size_t size = (LH_HASH_CHUNK_SIZE * 3) + 5;
+	unsigned char *big = calloc (1, size);
+	lh_view_hash (lh_view_create (big, size, NULL), LH_HASH_FAST128, &hash);
+	printf ("fast128 (tree): %s\n", lh_hash_to_string (&hash, buf, sizeof (buf)));
+	free (big);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
+void _libhelper_memmem_tests ()
+{
+	// big enough to be split into chunks, with a match across each boundary
+	size_t size = 16 * 1024 * 1024, count = 0;
+	unsigned char *big = calloc (1, size);
+	const unsigned char needle[] = "libhelper";
+
+	for (size_t off = (4 * 1024 * 1024) - 4; off + sizeof (needle) - 1 <= size; off += 4 * 1024 * 1024)
+		memcpy (big + off, needle, sizeof (needle) - 1);
+
+	unsigned char *first = bh_memmem_parallel (big, size, needle, sizeof (needle) - 1, 0);
+	printf ("memmem parallel: 0x%zx\n", (first) ? (size_t) (first - big) : 0);
+
+	size_t *all = bh_memmem_all (big, size, needle, sizeof (needle) - 1, 0, &count);
+	for (size_t i = 0; i < count; i++)
+		printf ("memmem all: 0x%zx\n", all[i]);
+
+	free (all);
+	free (big);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
+void _libhelper_file_test_free (void *data, size_t size, void *ctx)
+{
+	printf ("file free callback: %zu bytes, ctx: %s\n", size, (char *) ctx);
+	free (data);
+}
+
 void _libhelper_file_tests (char *path)
 {
 	file_t *test = file_load ((const char *) path);
 	if (test)
 		printf ("success\n");
+
+	// wrap a copy of the mapping, then a buffer with its own free callback
+	file_t *copy = file_from_buffer (test->data, test->size, LH_FILE_COPY);
+	printf ("file copy: %s\n", (copy && !memcmp (copy->data, test->data, test->size)) ? "matches" : "differs");
+
+	void *buf = malloc (test->size);
+	file_t *cb = file_from_buffer_with_free (buf, test->size, _libhelper_file_test_free, "test");
+
+	// extract the second half and then the first half of the file
+	file_range_t ranges[2] = { { test->size / 2, test->size - (test->size / 2) }, { 0, test->size / 2 } };
+	if (file_write_ranges (test, ranges, 2, "libhelper-general-ranges.bin")) {
+		file_t *out = file_load ("libhelper-general-ranges.bin");
+		printf ("file ranges: %s\n", (out && out->size == test->size &&
+				!memcmp (out->data, test->data + ranges[0].offset, ranges[0].size)) ? "matches" : "differs");
+		file_free (out);
+		remove ("libhelper-general-ranges.bin");
+	}
+
+	// replace a file after mapping it, the copy must still come from the mapping
+	if (file_write_range (test, 0, test->size, "libhelper-general-mapped.bin")) {
+		file_t *mapped = file_load ("libhelper-general-mapped.bin");
+		unsigned char *junk = calloc (1, test->size);
+
+		if (mapped && junk && (size_t) file_write_new ("libhelper-general-junk.bin", junk, test->size) == test->size &&
+			!rename ("libhelper-general-junk.bin", "libhelper-general-mapped.bin") &&
+			file_write_range (mapped, 0, mapped->size, "libhelper-general-ranges.bin")) {
+			file_t *out = file_load ("libhelper-general-ranges.bin");
+			printf ("file replaced: %s\n", (out && out->size == test->size &&
+					!memcmp (out->data, test->data, test->size)) ? "matches" : "differs");
+			file_free (out);
+		}
+		free (junk);
+		file_free (mapped);
+		remove ("libhelper-general-mapped.bin");
+		remove ("libhelper-general-ranges.bin");
+	}
+
+	char hex[65];
+	lh_hash_t hash;
+	if (file_hash (test, LH_HASH_FAST64, &hash))
+		printf ("file hash: %s\n", lh_hash_to_string (&hash, hex, sizeof (hex)));
+
+	printf ("file advise: %s\n", file_advise (test, 0, test->size, LH_ADVISE_SEQUENTIAL) ? "accepted" : "rejected");
+
+	file_free (cb);
+	file_free (copy);
+	file_free (test);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -113,6 +288,18 @@ int main (int argc, char *argv[])
 	
 	// hstring testing
 	_libhelper_hstring_tests ();
+
+	// interning testing
+	_libhelper_intern_tests ();
+
+	// view testing
+	_libhelper_view_tests ();
+
+	// hash testing
+	_libhelper_hash_tests ();
+
+	// memmem testing
+	_libhelper_memmem_tests ();
 	
 	// file testing
 	if (argc > 1)
@@ -85,20 +85,28 @@ int _libhelper_macho_32_tests (const char *path)
      *  handle command or segment info structs.
      * 
      */
+    char version[MACH_SOURCE_VERSION_STRLEN];
     mach_source_version_command_t *svc = mach_lc_find_source_version_cmd ((macho_t *) macho);
-    printf ("LC_SOURCE_VERSION: %s\n", mach_lc_source_version_string (svc));
+    if (svc)
+        printf ("LC_SOURCE_VERSION: %s\n", mach_lc_source_version_format (svc->version, version, sizeof (version)));
 
     mach_load_command_info_t *bv_inf = mach_lc_find_given_cmd ((macho_t *) macho, LC_BUILD_VERSION);
-    mach_build_version_info_t *bv = mach_lc_build_version_info (bv_inf->lc, bv_inf->offset, (macho_t *) macho);
-    printf ("LC_BUILD_VERSION: platform: %s, minos: %s, sdk: %s\n",
-        bv->platform, bv->minos, bv->sdk);
-        
-    // tool list
-    if (bv->tools) {
-        for (int i = 0; i < (int) h_slist_length (bv->tools); i++) {
-            build_tool_info_t *b = (build_tool_info_t *) h_slist_nth_data (bv->tools, i);
-            printf ("too: %s (%d.%d.%d)\n", b->tool, 
-                    b->version >> 16, (b->version >> 8) & 0xf, b->version & 0xf);
+    if (bv_inf) {
+        mach_build_version_command_t *bvc = (mach_build_version_command_t *) bv_inf->lc;
+        char minos[MACH_VERSION_STRLEN], sdk[MACH_VERSION_STRLEN];
+        build_tool_info_t tools[8];
+        uint32_t ntools;
+
+        printf ("LC_BUILD_VERSION: platform: %s, minos: %s, sdk: %s\n",
+            mach_lc_platform_string (bvc->platform),
+            mach_lc_version_format (bvc->minos, minos, sizeof (minos)),
+            mach_lc_version_format (bvc->sdk, sdk, sizeof (sdk)));
+
+        // tool list
+        ntools = mach_lc_build_version_tools ((macho_t *) macho, bvc, bv_inf->offset, tools, 8);
+        for (uint32_t i = 0; i < ntools && i < 8; i++) {
+            printf ("tool: %s (%d.%d.%d)\n", tools[i].tool,
+                    tools[i].version >> 16, (tools[i].version >> 8) & 0xff, tools[i].version & 0xff);
         }
     }
 
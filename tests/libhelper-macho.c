@@ -31,8 +31,21 @@
 //      Purpose is to test libhelper-macho
 //
 
+#ifndef _POSIX_C_SOURCE
+#   define _POSIX_C_SOURCE  200809L     /* mkdtemp() */
+#endif
+#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)
+#   define _DARWIN_C_SOURCE
+#endif
+
 #include <libhelper/libhelper.h>
 #include <libhelper/libhelper-macho.h>
+#include <libhelper/libhelper-fat.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <unistd.h>
 
 void __libhelper_macho_command_print_test (mach_load_command_info_t *inf, mach_load_command_t *lc)
 {
@@ -55,11 +68,13 @@ int _libhelper_macho_tests (const char *path)
 
     file_t *f = file_load (path);
 
-    macho_t *macho = macho_create_from_buffer ((unsigned char *) file_get_data (f, 0));
+    macho_t *macho = macho_create_from_buffer_sized ((unsigned char *) file_get_data (f, 0), f->size);
 
 
-    if (!macho)
+    if (!macho) {
         errorf ("libhelper-macho.c: _libhelper_macho_tests(): macho == NULL\n")
+        return 0;
+    }
 
     mach_header_t *header = macho->header;
 
@@ -106,6 +121,686 @@ int _libhelper_macho_tests (const char *path)
                 printf ("\tNo Section 64 data\n");
             }
     }
+
+    // commands are borrowed from the mapping, so there is nothing to free
+    mach_uuid_command_t *uuid = mach_lc_find_uuid_cmd (macho);
+    char uuid_str[MACH_UUID_STRLEN];
+    if (uuid)
+        printf ("\nLC_UUID: %s\n", mach_lc_uuid_format (uuid->uuid, uuid_str, sizeof (uuid_str)));
+
+    // content hashes of every segment and section
+    int nregions = 0;
+    char hex[65];
+    macho_region_hash_t *regions = macho_hash_regions (macho, LH_HASH_FAST64, &nregions);
+    for (int i = 0; regions && i < nregions; i++)
+        printf ("hash: %-16s %-16s %s\n", regions[i].segname, regions[i].sectname,
+                lh_hash_to_string (&regions[i].hash, hex, sizeof (hex)));
+    free (regions);
+    return 1;
+}
+
+
+void __libhelper_macho_stream_segment_test (void *ctx, const mach_segment_command_64_t *seg, uint32_t index)
+{
+    (void) ctx;
+    printf ("stream: segment %d: %-16.16s fileoff: 0x%llx filesize: 0x%llx\n",
+            index, seg->segname, (unsigned long long) seg->fileoff, (unsigned long long) seg->filesize);
+}
+
+/**
+ *  Check a streamed segment holds the same bytes as the mapped file.
+ *
+ */
+static void __libhelper_macho_stream_compare (macho_t *macho, macho_stream_t *stream, int range, const char *segname)
+{
+    lh_view_t view = macho_stream_get_range (stream, range);
+    uint64_t offset, size;
+
+    if (!macho_find_region (macho, segname, NULL, &offset, &size))
+        return;
+
+    printf ("stream: %s buffered: %zu bytes, %s\n", segname, view.size,
+            (view.size == size && (!size || !memcmp (view.data, macho->data + offset, size))) ? "matches" : "DIFFERS");
+}
+
+int _libhelper_macho_stream_tests (const char *path)
+{
+    macho_stream_callbacks_t callbacks = { 0 };
+    callbacks.segment = __libhelper_macho_stream_segment_test;
+
+    int fd = open (path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    // the stream only reads forward, so this works on a pipe as well.
+    //  __TEXT starts in the header, which is still held when it's resolved
+    macho_stream_t *stream = macho_stream_create (&callbacks, NULL);
+    int text = macho_stream_request_segment (stream, "__TEXT");
+    int linkedit = macho_stream_request_segment (stream, "__LINKEDIT");
+
+    if (macho_stream_run_fd (stream, fd)) {
+        macho_t *macho = macho_load (path);
+        if (macho) {
+            __libhelper_macho_stream_compare (macho, stream, text, "__TEXT");
+            __libhelper_macho_stream_compare (macho, stream, linkedit, "__LINKEDIT");
+        }
+    } else {
+        errorf ("libhelper-macho.c: _libhelper_macho_stream_tests(): stream failed\n")
+    }
+
+    macho_stream_free (stream);
+    close (fd);
+    return 1;
+}
+
+
+int _libhelper_macho_buffer_tests (const char *path)
+{
+    file_t *f = file_load (path);
+    if (!f)
+        return 0;
+
+    // parse from a heap buffer, as would be done with a decompressed payload
+    file_t *buf = file_from_buffer (f->data, f->size, LH_FILE_COPY);
+    file_free (f);
+
+    macho_t *macho = macho_load_from_file (buf);
+    if (macho)
+        printf ("buffer: magic 0x%x, %d load commands\n", macho->header->magic, macho->header->ncmds);
+    else
+        errorf ("libhelper-macho.c: _libhelper_macho_buffer_tests(): macho == NULL\n")
+
+    file_free (buf);
+    return 1;
+}
+
+
+/**
+ *  Create an empty cache directory for a test in $TMPDIR, so every run
+ *  starts cold. Remove it with `__libhelper_macho_cache_remove()`.
+ *
+ */
+static char *__libhelper_macho_cache_create (char *buf, size_t size)
+{
+    const char *tmp = getenv ("TMPDIR") ? getenv ("TMPDIR") : "/tmp";
+
+    snprintf (buf, size, "%s/libhelper-test.XXXXXX", tmp);
+    return mkdtemp (buf);
+}
+
+static void __libhelper_macho_cache_remove (const char *cache)
+{
+    char path[1024];
+    struct dirent *ent;
+    DIR *dir = opendir (cache);
+
+    if (dir) {
+        while ((ent = readdir (dir))) {
+            if (!strcmp (ent->d_name, ".") || !strcmp (ent->d_name, ".."))
+                continue;
+            snprintf (path, sizeof (path), "%s/%s", cache, ent->d_name);
+            unlink (path);
+        }
+        closedir (dir);
+    }
+    rmdir (cache);
+}
+
+int _libhelper_macho_index_tests (const char *path)
+{
+    char buf[1024];
+    const char *cache = __libhelper_macho_cache_create (buf, sizeof (buf));
+    if (!cache)
+        return 0;
+
+    // the first open builds the index, the second one just maps it
+    macho_index_free (macho_index_open_cached (path, cache));
+
+    macho_index_t *index = macho_index_open_cached (path, cache);
+    if (!index) {
+        errorf ("libhelper-macho.c: _libhelper_macho_index_tests(): index == NULL\n")
+        __libhelper_macho_cache_remove (cache);
+        return 0;
+    }
+
+    printf ("index: %d commands, %d segments, %d sections, %d symbols\n",
+            index->header->ncmds, index->header->nsegments, index->header->nsections, index->header->nsymbols);
+
+    const macho_index_symbol_t *sym = macho_index_find_symbol (index, "_main");
+    if (sym) {
+        const macho_index_symbol_t *near = macho_index_symbol_at (index, sym->value + 4);
+        printf ("index: _main at 0x%llx, 0x%llx is in %s\n", (unsigned long long) sym->value,
+                (unsigned long long) sym->value + 4, macho_index_symbol_name (index, near));
+    }
+
+    macho_index_free (index);
+    __libhelper_macho_cache_remove (cache);
+    return 1;
+}
+
+
+void __libhelper_macho_batch_test_callback (void *ctx, macho_batch_result_t *result)
+{
+    atomic_size_t *loaded = (atomic_size_t *) ctx;
+    if (result->macho)
+        atomic_fetch_add (loaded, 1);
+    macho_free (result->macho);
+}
+
+int _libhelper_macho_batch_tests (const char *path)
+{
+    macho_batch_item_t items[16];
+    macho_batch_options_t options = { 0 };
+    macho_batch_result_t result;
+    atomic_size_t loaded;
+    size_t collected = 0;
+
+    file_t *f = file_load (path);
+    if (!f)
+        return 0;
+
+    // mix of paths and in-memory views
+    for (int i = 0; i < 16; i++) {
+        items[i].path = (i & 1) ? path : NULL;
+        items[i].view = lh_view_create (f->data, f->size, f);
+        items[i].user = NULL;
+    }
+
+    // callback delivery
+    atomic_init (&loaded, 0);
+    options.nthreads = 4;
+    options.callback = __libhelper_macho_batch_test_callback;
+    options.ctx = &loaded;
+    size_t count = macho_load_many (items, 16, &options);
+    printf ("batch: macho_load_many loaded %zu/16 (callback saw %zu)\n", count, (size_t) atomic_load (&loaded));
+
+    // completion queue, with a budget of two files at a time
+    options.callback = NULL;
+    options.memory_budget = f->size * 2;
+    macho_batch_t *batch = macho_batch_start (items, 16, &options);
+    while (macho_batch_next (batch, &result)) {
+        collected += (result.macho != NULL);
+        macho_free (result.macho);
+    }
+    macho_batch_free (batch);
+    printf ("batch: queue collected %zu/16\n", collected);
+
+    // take one result and leave the rest for macho_batch_free()
+    batch = macho_batch_start (items, 16, &options);
+    if (macho_batch_next (batch, &result))
+        macho_free (result.macho);
+    macho_batch_free (batch);
+
+    file_free (f);
+    return 1;
+}
+
+
+int _libhelper_macho_fileset_tests (const char *path)
+{
+    macho_t *macho = macho_load (path);
+    macho_fileset_t *fileset;
+
+    if (!macho || macho->header->filetype != MACH_TYPE_FILESET) {
+        printf ("fileset: not a fileset\n");
+        return 0;
+    }
+
+    fileset = macho_fileset_load (macho);
+    if (!fileset)
+        return 0;
+
+    printf ("fileset: %zu entries, %zu loaded\n", fileset->count, macho_fileset_load_all (fileset, 0));
+    for (size_t i = 0; i < fileset->count; i++) {
+        macho_fileset_entry_t *entry = &fileset->entries[i];
+        macho_t *image = fileset->images[i];
+
+        printf ("fileset: %s vmaddr 0x%llx fileoff 0x%llx, %d segments\n", entry->entry_id,
+                (unsigned long long) entry->vmaddr, (unsigned long long) entry->fileoff,
+                (image) ? h_slist_length (image->scmds) : -1);
+    }
+
+    if (fileset->count)
+        printf ("fileset: find %s: %s\n", fileset->entries[0].entry_id,
+                (macho_fileset_find (fileset, fileset->entries[0].entry_id) == fileset->images[0]) ? "ok" : "missing");
+
+    macho_fileset_free (fileset);
+    return 1;
+}
+
+
+int _libhelper_macho_fat_tests (const char *path)
+{
+    file_t *f = file_load (path);
+    void *machos[FAT_SLICES_MAX];
+    fat_info_t info;
+    macho_t *macho;
+
+    if (!f)
+        return 0;
+
+    if (!mach_universal_read (file_get_view (f, 0, f->size), &info)) {
+        macho = macho_load_slice (f, CPU_TYPE_ANY, CPU_SUBTYPE_ANY);
+        printf ("fat: not a universal binary, thin slice %s\n", (macho) ? "loaded" : "missing");
+        file_free (f);
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < info.nslices; i++)
+        printf ("fat: slice %u: cputype 0x%x subtype 0x%x offset 0x%llx size 0x%llx\n", i,
+                info.slices[i].cputype, info.slices[i].cpusubtype,
+                (unsigned long long) info.slices[i].offset, (unsigned long long) info.slices[i].size);
+
+    macho = macho_load_slice (f, CPU_TYPE_ARM64, CPU_SUBTYPE_ANY);
+    if (macho)
+        printf ("fat: arm64 slice: %d load commands\n", macho->header->ncmds);
+
+    size_t n = macho_load_slices (f, machos, FAT_SLICES_MAX, 0);
+    for (size_t i = 0; i < n; i++)
+        printf ("fat: slice %zu parsed: %s\n", i, (machos[i]) ? "yes" : "no");
+
+    file_free (f);
+    return 1;
+}
+
+
+int _libhelper_macho_swap_tests ()
+{
+    nlist syms[7];
+    int ok = 1;
+
+    // big endian symbols, 7 so the SIMD path and the tail both run
+    for (int i = 0; i < 7; i++) {
+        syms[i].n_strx = OSSwapInt32 (i);
+        syms[i].n_type = 0x0f;
+        syms[i].n_sect = 1;
+        syms[i].n_desc = (uint16_t) ((i << 8) | (i >> 8));
+        syms[i].n_value = OSSwapInt64 (0x100004000ULL + i);
+    }
+
+    mach_swap_structs (syms, 7, MACH_LAYOUT_NLIST_64);
+    for (int i = 0; i < 7; i++) {
+        if (syms[i].n_strx != (uint32_t) i || syms[i].n_type != 0x0f || syms[i].n_desc != i ||
+            syms[i].n_value != 0x100004000ULL + i)
+            ok = 0;
+    }
+
+    printf ("swap: nlist_64 %s\n", (ok) ? "ok" : "mismatch");
+    return ok;
+}
+
+
+/**
+ *  Swap `count` structs at `offset` the other way, if they fit in the copy.
+ *  Relocations (a NULL layout) have their bitfields put back where a big
+ *  endian compiler has them first, the inverse of `mach_swap_relocations()`.
+ *
+ */
+static int __libhelper_macho_cigam_region (uint8_t *data, size_t size, uint64_t offset, uint64_t count,
+                                           size_t stride, const char *layout)
+{
+    uint32_t *words = (uint32_t *) (data + offset);
+
+    if (!count)
+        return 1;
+    if (offset > size || count > (size - offset) / stride)
+        return 0;
+
+    if (layout)
+        return mach_swap_structs (data + offset, (size_t) count, layout);
+
+    for (uint64_t i = 0; i < count; i++) {
+        uint32_t w = words[(i * 2) + 1];
+
+        // R_SCATTERED
+        if (words[i * 2] & 0x80000000)
+            continue;
+
+        words[(i * 2) + 1] = ((w & 0xffffff) << 8)         /* r_symbolnum */
+                           | (((w >> 24) & 0x1) << 7)      /* r_pcrel */
+                           | (((w >> 25) & 0x3) << 5)      /* r_length */
+                           | (((w >> 27) & 0x1) << 4)      /* r_extern */
+                           | (w >> 28);                    /* r_type */
+    }
+    return mach_swap_structs (data + offset, (size_t) count * 2, "I");
+}
+
+static size_t __libhelper_macho_layout_size (const char *layout)
+{
+    size_t size = 0, count;
+
+    while (*layout) {
+        for (count = 0; *layout >= '0' && *layout <= '9'; layout++)
+            count = (count * 10) + (size_t) (*layout - '0');
+        count = (count) ? count : 1;
+
+        switch (*layout++) {
+            case 'B': case 'b': case 's': size += count; break;
+            case 'H': case 'h': size += count * 2; break;
+            case 'I': case 'i': size += count * 4; break;
+            case 'Q': case 'q': size += count * 8; break;
+            default: return 0;
+        }
+    }
+    return size;
+}
+
+/**
+ *  Byte swap a native 64 bit image the other way, reading every count
+ *  before it is swapped, and checking every table against `size`.
+ *
+ */
+static int __libhelper_macho_make_cigam (uint8_t *data, size_t size)
+{
+    mach_header_t *hdr = (mach_header_t *) data;
+    uint32_t offset = sizeof (mach_header_t), ncmds, end;
+
+    if (size < sizeof (mach_header_t) || hdr->magic != MACH_MAGIC_64 || hdr->sizeofcmds > size - offset)
+        return 0;
+    ncmds = hdr->ncmds;
+    end = offset + hdr->sizeofcmds;
+
+    for (uint32_t i = 0; i < ncmds; i++) {
+        mach_load_command_t *lc = (mach_load_command_t *) (data + offset);
+        const mach_lc_descriptor_t *desc;
+        uint32_t cmdsize;
+        int ok = 1;
+
+        if (end - offset < sizeof (mach_load_command_t) || lc->cmdsize < sizeof (mach_load_command_t) ||
+            lc->cmdsize > end - offset)
+            return 0;
+        desc = mach_lc_descriptor (lc->cmd);
+        cmdsize = lc->cmdsize;
+
+        if (lc->cmd == LC_SEGMENT_64) {
+            mach_segment_command_64_t *seg = (mach_segment_command_64_t *) lc;
+            mach_section_64_t *sects = (mach_section_64_t *) (seg + 1);
+
+            if (cmdsize < sizeof (*seg) || seg->nsects > (cmdsize - sizeof (*seg)) / sizeof (mach_section_64_t))
+                return 0;
+            for (uint32_t s = 0; ok && s < seg->nsects; s++)
+                ok = __libhelper_macho_cigam_region (data, size, sects[s].reloff, sects[s].nreloc, 8, NULL);
+            ok = ok && __libhelper_macho_cigam_region (data, size, (uint8_t *) sects - data, seg->nsects,
+                                                       sizeof (mach_section_64_t), MACH_LAYOUT_SECTION_64);
+        } else if (lc->cmd == LC_SYMTAB) {
+            mach_symtab_command_t *symtab = (mach_symtab_command_t *) lc;
+            ok = __libhelper_macho_cigam_region (data, size, symtab->symoff, symtab->nsyms, 16, MACH_LAYOUT_NLIST_64);
+        } else if (lc->cmd == LC_DYSYMTAB) {
+            mach_dysymtab_command_t *dysymtab = (mach_dysymtab_command_t *) lc;
+            ok = __libhelper_macho_cigam_region (data, size, dysymtab->indirectsymoff, dysymtab->nindirectsyms, 4, "I") &&
+                 __libhelper_macho_cigam_region (data, size, dysymtab->extreloff, dysymtab->nextrel, 8, NULL) &&
+                 __libhelper_macho_cigam_region (data, size, dysymtab->locreloff, dysymtab->nlocrel, 8, NULL);
+        } else if (lc->cmd == LC_BUILD_VERSION) {
+            mach_build_version_command_t *bv = (mach_build_version_command_t *) lc;
+            ok = (cmdsize >= sizeof (*bv) && bv->ntools <= (cmdsize - sizeof (*bv)) / 8) &&
+                 mach_swap_structs (bv + 1, bv->ntools, "II");
+        } else if (lc->cmd == LC_THREAD || lc->cmd == LC_UNIXTHREAD) {
+            // thread state is swapped by flavor, which this doesn't attempt
+            return 0;
+        }
+        if (!ok)
+            return 0;
+
+        if (desc && desc->layout && cmdsize >= sizeof (mach_load_command_t) + __libhelper_macho_layout_size (desc->layout))
+            mach_swap_structs (data + offset + sizeof (mach_load_command_t), 1, desc->layout);
+        mach_swap_structs (lc, 1, "II");
+        offset += cmdsize;
+    }
+
+    mach_swap_structs (hdr, 1, "IiiIIIII");
+    return 1;
+}
+
+int _libhelper_macho_cigam_tests (const char *path)
+{
+    macho_t *native = macho_load (path), *swapped = NULL;
+    uint8_t *copy = NULL;
+    size_t size;
+    HSList *a, *b;
+    int ok = 0;
+
+    if (!native || !native->file || native->header->magic != MACH_MAGIC_64) {
+        printf ("swap: big endian copy skipped, not a native 64 bit Mach-O\n");
+        macho_free (native);
+        return 1;
+    }
+
+    // a big endian copy of the whole file, which must parse back to the same thing
+    size = native->file->size;
+    copy = malloc (size);
+    if (!copy)
+        goto cigam_out;
+    memcpy (copy, native->file->data, size);
+    if (!__libhelper_macho_make_cigam (copy, size)) {
+        printf ("swap: big endian copy skipped, can't swap this image\n");
+        ok = 1;
+        goto cigam_skip;
+    }
+
+    swapped = macho_load_from_view (lh_view_create (copy, size, NULL));
+    if (!swapped)
+        goto cigam_out;
+
+    ok = !memcmp (native->header, swapped->header, sizeof (mach_header_t)) &&
+         h_slist_length (native->lcmds) == h_slist_length (swapped->lcmds) &&
+         !memcmp (native->file->data, swapped->data, size);
+
+    for (a = native->scmds, b = swapped->scmds; ok && a && b; a = a->next, b = b->next) {
+        mach_segment_info_t *x = a->data, *y = b->data;
+        ok = !memcmp (x->segcmd, y->segcmd, sizeof (mach_segment_command_64_t)) &&
+             h_slist_length (x->sects) == h_slist_length (y->sects);
+    }
+    ok = ok && !a && !b;
+
+cigam_out:
+    printf ("swap: big endian copy %s\n", (ok) ? "matches" : "DIFFERS");
+cigam_skip:
+    macho_free (swapped);
+    macho_free (native);
+    free (copy);
+    return ok;
+}
+
+
+int _libhelper_macho_thread_swap_tests ()
+{
+    struct {
+        mach_header_t   hdr;
+        uint32_t        cmd, cmdsize, flavor, count;
+        uint64_t        x[33];
+        uint32_t        cpsr, flags;
+    } img;
+    HArena *arena = h_arena_new (0);
+    int ok = 0;
+
+    // a big endian LC_UNIXTHREAD with ARM_THREAD_STATE64
+    memset (&img, '\0', sizeof (img));
+    img.hdr.magic = MACH_CIGAM_64;
+    img.hdr.cputype = (cpu_type_t) OSSwapInt32 ((uint32_t) CPU_TYPE_ARM64);
+    img.hdr.ncmds = OSSwapInt32 (1);
+    img.hdr.sizeofcmds = OSSwapInt32 (sizeof (img) - sizeof (mach_header_t));
+    img.cmd = OSSwapInt32 (LC_UNIXTHREAD);
+    img.cmdsize = OSSwapInt32 (sizeof (img) - sizeof (mach_header_t));
+    img.flavor = OSSwapInt32 (6);
+    img.count = OSSwapInt32 (68);
+    for (int i = 0; i < 33; i++)
+        img.x[i] = OSSwapInt64 (0xfffffff007004000ULL + i);
+    img.cpsr = OSSwapInt32 (0x3c5);
+
+    uint8_t *data = (arena) ? macho_swap_image (lh_view_create (&img, sizeof (img), NULL), arena) : NULL;
+    if (data) {
+        memcpy (&img, data, sizeof (img));
+        ok = (img.flavor == 6 && img.count == 68 && img.x[32] == 0xfffffff007004020ULL && img.cpsr == 0x3c5);
+    }
+
+    printf ("swap: arm64 thread state %s\n", (ok) ? "ok" : "mismatch");
+    h_arena_free (arena);
+    return ok;
+}
+
+
+static int __libhelper_macho_search_match (void *ctx, uint32_t pattern, size_t offset)
+{
+    if ((*(int *) ctx)++ < 4)
+        printf ("search: pattern %u at 0x%zx\n", pattern, offset);
+    return 0;
+}
+
+int _libhelper_macho_search_tests (const char *path)
+{
+    static const char *signatures[] = { "__TEXT", "__LINKEDIT", "__text", "/usr/lib/" };
+    macho_t *macho = macho_load (path);
+    bh_patterns_t *set = bh_patterns_create ();
+    int seen = 0;
+
+    if (!macho || !set)
+        return 0;
+
+    // every signature in one pass, rather than one pass each
+    for (size_t i = 0; i < sizeof (signatures) / sizeof (signatures[0]); i++)
+        bh_patterns_add (set, (const unsigned char *) signatures[i], strlen (signatures[i]));
+    bh_patterns_compile (set);
+
+    printf ("search: %zu matches in the image\n", macho_patterns_scan (macho, set, NULL, NULL, __libhelper_macho_search_match, &seen));
+    seen = 4;
+    printf ("search: %zu matches in __TEXT,__text\n", macho_patterns_scan (macho, set, "__TEXT", "__text", __libhelper_macho_search_match, &seen));
+
+    bh_patterns_free (set);
+
+    // a BL to anywhere, then a RET, in the executable sections
+    uint32_t insns[] = { 0x94000000, 0xd65f03c0 }, masks[] = { 0xfc000000, 0xffffffff };
+    bh_masked_t pat;
+    size_t count = 0, *found;
+
+    bh_masked_init_insns (&pat, insns, masks, 1);
+    found = macho_masked_find_all (macho, &pat, NULL, NULL, 0, &count);
+    printf ("search: %zu BL instructions%s", count, (count) ? "," : "\n");
+    for (size_t i = 0; i < count && i < 4; i++)
+        printf (" 0x%zx%s", found[i], (i + 1 == count || i == 3) ? "\n" : "");
+    free (found);
+
+    bh_masked_init_insns (&pat, insns, masks, 2);
+    found = macho_masked_find_all (macho, &pat, NULL, NULL, 0, &count);
+    printf ("search: %zu BL; RET pairs\n", count);
+    free (found);
+    return 1;
+}
+
+
+int _libhelper_macho_xref_tests (const char *path)
+{
+    macho_t *macho = macho_load (path);
+    macho_xref_index_t *index;
+    macho_xref_t xref;
+    size_t first, count;
+
+    if (!macho)
+        return 0;
+
+    index = macho_xref_index_create (macho, 0);
+    if (!index)
+        return 0;
+    printf ("xref: %zu references\n", macho_xref_index_count (index));
+
+    // everything that references the lowest referenced address
+    if (macho_xref_get (index, 0, &xref)) {
+        count = macho_xref_lookup (index, xref.target, &first);
+        for (size_t i = first; i < first + count && macho_xref_get (index, i, &xref); i++)
+            printf ("xref: 0x%llx referenced from 0x%llx (kind %u)\n",
+                    (unsigned long long) xref.target, (unsigned long long) xref.from, xref.kind);
+    }
+
+    macho_xref_index_free (index);
+    return 1;
+}
+
+
+int _libhelper_macho_callgraph_tests (const char *path)
+{
+    macho_t *macho = macho_load (path);
+    macho_callgraph_t *graph;
+    const uint32_t *callers;
+    uint32_t busiest = MACHO_CALLGRAPH_NONE;
+    size_t count, most = 0;
+
+    if (!macho)
+        return 0;
+
+    graph = macho_callgraph_create (macho, 0);
+    if (!graph)
+        return 0;
+    printf ("callgraph: %zu functions, %zu calls\n", graph->nfunctions, graph->ncalls);
+
+    // whoever calls the most called function
+    for (uint32_t f = 0; f < graph->nfunctions; f++) {
+        count = macho_callgraph_callers (graph, f, &callers);
+        if (count > most) {
+            most = count;
+            busiest = f;
+        }
+    }
+
+    if (busiest != MACHO_CALLGRAPH_NONE) {
+        count = macho_callgraph_callers (graph, busiest, &callers);
+        for (size_t i = 0; i < count; i++) {
+            const macho_call_t *call = &graph->calls[callers[i]];
+            printf ("callgraph: %s called from 0x%llx\n",
+                    (graph->functions[busiest].name) ? graph->functions[busiest].name : "(unnamed)",
+                    (unsigned long long) call->site);
+        }
+    }
+
+    macho_callgraph_free (graph);
+    return 1;
+}
+
+
+/**
+ *  A few recipes in the style of a kernel patchfinder. The second run
+ *  answers from the cache written by the first.
+ *
+ */
+static const macho_pf_recipe_t __libhelper_macho_test_recipes[] = {
+    { "panic", { { .op = MACHO_PF_SUBSTRING, .str = "panic: " }, { .op = MACHO_PF_XREF }, { .op = MACHO_PF_FUNCTION } } },
+    { "main_first_call", { { .op = MACHO_PF_SYMBOL, .str = "_main" }, { .op = MACHO_PF_BL } } },
+    { "last_call_after_hello", { { .op = MACHO_PF_STRING, .str = "hello world" }, { .op = MACHO_PF_XREF },
+                                 { .op = MACHO_PF_BL_AFTER, .n = -1 } } },
+    { "exact_hello", { { .op = MACHO_PF_STRING, .str = "hello" } } },
+};
+
+int _libhelper_macho_patchfinder_tests (const char *path)
+{
+    char buf[1024];
+    const char *cache;
+    size_t count = sizeof (__libhelper_macho_test_recipes) / sizeof (macho_pf_recipe_t);
+    macho_pf_result_t results[sizeof (__libhelper_macho_test_recipes) / sizeof (macho_pf_recipe_t)];
+    macho_t *macho = macho_load (path);
+
+    if (!macho)
+        return 0;
+
+    if (!(cache = __libhelper_macho_cache_create (buf, sizeof (buf)))) {
+        macho_free (macho);
+        return 0;
+    }
+
+    for (int run = 0; run < 2; run++) {
+        macho_patchfinder_t *pf = macho_patchfinder_create (macho, cache, 0);
+        if (!pf)
+            break;
+
+        macho_patchfinder_run (pf, __libhelper_macho_test_recipes, count, results);
+        for (size_t i = 0; i < count; i++) {
+            printf ("patchfinder: %s: 0x%llx%s%s\n", __libhelper_macho_test_recipes[i].name,
+                    (unsigned long long) results[i].addr,
+                    (results[i].flags & MACHO_PF_RESULT_FOUND) ? "" : " (not found)",
+                    (results[i].flags & MACHO_PF_RESULT_CACHED) ? " (cached)" : "");
+        }
+        macho_patchfinder_free (pf);
+    }
+
+    __libhelper_macho_cache_remove (cache);
+    macho_free (macho);
     return 1;
 }
 
@@ -116,5 +811,18 @@ int main (int argc, char *argv[])
     if (argc < 2)
         return 0;
 
+    _libhelper_macho_stream_tests (argv[1]);
+    _libhelper_macho_buffer_tests (argv[1]);
+    _libhelper_macho_index_tests (argv[1]);
+    _libhelper_macho_batch_tests (argv[1]);
+    _libhelper_macho_fileset_tests (argv[1]);
+    _libhelper_macho_fat_tests (argv[1]);
+    _libhelper_macho_swap_tests ();
+    _libhelper_macho_cigam_tests (argv[1]);
+    _libhelper_macho_thread_swap_tests ();
+    _libhelper_macho_search_tests (argv[1]);
+    _libhelper_macho_xref_tests (argv[1]);
+    _libhelper_macho_callgraph_tests (argv[1]);
+    _libhelper_macho_patchfinder_tests (argv[1]);
     return _libhelper_macho_tests (argv[1]);
 }
\ No newline at end of file
@@ -0,0 +1,182 @@
+//===--------------------------- libhelper ----------------------------===//
+//
+//                         The Libhelper Project
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+//  Copyright (C) 2019, Is This On?, @h3adsh0tzz
+//  me@h3adsh0tzz.com.
+//
+//
+//===------------------------------------------------------------------===//
+
+//
+//  Compares bh_memmem(), a compiled bh_needle_t, the old scalar Horspool
+//  search and the system memmem(). Each needle is planted at the very end
+//  of the haystack, so every search scans all of it.
+//
+//  usage: libhelper-bench-memmem [file]
+//
+
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "libhelper/libhelper.h"
+
+#define BENCH_SIZE          (64 * 1024 * 1024)
+#define BENCH_ROUNDS        5
+
+typedef unsigned char *(*bench_func_t) (const unsigned char *, size_t, const unsigned char *, size_t);
+
+
+/**
+ *  The search bh_memmem() used to be: scalar Horspool, with the skip
+ *  table rebuilt on every call.
+ */
+static unsigned char *bench_horspool (const unsigned char *haystack, size_t hlen,
+                                      const unsigned char *needle, size_t nlen)
+{
+    size_t scan, last, bad_char_skip[__UCHAR_MAX + 1];
+
+    if (!nlen || !haystack || !needle)
+        return NULL;
+
+    for (scan = 0; scan <= __UCHAR_MAX; scan++)
+        bad_char_skip[scan] = nlen;
+
+    last = nlen - 1;
+    for (scan = 0; scan < last; scan++)
+        bad_char_skip[needle[scan]] = last - scan;
+
+    while (hlen >= nlen) {
+        for (scan = last; haystack[scan] == needle[scan]; scan--)
+            if (scan == 0)
+                return (unsigned char *) haystack;
+
+        hlen -= bad_char_skip[haystack[last]];
+        haystack += bad_char_skip[haystack[last]];
+    }
+    return NULL;
+}
+
+static unsigned char *bench_libc (const unsigned char *haystack, size_t hlen,
+                                  const unsigned char *needle, size_t nlen)
+{
+    return memmem (haystack, hlen, needle, nlen);
+}
+
+static bh_needle_t bench_needle;
+
+static unsigned char *bench_compiled (const unsigned char *haystack, size_t hlen,
+                                      const unsigned char *needle, size_t nlen)
+{
+    (void) needle;
+    (void) nlen;
+    return bh_needle_find (&bench_needle, haystack, hlen);
+}
+
+
+static double bench_now ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ *  Best of BENCH_ROUNDS, in GB/s. Returns a negative value if the search
+ *  didn't find the needle where it was planted.
+ */
+static double bench_run (bench_func_t func, const unsigned char *haystack, size_t hlen,
+                         const unsigned char *needle, size_t nlen)
+{
+    double best = 0;
+
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        double start = bench_now ();
+        unsigned char *found = func (haystack, hlen, needle, nlen);
+        double elapsed = bench_now () - start;
+
+        if (found != haystack + hlen - nlen)
+            return -1;
+        if (!best || elapsed < best)
+            best = elapsed;
+    }
+    return (hlen / best) / 1e9;
+}
+
+
+int main (int argc, char *argv[])
+{
+    static const size_t lengths[] = { 2, 4, 8, 12, 16, 32, 64, 128, 256 };
+    const unsigned char *needle;
+    unsigned char *haystack;
+    size_t hlen = BENCH_SIZE;
+    uint32_t seed = 0x6c68;
+
+    // a file is more realistic, kernelcaches are mostly small byte values
+    if (argc > 1) {
+        file_t *f = file_load (argv[1]);
+        if (!f) {
+            errorf ("could not load %s\n", argv[1]);
+            return 1;
+        }
+        hlen = f->size;
+        haystack = malloc (hlen + 256);
+        if (!haystack)
+            return 1;
+        memcpy (haystack, f->data, hlen);
+        file_free (f);
+    } else {
+        haystack = malloc (hlen + 256);
+        if (!haystack)
+            return 1;
+        for (size_t i = 0; i < hlen; i++) {
+            seed = seed * 1103515245 + 12345;
+            haystack[i] = (unsigned char) ((seed >> 16) & 0x3f);
+        }
+    }
+
+    printf ("haystack: %zu bytes\n", hlen);
+    printf ("%8s %12s %12s %12s %12s\n", "needle", "horspool", "bh_memmem", "bh_needle", "memmem");
+
+    for (size_t l = 0; l < sizeof (lengths) / sizeof (lengths[0]); l++) {
+        size_t nlen = lengths[l];
+
+        /*  Plant a needle at the end. Its first and last bytes are common in
+         *  the data, but the byte in the middle never occurs in the
+         *  generated data, so it can't match any earlier.
+         */
+        needle = haystack + hlen;
+        for (size_t i = 0; i < nlen; i++)
+            haystack[hlen + i] = (unsigned char) ((i * 37 + 11) & 0x3f);
+        haystack[hlen + nlen / 2] |= 0x80;
+        memcpy (haystack + hlen - nlen, needle, nlen);
+
+        bh_needle_init (&bench_needle, needle, nlen);
+        printf ("%8zu %12.2f %12.2f %12.2f %12.2f\n", nlen,
+                bench_run (bench_horspool, haystack, hlen, needle, nlen),
+                bench_run (bh_memmem, haystack, hlen, needle, nlen),
+                bench_run (bench_compiled, haystack, hlen, needle, nlen),
+                bench_run (bench_libc, haystack, hlen, needle, nlen));
+    }
+
+    free (haystack);
+    return 0;
+}